@@ -0,0 +1,394 @@
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+
+#include "AccessList.hpp"
+#include "MacAddress.hpp"
+#include "Vlan.hpp"
+
+static constexpr size_t IPV4_MIN_HEADER_SIZE = 20;
+static constexpr size_t IPV6_HEADER_SIZE = 40;
+
+// Where each field sits in a FlowKey: its word, its shift within the word, and its width in bits
+struct FlowField {
+    size_t word;
+    int shift;
+    int width;
+
+    uint64_t mask() const {
+        return (width == 64 ? UINT64_MAX : (1ULL << width) - 1) << shift;
+    }
+};
+
+static constexpr FlowField DESTINATION_MAC{0, 16, 48};
+static constexpr FlowField ETHER_TYPE{0, 0, 16};
+static constexpr FlowField SOURCE_MAC{1, 16, 48};
+static constexpr FlowField VLAN{1, 0, 16};
+static constexpr FlowField SOURCE_IP{2, 32, 32};
+static constexpr FlowField DESTINATION_IP{2, 0, 32};
+static constexpr FlowField IP_PROTOCOL{3, 32, 32};
+static constexpr FlowField SOURCE_PORT{3, 16, 16};
+static constexpr FlowField DESTINATION_PORT{3, 0, 16};
+
+// Sets a field of a key to the given value, which must fit in the field
+static void set_field(FlowKey& key, const FlowField& field, uint64_t value) {
+    key.words[field.word] = (key.words[field.word] & ~field.mask()) | value << field.shift;
+}
+
+static uint64_t get_field(const FlowKey& key, const FlowField& field) {
+    return (key.words[field.word] & field.mask()) >> field.shift;
+}
+
+static uint16_t read_u16(const unsigned char* bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static uint32_t read_u32(const unsigned char* bytes) {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 |
+           bytes[3];
+}
+
+// Formats an error message into the given string. Always returns false
+template <typename... Args>
+static bool fail(std::string& error, const char* format, Args... args) {
+    char message[256];
+    snprintf(message, sizeof(message), format, args...);
+    error = message;
+    return false;
+}
+
+// Parses an unsigned number up to the given maximum, in decimal or with a 0x prefix in hex
+static bool parse_number(const std::string& text, uint64_t max, uint64_t& value) {
+    char* end = nullptr;
+    value = strtoull(text.c_str(), &end, 0);
+    return !text.empty() && text[0] != '-' && *end == '\0' && value <= max;
+}
+
+// Parses a MAC, e.g. "02:00:00:00:00:01"
+static bool parse_mac(const std::string& text, uint64_t& mac) {
+    unsigned int octets[6];
+    int length = 0;
+    if (sscanf(
+            text.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x%n", &octets[0], &octets[1], &octets[2],
+            &octets[3], &octets[4], &octets[5], &length
+        ) != 6 ||
+        (size_t)length != text.size()) {
+        return false;
+    }
+
+    mac = 0;
+    for (unsigned int octet : octets) { mac = mac << 8 | octet; }
+    return true;
+}
+
+/*
+ * Parses a value and the mask it's matched with. MACs take an optional mask, e.g.
+ * "02:00:00:00:00:00/ff:ff:ff:00:00:00", and IPv4 addresses an optional prefix length, e.g.
+ * "10.0.0.0/8". Everything else is an exact number.
+ */
+static bool parse_field_value(
+    const std::string& name, const std::string& text, uint64_t& value, uint64_t& mask
+) {
+    const size_t slash = text.find('/');
+    const std::string address = text.substr(0, slash);
+    const std::string suffix = slash == std::string::npos ? "" : text.substr(slash + 1);
+
+    if (name == "src-mac" || name == "dst-mac") {
+        mask = 0xFFFFFFFFFFFF;
+        return parse_mac(address, value) &&
+               (slash == std::string::npos || parse_mac(suffix, mask));
+    }
+
+    if (name == "src-ip" || name == "dst-ip") {
+        in_addr parsed;
+        uint64_t prefix_length = 32;
+        if (inet_pton(AF_INET, address.c_str(), &parsed) != 1 ||
+            (slash != std::string::npos && !parse_number(suffix, 32, prefix_length))) {
+            return false;
+        }
+        value = ntohl(parsed.s_addr);
+        mask = prefix_length == 0 ? 0 : (0xFFFFFFFFULL << (32 - prefix_length)) & 0xFFFFFFFF;
+        return true;
+    }
+
+    if (slash != std::string::npos) {
+        return false;
+    }
+    if (name == "vlan") {
+        mask = 0xFFFF;
+        return parse_number(text, MAX_VLAN, value) && value >= DEFAULT_VLAN;
+    }
+    if (name == "ip-proto") {
+        mask = 0xFFFFFFFF;
+        return parse_number(text, UINT8_MAX, value);
+    }
+    mask = 0xFFFF;
+    return parse_number(text, UINT16_MAX, value);
+}
+
+// Parses the action a rule starts with, and the port or traffic class it takes
+static bool parse_action(std::istringstream& words, AclRule& rule, std::string& error) {
+    std::string action;
+    words >> action;
+    if (action == "permit") {
+        rule.action = AclAction::PERMIT;
+    } else if (action == "deny") {
+        rule.action = AclAction::DENY;
+    } else if (action == "redirect" || action == "mirror") {
+        rule.action = action == "redirect" ? AclAction::REDIRECT : AclAction::MIRROR;
+        if (!(words >> rule.port_name)) {
+            return fail(error, "'%s' needs a port", action.c_str());
+        }
+    } else if (action == "priority") {
+        std::string class_name;
+        words >> class_name;
+        rule.action = AclAction::SET_PRIORITY;
+
+        size_t traffic_class = 0;
+        while (traffic_class < TRAFFIC_CLASS_COUNT &&
+               class_name != traffic_class_name((TrafficClass)traffic_class)) {
+            ++traffic_class;
+        }
+        if (traffic_class == TRAFFIC_CLASS_COUNT) {
+            return fail(error, "Unknown traffic class '%s'", class_name.c_str());
+        }
+        rule.traffic_class = (TrafficClass)traffic_class;
+    } else {
+        return fail(error, "Unknown action '%s'", action.c_str());
+    }
+    return true;
+}
+
+// Parses a single rule: an action, then any number of fields to match, each followed by its value
+static bool parse_rule(const std::string& line, AclRule& rule, std::string& error) {
+    static const std::map<std::string, FlowField> FIELDS{
+        {"dst-mac", DESTINATION_MAC}, {"src-mac", SOURCE_MAC},
+        {"ether-type", ETHER_TYPE},   {"vlan", VLAN},
+        {"src-ip", SOURCE_IP},        {"dst-ip", DESTINATION_IP},
+        {"ip-proto", IP_PROTOCOL},    {"src-port", SOURCE_PORT},
+        {"dst-port", DESTINATION_PORT},
+    };
+
+    std::istringstream words{line};
+    if (!parse_action(words, rule, error)) {
+        return false;
+    }
+
+    std::string name;
+    while (words >> name) {
+        auto field = FIELDS.find(name);
+        if (field == FIELDS.end()) {
+            return fail(error, "Unknown field '%s'", name.c_str());
+        }
+
+        std::string text;
+        uint64_t value = 0;
+        uint64_t mask = 0;
+        if (!(words >> text) || !parse_field_value(name, text, value, mask)) {
+            return fail(error, "Invalid value '%s' for %s", text.c_str(), name.c_str());
+        }
+        if (get_field(rule.mask, field->second) != 0) {
+            return fail(error, "%s is given twice", name.c_str());
+        }
+        set_field(rule.key, field->second, value & mask);
+        set_field(rule.mask, field->second, mask);
+    }
+
+    // Only IPv4 frames have IPv4 addresses, so matching one implies matching the EtherType
+    const bool matches_ip = get_field(rule.mask, SOURCE_IP) || get_field(rule.mask, DESTINATION_IP);
+    if (matches_ip && get_field(rule.mask, ETHER_TYPE) == 0) {
+        set_field(rule.key, ETHER_TYPE, ETHERTYPE_IP);
+        set_field(rule.mask, ETHER_TYPE, 0xFFFF);
+    } else if (matches_ip && get_field(rule.key, ETHER_TYPE) != ETHERTYPE_IP) {
+        return fail(error, "IPv4 addresses only match EtherType 0x0800");
+    }
+    return true;
+}
+
+/*
+ * Parses an ACL, one rule per line, e.g.:
+ *  deny ether-type 0x86dd
+ *  redirect eth2 dst-ip 10.0.0.0/8 ip-proto 6 dst-port 80
+ *  priority interactive ip-proto 17 dst-port 5060
+ * Everything after a '#' is a comment. Returns an empty optional and describes the first invalid
+ * rule in the given string if there is one.
+ */
+std::optional<std::vector<AclRule>> AccessList::parse(const std::string& text, std::string& error) {
+    std::vector<AclRule> rules;
+    std::istringstream lines{text};
+    std::string line;
+    for (size_t line_number = 1; std::getline(lines, line); ++line_number) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        AclRule rule;
+        std::string rule_error;
+        if (!parse_rule(line, rule, rule_error)) {
+            fail(error, "Line %ld: %s", line_number, rule_error.c_str());
+            return {};
+        }
+        if (rules.size() == AccessList::NO_RULE) {
+            fail(error, "Line %ld: Too many rules", line_number);
+            return {};
+        }
+
+        const size_t start = line.find_first_not_of(" \t");
+        rule.text = line.substr(start, line.find_last_not_of(" \t\r") + 1 - start);
+        rules.push_back(rule);
+    }
+    return rules;
+}
+
+/*
+ * Builds the key an ACL looks a frame up by, from a frame whose VLAN tag, if it had one, has been
+ * taken off, and the VLAN it's switched in. IP headers are only parsed when asked to, since most
+ * ACLs only look at the ethernet header. Ports are only taken from the first fragment of a packet.
+ */
+FlowKey AccessList::flow_key(
+    std::span<const unsigned char> frame, uint16_t vlan, bool with_network_fields
+) {
+    FlowKey key;
+    if (frame.size() < sizeof(ethhdr)) {
+        return key;
+    }
+
+    const uint16_t ether_type = read_u16(frame.data() + 2 * ETH_ALEN);
+    key.words[0] = MacAddress(frame.data()).int_representation() << 16 | ether_type;
+    key.words[1] = MacAddress(frame.data() + ETH_ALEN).int_representation() << 16 | vlan;
+    if (!with_network_fields) {
+        return key;
+    }
+
+    const unsigned char* network = frame.data() + sizeof(ethhdr);
+    const size_t network_length = frame.size() - sizeof(ethhdr);
+    uint8_t protocol = 0;
+    size_t transport_offset = 0;
+    if (ether_type == ETHERTYPE_IP && network_length >= IPV4_MIN_HEADER_SIZE) {
+        protocol = network[9];
+        key.words[2] = (uint64_t)read_u32(network + 12) << 32 | read_u32(network + 16);
+
+        const bool first_fragment = (read_u16(network + 6) & 0x1FFF) == 0;
+        transport_offset = first_fragment ? (network[0] & 0x0F) * 4 : 0;
+    } else if (ether_type == ETHERTYPE_IPV6 && network_length >= IPV6_HEADER_SIZE) {
+        protocol = network[6];
+        transport_offset = IPV6_HEADER_SIZE;
+    }
+
+    uint64_t ports = 0;
+    if ((protocol == IPPROTO_TCP || protocol == IPPROTO_UDP) && transport_offset != 0 &&
+        transport_offset + 4 <= network_length) {
+        ports = read_u32(network + transport_offset);
+    }
+    key.words[3] = (uint64_t)protocol << 32 | ports;
+    return key;
+}
+
+uint64_t AccessList::hash(const FlowKey& key) {
+    uint64_t hash = 0;
+    for (uint64_t word : key.words) {
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// Compiles the given rules, in the order they apply, with hit counters for the given shards
+AccessList::AccessList(std::vector<AclRule> r, size_t s)
+    : rules{std::move(r)},
+      matches_network_fields{false},
+      shard_count{s},
+      hit_counters{std::make_unique<Counter[]>(shard_count * rules.size())} {
+    std::vector<std::vector<uint32_t>> tuple_rules;
+    for (uint32_t index = 0; index < rules.size(); ++index) {
+        const AclRule& rule = rules[index];
+        matches_network_fields |= rule.mask.words[2] != 0 || rule.mask.words[3] != 0;
+
+        auto tuple = std::ranges::find(tuples, rule.mask, &Tuple::mask);
+        if (tuple == tuples.end()) {
+            tuples.push_back({rule.mask, index, 0, {}});
+            tuple_rules.emplace_back();
+            tuple = tuples.end() - 1;
+        }
+        tuple_rules[tuple - tuples.begin()].push_back(index);
+    }
+
+    // Tables are at most half full, so probing always ends at an empty bucket
+    for (size_t t = 0; t < tuples.size(); ++t) {
+        Tuple& tuple = tuples[t];
+        tuple.buckets.resize(std::bit_ceil(tuple_rules[t].size() * 2));
+        tuple.bucket_mask = tuple.buckets.size() - 1;
+
+        for (uint32_t index : tuple_rules[t]) {
+            const FlowKey& key = rules[index].key;
+            size_t bucket = AccessList::hash(key) & tuple.bucket_mask;
+            while (tuple.buckets[bucket].rule != AccessList::NO_RULE &&
+                   !(tuple.buckets[bucket].key == key)) {
+                bucket = (bucket + 1) & tuple.bucket_mask;
+            }
+
+            // A later rule with the same key as an earlier one can never match
+            if (tuple.buckets[bucket].rule == AccessList::NO_RULE) {
+                tuple.buckets[bucket] = {key, index};
+            }
+        }
+    }
+
+    std::ranges::sort(tuples, {}, &Tuple::first_rule);
+}
+
+/*
+ * Returns the index of the first rule the given frame, switched in the given VLAN, matches, or an
+ * empty optional if it matches none
+ */
+std::optional<size_t> AccessList::classify(
+    std::span<const unsigned char> frame, uint16_t vlan
+) const {
+    const FlowKey key = AccessList::flow_key(frame, vlan, matches_network_fields);
+
+    uint32_t match = AccessList::NO_RULE;
+    for (const Tuple& tuple : tuples) {
+        // Every later table only holds rules after the match
+        if (tuple.first_rule >= match) {
+            break;
+        }
+
+        FlowKey masked;
+        for (size_t word = 0; word < masked.words.size(); ++word) {
+            masked.words[word] = key.words[word] & tuple.mask.words[word];
+        }
+
+        for (size_t bucket = AccessList::hash(masked) & tuple.bucket_mask;;
+             bucket = (bucket + 1) & tuple.bucket_mask) {
+            const Bucket& candidate = tuple.buckets[bucket];
+            if (candidate.rule == AccessList::NO_RULE) {
+                break;
+            }
+            if (candidate.key == masked) {
+                match = std::min(match, candidate.rule);
+                break;
+            }
+        }
+    }
+
+    if (match == AccessList::NO_RULE) {
+        return {};
+    }
+    return match;
+}
+
+// Returns the number of frames that matched the given rule, across every shard
+uint64_t AccessList::hits(size_t rule) const {
+    uint64_t total = 0;
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+        total += hit_counters[shard * rules.size() + rule].get();
+    }
+    return total;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Metrics.hpp"
+#include "TrafficClass.hpp"
+
+// What happens to a frame that matches an ACL rule
+enum class AclAction : uint8_t {
+    // Switch the frame as usual
+    PERMIT,
+
+    // Drop the frame before its source MAC is learned
+    DENY,
+
+    // Send the frame out of the rule's port instead of wherever it would have been switched to
+    REDIRECT,
+
+    // Switch the frame as usual, and send a copy out of the rule's port
+    MIRROR,
+
+    // Switch the frame as usual, in the rule's traffic class
+    SET_PRIORITY,
+};
+
+/*
+ * The fields of a frame an ACL rule can match on, packed into four words so that masking and
+ * comparing a whole key is a handful of AND and compare instructions:
+ *  0: destination MAC (48) | EtherType (16)
+ *  1: source MAC (48) | VLAN (16)
+ *  2: IPv4 source address (32) | IPv4 destination address (32)
+ *  3: IP protocol (32) | TCP or UDP source port (16) | TCP or UDP destination port (16)
+ * Fields a frame doesn't have, e.g. ports of a frame that isn't TCP or UDP, are zero.
+ */
+struct FlowKey {
+    std::array<uint64_t, 4> words{};
+
+    bool operator==(const FlowKey&) const = default;
+};
+
+struct AclRule {
+    AclAction action = AclAction::PERMIT;
+
+    // Interface a REDIRECT or MIRROR rule sends frames out of
+    std::string port_name;
+
+    // Traffic class a SET_PRIORITY rule puts frames in
+    TrafficClass traffic_class = BEST_EFFORT;
+
+    // Values of the fields the rule matches, and which bits of them it matches on
+    FlowKey key;
+    FlowKey mask;
+
+    // The rule as written, for showing it back
+    std::string text;
+};
+
+/*
+ * An access control list: rules that permit, deny, redirect, mirror, or reprioritize frames by
+ * their MACs, EtherType, VLAN, IPv4 addresses, IP protocol and TCP or UDP ports. The first rule a
+ * frame matches applies, and frames that match no rule are permitted.
+ *
+ * Rules are compiled into a tuple space: rules that match on exactly the same bits, e.g. every
+ * rule on a destination /24 and a TCP port, share a hash table keyed on the masked fields. Looking
+ * a frame up masks its key once per distinct mask and probes that mask's table, so the cost grows
+ * with the number of distinct masks rather than the number of rules. Tables are searched in the
+ * order of the earliest rule they hold, and the search stops as soon as no later table can hold an
+ * earlier match. A compiled list is immutable, so it's rebuilt from scratch to change it and can be
+ * shared by every thread without a lock.
+ *
+ * Every rule counts its hits per shard, each shard being a single thread, so counting a hit never
+ * contends with another thread.
+ */
+class AccessList {
+private:
+    static constexpr uint32_t NO_RULE = UINT32_MAX;
+
+    struct Bucket {
+        FlowKey key;
+        uint32_t rule = AccessList::NO_RULE;
+    };
+
+    // Every rule with the same mask, in an open addressing hash table with linear probing
+    struct Tuple {
+        FlowKey mask;
+
+        // Earliest rule in the table
+        uint32_t first_rule;
+
+        size_t bucket_mask;
+        std::vector<Bucket> buckets;
+    };
+
+    const std::vector<AclRule> rules;
+    std::vector<Tuple> tuples;
+
+    // Whether any rule looks past the ethernet header, so frames need their IP headers parsed
+    bool matches_network_fields;
+
+    const size_t shard_count;
+
+    // Indexed by shard, then by rule
+    const std::unique_ptr<Counter[]> hit_counters;
+
+    static uint64_t hash(const FlowKey&);
+
+public:
+    AccessList(std::vector<AclRule>, size_t);
+
+    AccessList(const AccessList&) = delete;
+    AccessList& operator=(const AccessList&) = delete;
+
+    static std::optional<std::vector<AclRule>> parse(const std::string&, std::string&);
+    static FlowKey flow_key(std::span<const unsigned char>, uint16_t, bool = true);
+
+    std::optional<size_t> classify(std::span<const unsigned char>, uint16_t) const;
+
+    // Records a hit on the given rule by the given shard. Only that shard's thread may call this
+    void count_hit(size_t shard, size_t rule) const {
+        hit_counters[shard * rules.size() + rule].add(1);
+    }
+
+    uint64_t hits(size_t) const;
+
+    const AclRule& rule(size_t index) const {
+        return rules[index];
+    }
+
+    size_t size() const {
+        return rules.size();
+    }
+
+    // Number of distinct masks, each of which costs a hash table probe per lookup
+    size_t tuple_count() const {
+        return tuples.size();
+    }
+};
@@ -0,0 +1,123 @@
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "ControlServer.hpp"
+#include "UnixSocket.hpp"
+#include "panic.hpp"
+
+/*
+ * Helper function to create the listening socket. Any stale socket left at the path by a previous
+ * run is replaced. Panics if the socket could not be created.
+ */
+int ControlServer::initialize_listen_socket(const std::string& path) {
+    int new_listen_fd = listen_unix_socket(path);
+    if (new_listen_fd < 0) {
+        PANIC("Failed to listen on control socket %s: %s\n", path.c_str(), strerror(errno));
+    }
+    return new_listen_fd;
+}
+
+ControlServer::ControlServer(const std::string& p)
+    : socket_path{p},
+      listen_fd{ControlServer::initialize_listen_socket(socket_path)} {
+}
+
+ControlServer::~ControlServer() {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+}
+
+/*
+ * Reads a client's command, up to the end of its first line or until the client stops sending.
+ * Returns an empty optional if the client went away or took too long to send anything.
+ */
+std::optional<std::string> ControlServer::read_command(int client_fd) {
+    timeval timeout{ControlServer::COMMAND_TIMEOUT_SECONDS, 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string command;
+    char buffer[512];
+    while (command.find('\n') == std::string::npos &&
+           command.size() < ControlServer::MAX_COMMAND_LENGTH) {
+        ssize_t read_length = recv(client_fd, buffer, sizeof(buffer), 0);
+        if (read_length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read_length < 0) {
+            return {};
+        }
+        if (read_length == 0) {
+            break;
+        }
+        command.append(buffer, read_length);
+    }
+
+    command.resize(std::min(command.find('\n'), command.size()));
+    if (!command.empty() && command.back() == '\r') {
+        command.pop_back();
+    }
+    return command;
+}
+
+/*
+ * Accepts connections forever, running each one's command through the given function and writing
+ * whatever it returns back before closing the connection.
+ */
+void ControlServer::serve(const std::function<std::string(const std::string&)>& execute) {
+    while (true) {
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno != EINTR) {
+                syslog(LOG_ERR, "Failed to accept control connection: %m");
+            }
+            continue;
+        }
+
+        std::optional<std::string> command = ControlServer::read_command(client_fd);
+        if (command.has_value()) {
+            const std::string reply = execute(command.value());
+            write_all(client_fd, reply.data(), reply.size());
+        }
+        close(client_fd);
+    }
+}
+
+/*
+ * Sends the given command to the control socket at the given path and returns the switch's reply,
+ * or an empty optional if the socket couldn't be reached
+ */
+std::optional<std::string> ControlServer::send(
+    const std::string& path, const std::string& command
+) {
+    int fd = connect_unix_socket(path);
+    if (fd < 0) {
+        return {};
+    }
+
+    const std::string line = command + "\n";
+    if (!write_all(fd, line.data(), line.size())) {
+        close(fd);
+        return {};
+    }
+
+    std::string reply;
+    char buffer[4096];
+    ssize_t read_length;
+    while ((read_length = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (read_length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return {};
+        }
+        reply.append(buffer, read_length);
+    }
+
+    close(fd);
+    return reply;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+
+/*
+ * Takes commands that change a running switch over a Unix domain socket. Every connection sends a
+ * single line holding one command, gets the command's reply back, and is then closed, so the
+ * endpoint can be used with the switch's --control option, or with anything that can write to a
+ * Unix socket, e.g. `echo show-ports | socat - UNIX-CONNECT:<path>`.
+ *
+ * Commands are run one at a time, in the order their connections were accepted.
+ */
+class ControlServer {
+public:
+    // Longest command line accepted. Longer commands are cut off and fail to parse
+    static constexpr size_t MAX_COMMAND_LENGTH = 4096;
+
+    // Seconds a client has to send its command before it's hung up on
+    static constexpr int COMMAND_TIMEOUT_SECONDS = 1;
+
+private:
+    const std::string socket_path;
+    const int listen_fd;
+
+    static int initialize_listen_socket(const std::string&);
+    static std::optional<std::string> read_command(int);
+
+public:
+    explicit ControlServer(const std::string&);
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    void serve(const std::function<std::string(const std::string&)>&);
+
+    static std::optional<std::string> send(const std::string&, const std::string&);
+};
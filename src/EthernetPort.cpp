@@ -3,8 +3,13 @@
 #include <net/ethernet.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <net/if_arp.h>
 #include <netinet/ip.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
@@ -13,14 +18,19 @@
 #include <string_view>
 
 #include "EthernetPort.hpp"
+#include "Segmenter.hpp"
 #include "panic.hpp"
 
 /*
  * Helper function to initialize a raw socket. Panics if the socket could not be initialized.
  * Returns the socket file descriptor.
+ *
+ * The socket is opened without a protocol, so it receives nothing until it's bound. That way the
+ * kernel already ignores outgoing frames and applies the given filter to the very first frame the
+ * socket receives.
  */
-int EthernetPort::initialize_raw_socket(std::string_view interface_name) {
-    int new_socket_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+int EthernetPort::initialize_raw_socket(std::string_view interface_name, const PortFilter& filter) {
+    int new_socket_fd = socket(AF_PACKET, SOCK_RAW, 0);
 
     if (new_socket_fd < 0) {
         PANIC(
@@ -41,6 +51,49 @@ int EthernetPort::initialize_raw_socket(std::string_view interface_name) {
     }
     const int interface_index = index_ifreq.ifr_ifindex;
 
+    /*
+     * Without this, the socket also reads back every frame sent out of the interface, by the host
+     * or by the switch's other sockets on it, and the switch would learn and switch them again
+     */
+    int ignore_outgoing = 1;
+    if (setsockopt(
+            new_socket_fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore_outgoing, sizeof(int)
+        ) < 0) {
+        PANIC(
+            "Failed to enable PACKET_IGNORE_OUTGOING on interface %s: %s\n", interface_name.data(),
+            strerror(errno)
+        );
+    }
+
+    /*
+     * Lets GSO frames through whole rather than cut down to the read buffer, and keeps checksums
+     * the host left for its NIC to fill in from going out wrong. The kernel only ever hands frames
+     * like that to sockets that can pass the offloads along, so a socket without it still works.
+     */
+    int enable_vnet_header = 1;
+    if (setsockopt(
+            new_socket_fd, SOL_PACKET, PACKET_VNET_HDR, &enable_vnet_header, sizeof(int)
+        ) < 0) {
+        syslog(
+            LOG_WARNING, "Failed to enable PACKET_VNET_HDR on interface %s, so GSO is off: %m",
+            interface_name.data()
+        );
+    }
+
+    if (!filter.empty()) {
+        std::vector<sock_filter> program = filter.compile();
+        sock_fprog attached_program{(unsigned short)program.size(), program.data()};
+        if (setsockopt(
+                new_socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &attached_program,
+                sizeof(attached_program)
+            ) < 0) {
+            PANIC(
+                "Failed to attach filter on interface %s: %s\n", interface_name.data(),
+                strerror(errno)
+            );
+        }
+    }
+
     // Configure the socket to only be bound to a specific interface
     sockaddr_ll socket_config;
     socket_config.sll_family = AF_PACKET;
@@ -51,59 +104,521 @@ int EthernetPort::initialize_raw_socket(std::string_view interface_name) {
         PANIC("Failed to bind\n");
     }
 
+    // With VLAN offload, the kernel strips tags on receive and only tells us about them this way
+    int enable_auxdata = 1;
+    if (setsockopt(new_socket_fd, SOL_PACKET, PACKET_AUXDATA, &enable_auxdata, sizeof(int)) < 0) {
+        PANIC(
+            "Failed to enable PACKET_AUXDATA on interface %s: %s\n", interface_name.data(),
+            strerror(errno)
+        );
+    }
+
     return new_socket_fd;
 }
 
+/*
+ * Returns the tag control information of the VLAN tag the kernel stripped off a frame received
+ * with the given message header, or an empty optional if the frame wasn't tagged
+ */
+std::optional<uint16_t> EthernetPort::stripped_vlan_tci(const msghdr& message) {
+    for (const cmsghdr* control = CMSG_FIRSTHDR(&message); control != nullptr;
+         control = CMSG_NXTHDR((msghdr*)&message, (cmsghdr*)control)) {
+        if (control->cmsg_level != SOL_PACKET || control->cmsg_type != PACKET_AUXDATA ||
+            control->cmsg_len < CMSG_LEN(sizeof(tpacket_auxdata))) {
+            continue;
+        }
+
+        tpacket_auxdata auxdata;
+        memcpy(&auxdata, CMSG_DATA(control), sizeof(tpacket_auxdata));
+
+        // Older kernels don't set the valid flag, but then a tag of all zeroes means no tag
+        if (auxdata.tp_vlan_tci != 0 || (auxdata.tp_status & TP_STATUS_VLAN_VALID)) {
+            return auxdata.tp_vlan_tci;
+        }
+    }
+    return {};
+}
+
+// Whether the given socket passes each frame's offloads along with it in a FrameOffload
+bool EthernetPort::takes_vnet_header(int socket) {
+    int vnet_header = 0;
+    socklen_t vnet_header_length = sizeof(int);
+    return getsockopt(socket, SOL_PACKET, PACKET_VNET_HDR, &vnet_header, &vnet_header_length) ==
+               0 &&
+           vnet_header != 0;
+}
+
+// Returns the MTU of the given interface, or an empty optional if it couldn't be read
+std::optional<uint32_t> EthernetPort::interface_mtu(std::string_view interface_name, int socket) {
+    ifreq mtu_ifreq;
+    memset(&mtu_ifreq, 0, sizeof(ifreq));
+
+    strncpy(mtu_ifreq.ifr_name, interface_name.data(), IFNAMSIZ - 1);
+    if (ioctl(socket, SIOCGIFMTU, &mtu_ifreq) < 0) {
+        return {};
+    }
+    return (uint32_t)mtu_ifreq.ifr_mtu;
+}
+
+/*
+ * Size of the buffer frames are read into: the largest frame the interface's MTU allows, with room
+ * for two VLAN tags, or a whole GSO frame if the socket takes them and they're bigger than that.
+ * Without an MTU to go by, the standard ethernet MTU is assumed.
+ */
+size_t EthernetPort::receive_buffer_size(
+    std::string_view interface_name, int socket, bool vnet_header
+) {
+    const size_t largest_frame = ETH_HLEN + 2 * VLAN_TAG_SIZE +
+                                 EthernetPort::interface_mtu(interface_name, socket)
+                                     .value_or(ETH_DATA_LEN);
+    if (!vnet_header) {
+        return largest_frame;
+    }
+    return std::max(largest_frame, EthernetPort::MAX_GSO_FRAME_SIZE);
+}
+
 /*
  * Constructs an ethernet port using the given interface name. This interface name will have a raw
  * socket bound to it to emulate the behavior of a physical port.
  */
-EthernetPort::EthernetPort(const std::string& i)
+EthernetPort::EthernetPort(const std::string& i, const PortFilter& f)
     : interface_name{i},
-      socket_fd{EthernetPort::initialize_raw_socket(interface_name)} {
-    read_buffer.fill(0);
+      frame_pool{EthernetPort::FRAME_POOL_SIZE},
+      socket_fd{EthernetPort::initialize_raw_socket(interface_name, f)},
+      vnet_header{EthernetPort::takes_vnet_header(socket_fd)},
+      filter{f},
+      read_buffer(EthernetPort::receive_buffer_size(interface_name, socket_fd, vnet_header)) {
+    tx_batch.reserve(EthernetPort::TX_BATCH_SIZE);
+    owns_socket = true;
+}
+
+EthernetPort::~EthernetPort() {
+    if (owns_socket) {
+        close(socket_fd);
+    }
 }
 
 bool EthernetPort::operator==(const EthernetPort& other) const {
     return socket_fd == other.socket_fd;
 }
 
+// Name of the kind of socket behind the port, as given in port specs
+const char* EthernetPort::backend() const {
+    return "raw";
+}
+
+/*
+ * Opens another port of the same kind on the same interface, with its own socket. Used to give each
+ * forwarding worker its own socket on every interface.
+ */
+std::shared_ptr<EthernetPort> EthernetPort::clone() const {
+    std::shared_ptr<EthernetPort> port = std::make_shared<EthernetPort>(interface_name, filter);
+    port->vlans = vlans;
+    return port;
+}
+
+/*
+ * Returns another port that shares this port's socket, for transmitting on the port from a thread
+ * other than the one receiving on it. Each handle batches its own transmits, so threads never share
+ * a batch. Since it's the same socket, the kernel still won't loop frames sent through a handle
+ * back to this port. Frames should only ever be received through the original port.
+ */
+std::shared_ptr<EthernetPort> EthernetPort::transmit_handle() const {
+    std::shared_ptr<EthernetPort> handle{new EthernetPort{interface_name, socket_fd}};
+    handle->vlans = vlans;
+    handle->filter = filter;
+    return handle;
+}
+
+// Returns the MAC address of the port's interface, or an empty optional if it has none
+std::optional<MacAddress> EthernetPort::hardware_address() const {
+    ifreq hwaddr_ifreq;
+    memset(&hwaddr_ifreq, 0, sizeof(ifreq));
+
+    strncpy(hwaddr_ifreq.ifr_name, interface_name.c_str(), IFNAMSIZ - 1);
+    if (ioctl(socket_fd, SIOCGIFHWADDR, &hwaddr_ifreq) < 0 ||
+        hwaddr_ifreq.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+        return {};
+    }
+    return MacAddress{(const uint8_t*)hwaddr_ifreq.ifr_hwaddr.sa_data};
+}
+
+/*
+ * Whether the port's interface has carrier. A port whose flags can't be read is assumed to be up,
+ * since it's still open as far as the switch is concerned.
+ */
+bool EthernetPort::link_up() const {
+    ifreq flags_ifreq;
+    memset(&flags_ifreq, 0, sizeof(ifreq));
+
+    strncpy(flags_ifreq.ifr_name, interface_name.c_str(), IFNAMSIZ - 1);
+    if (ioctl(socket_fd, SIOCGIFFLAGS, &flags_ifreq) < 0) {
+        return true;
+    }
+    return (flags_ifreq.ifr_flags & IFF_RUNNING) != 0;
+}
+
+/*
+ * Adds this port's socket to a PACKET_FANOUT group. The kernel spreads frames received on the
+ * interface across every socket in the group by flow hash, so all frames of a flow are always
+ * received by the same socket. If no group is given, a new group with a unique ID is created.
+ * Returns the ID of the group that was joined, or an empty optional if joining failed.
+ */
+std::optional<uint16_t> EthernetPort::join_fanout(std::optional<uint16_t> group_id) {
+    int fanout_mode = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+    if (!group_id.has_value()) {
+        fanout_mode |= PACKET_FANOUT_FLAG_UNIQUEID;
+    }
+
+    int fanout_config = group_id.value_or(0) | (fanout_mode << 16);
+    if (setsockopt(socket_fd, SOL_PACKET, PACKET_FANOUT, &fanout_config, sizeof(int)) < 0) {
+        return {};
+    }
+    if (group_id.has_value()) {
+        return group_id;
+    }
+
+    // Read back the ID the kernel picked for the new group
+    socklen_t fanout_config_length = sizeof(int);
+    if (getsockopt(socket_fd, SOL_PACKET, PACKET_FANOUT, &fanout_config, &fanout_config_length) <
+        0) {
+        return {};
+    }
+    return (uint16_t)(fanout_config & 0xFFFF);
+}
+
+/*
+ * Puts this port's socket in non-blocking mode. Receives on a non-blocking port return no frames
+ * instead of waiting when nothing has arrived yet.
+ */
+void EthernetPort::set_nonblocking() {
+    int flags = fcntl(socket_fd, F_GETFL);
+    if (flags < 0 || fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        PANIC(
+            "Failed to make socket on interface %s non-blocking: %s\n", interface_name.c_str(),
+            strerror(errno)
+        );
+    }
+    nonblocking = true;
+}
+
+int EthernetPort::get_socket_fd() const {
+    return socket_fd;
+}
+
+/*
+ * Returns the file descriptor that becomes readable when frames are waiting to be received, for
+ * waiting on the port with poll() or epoll alongside other ports
+ */
+int EthernetPort::receive_fd() const {
+    return socket_fd;
+}
+
+/*
+ * Returns the number of frames the kernel has dropped on this port's socket because its receive
+ * buffer was full. Safe to call from any thread.
+ */
+uint64_t EthernetPort::kernel_drops() {
+    // The v3 stats are a superset of the older ones, and the kernel fills in whichever apply
+    tpacket_stats_v3 stats{};
+    socklen_t stats_length = sizeof(stats);
+    if (getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &stats_length) < 0) {
+        return kernel_drops_count.load();
+    }
+    return kernel_drops_count.fetch_add(stats.tp_drops) + stats.tp_drops;
+}
+
+/*
+ * Sets the VLANs this port carries. Must be called before the port is cloned or used to send
+ * anything.
+ */
+void EthernetPort::set_vlans(const PortVlans& port_vlans) {
+    vlans = port_vlans;
+}
+
+// Returns the VLANs this port carries, or an empty optional if the port doesn't know about VLANs
+const std::optional<PortVlans>& EthernetPort::get_vlans() const {
+    return vlans;
+}
+
+/*
+ * Returns the tag control information of the VLAN tag the given frame should be sent with on this
+ * port, or an empty optional if it should be sent untagged. A frame keeps the priority it was
+ * received with.
+ */
+std::optional<uint16_t> EthernetPort::egress_vlan_tci(const Frame& frame) const {
+    if (!vlans.has_value()) {
+        return frame.vlan_tci();
+    }
+    if (!vlans->tags(frame.vlan())) {
+        return {};
+    }
+    return (uint16_t)((frame.vlan_tci().value_or(0) & ~VLAN_ID_MASK) | frame.vlan());
+}
+
 /*
- * Receives the next frame from the bound interface and returns it as a Frame instance. Note that
- * this method blocks until the next packet arrives.
+ * Points the given iovecs at the given frame as it should go out on this port, pushing a VLAN tag
+ * held in the given scratch buffer between the MACs and the rest of the frame if the port tags it.
+ * If the socket takes offloads, the frame's go in front of it from the given scratch header. The
+ * frame's own buffer is never written to. Returns the number of iovecs used, at most four.
+ */
+size_t EthernetPort::gather_frame(
+    const Frame& frame, iovec* iovecs, std::array<unsigned char, VLAN_TAG_SIZE>& tag,
+    FrameOffload& offload
+) const {
+    const std::span<const unsigned char> buffer = frame.buffer();
+    const std::optional<uint16_t> tci = egress_vlan_tci(frame);
+
+    size_t count = 0;
+    if (vnet_header) {
+        // A pushed tag moves everything behind the MACs along, the offloads' offsets included
+        offload = frame.offload();
+        if (tci.has_value() && offload.needs_checksum()) {
+            offload.checksum_start += VLAN_TAG_SIZE;
+        }
+        if (tci.has_value() && offload.header_length > 0) {
+            offload.header_length += VLAN_TAG_SIZE;
+        }
+        iovecs[count++] = {&offload, sizeof(FrameOffload)};
+    }
+
+    if (!tci.has_value()) {
+        iovecs[count++] = {(void*)buffer.data(), buffer.size()};
+        return count;
+    }
+
+    tag = {
+        ETHERTYPE_VLAN >> 8, ETHERTYPE_VLAN & 0xFF, (unsigned char)(tci.value() >> 8),
+        (unsigned char)(tci.value() & 0xFF)
+    };
+    iovecs[count++] = {(void*)buffer.data(), 2 * ETH_ALEN};
+    iovecs[count++] = {tag.data(), tag.size()};
+    iovecs[count++] = {(void*)(buffer.data() + 2 * ETH_ALEN), buffer.size() - 2 * ETH_ALEN};
+    return count;
+}
+
+/*
+ * Receives the next frame from the bound interface and returns it as a Frame instance. The frame is
+ * read straight into a buffer from this port's pool, so nothing is copied or allocated, and its
+ * VLAN tag is popped off in place. Only a frame too large for a slot, e.g. a GSO frame, spills over
+ * into the read buffer and is copied into a buffer of its own. Note that this method blocks until
+ * the next packet arrives.
  */
 std::optional<Frame> EthernetPort::receive_frame() {
-    ssize_t read_length =
-        recvfrom(socket_fd, read_buffer.data(), EthernetPort::READ_BUFFER_SIZE, 0, NULL, NULL);
-    if (read_length < 0) {
+    FrameBuffer* frame_buffer = frame_pool.allocate(FramePool::SLOT_CAPACITY);
+
+    std::array<iovec, 3> read_iovecs;
+    size_t iovec_count = 0;
+    if (vnet_header) {
+        read_iovecs[iovec_count++] = {&read_offload, sizeof(FrameOffload)};
+    }
+    const size_t header_length = iovec_count * sizeof(FrameOffload);
+    read_iovecs[iovec_count++] = {frame_buffer->data(), FramePool::SLOT_CAPACITY};
+    read_iovecs[iovec_count++] = {read_buffer.data(), read_buffer.size()};
+
+    msghdr message{};
+    message.msg_iov = read_iovecs.data();
+    message.msg_iovlen = iovec_count;
+    message.msg_control = read_control.data();
+    message.msg_controllen = read_control.size();
+
+    ssize_t read_length = recvmsg(socket_fd, &message, 0);
+    if (read_length < (ssize_t)header_length) {
+        frame_pool.release(frame_buffer);
         return {};
     }
 
-    // If successful, parse the ethernet header and package it into a Frame instance
-    ethhdr* eth_header = (ethhdr*)(read_buffer.data());
+    const size_t frame_length = read_length - header_length;
+    if (frame_length > FramePool::SLOT_CAPACITY) {
+        FrameBuffer* large_buffer = frame_pool.allocate(frame_length);
+        memcpy(large_buffer->data(), frame_buffer->data(), FramePool::SLOT_CAPACITY);
+        memcpy(
+            large_buffer->data() + FramePool::SLOT_CAPACITY, read_buffer.data(),
+            frame_length - FramePool::SLOT_CAPACITY
+        );
+        frame_pool.release(frame_buffer);
+        frame_buffer = large_buffer;
+    }
+    frame_buffer->length = (uint32_t)frame_length;
 
-    return Frame{
-        MacAddress(
-            eth_header->h_source[0], eth_header->h_source[1], eth_header->h_source[2],
-            eth_header->h_source[3], eth_header->h_source[4], eth_header->h_source[5]
-        ),
-        MacAddress(
-            eth_header->h_dest[0], eth_header->h_dest[1], eth_header->h_dest[2],
-            eth_header->h_dest[3], eth_header->h_dest[4], eth_header->h_dest[5]
-        ),
+    Frame frame{frame_buffer};
+    if (vnet_header) {
+        frame.set_offload(read_offload);
+    }
+    frame.take_vlan_tag(EthernetPort::stripped_vlan_tci(message));
+    return frame;
+}
 
-        /*
-         * Only copy as much data was read to we don't need to copy around READ_BUFFER_SIZE bytes
-         * where not needed
-         */
-        std::vector(read_buffer.begin(), read_buffer.begin() + read_length)};
+/*
+ * Receives the next batch of frames from the bound interface and hands each one to the given
+ * callback as a view into this port's read buffer. Returns the number of frames received, or an
+ * empty optional if the read failed. The raw socket implementation can only ever read one frame per
+ * syscall, so batches are always a single frame here; subclasses backed by a ring override this.
+ * Note that this method blocks until the next packet arrives unless the port is non-blocking.
+ */
+std::optional<size_t> EthernetPort::receive_frames(const FrameViewCallback& callback) {
+    std::array<iovec, 2> read_iovecs;
+    size_t iovec_count = 0;
+    if (vnet_header) {
+        read_iovecs[iovec_count++] = {&read_offload, sizeof(FrameOffload)};
+    }
+    const size_t header_length = iovec_count * sizeof(FrameOffload);
+    read_iovecs[iovec_count++] = {read_buffer.data(), read_buffer.size()};
+
+    msghdr message{};
+    message.msg_iov = read_iovecs.data();
+    message.msg_iovlen = iovec_count;
+    message.msg_control = read_control.data();
+    message.msg_controllen = read_control.size();
+
+    ssize_t read_length = recvmsg(socket_fd, &message, 0);
+    if (read_length < 0) {
+        // Nothing to read yet on a non-blocking socket isn't an error
+        if (nonblocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        return {};
+    }
+
+    // Runt frames can't hold an ethernet header, so there's nothing for the switch to do with them
+    if ((size_t)read_length < header_length + sizeof(ethhdr)) {
+        return 0;
+    }
+
+    callback(FrameView{
+        {read_buffer.data(), read_length - header_length},
+        EthernetPort::stripped_vlan_tci(message),
+        nullptr,
+        read_offload
+    });
+    return 1;
 }
 
 /*
- * Attempts to send the given Frame on this EthernetPort's interface. Returns true if sending was
- * successful and false otherwise.
+ * Attempts to send the given Frame on this EthernetPort's interface, tagged if this port tags its
+ * VLAN. Returns true if sending was successful and false otherwise.
  */
 bool EthernetPort::send_frame(const Frame& frame) {
-    ssize_t send_length = send(socket_fd, frame.buffer.data(), frame.buffer.size(), 0);
+    if (!vnet_header && Segmenter::needed(frame.offload())) {
+        return send_segments(frame);
+    }
+
+    std::array<iovec, 4> iovecs;
+    std::array<unsigned char, VLAN_TAG_SIZE> tag;
+    FrameOffload offload;
+
+    msghdr message{};
+    message.msg_iov = iovecs.data();
+    message.msg_iovlen = gather_frame(frame, iovecs.data(), tag, offload);
+
+    ssize_t send_length = sendmsg(socket_fd, &message, 0);
     return send_length >= 0;
 }
+
+/*
+ * Queues the given Frame to be sent on the next call to flush_frames(). The frame is not copied, so
+ * it must outlive the flush. Returns false if the batch is already full, in which case the frame
+ * was not queued.
+ */
+bool EthernetPort::enqueue_frame(const Frame& frame) {
+    if (tx_batch.size() == EthernetPort::TX_BATCH_SIZE) {
+        return false;
+    }
+
+    tx_batch.push_back(&frame);
+    return true;
+}
+
+/*
+ * Sends the first given number of message headers with as few sendmmsg() syscalls as possible,
+ * stopping at the first one the kernel refuses. Returns the number of messages that were sent.
+ */
+size_t EthernetPort::send_messages(size_t count) {
+    // sendmmsg() may send only part of the batch, so keep going until it's all out or it fails
+    size_t sent = 0;
+    while (sent < count) {
+        int sent_now = sendmmsg(socket_fd, &tx_messages[sent], count - sent, 0);
+        if (sent_now < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent_now <= 0) {
+            break;
+        }
+        sent += sent_now;
+    }
+    return sent;
+}
+
+/*
+ * Sends the given frame as the frames its offloads stand for, segmenting it and filling in its
+ * checksums in software, for a socket that can't pass offloads on to the kernel. The segments are
+ * written out to a scratch buffer and sent a batch at a time. Returns false unless every segment
+ * was sent, which it never is for a frame whose offloads don't add up.
+ */
+bool EthernetPort::send_segments(const Frame& frame) {
+    const Segmenter segmenter{frame.buffer(), frame.offload()};
+    if (!segmenter.valid()) {
+        return false;
+    }
+
+    const std::optional<uint16_t> tci = egress_vlan_tci(frame);
+    tx_segments.resize(segmenter.total_length(tci.has_value()));
+
+    size_t offset = 0;
+    size_t segment = 0;
+    while (segment < segmenter.segments()) {
+        size_t gathered = 0;
+        for (; gathered < EthernetPort::TX_BATCH_SIZE && segment < segmenter.segments();
+             ++gathered, ++segment) {
+            const size_t length =
+                segmenter.write_segment(segment, tci, tx_segments.data() + offset);
+            tx_iovecs[gathered] = {tx_segments.data() + offset, length};
+            memset(&tx_messages[gathered], 0, sizeof(mmsghdr));
+            tx_messages[gathered].msg_hdr.msg_iov = &tx_iovecs[gathered];
+            tx_messages[gathered].msg_hdr.msg_iovlen = 1;
+            offset += length;
+        }
+
+        if (send_messages(gathered) < gathered) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Sends every queued frame with as few sendmmsg() syscalls as possible, in the order they were
+ * queued, pushing VLAN tags on the way out as needed. A frame with offloads the socket can't pass
+ * on is sent on its own as its segments, once everything queued ahead of it is out. Sending stops
+ * at the first frame the kernel refuses, and that frame and everything queued after it are dropped,
+ * so the frames that failed are always a suffix of the batch. Returns the number of frames that
+ * were sent. The batch is empty once this returns.
+ */
+size_t EthernetPort::flush_frames() {
+    size_t sent = 0;
+    size_t gathered = 0;
+    for (const Frame* frame : tx_batch) {
+        if (vnet_header || !Segmenter::needed(frame->offload())) {
+            memset(&tx_messages[gathered], 0, sizeof(mmsghdr));
+            tx_messages[gathered].msg_hdr.msg_iov = &tx_iovecs[4 * gathered];
+            tx_messages[gathered].msg_hdr.msg_iovlen = gather_frame(
+                *frame, &tx_iovecs[4 * gathered], tx_tags[gathered], tx_offloads[gathered]
+            );
+            ++gathered;
+            continue;
+        }
+
+        const size_t sent_now = send_messages(gathered);
+        sent += sent_now;
+        const bool failed = sent_now < gathered || !send_segments(*frame);
+        gathered = 0;
+        if (failed) {
+            break;
+        }
+        ++sent;
+    }
+    sent += send_messages(gathered);
+
+    tx_batch.clear();
+    return sent;
+}
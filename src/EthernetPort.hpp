@@ -2,13 +2,25 @@
 
 #include <cstdlib>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <array>
+#include <span>
 #include <string>
+#include <memory>
+#include <atomic>
+#include <cstdint>
 #include <optional>
+#include <vector>
 #include <functional>
 #include <string_view>
 #include <linux/if_packet.h>
+#include <net/ethernet.h>
 #include "Frame.hpp"
+#include "FrameOffload.hpp"
+#include "FramePool.hpp"
+#include "MacAddress.hpp"
+#include "Vlan.hpp"
+#include "PortFilter.hpp"
 
 /*
  * Represents a physical ethernet port on a switch. This class encapsulates all of the low-level raw
@@ -24,33 +36,147 @@ public:
      */
     const std::string interface_name;
 
+    // Callback used to hand received frames to the caller without copying them out of the port
+    using FrameViewCallback = std::function<void(const FrameView&)>;
+
+    // Maximum number of frames that can be queued with enqueue_frame() between flushes
+    static constexpr size_t TX_BATCH_SIZE = 64;
+
+    /*
+     * Number of buffers in each port's frame pool. This bounds how many frames received on a port
+     * can be in flight at once before falling back to the heap, so it should comfortably cover a
+     * full input queue plus a batch being switched.
+     */
+    static constexpr size_t FRAME_POOL_SIZE = 4096;
+
+    /*
+     * Pool every Frame received on this port is allocated from. Only the thread receiving on the
+     * port may allocate from it.
+     */
+    FramePool frame_pool;
+
 protected:
     EthernetPort(const std::string& i, int s)
         : interface_name{i},
-          socket_fd{s} {
+          frame_pool{EthernetPort::FRAME_POOL_SIZE},
+          socket_fd{s},
+          vnet_header{EthernetPort::takes_vnet_header(s)},
+          read_buffer(EthernetPort::receive_buffer_size(i, s, vnet_header)) {
+        tx_batch.reserve(EthernetPort::TX_BATCH_SIZE);
     }
 
-    static int initialize_raw_socket(std::string_view);
+    static int initialize_raw_socket(std::string_view, const PortFilter&);
+    static std::optional<uint16_t> stripped_vlan_tci(const msghdr&);
+    static bool takes_vnet_header(int);
+    static std::optional<uint32_t> interface_mtu(std::string_view, int);
+    static size_t receive_buffer_size(std::string_view, int, bool);
 
     /*
-     * Size of the socket read buffer. Size based on the largest possible ethernet frame length,
-     * including an optional VLAN tag.
+     * Largest GSO frame the kernel hands a socket that takes PACKET_VNET_HDR: a 64 KiB IP packet
+     * behind an ethernet header and up to two VLAN tags
      */
-    static constexpr size_t READ_BUFFER_SIZE = 1522;
+    static constexpr size_t MAX_GSO_FRAME_SIZE = ETH_HLEN + 2 * VLAN_TAG_SIZE + (1 << 16);
 
     // File descriptor for the raw socket used to capture and send frames
     const int socket_fd;
 
-    // Raw buffer used for reading frames off the raw socket
-    std::array<unsigned char, EthernetPort::READ_BUFFER_SIZE> read_buffer;
+    /*
+     * Whether this port opened its socket itself, and so closes it when it's destroyed. Transmit
+     * handles share their port's socket and leave it alone.
+     */
+    bool owns_socket = false;
+
+    /*
+     * Whether every frame goes through the socket behind a FrameOffload carrying its offloads, so
+     * GSO frames are received and sent whole and checksums are left to whoever sends the frame.
+     * Ports whose socket doesn't do it segment and checksum frames in software before sending them.
+     */
+    const bool vnet_header;
+
+    // Frames the socket drops in the kernel. Kept so clones of the port filter the same way
+    PortFilter filter;
+
+    // Whether receives should return immediately when no frames are waiting
+    bool nonblocking = false;
+
+    /*
+     * Raw buffer used for reading frames off the raw socket, big enough for the largest frame the
+     * socket can receive, and the offloads of the frame last read into it
+     */
+    std::vector<unsigned char> read_buffer;
+    FrameOffload read_offload{};
+
+    // Control message buffer the kernel hands each received frame's tpacket_auxdata back in
+    alignas(cmsghdr) std::array<unsigned char, CMSG_SPACE(sizeof(tpacket_auxdata))> read_control;
+
+    /*
+     * VLANs this port carries, and which of them it tags on transmit. When empty, the port doesn't
+     * know about VLANs and frames are sent tagged exactly when they were received tagged.
+     */
+    std::optional<PortVlans> vlans;
+
+    /*
+     * Frames queued by enqueue_frame() that are waiting for the next flush_frames(). The frames
+     * aren't copied, so the caller must keep them alive until the flush.
+     */
+    std::vector<const Frame*> tx_batch;
+
+    /*
+     * Message headers handed to sendmmsg() when flushing. Kept around to avoid rebuilding them.
+     * Each frame gets up to four iovecs, so that its offloads can go in front of it and a VLAN tag
+     * can be pushed between the MACs and the rest of the frame without touching the frame's buffer,
+     * which other ports may be sending too.
+     */
+    std::array<mmsghdr, EthernetPort::TX_BATCH_SIZE> tx_messages;
+    std::array<iovec, 4 * EthernetPort::TX_BATCH_SIZE> tx_iovecs;
+
+    /*
+     * The VLAN tag pushed onto each frame of the batch being flushed, if it's sent tagged, and the
+     * offloads each frame is sent with, moved along to make room for the tag
+     */
+    std::array<std::array<unsigned char, VLAN_TAG_SIZE>, EthernetPort::TX_BATCH_SIZE> tx_tags;
+    std::array<FrameOffload, EthernetPort::TX_BATCH_SIZE> tx_offloads;
+
+    // Segments of a frame being segmented in software, which the iovecs point into while sending
+    std::vector<unsigned char> tx_segments;
+
+    size_t gather_frame(
+        const Frame&, iovec*, std::array<unsigned char, VLAN_TAG_SIZE>&, FrameOffload&
+    ) const;
+    size_t send_messages(size_t);
+    bool send_segments(const Frame&);
+
+    /*
+     * Frames the kernel dropped because this socket's receive buffer was full, as of the last
+     * kernel_drops(). The kernel resets its count every time it's read, so it's accumulated here.
+     */
+    std::atomic_uint64_t kernel_drops_count{0};
 
 public:
-    EthernetPort(const std::string&);
-    virtual ~EthernetPort() {
-    }
+    EthernetPort(const std::string&, const PortFilter& = {});
+    virtual ~EthernetPort();
 
     virtual bool operator==(const EthernetPort&) const;
 
+    virtual const char* backend() const;
+    virtual std::shared_ptr<EthernetPort> clone() const;
+    virtual std::shared_ptr<EthernetPort> transmit_handle() const;
+    std::optional<uint16_t> join_fanout(std::optional<uint16_t> = {});
+    virtual void set_nonblocking();
+    int get_socket_fd() const;
+    virtual int receive_fd() const;
+    std::optional<MacAddress> hardware_address() const;
+    bool link_up() const;
+    virtual uint64_t kernel_drops();
+
+    void set_vlans(const PortVlans&);
+    const std::optional<PortVlans>& get_vlans() const;
+    std::optional<uint16_t> egress_vlan_tci(const Frame&) const;
+
     virtual std::optional<Frame> receive_frame();
+    virtual std::optional<size_t> receive_frames(const FrameViewCallback&);
     virtual bool send_frame(const Frame&);
+
+    bool enqueue_frame(const Frame&);
+    virtual size_t flush_frames();
 };
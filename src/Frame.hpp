@@ -1,25 +1,226 @@
 #pragma once
-#include <vector>
+#include <atomic>
+#include <cstring>
+#include <net/ethernet.h>
+#include <optional>
+#include <span>
+#include <utility>
 #include "MacAddress.hpp"
+#include "FrameOffload.hpp"
+#include "FramePool.hpp"
+#include "TrafficClass.hpp"
+#include "Vlan.hpp"
+
+class Frame;
+
+/*
+ * A non-owning view of a frame that still lives in a port's receive buffer, e.g. a slot in a
+ * PACKET_MMAP ring. Views are only valid until the callback they were handed to returns, so
+ * anything that needs to outlive that callback should be copied into a Frame. The buffer must be
+ * at least as long as an ethernet header.
+ */
+struct FrameView {
+    const std::span<const unsigned char> buffer;
+
+    /*
+     * Tag control information of the frame's 802.1Q tag if the kernel stripped it off on receive,
+     * as it does whenever VLAN offload is on. A tag still in the buffer isn't included.
+     */
+    const std::optional<uint16_t> vlan_tci = {};
+
+    /*
+     * Frame the bytes already belong to, if the port received them straight into a frame buffer,
+     * e.g. an AF_XDP UMEM chunk. Frames made from the view share its buffer instead of copying it.
+     */
+    const Frame* frame = nullptr;
+
+    // Offloads the kernel left for whoever sends the frame, if the port takes PACKET_VNET_HDR
+    const FrameOffload offload = {};
+
+    MacAddress source_mac_address() const {
+        return MacAddress(buffer.data() + ETH_ALEN);
+    }
+
+    MacAddress destination_mac_address() const {
+        return MacAddress(buffer.data());
+    }
+
+    TrafficClass traffic_class() const {
+        return classify_frame(buffer, vlan_tci);
+    }
+};
 
 /*
  * A simple abstraction for a layer 2 frame.
+ *
+ * A Frame is a reference counted handle to a buffer from a FramePool, so copying a Frame never
+ * copies the frame's bytes and the same buffer can be shared by everything that needs it, e.g. all
+ * of the ports a frame is flooded to. The buffer goes back to its pool when the last Frame
+ * referencing it is destroyed. Frames are cheap to move and copy, and allocate nothing once the
+ * pool is warm.
  */
-struct Frame {
-    const MacAddress source_mac_address;
-    const MacAddress destination_mac_address;
+class Frame {
+private:
+    FrameBuffer* frame_buffer;
+
+    void release() {
+        if (frame_buffer != nullptr &&
+            frame_buffer->reference_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            frame_buffer->pool->release(frame_buffer);
+        }
+    }
+
+public:
+    // Takes over a freshly allocated buffer, which must have a reference count of one
+    explicit Frame(FrameBuffer* b)
+        : frame_buffer{b} {
+    }
+
+    /*
+     * Copies the given bytes into a buffer from the given pool, optionally stamped with the time
+     * the frame was received. Must be called from the pool's allocating thread.
+     */
+    Frame(FramePool& pool, std::span<const unsigned char> bytes, uint64_t received_at = 0)
+        : frame_buffer{pool.allocate(bytes.size())} {
+        memcpy(frame_buffer->data(), bytes.data(), bytes.size());
+        frame_buffer->received_at = received_at;
+    }
+
+    /*
+     * Copies a received frame out of its view along with its offloads, taking its VLAN tag off as
+     * it goes. A view of a frame that's already in a buffer shares that buffer instead, so nothing
+     * is copied.
+     */
+    Frame(FramePool& pool, const FrameView& view, uint64_t received_at = 0)
+        : frame_buffer{
+              view.frame != nullptr ? view.frame->frame_buffer : pool.allocate(view.buffer.size())
+          } {
+        if (view.frame != nullptr) {
+            frame_buffer->reference_count.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            memcpy(frame_buffer->data(), view.buffer.data(), view.buffer.size());
+            frame_buffer->offload = view.offload;
+            take_vlan_tag(view.vlan_tci);
+        }
+        frame_buffer->received_at = received_at;
+    }
+
+    Frame(const Frame& other)
+        : frame_buffer{other.frame_buffer} {
+        frame_buffer->reference_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Frame(Frame&& other) noexcept
+        : frame_buffer{std::exchange(other.frame_buffer, nullptr)} {
+    }
+
+    Frame& operator=(const Frame& other) {
+        if (this != &other) {
+            other.frame_buffer->reference_count.fetch_add(1, std::memory_order_relaxed);
+            release();
+            frame_buffer = other.frame_buffer;
+        }
+        return *this;
+    }
+
+    Frame& operator=(Frame&& other) noexcept {
+        if (this != &other) {
+            release();
+            frame_buffer = std::exchange(other.frame_buffer, nullptr);
+        }
+        return *this;
+    }
+
+    ~Frame() {
+        release();
+    }
+
+    // Raw bytes of the frame, starting at the ethernet header
+    std::span<const unsigned char> buffer() const {
+        return {frame_buffer->data(), frame_buffer->length};
+    }
+
+    MacAddress source_mac_address() const {
+        return MacAddress(frame_buffer->data() + ETH_ALEN);
+    }
+
+    MacAddress destination_mac_address() const {
+        return MacAddress(frame_buffer->data());
+    }
+
+    TrafficClass traffic_class() const {
+        return classify_frame(buffer(), vlan_tci());
+    }
 
     /*
-     * Raw buffer straight from the socket that this frame was parsed from. Note that we deep copy
-     * the buffer into a member to allow Frame objects to own the data that represents them and not
-     * be coupled to the lifetime or consistency of the read buffers written to by EthernetPort
-     * objects.
+     * Moves the frame's 802.1Q tag out of the frame data and into the frame's buffer header, if it
+     * has one. A tag the kernel already stripped on receive is given instead. A tag still in the
+     * frame is popped in place by sliding the MAC addresses up over it, which leaves headroom in
+     * front of the frame rather than copying the rest of it down, and moves the frame's offload
+     * offsets along with it. Only 802.1Q tags are popped; 802.1ad service tags are left alone. Must
+     * be called before the frame is shared.
      */
-    const std::vector<unsigned char> buffer;
+    void take_vlan_tag(std::optional<uint16_t> stripped_tci) {
+        if (stripped_tci.has_value()) {
+            frame_buffer->vlan_tci = stripped_tci.value();
+            frame_buffer->vlan_tagged = true;
+            return;
+        }
+
+        unsigned char* data = frame_buffer->data();
+        if (frame_buffer->length < sizeof(ethhdr) + VLAN_TAG_SIZE ||
+            (data[2 * ETH_ALEN] << 8 | data[2 * ETH_ALEN + 1]) != ETHERTYPE_VLAN) {
+            return;
+        }
+
+        frame_buffer->vlan_tci = (uint16_t)(data[2 * ETH_ALEN + 2] << 8 | data[2 * ETH_ALEN + 3]);
+        frame_buffer->vlan_tagged = true;
+        memmove(data + VLAN_TAG_SIZE, data, 2 * ETH_ALEN);
+        frame_buffer->headroom += VLAN_TAG_SIZE;
+        frame_buffer->length -= VLAN_TAG_SIZE;
+
+        FrameOffload& offload = frame_buffer->offload;
+        if (offload.needs_checksum()) {
+            offload.checksum_start -= VLAN_TAG_SIZE;
+        }
+        if (offload.header_length > VLAN_TAG_SIZE) {
+            offload.header_length -= VLAN_TAG_SIZE;
+        }
+    }
+
+    // Offloads the kernel left for whoever sends the frame. All zeroes when there are none
+    const FrameOffload& offload() const {
+        return frame_buffer->offload;
+    }
+
+    void set_offload(const FrameOffload& offload) {
+        frame_buffer->offload = offload;
+    }
+
+    // Tag control information of the 802.1Q tag the frame was received with, if it had one
+    std::optional<uint16_t> vlan_tci() const {
+        if (!frame_buffer->vlan_tagged) {
+            return {};
+        }
+        return frame_buffer->vlan_tci;
+    }
+
+    // VLAN the switch put the frame in, or zero if it hasn't been switched in a VLAN
+    uint16_t vlan() const {
+        return frame_buffer->vlan;
+    }
+
+    void set_vlan(uint16_t vlan) {
+        frame_buffer->vlan = vlan;
+    }
+
+    // metrics_clock() time the frame was received at, or zero if it wasn't recorded
+    uint64_t received_at() const {
+        return frame_buffer->received_at;
+    }
 
-    Frame(const MacAddress& s, const MacAddress& d, const std::vector<unsigned char>& b)
-        : source_mac_address{s},
-          destination_mac_address{d},
-          buffer{b} {
+    // Number of Frames sharing this frame's buffer
+    uint32_t reference_count() const {
+        return frame_buffer->reference_count.load(std::memory_order_relaxed);
     }
 };
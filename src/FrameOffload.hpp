@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Offloads the kernel leaves for whoever sends a frame, e.g. splitting a GSO frame up or filling in
+ * a checksum, as a PACKET_VNET_HDR socket passes them in front of every frame. Laid out exactly
+ * like the kernel's virtio_net_hdr, in the host's byte order, since <linux/virtio_net.h> can't be
+ * included from C++. All zeroes means the frame goes out as is.
+ */
+struct FrameOffload {
+    // Whether the checksum still has to be filled in, or was already checked
+    static constexpr uint8_t NEEDS_CHECKSUM = 1;
+    static constexpr uint8_t DATA_VALID = 2;
+
+    // Kinds of GSO frame, the last of which is a flag for TCP with ECN on
+    static constexpr uint8_t GSO_NONE = 0;
+    static constexpr uint8_t GSO_TCPV4 = 1;
+    static constexpr uint8_t GSO_UDP = 3;
+    static constexpr uint8_t GSO_TCPV6 = 4;
+    static constexpr uint8_t GSO_UDP_L4 = 5;
+    static constexpr uint8_t GSO_ECN = 0x80;
+
+    uint8_t flags;
+    uint8_t gso_type;
+
+    // Length of the headers every segment gets a copy of. Only a hint
+    uint16_t header_length;
+
+    // Most payload bytes each segment of a GSO frame carries
+    uint16_t gso_size;
+
+    /*
+     * Where the checksum starts, from the start of the frame, and where it goes from there. The
+     * checksum field already holds the sum of the pseudo header.
+     */
+    uint16_t checksum_start;
+    uint16_t checksum_offset;
+
+    // Whether the frame stands for several frames, to be split up on the way out
+    bool gso() const {
+        return (gso_type & ~FrameOffload::GSO_ECN) != FrameOffload::GSO_NONE;
+    }
+
+    bool needs_checksum() const {
+        return (flags & FrameOffload::NEEDS_CHECKSUM) != 0;
+    }
+};
+
+static_assert(sizeof(FrameOffload) == 10);
@@ -0,0 +1,144 @@
+#include <new>
+
+#include "FramePool.hpp"
+
+void FramePool::SlotMemoryDeleter::operator()(unsigned char* memory) const {
+    if (!owned) {
+        return;
+    }
+    ::operator delete(memory, std::align_val_t{FrameBuffer::HEADER_SIZE});
+}
+
+// Creates a pool with the given number of slots. The slots themselves aren't touched until needed
+FramePool::FramePool(size_t s)
+    : slot_count{s},
+      slot_memory{
+          (unsigned char*)::operator new(
+              slot_count * FramePool::SLOT_SIZE, std::align_val_t{FrameBuffer::HEADER_SIZE}
+          ),
+          SlotMemoryDeleter{true}
+      },
+      next_unused_slot{0},
+      free_list{nullptr},
+      released_list{nullptr},
+      heap_allocations_count{0} {
+}
+
+/*
+ * Creates a pool over the given memory, which must hold the given number of slots, start on a slot
+ * boundary, and outlive the pool. Used to hand out buffers the kernel can read and write directly.
+ */
+FramePool::FramePool(unsigned char* memory, size_t s)
+    : slot_count{s},
+      slot_memory{memory, SlotMemoryDeleter{false}},
+      next_unused_slot{0},
+      free_list{nullptr},
+      released_list{nullptr},
+      heap_allocations_count{0} {
+}
+
+/*
+ * Frees any heap allocated buffers that were returned to the pool. Every frame allocated from the
+ * pool must have been released before the pool is destroyed.
+ */
+FramePool::~FramePool() {
+    FrameBuffer* buffers[] = {free_list, released_list.exchange(nullptr)};
+    for (FrameBuffer* buffer : buffers) {
+        while (buffer != nullptr) {
+            FrameBuffer* next = buffer->next_free;
+            if (buffer->heap_allocated) {
+                ::operator delete(buffer, std::align_val_t{FrameBuffer::HEADER_SIZE});
+            }
+            buffer = next;
+        }
+    }
+}
+
+FrameBuffer* FramePool::allocate_from_heap(size_t length) {
+    heap_allocations_count.fetch_add(1, std::memory_order_relaxed);
+
+    void* memory = ::operator new(
+        FrameBuffer::HEADER_SIZE + length, std::align_val_t{FrameBuffer::HEADER_SIZE}
+    );
+    FrameBuffer* buffer = new (memory) FrameBuffer{};
+    buffer->heap_allocated = true;
+    return buffer;
+}
+
+// Resets a buffer that's being handed out to hold a frame of the given length
+FrameBuffer* FramePool::prepare(FrameBuffer* buffer, size_t length) {
+    buffer->pool = this;
+    buffer->next_free = nullptr;
+    buffer->reference_count.store(1, std::memory_order_relaxed);
+    buffer->length = (uint32_t)length;
+    buffer->headroom = 0;
+    buffer->received_at = 0;
+    buffer->vlan_tagged = false;
+    buffer->vlan = 0;
+    buffer->offload = {};
+    return buffer;
+}
+
+/*
+ * Hands out a buffer big enough for a frame of the given length, with a reference count of one.
+ * Must only be called from the pool's allocating thread.
+ */
+FrameBuffer* FramePool::allocate(size_t length) {
+    if (length > FramePool::SLOT_CAPACITY) {
+        return prepare(allocate_from_heap(length), length);
+    }
+
+    FrameBuffer* buffer = allocate_slot(length);
+    if (buffer == nullptr) {
+        buffer = prepare(allocate_from_heap(FramePool::SLOT_CAPACITY), length);
+    }
+    return buffer;
+}
+
+/*
+ * Hands out a slot for a frame of the given length, which must fit in a slot, with a reference
+ * count of one. Unlike allocate(), this never falls back to the heap, and returns null instead if
+ * every slot is in use. Must only be called from the pool's allocating thread.
+ */
+FrameBuffer* FramePool::allocate_slot(size_t length) {
+    // Our own free list first, then whatever other threads have released, then fresh slots
+    if (free_list == nullptr) {
+        free_list = released_list.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    FrameBuffer* buffer = nullptr;
+    if (free_list != nullptr) {
+        buffer = free_list;
+        free_list = buffer->next_free;
+    } else if (next_unused_slot < slot_count) {
+        void* slot = slot_memory.get() + next_unused_slot++ * FramePool::SLOT_SIZE;
+        buffer = new (slot) FrameBuffer{};
+    } else {
+        return nullptr;
+    }
+    return prepare(buffer, length);
+}
+
+/*
+ * Returns a buffer whose last reference was dropped to the pool. Safe to call from any thread.
+ * Slot sized heap allocated buffers are kept around and reused like any other buffer, so a pool
+ * that overflows once doesn't keep allocating. Buffers for frames too large for a slot are freed.
+ */
+void FramePool::release(FrameBuffer* buffer) {
+    if (buffer->headroom + buffer->length > FramePool::SLOT_CAPACITY) {
+        ::operator delete(buffer, std::align_val_t{FrameBuffer::HEADER_SIZE});
+        return;
+    }
+
+    FrameBuffer* head = released_list.load(std::memory_order_relaxed);
+    do {
+        buffer->next_free = head;
+    } while (!released_list.compare_exchange_weak(
+        head, buffer, std::memory_order_release, std::memory_order_relaxed
+    ));
+}
+
+// Returns the number of buffers that had to be allocated on the heap
+uint64_t FramePool::heap_allocations() const {
+    return heap_allocations_count.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "FrameOffload.hpp"
+
+class FramePool;
+
+/*
+ * Header of a fixed size slot in a FramePool. The frame's bytes immediately follow the header in
+ * the same slot, so a frame is a single allocation that fits in a couple of pages at most.
+ */
+struct FrameBuffer {
+    // Size of the header, padded to a cache line so frame data starts cache line aligned
+    static constexpr size_t HEADER_SIZE = 64;
+
+    // Pool this buffer is returned to when its last reference goes away
+    FramePool* pool;
+
+    // Next buffer in whichever of the pool's free lists this buffer is on
+    FrameBuffer* next_free;
+
+    // Number of Frame handles referencing this buffer
+    std::atomic_uint32_t reference_count;
+
+    // Number of bytes of frame data in the buffer
+    uint32_t length;
+
+    // Unused bytes between the header and the frame data, left behind by popping a VLAN tag
+    uint32_t headroom;
+
+    // metrics_clock() time the frame was received at, or zero if it wasn't recorded
+    uint64_t received_at;
+
+    /*
+     * Tag control information of the frame's 802.1Q tag, if it had one. The tag itself is never
+     * left in the frame data: it's either popped off on receive or was already stripped by the
+     * kernel. Only valid if vlan_tagged is set.
+     */
+    uint16_t vlan_tci;
+    bool vlan_tagged;
+
+    // VLAN the switch put the frame in, or zero if it hasn't been switched in a VLAN
+    uint16_t vlan;
+
+    // Whether this buffer was allocated on the heap because the pool was empty or it was too large
+    bool heap_allocated;
+
+    /*
+     * Offloads the kernel left for whoever sends the frame, e.g. segmenting a GSO frame or filling
+     * in a checksum, as it was received through PACKET_VNET_HDR. All zeroes when there are none.
+     * Offsets are from the start of the frame data.
+     */
+    FrameOffload offload;
+
+    unsigned char* data() {
+        return (unsigned char*)this + FrameBuffer::HEADER_SIZE + headroom;
+    }
+
+    const unsigned char* data() const {
+        return (const unsigned char*)this + FrameBuffer::HEADER_SIZE + headroom;
+    }
+};
+
+static_assert(sizeof(FrameBuffer) <= FrameBuffer::HEADER_SIZE);
+
+/*
+ * A preallocated arena of fixed size frame buffers. Frames are received into buffers from a pool
+ * and returned to it when their last reference is dropped, so the steady state does no heap
+ * allocations at all. If the pool runs dry (or a frame doesn't fit in a slot), buffers fall back to
+ * the heap and are counted so that it shows up in the metrics.
+ *
+ * Only one thread may allocate from a pool at a time, which is always the thread receiving frames
+ * on the pool's port. Buffers may be released from any thread. Released buffers are pushed onto a
+ * lock-free list, and the allocating thread takes the whole list at once when it runs out of
+ * buffers of its own.
+ *
+ * Slots are handed out in order the first time around, so memory for slots that are never needed
+ * is never touched.
+ */
+class FramePool {
+public:
+    // Size of each slot, header included
+    static constexpr size_t SLOT_SIZE = 2048;
+
+    // Largest frame that fits in a slot
+    static constexpr size_t SLOT_CAPACITY = FramePool::SLOT_SIZE - FrameBuffer::HEADER_SIZE;
+
+private:
+    const size_t slot_count;
+
+    struct SlotMemoryDeleter {
+        // Whether the pool allocated the slots itself, rather than being handed memory to carve up
+        bool owned;
+
+        void operator()(unsigned char*) const;
+    };
+    const std::unique_ptr<unsigned char, SlotMemoryDeleter> slot_memory;
+
+    // Index of the first slot that has never been handed out. Allocating thread only
+    size_t next_unused_slot;
+
+    // Buffers owned by the allocating thread, ready to be handed out
+    FrameBuffer* free_list;
+
+    // Buffers released by any thread since the allocating thread last took them
+    std::atomic<FrameBuffer*> released_list;
+
+    std::atomic_uint64_t heap_allocations_count;
+
+    FrameBuffer* allocate_from_heap(size_t);
+    FrameBuffer* prepare(FrameBuffer*, size_t);
+
+public:
+    explicit FramePool(size_t);
+    FramePool(unsigned char*, size_t);
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    FrameBuffer* allocate(size_t);
+    FrameBuffer* allocate_slot(size_t);
+    void release(FrameBuffer*);
+
+    uint64_t heap_allocations() const;
+};
@@ -0,0 +1,60 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include "IdleNotifier.hpp"
+#include "panic.hpp"
+
+static int initialize_event_fd() {
+    int new_event_fd = eventfd(0, EFD_CLOEXEC);
+    if (new_event_fd < 0) {
+        PANIC("Failed to create eventfd: %s\n", strerror(errno));
+    }
+    return new_event_fd;
+}
+
+IdleNotifier::IdleNotifier()
+    : event_fd{initialize_event_fd()},
+      sleeping{false} {
+}
+
+IdleNotifier::~IdleNotifier() {
+    close(event_fd);
+}
+
+/*
+ * Announces that the consumer is about to sleep. The consumer must check for work again after
+ * calling this, since work published before this call may not have triggered a notification.
+ */
+void IdleNotifier::prepare_sleep() {
+    sleeping.store(true, std::memory_order_seq_cst);
+
+    // Pairs with notify(), so the consumer's check for work can't be reordered before the store
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+// Called by the consumer instead of sleep() if it found work after prepare_sleep()
+void IdleNotifier::cancel_sleep() {
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+// Blocks the consumer until a producer calls notify()
+void IdleNotifier::sleep() {
+    uint64_t wakeups;
+    while (read(event_fd, &wakeups, sizeof(wakeups)) < 0 && errno == EINTR) {}
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+// Wakes the consumer up if it's sleeping. Called by producers after publishing work
+void IdleNotifier::notify() {
+    // Pairs with prepare_sleep() so that either we see the consumer sleeping or it sees our work
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!sleeping.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    uint64_t wakeup = 1;
+    while (write(event_fd, &wakeup, sizeof(wakeup)) < 0 && errno == EINTR) {}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+
+/*
+ * Lets a polling consumer thread go to sleep when it runs out of work and lets producer threads
+ * wake it back up, backed by an eventfd. Producers only pay for a syscall when the consumer is
+ * actually asleep, so a busy consumer that never sleeps costs producers nothing but a fence.
+ *
+ * The consumer must announce it's going to sleep with prepare_sleep(), re-check for work, then
+ * either cancel_sleep() or sleep(). Producers must publish their work before calling notify().
+ */
+class IdleNotifier {
+private:
+    const int event_fd;
+
+    // Set while the consumer is asleep or about to go to sleep
+    alignas(64) std::atomic_bool sleeping;
+
+public:
+    IdleNotifier();
+    ~IdleNotifier();
+
+    IdleNotifier(const IdleNotifier&) = delete;
+    IdleNotifier& operator=(const IdleNotifier&) = delete;
+
+    void prepare_sleep();
+    void cancel_sleep();
+    void sleep();
+    void notify();
+};
@@ -3,145 +3,1849 @@
 #include <chrono>
 #include <cstdio>
 #include <fstream>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <net/if.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+#include <cctype>
 #include "Layer2Switch.hpp"
+#include "PortSpec.hpp"
+#include "MacSnapshot.hpp"
 #include "panic.hpp"
 
-Layer2Switch::Layer2Switch(const std::vector<std::shared_ptr<EthernetPort>>& v)
-    : ports{v},
-      received_frames_count{0},
-      sent_frames_count{0},
-      flood_count{0},
-      read_errors_count{0} {
+// Whether every VLAN the given settings mention is one a port can carry
+static bool valid_vlans(const PortVlans& port_vlans) {
+    return port_vlans.native_vlan >= DEFAULT_VLAN && port_vlans.native_vlan <= MAX_VLAN &&
+           !port_vlans.tagged_vlans.test(0) && !port_vlans.tagged_vlans.test(VLAN_COUNT - 1);
+}
+
+// Pads the given ports out with free slots up to the given capacity
+static std::vector<std::shared_ptr<EthernetPort>> port_slots(
+    const std::vector<std::shared_ptr<EthernetPort>>& ports, size_t max_ports
+) {
+    std::vector<std::shared_ptr<EthernetPort>> slots{ports};
+    slots.resize(std::max(ports.size(), max_ports));
+    return slots;
+}
+
+Layer2Switch::Layer2Switch(
+    const std::vector<std::shared_ptr<EthernetPort>>& v, const SwitchConfig& c
+)
+    : config{c},
+      mac_address_table{c.mac_table_size, c.mac_aging_seconds},
+      ports{port_slots(v, c.max_ports)},
+      port_set{
+          std::make_unique<PortSet>(), std::max<size_t>({c.forwarding_workers, c.reactors, 1})
+      },
+      batch_counts(ports.size() * TRAFFIC_CLASS_COUNT, 0),
+      next_input_queue{0},
+      ingress_deficits{},
+      idle_polls_before_sleep{c.idle_polls_before_sleep},
+      started{false},
+      metrics{ports.size()},
+      storm_control{c.storm_control, ports.size()},
+      port_shut_down{std::make_unique<std::atomic_bool[]>(ports.size())},
+      last_storm_suppressed_counts(ports.size(), 0),
+      port_shut_down_until(ports.size(), 0),
+      storm_control_metrics{&metrics.add_thread()} {
+    if (ports.size() > MacTable::MAX_PORTS) {
+        PANIC("Too many ports. At most %ld ports are supported\n", MacTable::MAX_PORTS);
+    }
+
+    // These index their settings by port, so ports can't come and go underneath them
+    if (ports.size() > v.size() &&
+        (config.spanning_tree || !config.port_lags.empty() || !config.mirror_sessions.empty())) {
+        PANIC("Spare port slots can't be used with spanning tree, link aggregation or mirroring\n");
+    }
+
+    if (!config.port_queue_depths.empty() && config.port_queue_depths.size() != v.size()) {
+        PANIC(
+            "Expected an input queue depth for each of the %ld port(s), but got %ld\n", v.size(),
+            config.port_queue_depths.size()
+        );
+    }
+
+    for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+        if (config.class_weights[traffic_class] == 0) {
+            PANIC("Traffic class weights must be at least 1\n");
+        }
+        class_weights[traffic_class] = config.class_weights[traffic_class];
+    }
+
+    if (!config.port_vlans.empty() && config.port_vlans.size() != v.size()) {
+        PANIC(
+            "Expected VLANs for each of the %ld port(s), but got %ld\n", v.size(),
+            config.port_vlans.size()
+        );
+    }
+
+    // Ports tag their VLANs on transmit, so they need to know them before they're cloned
+    for (size_t port = 0; port < config.port_vlans.size(); ++port) {
+        const PortVlans& port_vlans = config.port_vlans[port];
+        if (!valid_vlans(port_vlans)) {
+            PANIC(
+                "Invalid VLAN on port %s. VLANs must be between %d and %d\n",
+                ports[port]->interface_name.c_str(), DEFAULT_VLAN, MAX_VLAN
+            );
+        }
+        ports[port]->set_vlans(port_vlans);
+    }
+
+    if (config.spanning_tree || !config.port_lags.empty()) {
+        for (const std::shared_ptr<EthernetPort>& port : ports) {
+            control_ports.push_back(port->transmit_handle());
+        }
+    }
+
+    if (!config.port_lags.empty()) {
+        if (config.port_lags.size() != ports.size()) {
+            PANIC(
+                "Expected a LAG for each of the %ld port(s), but got %ld\n", ports.size(),
+                config.port_lags.size()
+            );
+        }
+
+        link_aggregation = std::make_unique<LinkAggregation>(
+            bridge_address(), config.port_lags, port_names(), config.lacp,
+            [this](size_t port, const Frame& lacpdu) { control_ports[port]->send_frame(lacpdu); }
+        );
+
+        // A LAG is switched as its aggregate port, so every member has to agree on the VLANs
+        for (size_t port = 0; port < ports.size() && !config.port_vlans.empty(); ++port) {
+            const size_t aggregate_port = link_aggregation->aggregate_port(port);
+            if (!(config.port_vlans[port] == config.port_vlans[aggregate_port])) {
+                PANIC(
+                    "Ports %s and %s are in the same LAG, but have different VLANs\n",
+                    ports[aggregate_port]->interface_name.c_str(),
+                    ports[port]->interface_name.c_str()
+                );
+            }
+        }
+    }
+
+    // Input queues are only needed when receiver threads feed the main switch loop
+    if (config.forwarding_workers == 0) {
+        for (size_t port = 0; port < ports.size(); ++port) {
+            const size_t depth = port < config.port_queue_depths.size()
+                                     ? config.port_queue_depths[port]
+                                     : config.input_queue_depth;
+            if (depth == 0) {
+                PANIC("Input queue depth must be at least 1\n");
+            }
+
+            for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+                input_queues.push_back(std::make_unique<SpscRing<Frame>>(depth));
+            }
+            receiver_metrics.push_back(&metrics.add_thread());
+        }
+        head_drop_requests = std::make_unique<std::atomic_size_t[]>(input_queues.size());
+    }
+
+    // Receivers wait on an eventfd as well as their port, so they can be stopped one at a time
+    if (config.forwarding_workers == 0 && config.reactors == 0) {
+        receivers.resize(ports.size());
+        for (size_t port = 0; port < ports.size() && !config.control_socket_path.empty(); ++port) {
+            receiver_stop_fds.push_back(eventfd(0, EFD_CLOEXEC));
+            if (receiver_stop_fds.back() < 0) {
+                PANIC("Failed to create receiver eventfd: %s\n", strerror(errno));
+            }
+        }
+    }
+
+    if (config.forwarding_workers > 0 && config.reactors > 0) {
+        PANIC("Forwarding workers and reactors can't be used together\n");
+    }
+
+    std::unique_ptr<PortSet> initial_port_set = std::make_unique<PortSet>();
+
+    // Every port is owned by exactly one reactor, round robin unless configured otherwise
+    if (config.reactors > 0) {
+        std::vector<size_t>& port_reactors = initial_port_set->port_reactors;
+        port_reactors = config.port_reactors;
+        if (port_reactors.empty()) {
+            for (size_t port = 0; port < v.size(); ++port) {
+                port_reactors.push_back(port % config.reactors);
+            }
+        }
+
+        if (port_reactors.size() != v.size()) {
+            PANIC(
+                "Expected a reactor for each of the %ld port(s), but got %ld\n", v.size(),
+                port_reactors.size()
+            );
+        }
+        for (size_t reactor : port_reactors) {
+            if (reactor >= config.reactors) {
+                PANIC(
+                    "Invalid reactor %ld. Only %ld reactor(s) are running\n", reactor,
+                    config.reactors
+                );
+            }
+        }
+        port_reactors.resize(ports.size(), 0);
+    }
+
+    shards.resize(std::max<size_t>({config.forwarding_workers, config.reactors, 1}));
+    for (size_t shard = 0; shard < shards.size(); ++shard) {
+        shards[shard].index = shard;
+
+        // A port is sent each frame of a batch at most once, so these never grow past a batch
+        shards[shard].egress_queues.resize(ports.size());
+        for (auto& class_queues : shards[shard].egress_queues) {
+            for (std::vector<QueuedFrame>& egress_queue : class_queues) {
+                egress_queue.reserve(Layer2Switch::SWITCH_BATCH_SIZE);
+            }
+        }
+        shards[shard].transmit_order.reserve(Layer2Switch::SWITCH_BATCH_SIZE);
+        shards[shard].received_frames.reserve(Layer2Switch::SWITCH_BATCH_SIZE);
+        shards[shard].floods.reserve(Layer2Switch::SWITCH_BATCH_SIZE);
+        shards[shard].multicast_egress = PortBitmap{ports.size()};
+        shards[shard].mirror_egress = PortBitmap{ports.size()};
+        shards[shard].metrics = &metrics.add_thread();
+
+        if (config.forwarding_workers > 0) {
+            shards[shard].wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (shards[shard].wake_fd < 0) {
+                PANIC("Failed to create eventfd for forwarding worker: %s\n", strerror(errno));
+            }
+        }
+        if (config.reactors > 0) {
+            shards[shard].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (shards[shard].epoll_fd < 0) {
+                PANIC("Failed to create epoll instance for reactor: %s\n", strerror(errno));
+            }
+        }
+    }
+
+    // Every shard captures frames, so captures can only be opened once the shards exist
+    build_mirror_targets();
+
+    initial_port_set->shard_ports.assign(
+        shards.size(), std::vector<std::shared_ptr<EthernetPort>>(ports.size())
+    );
+    if (!config.port_vlans.empty()) {
+        initial_port_set->port_vlans = config.port_vlans;
+        initial_port_set->port_vlans.resize(ports.size());
+    }
+    for (size_t port = 0; port < v.size(); ++port) {
+        std::optional<std::string> error = open_shard_ports(*initial_port_set, port);
+        if (error.has_value()) {
+            PANIC("%s\n", error->c_str());
+        }
+    }
+    if (!config.acl_path.empty()) {
+        std::optional<std::string> error = load_access_list(initial_port_set->access_list);
+        if (error.has_value()) {
+            PANIC("%s\n", error->c_str());
+        }
+    }
+    publish_port_set(std::move(initial_port_set));
+    for (ForwardingShard& shard : shards) { shard.port_set = port_set.get(); }
+
+    if (config.spanning_tree) {
+        spanning_tree = std::make_unique<SpanningTree>(
+            bridge_address(), config.bridge_priority, config.port_path_cost, port_names(),
+            [this](size_t port, const Frame& bpdu) { send_bpdu(port, bpdu); },
+            [this](size_t port) { mac_address_table.flush_port(port); }
+        );
+    }
+
+    if (config.multicast_snooping) {
+        multicast_snooping = std::make_unique<MulticastSnooping>(port_names(), shards.size());
+    }
+
+    if (!config.metrics_socket_path.empty()) {
+        metrics_server = std::make_unique<MetricsServer>(config.metrics_socket_path);
+    }
+
+    if (!config.control_socket_path.empty()) {
+        control_server = std::make_unique<ControlServer>(config.control_socket_path);
+    }
+
     openlog("virtualswitch", LOG_CONS | LOG_NDELAY | LOG_PID, LOG_DAEMON);
+
+    if (!config.mac_snapshot_path.empty()) {
+        restore_mac_table();
+    }
+}
+
+Layer2Switch::~Layer2Switch() {
+    for (const ForwardingShard& shard : shards) {
+        if (shard.wake_fd >= 0) {
+            close(shard.wake_fd);
+        }
+        if (shard.epoll_fd >= 0) {
+            close(shard.epoll_fd);
+        }
+    }
+    for (int stop_fd : receiver_stop_fds) { close(stop_fd); }
+    closelog();
+}
+
+// Name of the port in each slot, or an empty name for slots that are free
+std::vector<std::string> Layer2Switch::port_names() const {
+    std::vector<std::string> names;
+    for (const std::shared_ptr<EthernetPort>& port : ports) {
+        names.push_back(port ? port->interface_name : "");
+    }
+    return names;
+}
+
+/*
+ * Picks the MAC the spanning tree identifies this switch by: the lowest MAC of any of its ports, as
+ * a Linux bridge does, or a random locally administered one if no port has a MAC
+ */
+MacAddress Layer2Switch::bridge_address() const {
+    std::optional<MacAddress> lowest;
+    for (const std::shared_ptr<EthernetPort>& port : ports) {
+        if (!port) {
+            continue;
+        }
+
+        std::optional<MacAddress> address = port->hardware_address();
+        if (address.has_value() && (!lowest.has_value() || address.value() < lowest.value())) {
+            lowest = address;
+        }
+    }
+    if (lowest.has_value()) {
+        return lowest.value();
+    }
+
+    std::random_device random;
+    std::array<uint8_t, 6> octets;
+    for (uint8_t& octet : octets) { octet = (uint8_t)random(); }
+    octets[0] = (octets[0] & 0xFC) | 0x02;
+    return MacAddress{octets.data()};
+}
+
+// Whether the spanning tree lets the given port forward frames
+bool Layer2Switch::port_forwarding(size_t port) const {
+    return !spanning_tree || spanning_tree->port_state(port) == PortState::FORWARDING;
+}
+
+// Whether the given port carries the given VLAN. Every port carries everything without VLANs
+bool Layer2Switch::port_in_vlan(const PortSet& set, size_t port, uint16_t vlan) {
+    return set.port_vlans.empty() || set.port_vlans[port].carries(vlan);
+}
+
+/*
+ * Works out every flood domain of the given port set up front, so flooding a frame walks the
+ * handful of ports in its domain instead of checking the VLAN membership of every port on the
+ * switch. A LAG is flooded to through its aggregate port alone, and mirror destinations are never
+ * flooded to.
+ */
+void Layer2Switch::build_flood_sets(PortSet& set) const {
+    std::bitset<VLAN_COUNT> carried;
+    if (set.port_vlans.empty()) {
+        carried.set(DEFAULT_VLAN);
+    }
+    for (size_t port : set.active_ports) {
+        if (!set.port_vlans.empty()) {
+            const PortVlans& port_vlans = set.port_vlans[port];
+            carried.set(port_vlans.native_vlan);
+            if (port_vlans.mode == VlanMode::TRUNK) {
+                carried |= port_vlans.tagged_vlans;
+            }
+        }
+    }
+
+    // Only ports that hold a port can be flooded to, so free slots cost nothing
+    set.flood_set_vlans.assign(VLAN_COUNT, 0);
+    set.flood_sets.clear();
+    for (uint16_t vlan = DEFAULT_VLAN; vlan <= MAX_VLAN; ++vlan) {
+        if (!carried.test(vlan)) {
+            continue;
+        }
+
+        set.flood_set_vlans[vlan] = set.flood_sets.size();
+        PortBitmap& flood_set = set.flood_sets.emplace_back(ports.size());
+        for (size_t port : set.active_ports) {
+            const bool aggregate_port =
+                !link_aggregation || link_aggregation->aggregate_port(port) == port;
+            if (aggregate_port && !mirror_destinations.test(port) &&
+                Layer2Switch::port_in_vlan(set, port, vlan)) {
+                flood_set.set(port);
+            }
+        }
+    }
+}
+
+/*
+ * Opens every shard's socket on the port in the given slot, into the given port set. The first
+ * shard uses the port as given. With forwarding workers, every other shard opens its own socket on
+ * the port. With reactors, the reactor that owns the port uses it as given, and every other one a
+ * transmit handle. Returns what went wrong if the sockets couldn't be set up.
+ */
+std::optional<std::string> Layer2Switch::open_shard_ports(PortSet& set, size_t slot) const {
+    const std::shared_ptr<EthernetPort>& port = ports[slot];
+    for (size_t shard = 0; shard < shards.size(); ++shard) {
+        std::shared_ptr<EthernetPort>& shard_port = set.shard_ports[shard][slot];
+        if (config.reactors > 0) {
+            shard_port = set.port_reactors[slot] == shard ? port : port->transmit_handle();
+        } else {
+            shard_port = shard == 0 ? port : port->clone();
+        }
+    }
+
+    // Spread the port's traffic across the workers' sockets by flow so each flow stays in order
+    if (config.forwarding_workers > 1) {
+        std::optional<uint16_t> group_id = set.shard_ports[0][slot]->join_fanout();
+        for (size_t shard = 1; shard < shards.size() && group_id.has_value(); ++shard) {
+            group_id = set.shard_ports[shard][slot]->join_fanout(group_id);
+        }
+
+        if (!group_id.has_value()) {
+            return "Failed to set up PACKET_FANOUT on interface " + port->interface_name + ": " +
+                   strerror(errno);
+        }
+    }
+    return {};
+}
+
+/*
+ * Reads and compiles the ACL at the configured path, with hit counters for every shard, off the
+ * data path. Every port a rule names must be on the switch. Returns what's wrong with the ACL if
+ * it couldn't be loaded, leaving the given pointer alone.
+ */
+std::optional<std::string> Layer2Switch::load_access_list(
+    std::shared_ptr<const AccessList>& access_list
+) const {
+    std::ifstream file{config.acl_path};
+    std::stringstream text;
+    text << file.rdbuf();
+    if (!file) {
+        return "Failed to read ACL " + config.acl_path;
+    }
+
+    std::string error;
+    std::optional<std::vector<AclRule>> rules = AccessList::parse(text.str(), error);
+    if (!rules.has_value()) {
+        return "Invalid ACL " + config.acl_path + ". " + error;
+    }
+
+    const std::vector<std::string> names = port_names();
+    for (const AclRule& rule : rules.value()) {
+        if (!rule.port_name.empty() && std::ranges::find(names, rule.port_name) == names.end()) {
+            return "Invalid ACL " + config.acl_path + ". No port " + rule.port_name +
+                   " on the switch";
+        }
+    }
+
+    access_list = std::make_shared<const AccessList>(std::move(rules.value()), shards.size());
+    syslog(
+        LOG_INFO, "Loaded %ld ACL rule(s) from %s into %ld table(s)", access_list->size(),
+        config.acl_path.c_str(), access_list->tuple_count()
+    );
+    return {};
+}
+
+/*
+ * Works out which slot each rule of the given port set's ACL sends frames to, since slots change
+ * as ports come and go. A rule naming a LAG member sends to the whole LAG.
+ */
+void Layer2Switch::resolve_access_list_ports(PortSet& set) const {
+    set.access_list_ports.clear();
+    if (!set.access_list) {
+        return;
+    }
+
+    for (size_t rule = 0; rule < set.access_list->size(); ++rule) {
+        const std::string& name = set.access_list->rule(rule).port_name;
+        std::optional<size_t> slot;
+        for (size_t port = 0; port < ports.size() && !name.empty(); ++port) {
+            if (ports[port] && set.shard_ports[0][port] && ports[port]->interface_name == name) {
+                slot = link_aggregation ? link_aggregation->aggregate_port(port) : port;
+            }
+        }
+        set.access_list_ports.push_back(slot);
+    }
+}
+
+/*
+ * Works out which slots of the given port set are in use and where their frames flood to, then
+ * publishes it to every shard and wakes up the forwarding workers to pick it up. Returns once no
+ * shard can still be switching with the port set it replaces. Must be called with port_set_mutex
+ * held, or before the switch is started.
+ */
+void Layer2Switch::publish_port_set(std::unique_ptr<PortSet> set) {
+    set->active_ports.clear();
+    for (size_t slot = 0; slot < ports.size(); ++slot) {
+        if (set->shard_ports[0][slot]) {
+            set->active_ports.push_back(slot);
+        }
+    }
+    build_flood_sets(*set);
+    resolve_access_list_ports(*set);
+    set->version = port_set.get()->version + 1;
+
+    port_set.publish(std::move(set));
+
+    const uint64_t wakeups = 1;
+    for (const ForwardingShard& shard : shards) {
+        if (shard.wake_fd >= 0 && write(shard.wake_fd, &wakeups, sizeof(wakeups)) < 0) {
+            syslog(LOG_ERR, "Failed to wake up forwarding worker %ld: %m", shard.index);
+        }
+    }
+}
+
+// Picks up the current port set for the given shard, which it may switch with until it exits
+void Layer2Switch::enter_port_set(ForwardingShard& shard) {
+    shard.port_set = port_set.enter(shard.index);
+}
+
+// Lets go of the port set the given shard entered, so a port removed from it can be closed
+void Layer2Switch::exit_port_set(ForwardingShard& shard) {
+    port_set.exit(shard.index);
+}
+
+/*
+ * Works out where each port's received and sent frames are mirrored to from the configured mirror
+ * sessions, and opens every session's capture file. Panics if a session is invalid.
+ */
+void Layer2Switch::build_mirror_targets() {
+    mirror_destinations = PortBitmap{ports.size()};
+    if (config.mirror_sessions.empty()) {
+        return;
+    }
+
+    ingress_mirrors.assign(ports.size(), {PortBitmap{ports.size()}, {}});
+    egress_mirrors.assign(ports.size(), {PortBitmap{ports.size()}, {}});
+
+    PortBitmap sources{ports.size()};
+    for (const MirrorSession& session : config.mirror_sessions) {
+        if (!session.destination_port.has_value() && session.capture_path.empty()) {
+            PANIC("Mirror sessions need a destination port, a capture file, or both\n");
+        }
+        for (const std::vector<size_t>& session_ports :
+             {session.ingress_ports, session.egress_ports}) {
+            for (size_t port : session_ports) {
+                if (port >= ports.size()) {
+                    PANIC("Invalid mirror source port %ld\n", port);
+                }
+                sources.set(port);
+            }
+        }
+
+        if (!session.capture_path.empty()) {
+            for (size_t port : session.ingress_ports) {
+                ingress_mirrors[port].captures.push_back(captures.size());
+            }
+            for (size_t port : session.egress_ports) {
+                egress_mirrors[port].captures.push_back(captures.size());
+            }
+            captures.push_back(
+                std::make_unique<PacketCapture>(session.capture_path, port_names(), shards.size())
+            );
+        }
+
+        if (!session.destination_port.has_value()) {
+            continue;
+        }
+
+        const size_t destination = session.destination_port.value();
+        if (destination >= ports.size()) {
+            PANIC("Invalid mirror destination port %ld\n", destination);
+        }
+        if (link_aggregation && link_aggregation->in_lag(destination)) {
+            PANIC(
+                "Port %s is in a LAG, so it can't be a mirror destination\n",
+                ports[destination]->interface_name.c_str()
+            );
+        }
+        mirror_destinations.set(destination);
+        for (size_t port : session.ingress_ports) {
+            ingress_mirrors[port].ports.set(destination);
+        }
+        for (size_t port : session.egress_ports) {
+            egress_mirrors[port].ports.set(destination);
+        }
+    }
+
+    // A destination that was also a source would mirror its own mirrored frames
+    mirror_destinations.for_each([&](size_t port) {
+        if (sources.test(port)) {
+            PANIC(
+                "Port %s can't be both a mirror destination and mirrored\n",
+                ports[port]->interface_name.c_str()
+            );
+        }
+    });
+}
+
+// Ports of the given port set that frames in the given VLAN flood to, the ingress port aside
+const PortBitmap& Layer2Switch::flood_set(const PortSet& set, uint16_t vlan) {
+    return set.flood_sets[set.flood_set_vlans[vlan]];
+}
+
+// Returns the total number of frames waiting in all of the input queues
+size_t Layer2Switch::queued_frame_count() const {
+    size_t count = 0;
+    for (const std::unique_ptr<SpscRing<Frame>>& input_queue : input_queues) {
+        count += input_queue->size();
+    }
+    return count;
+}
+
+// Index into input_queues of the given port's input queue for the given traffic class
+size_t Layer2Switch::input_queue_index(size_t port, size_t traffic_class) {
+    return port * TRAFFIC_CLASS_COUNT + traffic_class;
+}
+
+/*
+ * Blocks until at least one frame is waiting in the input queues. The queues are busy polled at
+ * first to keep latency low under load, and after enough empty polls the main switch loop goes to
+ * sleep until a receiver thread wakes it up, so an idle switch doesn't burn a core.
+ */
+void Layer2Switch::wait_for_frames() {
+    size_t empty_polls = 0;
+    while (queued_frame_count() == 0) {
+        const size_t polls_before_sleep = idle_polls_before_sleep.load(std::memory_order_relaxed);
+        if (polls_before_sleep == SwitchConfig::NEVER_SLEEP || ++empty_polls < polls_before_sleep) {
+            continue;
+        }
+
+        // Receivers may have queued frames before they saw that we're going to sleep
+        idle_notifier.prepare_sleep();
+        if (queued_frame_count() > 0) {
+            idle_notifier.cancel_sleep();
+            return;
+        }
+
+        idle_notifier.sleep();
+        empty_polls = 0;
+    }
+}
+
+/*
+ * Drops frames from the front of the input queue of every active port whose receiver asked for
+ * room. Must only be called between batches, while no frames are being switched in place.
+ */
+void Layer2Switch::drop_requested_frames() {
+    for (size_t port : shards[0].port_set->active_ports) {
+        for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+            const size_t queue = Layer2Switch::input_queue_index(port, traffic_class);
+            const size_t requested =
+                head_drop_requests[queue].exchange(0, std::memory_order_acquire);
+            if (requested == 0) {
+                continue;
+            }
+
+            const size_t dropped = std::min(requested, input_queues[queue]->readable());
+            input_queues[queue]->pop(dropped);
+            shards[0].metrics->ports[port].head_drops.add(dropped);
+            shards[0].metrics->classes[traffic_class].dropped_frames.add(dropped);
+        }
+    }
+}
+
+/*
+ * Returns whether any active port has frames of the given traffic class waiting that aren't in the
+ * batch
+ */
+bool Layer2Switch::input_class_waiting(size_t traffic_class) const {
+    for (size_t port : shards[0].port_set->active_ports) {
+        const size_t queue = Layer2Switch::input_queue_index(port, traffic_class);
+        if (input_queues[queue]->readable() > batch_counts[queue]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Switches up to the given number of frames of a single traffic class in place in the input
+ * queues, taking a frame from each port in turn so that ports share the class fairly. Under
+ * deficit round robin, frames are only taken while the class's deficit covers them. Returns the
+ * number of frames taken.
+ */
+size_t Layer2Switch::switch_input_class(size_t traffic_class, size_t limit, uint64_t dequeued_at) {
+    const bool round_robin = config.traffic_scheduler == TrafficScheduler::DEFICIT_ROUND_ROBIN;
+    size_t& deficit = ingress_deficits[traffic_class];
+    ThreadMetrics& thread_metrics = *shards[0].metrics;
+    const std::vector<size_t>& active_ports = shards[0].port_set->active_ports;
+
+    size_t taken = 0;
+    bool took_any = true;
+    while (took_any && taken < limit) {
+        took_any = false;
+        for (size_t i = 0; i < active_ports.size() && taken < limit; ++i) {
+            const size_t port = active_ports[(next_input_queue + i) % active_ports.size()];
+            const size_t queue = Layer2Switch::input_queue_index(port, traffic_class);
+            SpscRing<Frame>& input_queue = *input_queues[queue];
+            if (batch_counts[queue] == input_queue.readable()) {
+                continue;
+            }
+
+            Frame& frame = input_queue.peek(batch_counts[queue]);
+            if (round_robin) {
+                if (frame.buffer().size() > deficit) {
+                    continue;
+                }
+                deficit -= frame.buffer().size();
+            }
+
+            thread_metrics.queue_residency[traffic_class].record(dequeued_at - frame.received_at());
+            switch_frame(shards[0], frame, port, (TrafficClass)traffic_class);
+            ++batch_counts[queue];
+            ++taken;
+            took_any = true;
+        }
+    }
+
+    return taken;
 }
 
-Layer2Switch::~Layer2Switch() {
-    closelog();
+/*
+ * This method encapsulates the actual implementation of the layer 2 switching logic. It waits for
+ * frames to be enqueued on the input queues, takes up to a batch of them, then uses the MAC address
+ * table to decide how to switch each frame. Output is gathered per destination port and each port
+ * is flushed once at the end of the batch, so a flood costs one syscall per port per batch rather
+ * than one per port per frame.
+ *
+ * Frames are taken by traffic class. Under strict priority, the highest class with frames waiting
+ * fills as much of the batch as it can before a lower class gets a look in. Under deficit round
+ * robin, each class with frames waiting earns its weight in bytes every round and spends it on
+ * frames, until the batch is full or everything waiting has been taken.
+ */
+void Layer2Switch::switch_impl() {
+    // Wait for frames to be enqueued by the frame receiver workers
+    wait_for_frames();
+
+    // Ports can't be removed from underneath the batch until it's been flushed and released
+    ForwardingShard& shard = shards[0];
+    enter_port_set(shard);
+    const std::vector<size_t>& active_ports = shard.port_set->active_ports;
+
+    if (config.queue_full_policy == QueueFullPolicy::HEAD_DROP) {
+        drop_requested_frames();
+    }
+
+    const uint64_t dequeued_at = metrics_clock();
+    size_t batch_size = 0;
+
+    if (config.traffic_scheduler == TrafficScheduler::STRICT_PRIORITY) {
+        for (size_t traffic_class = TRAFFIC_CLASS_COUNT; traffic_class-- > 0;) {
+            batch_size += switch_input_class(
+                traffic_class, Layer2Switch::SWITCH_BATCH_SIZE - batch_size, dequeued_at
+            );
+        }
+    } else {
+        bool any_waiting = true;
+        while (any_waiting && batch_size < Layer2Switch::SWITCH_BATCH_SIZE) {
+            any_waiting = false;
+            for (size_t traffic_class = TRAFFIC_CLASS_COUNT; traffic_class-- > 0;) {
+                // A class that has nothing waiting doesn't get to bank its share for later
+                if (!input_class_waiting(traffic_class)) {
+                    ingress_deficits[traffic_class] = 0;
+                    continue;
+                }
+
+                any_waiting = true;
+                ingress_deficits[traffic_class] +=
+                    class_weights[traffic_class].load(std::memory_order_relaxed) *
+                    Layer2Switch::DRR_QUANTUM;
+                batch_size += switch_input_class(
+                    traffic_class, Layer2Switch::SWITCH_BATCH_SIZE - batch_size, dequeued_at
+                );
+            }
+        }
+    }
+    if (!active_ports.empty()) {
+        next_input_queue = (next_input_queue + 1) % active_ports.size();
+    }
+
+    flush_ports(shard);
+    const uint64_t flushed_at = metrics_clock();
+
+    // Now that no port holds onto the batch anymore, the frames can be released
+    ThreadMetrics& thread_metrics = *shard.metrics;
+    for (size_t port : active_ports) {
+        for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+            const size_t queue = Layer2Switch::input_queue_index(port, traffic_class);
+            if (batch_counts[queue] == 0) {
+                continue;
+            }
+
+            LatencyHistogram& forwarding_latency = thread_metrics.forwarding_latency[traffic_class];
+            for (size_t j = 0; j < batch_counts[queue]; ++j) {
+                forwarding_latency.record(flushed_at - input_queues[queue]->peek(j).received_at());
+            }
+
+            input_queues[queue]->pop(batch_counts[queue]);
+            batch_counts[queue] = 0;
+        }
+    }
+
+    exit_port_set(shard);
+}
+
+/*
+ * Switches the given frame, received on the given port, using the given shard's sockets. If the
+ * frame was received or is sent on a mirrored port, it's also captured and queued for transmit on
+ * the mirror destination ports, each of which gets a single copy however many of the frame's ports
+ * are mirrored to it. Frames received on mirror destinations are dropped.
+ */
+void Layer2Switch::switch_frame(
+    ForwardingShard& shard, Frame& frame, size_t ingress_port, TrafficClass traffic_class
+) {
+    if (ingress_mirrors.empty()) {
+        forward_frame(shard, frame, ingress_port, traffic_class);
+        return;
+    }
+    if (mirror_destinations.test(ingress_port)) {
+        return;
+    }
+
+    mirror_frame(
+        shard, ingress_mirrors[ingress_port], frame, ingress_port, false, frame.vlan_tci()
+    );
+    forward_frame(shard, frame, ingress_port, traffic_class);
+
+    shard.mirror_egress.for_each([&](size_t port) {
+        shard.mirror_egress.reset(port);
+        shard.egress_queues[port][traffic_class].push_back({&frame, traffic_class, {}});
+    });
+}
+
+/*
+ * Puts the given frame in a VLAN, learns its source MAC and queues the frame for transmit on the
+ * port(s) it should be switched to, using the given shard's sockets.
+ */
+void Layer2Switch::forward_frame(
+    ForwardingShard& shard, Frame& frame, size_t ingress_port, TrafficClass traffic_class
+) {
+    // LAG members receive on behalf of their LAG, which everything below sees as a single port
+    if (link_aggregation) {
+        if (frame.destination_mac_address() == LinkAggregation::SLOW_PROTOCOLS_ADDRESS) {
+            link_aggregation->receive_lacpdu(ingress_port, frame.buffer());
+            return;
+        }
+        if (!link_aggregation->is_active(ingress_port)) {
+            shard.metrics->ports[ingress_port].lag_discards.add(1);
+            return;
+        }
+        ingress_port = link_aggregation->aggregate_port(ingress_port);
+    }
+
+    if (port_shut_down[ingress_port].load(std::memory_order_relaxed)) {
+        shard.metrics->ports[ingress_port].storm_shutdown_drops.add(1);
+        return;
+    }
+
+    // Without VLANs, everything is switched as if it were in the default VLAN
+    const PortSet& set = *shard.port_set;
+    uint16_t vlan = DEFAULT_VLAN;
+    if (!set.port_vlans.empty()) {
+        std::optional<uint16_t> ingress_vlan =
+            set.port_vlans[ingress_port].ingress_vlan(frame.vlan_tci());
+        if (!ingress_vlan.has_value()) {
+            shard.metrics->ports[ingress_port].vlan_discards.add(1);
+            return;
+        }
+
+        vlan = ingress_vlan.value();
+        frame.set_vlan(vlan);
+    }
+
+    const MacAddress destination_mac_address = frame.destination_mac_address();
+    if (spanning_tree) {
+        if (destination_mac_address == SpanningTree::BRIDGE_GROUP_ADDRESS) {
+            spanning_tree->receive_bpdu(ingress_port, frame.buffer());
+            return;
+        }
+
+        /*
+         * A blocked port drops everything it receives, though a learning port learns from it
+         * first, unless the ACL would deny it
+         */
+        const PortState state = spanning_tree->port_state(ingress_port);
+        if (state != PortState::FORWARDING) {
+            if (state == PortState::LEARNING && !Layer2Switch::acl_denies(set, frame, vlan)) {
+                mac_address_table.learn(frame.source_mac_address(), ingress_port, vlan);
+            }
+            shard.metrics->ports[ingress_port].stp_discards.add(1);
+            return;
+        }
+    }
+
+    // The ACL applies before learning, so a denied host never gets into the MAC table
+    std::optional<size_t> redirect_port;
+    std::optional<size_t> mirror_port;
+    if (set.access_list) {
+        std::optional<size_t> rule = set.access_list->classify(frame.buffer(), vlan);
+        if (rule.has_value()) {
+            set.access_list->count_hit(shard.index, rule.value());
+            const AclRule& matched = set.access_list->rule(rule.value());
+            const std::optional<size_t> rule_port = set.access_list_ports[rule.value()];
+
+            switch (matched.action) {
+            case AclAction::PERMIT:
+                break;
+            case AclAction::DENY:
+                shard.metrics->ports[ingress_port].acl_drops.add(1);
+                return;
+            case AclAction::REDIRECT:
+                if (!rule_port.has_value()) {
+                    shard.metrics->ports[ingress_port].acl_drops.add(1);
+                    return;
+                }
+                redirect_port = rule_port;
+                break;
+            case AclAction::MIRROR:
+                mirror_port = rule_port;
+                break;
+            case AclAction::SET_PRIORITY:
+                traffic_class = matched.traffic_class;
+                break;
+            }
+        }
+    }
+
+    mac_address_table.learn(frame.source_mac_address(), ingress_port, vlan);
+
+    // A redirected frame goes out of the rule's port alone, wherever its destination MAC is
+    if (redirect_port.has_value()) {
+        if (acl_port_can_send(set, redirect_port.value(), ingress_port, vlan)) {
+            queue_frame(shard, redirect_port.value(), frame, traffic_class, {});
+        }
+        return;
+    }
+
+    // A mirrored frame is copied to the rule's port, unless it's switched there anyway
+    const auto mirror_unless_sent_to = [&](bool sent_to_mirror_port) {
+        if (mirror_port.has_value() && !sent_to_mirror_port &&
+            acl_port_can_send(set, mirror_port.value(), ingress_port, vlan)) {
+            queue_frame(shard, mirror_port.value(), frame, traffic_class, {});
+        }
+    };
+
+    /*
+     * There are two cases where we'll want to "flood", i.e., send this frame out all the
+     * ethernet ports in its VLAN except the port that we just received a frame from:
+     * 1. If the destination MAC is a broadcast MAC, i.e. FF:FF:FF:FF:FF:FF. This will occur for
+     *    certain protocols like ARP which are intended to be broadcast out.
+     * 2. If we don't know which ethernet port corresponds to the destination MAC. In that case,
+     *    we'll unicast flood with the intention of eventually getting a response from that MAC to
+     *    populate the MAC address table with.
+     */
+    std::optional<uint16_t> destination_port;
+    if (!destination_mac_address.is_broadcast()) {
+        destination_port = mac_address_table.lookup(destination_mac_address, vlan);
+    }
+
+    // A port that was just removed stays in the MAC table until it's flushed, so it's unknown
+    if (destination_port.has_value() && !set.shard_ports[shard.index][destination_port.value()]) {
+        destination_port.reset();
+    }
+
+    if (!destination_port.has_value()) {
+        // Storm control only limits flooded traffic, so known unicast never pays for the check
+        const FloodType flood_type = destination_mac_address.is_broadcast() ? BROADCAST
+                                     : destination_mac_address.is_multicast() ? MULTICAST
+                                                                              : UNKNOWN_UNICAST;
+        if (!storm_control.allow(
+                ingress_port, flood_type, frame.buffer().size(), frame.received_at()
+            )) {
+            // A suppressed frame isn't mirrored by the ACL either, so it adds no egress traffic
+            shard.metrics->ports[ingress_port].storm_suppressed[flood_type].add(1);
+            return;
+        }
+
+        const PortBitmap& flood_set = Layer2Switch::flood_set(set, vlan);
+
+        // Multicast only goes to the ports that asked for it, if any host has
+        if (multicast_snooping && flood_type == MULTICAST &&
+            multicast_snooping->snoop(
+                ingress_port, frame.buffer(), shard.multicast_egress, vlan, shard.index
+            )) {
+            shard.metrics->ports[ingress_port].snooped_multicast.add(1);
+            shard.multicast_egress &= flood_set;
+            flood_frame(shard, shard.multicast_egress, frame, ingress_port, traffic_class);
+            mirror_unless_sent_to(mirror_port && shard.multicast_egress.test(mirror_port.value()));
+            return;
+        }
+
+        shard.metrics->ports[ingress_port].floods.add(1);
+        flood_frame(shard, flood_set, frame, ingress_port, traffic_class);
+        mirror_unless_sent_to(mirror_port && flood_set.test(mirror_port.value()));
+        return;
+    }
+
+    mirror_unless_sent_to(destination_port == mirror_port);
+
+    if (port_shut_down[destination_port.value()].load(std::memory_order_relaxed)) {
+        shard.metrics->ports[destination_port.value()].storm_shutdown_drops.add(1);
+        return;
+    }
+    if (!port_forwarding(destination_port.value())) {
+        shard.metrics->ports[destination_port.value()].stp_discards.add(1);
+        return;
+    }
+
+    // If we know there this frame should go, just send it
+    queue_frame(shard, destination_port.value(), frame, traffic_class, {});
+}
+
+/*
+ * Whether the ACL would drop the given frame in the given VLAN, by denying it or redirecting it to
+ * a port that isn't there. Counts no hits, since it's only for frames that are dropped regardless.
+ */
+bool Layer2Switch::acl_denies(const PortSet& set, const Frame& frame, uint16_t vlan) {
+    if (!set.access_list) {
+        return false;
+    }
+    const std::optional<size_t> rule = set.access_list->classify(frame.buffer(), vlan);
+    if (!rule.has_value()) {
+        return false;
+    }
+    const AclAction action = set.access_list->rule(rule.value()).action;
+    return action == AclAction::DENY ||
+           (action == AclAction::REDIRECT && !set.access_list_ports[rule.value()].has_value());
+}
+
+/*
+ * Whether a frame an ACL rule redirects or mirrors out of the given port can be sent there: the
+ * port isn't the one the frame came in on or a mirror destination, isn't shut down by storm
+ * control, is forwarding, and carries the frame's VLAN.
+ */
+bool Layer2Switch::acl_port_can_send(
+    const PortSet& set, size_t port, size_t ingress_port, uint16_t vlan
+) const {
+    return port != ingress_port && !mirror_destinations.test(port) &&
+           !port_shut_down[port].load(std::memory_order_relaxed) && port_forwarding(port) &&
+           Layer2Switch::port_in_vlan(set, port, vlan);
+}
+
+/*
+ * Queues the given frame on every port of the given set that's up and forwarding, as a single
+ * flood. We already know the MAC of the ingress port, so the frame is never sent back out of it.
+ * Ports that fail to send it are counted when the batch is flushed.
+ */
+void Layer2Switch::flood_frame(
+    ForwardingShard& shard, const PortBitmap& egress_ports, const Frame& frame,
+    size_t ingress_port, TrafficClass traffic_class
+) {
+    const uint32_t flood = shard.floods.size();
+    shard.floods.push_back({ingress_port, false});
+
+    egress_ports.for_each([&](size_t port) {
+        if (port != ingress_port && !port_shut_down[port].load(std::memory_order_relaxed) &&
+            port_forwarding(port)) {
+            queue_frame(shard, port, frame, traffic_class, flood);
+        }
+    });
+}
+
+/*
+ * Queues the given frame for transmit on the given port at the end of the current batch. Frames
+ * switched to a LAG go out of the member its flow hashes to.
+ */
+void Layer2Switch::queue_frame(
+    ForwardingShard& shard, size_t port, const Frame& frame, TrafficClass traffic_class,
+    std::optional<uint32_t> flood
+) {
+    if (link_aggregation) {
+        std::optional<size_t> member = link_aggregation->egress_port(port, frame.buffer());
+        if (!member.has_value()) {
+            shard.metrics->ports[port].lag_discards.add(1);
+            return;
+        }
+        port = member.value();
+    }
+
+    if (!egress_mirrors.empty()) {
+        mirror_frame(
+            shard, egress_mirrors[port], frame, port, true, shard.port(port).egress_vlan_tci(frame)
+        );
+    }
+    shard.egress_queues[port][traffic_class].push_back({&frame, traffic_class, flood});
+}
+
+/*
+ * Captures the given frame, received or sent on the given port with the given VLAN tag, for every
+ * capture of the given targets, and marks it for the targets' destination ports. A capture that's
+ * fallen behind drops the frame rather than holding up the shard.
+ */
+void Layer2Switch::mirror_frame(
+    ForwardingShard& shard, const MirrorTargets& targets, const Frame& frame, size_t port,
+    bool egress, std::optional<uint16_t> vlan_tci
+) {
+    shard.mirror_egress |= targets.ports;
+
+    // Each shard is its own producer in every capture
+    for (size_t capture : targets.captures) {
+        if (!captures[capture]->capture(shard.index, frame, port, egress, vlan_tci)) {
+            shard.metrics->ports[port].mirror_drops.add(1);
+        }
+    }
+}
+
+/*
+ * Moves every frame switched to the given port in the current batch into the shard's transmit
+ * order, in the order the configured scheduler serves their traffic classes. Under strict priority
+ * every frame of a higher class goes first. Under deficit round robin, classes take turns sending
+ * their weight in bytes. Either way, if the port can't send everything, the frames that are left
+ * over are the ones the scheduler cares least about.
+ */
+void Layer2Switch::schedule_egress(ForwardingShard& shard, size_t port) {
+    std::array<std::vector<QueuedFrame>, TRAFFIC_CLASS_COUNT>& class_queues =
+        shard.egress_queues[port];
+
+    if (config.traffic_scheduler == TrafficScheduler::STRICT_PRIORITY) {
+        for (size_t traffic_class = TRAFFIC_CLASS_COUNT; traffic_class-- > 0;) {
+            std::vector<QueuedFrame>& egress_queue = class_queues[traffic_class];
+            shard.transmit_order.insert(
+                shard.transmit_order.end(), egress_queue.begin(), egress_queue.end()
+            );
+            egress_queue.clear();
+        }
+        return;
+    }
+
+    std::array<size_t, TRAFFIC_CLASS_COUNT> deficits{};
+    std::array<size_t, TRAFFIC_CLASS_COUNT> next_frames{};
+    bool any_waiting = true;
+    while (any_waiting) {
+        any_waiting = false;
+        for (size_t traffic_class = TRAFFIC_CLASS_COUNT; traffic_class-- > 0;) {
+            std::vector<QueuedFrame>& egress_queue = class_queues[traffic_class];
+            size_t& next_frame = next_frames[traffic_class];
+            if (next_frame == egress_queue.size()) {
+                continue;
+            }
+
+            any_waiting = true;
+            deficits[traffic_class] +=
+                class_weights[traffic_class].load(std::memory_order_relaxed) *
+                Layer2Switch::DRR_QUANTUM;
+            while (next_frame < egress_queue.size() &&
+                   egress_queue[next_frame].frame->buffer().size() <= deficits[traffic_class]) {
+                deficits[traffic_class] -= egress_queue[next_frame].frame->buffer().size();
+                shard.transmit_order.push_back(egress_queue[next_frame++]);
+            }
+        }
+    }
+
+    for (std::vector<QueuedFrame>& egress_queue : class_queues) { egress_queue.clear(); }
+}
+
+/*
+ * Flushes every port of the given shard that had frames switched to it in the current batch.
+ * Frames that fail to send are a suffix of what was handed to a port, so they're attributed to the
+ * flood or send error counters based on how each one was queued. A flood that failed on any port
+ * counts once against its ingress port as a partial flood. The forwarding latency of frames
+ * received by the shard itself is recorded once they've all been flushed.
+ */
+void Layer2Switch::flush_ports(ForwardingShard& shard) {
+    std::vector<QueuedFrame>& transmit_order = shard.transmit_order;
+
+    for (size_t port : shard.port_set->active_ports) {
+        schedule_egress(shard, port);
+        if (transmit_order.empty()) {
+            continue;
+        }
+
+        EthernetPort& egress_port = shard.port(port);
+        size_t queued = 0;
+        while (queued < transmit_order.size() &&
+               egress_port.enqueue_frame(*transmit_order[queued].frame)) {
+            ++queued;
+        }
+
+        PortCounters& counters = shard.metrics->ports[port];
+        const size_t sent = queued > 0 ? egress_port.flush_frames() : 0;
+        counters.sent_frames.add(sent);
+
+        for (size_t i = 0; i < transmit_order.size(); ++i) {
+            const QueuedFrame& queued_frame = transmit_order[i];
+            if (i < sent) {
+                shard.metrics->classes[queued_frame.traffic_class].sent_frames.add(1);
+            } else if (queued_frame.flood.has_value()) {
+                counters.flood_errors.add(1);
+                shard.floods[queued_frame.flood.value()].incomplete = true;
+            } else {
+                counters.send_errors.add(1);
+            }
+        }
+
+        if (sent < transmit_order.size()) {
+            syslog(
+                LOG_ERR, "Error while sending %ld frame(s) to %s", transmit_order.size() - sent,
+                egress_port.interface_name.c_str()
+            );
+        }
+
+        transmit_order.clear();
+    }
+
+    for (const Flood& flood : shard.floods) {
+        if (flood.incomplete) {
+            shard.metrics->ports[flood.ingress_port].partial_floods.add(1);
+        }
+    }
+    shard.floods.clear();
+
+    if (shard.received_frames.empty()) {
+        return;
+    }
+
+    const uint64_t flushed_at = metrics_clock();
+    for (const Frame& frame : shard.received_frames) {
+        shard.metrics->forwarding_latency[frame.traffic_class()].record(
+            flushed_at - frame.received_at()
+        );
+    }
+    shard.received_frames.clear();
+}
+
+/*
+ * Simple async metric worker to occassionally log some metrics about the virtual switch to syslog.
+ */
+void Layer2Switch::metric_worker() {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(60000));
+
+        const MetricsSnapshot snapshot = collect_metrics();
+        syslog(
+            LOG_INFO,
+            "Metrics report => "
+            "received_frames_count: %ld, "
+            "sent_frames_count: %ld, "
+            "flood_count: %ld, "
+            "read_errors_count: %ld, "
+            "send_errors_count: %ld, "
+            "flood_errors_count: %ld, "
+            "partial_floods_count: %ld, "
+            "tail_drops_count: %ld, "
+            "head_drops_count: %ld, "
+            "kernel_drops_count: %ld, "
+            "receiver_pauses_count: %ld, "
+            "storm_suppressed_count: %ld, "
+            "storm_shutdowns_count: %ld, "
+            "stp_discards_count: %ld, "
+            "stp_topology_changes_count: %ld, "
+            "multicast_snooped_count: %ld, "
+            "multicast_groups: %ld, "
+            "vlan_discards_count: %ld, "
+            "lag_discards_count: %ld, "
+            "acl_drops_count: %ld, "
+            "mirror_drops_count: %ld, "
+            "mac_table_entries: %ld, "
+            "mac_table_evictions_count: %ld, "
+            "frame_heap_allocations_count: %ld, "
+            "forwarding_latency_p99_ns: %ld",
+            snapshot.totals.received_frames_count, snapshot.totals.sent_frames_count,
+            snapshot.totals.flood_count, snapshot.totals.read_errors_count,
+            snapshot.totals.send_errors_count, snapshot.totals.flood_errors_count,
+            snapshot.totals.partial_floods_count, snapshot.totals.tail_drops_count,
+            snapshot.totals.head_drops_count, snapshot.totals.kernel_drops_count,
+            snapshot.totals.receiver_pauses_count, snapshot.totals.storm_suppressed_count(),
+            snapshot.totals.storm_shutdowns_count, snapshot.totals.stp_discards_count,
+            snapshot.stp_topology_changes_count, snapshot.totals.snooped_multicast_count,
+            snapshot.multicast_groups, snapshot.totals.vlan_discards_count,
+            snapshot.totals.lag_discards_count, snapshot.totals.acl_drops_count,
+            snapshot.totals.mirror_drops_count, snapshot.mac_table_entries,
+            snapshot.mac_table_evictions_count, snapshot.frame_heap_allocations_count,
+            snapshot.forwarding_latency.quantile(0.99)
+        );
+    }
+}
+
+/*
+ * Serves a fresh snapshot of the switch's metrics to every scraper that connects, labelled with
+ * the ports as they are at the time
+ */
+void Layer2Switch::metrics_server_worker() {
+    metrics_server->serve([&] {
+        std::vector<std::string> names;
+        {
+            std::lock_guard lock{port_set_mutex};
+            names = port_names();
+        }
+        return collect_metrics().to_prometheus(names);
+    });
+}
+
+/*
+ * Simple async worker that keeps the MAC address table's clock ticking once a second and sweeps out
+ * entries that have aged out, along with multicast memberships and router ports.
+ */
+void Layer2Switch::mac_aging_worker() {
+    const auto start_time = std::chrono::steady_clock::now();
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        auto uptime = std::chrono::steady_clock::now() - start_time;
+        const uint32_t now =
+            (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(uptime).count();
+        mac_address_table.age_out(now);
+        if (multicast_snooping) {
+            multicast_snooping->age_out(now);
+        }
+    }
+}
+
+// Seconds since the epoch by the wall clock, which MAC table snapshots are timestamped with
+static uint64_t wall_clock_seconds() {
+    const auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::seconds>(since_epoch).count();
+}
+
+/*
+ * Preloads the MAC address table from the snapshot the last switch on this path left behind, so a
+ * restarted switch can unicast to every host it already knew about straight away. Entries that
+ * aged out in the meantime, and entries whose port is gone or no longer in the entry's VLAN, are
+ * left out. A missing or invalid snapshot only means the table starts out empty.
+ */
+void Layer2Switch::restore_mac_table() {
+    std::string error;
+    std::optional<std::vector<MacSnapshot::Entry>> entries =
+        MacSnapshot::read(config.mac_snapshot_path, wall_clock_seconds(), error);
+    if (!entries.has_value()) {
+        syslog(
+            LOG_WARNING, "Not restoring the MAC address table from %s: %s",
+            config.mac_snapshot_path.c_str(), error.c_str()
+        );
+        return;
+    }
+
+    std::unordered_map<std::string, size_t> port_indices;
+    for (size_t port = 0; port < ports.size(); ++port) {
+        if (ports[port]) {
+            port_indices.emplace(ports[port]->interface_name, port);
+        }
+    }
+
+    const PortSet& set = *port_set.get();
+    const uint32_t aging_timeout = mac_address_table.get_aging_timeout();
+    size_t restored = 0;
+    for (const MacSnapshot::Entry& entry : entries.value()) {
+        auto port = port_indices.find(entry.port_name);
+        if (port == port_indices.end() || (aging_timeout != 0 && entry.age > aging_timeout)) {
+            continue;
+        }
+
+        // Without VLANs everything is learned in the default VLAN
+        const size_t index = port->second;
+        const bool in_vlan = Layer2Switch::port_in_vlan(set, index, entry.vlan) &&
+                             (!set.port_vlans.empty() || entry.vlan == DEFAULT_VLAN);
+
+        // MACs are only ever learned on a LAG's aggregate port, and never on mirror destinations
+        if (!in_vlan || mirror_destinations.test(index) ||
+            (link_aggregation && link_aggregation->aggregate_port(index) != index)) {
+            continue;
+        }
+
+        if (mac_address_table.restore(entry.mac_address, index, entry.vlan, entry.age)) {
+            ++restored;
+        }
+    }
+
+    syslog(
+        LOG_INFO, "Restored %ld of %ld MAC address table entries from %s", restored,
+        entries->size(), config.mac_snapshot_path.c_str()
+    );
+}
+
+/*
+ * Writes the MAC address table out to the snapshot path, recording each entry's port by name.
+ * Returns false and leaves errno set if it couldn't be written.
+ */
+bool Layer2Switch::save_mac_table() {
+    // Slots can be reused by other ports once they're removed, so names are taken alongside entries
+    std::vector<MacSnapshot::Entry> entries;
+    {
+        std::lock_guard lock{port_set_mutex};
+        for (const MacTable::Entry& entry : mac_address_table.entries()) {
+            if (ports[entry.port]) {
+                entries.push_back(
+                    {entry.mac_address, entry.vlan, ports[entry.port]->interface_name, entry.age}
+                );
+            }
+        }
+    }
+    return MacSnapshot::write(config.mac_snapshot_path, entries, wall_clock_seconds());
+}
+
+// Periodically snapshots the MAC address table, so a restarted switch doesn't have to relearn it
+void Layer2Switch::mac_snapshot_worker() {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(config.mac_snapshot_interval_seconds));
+        if (!save_mac_table()) {
+            syslog(
+                LOG_ERR, "Failed to write MAC address table snapshot %s: %s",
+                config.mac_snapshot_path.c_str(), strerror(errno)
+            );
+        }
+    }
+}
+
+/*
+ * Shuts down every port on which storm control suppressed more than the configured threshold of
+ * frames since the last call, and brings back every shut down port whose time is up at the given
+ * uptime in seconds. Called once a second by the storm control worker.
+ */
+void Layer2Switch::enforce_storm_shutdowns(uint32_t uptime) {
+    // Counters of a port that's removed are reset, so they're collected with the ports held still
+    std::lock_guard lock{port_set_mutex};
+    const MetricsSnapshot snapshot = metrics.collect();
+    for (size_t port = 0; port < ports.size(); ++port) {
+        if (!ports[port]) {
+            continue;
+        }
+
+        const uint64_t suppressed = snapshot.ports[port].storm_suppressed_count();
+        const uint64_t newly_suppressed = suppressed - last_storm_suppressed_counts[port];
+        last_storm_suppressed_counts[port] = suppressed;
+
+        if (port_shut_down[port].load(std::memory_order_relaxed)) {
+            if (uptime >= port_shut_down_until[port]) {
+                syslog(
+                    LOG_WARNING, "Storm control re-enabled %s", ports[port]->interface_name.c_str()
+                );
+                port_shut_down[port].store(false, std::memory_order_relaxed);
+            }
+            continue;
+        }
+
+        if (newly_suppressed > config.storm_shutdown_threshold) {
+            syslog(
+                LOG_WARNING,
+                "Storm control shut down %s for %u second(s) after suppressing %ld frame(s)",
+                ports[port]->interface_name.c_str(), config.storm_shutdown_seconds, newly_suppressed
+            );
+            port_shut_down_until[port] = uptime + config.storm_shutdown_seconds;
+            port_shut_down[port].store(true, std::memory_order_relaxed);
+            storm_control_metrics->ports[port].storm_shutdowns.add(1);
+        }
+    }
+}
+
+// Simple async worker that checks storm control's suppression counters once a second
+void Layer2Switch::storm_control_worker() {
+    const auto start_time = std::chrono::steady_clock::now();
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        auto uptime = std::chrono::steady_clock::now() - start_time;
+        enforce_storm_shutdowns(
+            (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(uptime).count()
+        );
+    }
+}
+
+// Simple async worker that ticks the spanning tree's timers once a second
+void Layer2Switch::spanning_tree_worker() {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        spanning_tree->tick();
+    }
+}
+
+/*
+ * Sends a BPDU out of the given port. A LAG takes part in the spanning tree as its aggregate port,
+ * whose BPDUs go out of one of its active members. The LAG's other members stay quiet.
+ */
+void Layer2Switch::send_bpdu(size_t port, const Frame& bpdu) {
+    if (link_aggregation) {
+        if (link_aggregation->aggregate_port(port) != port) {
+            return;
+        }
+
+        std::optional<size_t> member = link_aggregation->egress_port(port, bpdu.buffer());
+        if (!member.has_value()) {
+            return;
+        }
+        port = member.value();
+    }
+
+    control_ports[port]->send_frame(bpdu);
+}
+
+// Keeps the LAGs up to date with their members' links, and runs LACP's timers
+void Layer2Switch::link_aggregation_worker() {
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        for (size_t port = 0; port < ports.size(); ++port) {
+            if (link_aggregation->in_lag(port)) {
+                link_aggregation->set_link_up(port, ports[port]->link_up());
+            }
+        }
+        link_aggregation->tick();
+    }
+}
+
+/*
+ * Writes mirrored frames to every capture file as the shards queue them. While there's nothing to
+ * write it polls every millisecond, far sooner than a busy shard can fill its capture queue.
+ */
+void Layer2Switch::capture_worker() {
+    while (true) {
+        size_t written = 0;
+        for (const std::unique_ptr<PacketCapture>& capture : captures) {
+            written += capture->write_pending();
+        }
+        if (written == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+// Runs every command sent to the control socket
+void Layer2Switch::control_server_worker() {
+    control_server->serve([this](const std::string& command) { return execute_command(command); });
+}
+
+/*
+ * Copies a received frame into the given port's input queue for the frame's traffic class. If the
+ * queue is full, the frame is handled according to the configured QueueFullPolicy: it's dropped,
+ * or the receiver waits for the main switch loop to make room, either by dropping the oldest frame
+ * or by switching a batch.
+ */
+void Layer2Switch::enqueue_received_frame(
+    size_t port_index, const FrameView& frame_view, uint64_t received_at
+) {
+    const TrafficClass traffic_class = frame_view.traffic_class();
+    const size_t queue = Layer2Switch::input_queue_index(port_index, traffic_class);
+    SpscRing<Frame>& input_queue = *input_queues[queue];
+    FramePool& frame_pool = ports[port_index]->frame_pool;
+    ThreadMetrics& thread_metrics = *receiver_metrics[port_index];
+    PortCounters& counters = thread_metrics.ports[port_index];
+
+    thread_metrics.classes[traffic_class].received_frames.add(1);
+    if (input_queue.try_emplace(frame_pool, frame_view, received_at)) {
+        return;
+    }
+
+    switch (config.queue_full_policy) {
+    case QueueFullPolicy::TAIL_DROP:
+        counters.tail_drops.add(1);
+        thread_metrics.classes[traffic_class].dropped_frames.add(1);
+        return;
+    case QueueFullPolicy::HEAD_DROP:
+        head_drop_requests[queue].fetch_add(1, std::memory_order_release);
+        break;
+    case QueueFullPolicy::PAUSE:
+        counters.receiver_pauses.add(1);
+        break;
+    }
+
+    // The main switch loop may be asleep, since it's only woken up after a whole receive batch
+    do {
+        idle_notifier.notify();
+        std::this_thread::yield();
+    } while (!input_queue.try_emplace(frame_pool, frame_view, received_at));
+
+    // Don't drop a frame if room was made by switching a batch before the request was seen
+    if (config.queue_full_policy == QueueFullPolicy::HEAD_DROP) {
+        size_t requested = 1;
+        head_drop_requests[queue].compare_exchange_strong(requested, 0);
+    }
+}
+
+/*
+ * Implementation of a frame receiver worker. Frames are received in batches as views into the
+ * port's receive buffers and copied straight into the port's input queue.
+ */
+void Layer2Switch::frame_receiver_worker_impl(size_t port_index) {
+    const std::shared_ptr<EthernetPort>& port = ports[port_index];
+    PortCounters& counters = receiver_metrics[port_index]->ports[port_index];
+
+    // Every frame of a batch arrived at about the same time, so the clock is only read once
+    uint64_t received_at = 0;
+    std::optional<size_t> received_count = port->receive_frames([&](const FrameView& frame_view) {
+        if (received_at == 0) {
+            received_at = metrics_clock();
+        }
+
+        // Add this frame to the input queue to be processed by the main switch loop
+        enqueue_received_frame(port_index, frame_view, received_at);
+    });
+    idle_notifier.notify();
+
+    if (!received_count.has_value()) {
+        counters.read_errors.add(1);
+        syslog(
+            LOG_ERR, "Failed to receive from on port %s. Skipping", port->interface_name.c_str()
+        );
+        return;
+    }
+
+    counters.received_frames.add(received_count.value());
+}
+
+/*
+ * Checks the result of a worker's poll() or epoll_wait(), returning whether it failed. Interrupted
+ * waits are retried straight away, but any other error is logged the first time in a row it
+ * happens and backed off from, so a lasting failure doesn't spin the worker at full speed.
+ */
+static bool wait_failed(int result, const char* worker, bool& failure_logged) {
+    if (result >= 0) {
+        failure_logged = false;
+        return false;
+    }
+    if (errno == EINTR) {
+        return true;
+    }
+
+    if (!failure_logged) {
+        syslog(LOG_ERR, "%s failed to wait for frames: %m", worker);
+        failure_logged = true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return true;
 }
 
 /*
- * This method encapsulates the actual implementation of the layer 2 switching logic. It waits for a
- * frame to be enqueued on the input queue, pulls that frame off, then uses the MAC address table to
- * decide how to switch the frame.
+ * Simple std::thread worker to perform receiving of the frames from the given port. The actual
+ * implementation of the logic has been split into a separate method to make unit testing easier.
+ * When ports can be removed, the worker waits on its stop eventfd alongside the port, and returns
+ * once it's written to.
  */
-void Layer2Switch::switch_impl() {
-    // Wait for frames to be enqueued by the frame receiver workers
-    while (input_queue.empty()) {}
-
-    // Once we get a frame, pop it off the input queue and process it
-    input_queue_mutex.lock();
-    auto frame_port_pair = input_queue.front();
-    input_queue.pop();
-    input_queue_mutex.unlock();
+void Layer2Switch::frame_receiver_worker(size_t port_index) {
+    if (receiver_stop_fds.empty()) {
+        while (true) { frame_receiver_worker_impl(port_index); }
+    }
 
-    Frame frame = frame_port_pair.first;
-    std::shared_ptr<EthernetPort> port = frame_port_pair.second;
+    ports[port_index]->set_nonblocking();
+    std::array<pollfd, 2> poll_configs{
+        {{ports[port_index]->receive_fd(), POLLIN, 0}, {receiver_stop_fds[port_index], POLLIN, 0}}
+    };
+    bool failure_logged = false;
+    while (true) {
+        const int ready = poll(poll_configs.data(), poll_configs.size(), -1);
+        if (wait_failed(ready, "Frame receiver worker", failure_logged)) {
+            continue;
+        }
 
-    mac_address_table.insert_or_assign(frame.source_mac_address, port);
+        if (poll_configs[1].revents != 0) {
+            uint64_t stops;
+            if (read(receiver_stop_fds[port_index], &stops, sizeof(stops)) < 0) {
+                syslog(LOG_ERR, "Failed to read receiver eventfd: %m");
+            }
+            return;
+        }
+        if (poll_configs[0].revents != 0) {
+            frame_receiver_worker_impl(port_index);
+        }
+    }
+}
 
-    /*
-     * There are two cases where we'll want to "flood", i.e., send this frame out all the
-     * ethernet ports except the port that we just received a frame from:
-     * 1. If the destination MAC is a broadcast MAC, i.e. FF:FF:FF:FF:FF:FF. This will occur for
-     *    certain protocols like ARP which are intended to be broadcast out.
-     * 2. If we don't know which ethernet port corresponds to the destination MAC. In that case,
-     *    we'll unicast flood with the intention of eventually getting a response from that MAC to
-     *    populate the MAC address table with.
-     */
-    if (frame.destination_mac_address.is_broadcast() ||
-        mac_address_table.find(frame.destination_mac_address) == mac_address_table.end()) {
-        ++flood_count;
+// Starts the receiver thread of the port in the given slot
+void Layer2Switch::start_receiver(size_t port) {
+    syslog(LOG_INFO, "Starting frame receiver worker on %s", ports[port]->interface_name.c_str());
+    receivers[port] = std::jthread(&Layer2Switch::frame_receiver_worker, this, port);
+}
 
-        for (const std::shared_ptr<EthernetPort>& current_port : ports) {
-            // We already know the MAC of the port, so we don't need to flood to it
-            if (*current_port == *port) {
-                continue;
-            }
+/*
+ * Implementation of a sharded forwarding worker. Receives whatever is waiting on the worker's
+ * socket for the given port and switches it inline, with no hand off to another thread. Frames are
+ * flushed whenever a full batch has been queued; the caller is responsible for flushing whatever is
+ * left. Returns the number of frames received.
+ */
+size_t Layer2Switch::forwarding_worker_impl(size_t worker, size_t port_index) {
+    ForwardingShard& shard = shards[worker];
+    EthernetPort& port = shard.port(port_index);
+    PortCounters& counters = shard.metrics->ports[port_index];
 
-            if (!current_port->send_frame(frame)) {
-                ++flood_errors_count;
-                syslog(
-                    LOG_ERR, "Error while flooding frame to %s",
-                    current_port->interface_name.c_str()
-                );
-                return;
-            }
-            ++sent_frames_count;
+    uint64_t received_at = 0;
+    std::optional<size_t> received_count = port.receive_frames([&](const FrameView& frame_view) {
+        if (received_at == 0) {
+            received_at = metrics_clock();
         }
 
-        return;
-    }
+        const TrafficClass traffic_class = frame_view.traffic_class();
+        shard.metrics->classes[traffic_class].received_frames.add(1);
+        switch_frame(
+            shard, shard.received_frames.emplace_back(port.frame_pool, frame_view, received_at),
+            port_index, traffic_class
+        );
+        if (shard.received_frames.size() == Layer2Switch::SWITCH_BATCH_SIZE) {
+            flush_ports(shard);
+        }
+    });
 
-    // If we know there this frame should go, just send it
-    std::shared_ptr<EthernetPort> destination_port =
-        mac_address_table.at(frame.destination_mac_address);
-    if (!destination_port->send_frame(frame)) {
-        ++send_errors_count;
+    if (!received_count.has_value()) {
+        counters.read_errors.add(1);
         syslog(
-            LOG_ERR, "Error while sending frame from %s to %s", port->interface_name.c_str(),
-            destination_port->interface_name.c_str()
+            LOG_ERR, "Failed to receive from on port %s. Skipping", port.interface_name.c_str()
         );
+        return 0;
+    }
+
+    counters.received_frames.add(received_count.value());
+    return received_count.value();
+}
+
+// Pins the calling thread to its CPU from the configured list, if there is one
+void Layer2Switch::pin_to_cpu(size_t thread_index, const char* thread_kind) {
+    if (config.worker_cpus.empty()) {
         return;
     }
-    ++sent_frames_count;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(config.worker_cpus[thread_index % config.worker_cpus.size()], &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) != 0) {
+        syslog(LOG_ERR, "Failed to pin %s %ld to a CPU", thread_kind, thread_index);
+    }
 }
 
 /*
- * Simple async metric worker to occassionally log some metrics about the virtual switch to syslog.
+ * Receives and switches whatever is waiting on the given shard's socket for the given port, but
+ * only up to a batch at a time so that no port starves the others.
  */
-void Layer2Switch::metric_worker() {
+void Layer2Switch::drain_port(size_t shard, size_t port) {
+    size_t received = 0;
+    size_t received_now;
+    do {
+        received_now = forwarding_worker_impl(shard, port);
+        received += received_now;
+    } while (received_now > 0 && received < Layer2Switch::SWITCH_BATCH_SIZE);
+}
+
+/*
+ * Sharded forwarding worker. Waits on the worker's sockets for every port at once, drains each port
+ * that has frames waiting, then flushes everything that was switched. Since the kernel fans frames
+ * out to workers by flow, every frame of a flow is received, switched, and sent by the same worker,
+ * in order. The worker also waits on its wake eventfd, so that it picks up ports that are added or
+ * removed.
+ */
+void Layer2Switch::forwarding_worker(size_t worker) {
+    ForwardingShard& shard = shards[worker];
+    pin_to_cpu(worker, "forwarding worker");
+
+    // The worker's wake eventfd comes first, followed by the port in each slot of poll_ports
+    std::vector<pollfd> poll_configs;
+    std::vector<size_t> poll_ports;
+    uint64_t version = 0;
+    bool failure_logged = false;
+
     while (true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(60000));
-        syslog(
-            LOG_INFO,
-            "Metrics report => "
-            "received_frames_count: %ld, "
-            "sent_frames_count: %ld, "
-            "flood_count: %ld, "
-            "read_errors_count: %ld, "
-            "send_errors_count: %ld, "
-            "flood_errors_count: %ld",
-            received_frames_count.load(), sent_frames_count.load(), flood_count.load(),
-            read_errors_count.load(), send_errors_count.load(), flood_errors_count.load()
-        );
+        enter_port_set(shard);
+        if (shard.port_set->version != version) {
+            // What poll() last saw may be for sockets that are gone, so it's polled again first
+            version = shard.port_set->version;
+            poll_configs.assign(1, {shard.wake_fd, POLLIN, 0});
+            poll_ports.clear();
+            for (size_t port : shard.port_set->active_ports) {
+                shard.port(port).set_nonblocking();
+                poll_configs.push_back({shard.port(port).receive_fd(), POLLIN, 0});
+                poll_ports.push_back(port);
+            }
+        } else {
+            for (size_t i = 0; i < poll_ports.size(); ++i) {
+                if (poll_configs[i + 1].revents != 0) {
+                    drain_port(worker, poll_ports[i]);
+                }
+            }
+
+            flush_ports(shard);
+        }
+        exit_port_set(shard);
+
+        const int ready = poll(poll_configs.data(), poll_configs.size(), -1);
+        if (wait_failed(ready, "Forwarding worker", failure_logged)) {
+            for (pollfd& poll_config : poll_configs) { poll_config.revents = 0; }
+            continue;
+        }
+
+        if (poll_configs[0].revents != 0) {
+            uint64_t wakeups;
+            if (read(shard.wake_fd, &wakeups, sizeof(wakeups)) < 0) {
+                syslog(LOG_ERR, "Failed to read forwarding worker eventfd: %m");
+            }
+        }
     }
 }
 
 /*
- * Implementation of a frame receiver worker.
+ * Registers the port in the given slot of the given port set with the epoll instance of the
+ * reactor that owns it. Returns false if it couldn't be registered.
  */
-void Layer2Switch::frame_receiver_worker_impl(const std::shared_ptr<EthernetPort>& port) {
-    std::optional<Frame> optional_frame = port->receive_frame();
-    if (!optional_frame.has_value()) {
-        ++read_errors_count;
+bool Layer2Switch::watch_port(const PortSet& set, size_t port) {
+    const size_t reactor = set.port_reactors[port];
+    EthernetPort& reactor_port = *set.shard_ports[reactor][port];
+    reactor_port.set_nonblocking();
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = port;
+    if (epoll_ctl(shards[reactor].epoll_fd, EPOLL_CTL_ADD, reactor_port.receive_fd(), &event) < 0 &&
+        errno != EEXIST) {
         syslog(
-            LOG_ERR, "Failed to receive from on port %s. Skipping", port->interface_name.c_str()
+            LOG_ERR, "Failed to add port %s to reactor %ld: %m",
+            reactor_port.interface_name.c_str(), reactor
         );
-        return;
+        return false;
     }
-
-    const Frame frame = optional_frame.value();
-    ++received_frames_count;
-
-    // Add this frame to the input queue to be processed by the main switch loop
-    std::lock_guard<std::mutex> g(input_queue_mutex);
-    input_queue.emplace(frame, port);
+    return true;
 }
 
 /*
- * Simple std::thread worker to perform receiving of the frames from the given port. The actual
- * implementation of the logic has been split into a separate method to make unit testing easier.
+ * Reactor. Waits on the sockets of every port the reactor owns with a single epoll instance, drains
+ * each port that has frames waiting, and switches and transmits them inline, then flushes
+ * everything that was switched. Every frame received on a port is handled by the port's reactor,
+ * in order. Reactors transmit on ports they don't own through their own transmit handles.
  */
-void Layer2Switch::frame_receiver_worker(const std::shared_ptr<EthernetPort>& port) {
-    while (true) { frame_receiver_worker_impl(port); }
+void Layer2Switch::reactor_worker(size_t reactor) {
+    ForwardingShard& shard = shards[reactor];
+    pin_to_cpu(reactor, "reactor");
+
+    // Ports added once the switch has started are registered by add_port()
+    {
+        std::lock_guard lock{port_set_mutex};
+        const PortSet& set = *port_set.get();
+        for (size_t port : set.active_ports) {
+            if (set.port_reactors[port] == reactor) {
+                watch_port(set, port);
+            }
+        }
+    }
+
+    std::array<epoll_event, Layer2Switch::REACTOR_EVENTS> events;
+    bool failure_logged = false;
+    while (true) {
+        int ready = epoll_wait(shard.epoll_fd, events.data(), events.size(), -1);
+        if (wait_failed(ready, "Reactor", failure_logged)) {
+            continue;
+        }
+
+        // A port may have been removed, or even handed to another reactor, since it became ready
+        enter_port_set(shard);
+        for (int i = 0; i < ready; ++i) {
+            const size_t port = events[i].data.u64;
+            if (shard.port_set->shard_ports[reactor][port] &&
+                shard.port_set->port_reactors[port] == reactor) {
+                drain_port(reactor, port);
+            }
+        }
+
+        flush_ports(shard);
+        exit_port_set(shard);
+    }
 }
 
 /*
  * Starts the actual frame switching logic. Note that this function blocks forever as it spawns the
- * main switching loop.
+ * main switching loop, or the sharded forwarding workers or reactors if the switch was configured
+ * with any.
  */
 void Layer2Switch::start() {
-    syslog(LOG_INFO, "Starting virtual layer 2 switch process on %ld port(s)", ports.size());
+    syslog(
+        LOG_INFO, "Starting virtual layer 2 switch process on %ld port(s)",
+        port_set.get()->active_ports.size()
+    );
 
     /*
      * We'll store all the worker threads in a vector in this scope because we need to ensure that
@@ -154,17 +1858,503 @@ void Layer2Switch::start() {
      */
     std::vector<std::jthread> threads;
 
-    // Spawn one thread per port to accept frames asynchronously
-    for (std::shared_ptr<EthernetPort> port : ports) {
-        syslog(LOG_INFO, "Starting frame receiver worker on %s", port->interface_name.c_str());
-        threads.emplace_back(&Layer2Switch::frame_receiver_worker, this, port);
-    }
-
     syslog(LOG_INFO, "Starting metrics worker");
     std::jthread metrics_worker(&Layer2Switch::metric_worker, this);
 
+    syslog(LOG_INFO, "Starting MAC aging worker");
+    std::jthread aging_worker(&Layer2Switch::mac_aging_worker, this);
+
+    // Spawn one thread per port to accept frames asynchronously, unless frames are received inline
+    {
+        std::lock_guard lock{port_set_mutex};
+        started = true;
+        for (size_t port = 0; port < receivers.size(); ++port) {
+            if (ports[port]) {
+                start_receiver(port);
+            }
+        }
+    }
+
+    if (!config.mac_snapshot_path.empty() && config.mac_snapshot_interval_seconds > 0) {
+        syslog(
+            LOG_INFO, "Snapshotting the MAC address table to %s every %u second(s)",
+            config.mac_snapshot_path.c_str(), config.mac_snapshot_interval_seconds
+        );
+        threads.emplace_back(&Layer2Switch::mac_snapshot_worker, this);
+    }
+
+    if (control_server) {
+        syslog(LOG_INFO, "Taking commands on %s", config.control_socket_path.c_str());
+        threads.emplace_back(&Layer2Switch::control_server_worker, this);
+    }
+
+    if (metrics_server) {
+        syslog(LOG_INFO, "Serving metrics on %s", config.metrics_socket_path.c_str());
+        threads.emplace_back(&Layer2Switch::metrics_server_worker, this);
+    }
+
+    if (spanning_tree) {
+        syslog(LOG_INFO, "Starting spanning tree worker as bridge %016lx", spanning_tree->id());
+        threads.emplace_back(&Layer2Switch::spanning_tree_worker, this);
+    }
+
+    if (link_aggregation) {
+        syslog(
+            LOG_INFO, "Starting link aggregation worker%s", config.lacp ? " running LACP" : ""
+        );
+        threads.emplace_back(&Layer2Switch::link_aggregation_worker, this);
+    }
+
+    if (!captures.empty()) {
+        syslog(LOG_INFO, "Starting capture worker for %ld capture file(s)", captures.size());
+        threads.emplace_back(&Layer2Switch::capture_worker, this);
+    }
+
+    if (config.storm_shutdown_seconds > 0) {
+        syslog(LOG_INFO, "Starting storm control worker");
+        threads.emplace_back(&Layer2Switch::storm_control_worker, this);
+    }
+
+    if (config.forwarding_workers > 0) {
+        for (size_t worker = 0; worker < shards.size(); ++worker) {
+            syslog(LOG_INFO, "Starting forwarding worker %ld", worker);
+            threads.emplace_back(&Layer2Switch::forwarding_worker, this, worker);
+        }
+
+        // The forwarding workers never return, so this blocks forever joining them
+        puts("Starting forwarding workers");
+        return;
+    }
+
+    if (config.reactors > 0) {
+        for (size_t reactor = 0; reactor < shards.size(); ++reactor) {
+            syslog(LOG_INFO, "Starting reactor %ld", reactor);
+            threads.emplace_back(&Layer2Switch::reactor_worker, this, reactor);
+        }
+
+        // The reactors never return, so this blocks forever joining them
+        puts("Starting reactors");
+        return;
+    }
+
     // Main switch logic loop
     syslog(LOG_INFO, "Starting main switch loop");
     puts("Starting main switch loop");
     while (true) { switch_impl(); }
 }
+
+/*
+ * Takes a snapshot of every metric the switch keeps. Safe to call from any thread while the switch
+ * is running.
+ */
+MetricsSnapshot Layer2Switch::collect_metrics() const {
+    MetricsSnapshot snapshot = metrics.collect();
+    snapshot.mac_table_entries = mac_address_table.size();
+    snapshot.mac_table_capacity = mac_address_table.capacity();
+    snapshot.mac_table_evictions_count = mac_address_table.evictions();
+    snapshot.stp_topology_changes_count = spanning_tree ? spanning_tree->topology_changes() : 0;
+    snapshot.multicast_groups = multicast_snooping ? multicast_snooping->group_count() : 0;
+    for (const std::unique_ptr<PacketCapture>& capture : captures) {
+        snapshot.capture_write_errors_count += capture->write_errors();
+    }
+
+    /*
+     * Frames that didn't fit in their port's pool, which means the pools are too small. Every
+     * shard's port objects count kernel drops separately, even when they share a socket.
+     */
+    std::lock_guard lock{port_set_mutex};
+    const PortSet& set = *port_set.get();
+    for (size_t rule = 0; set.access_list && rule < set.access_list->size(); ++rule) {
+        snapshot.acl_rule_hits.push_back(set.access_list->hits(rule));
+    }
+    for (const std::vector<std::shared_ptr<EthernetPort>>& shard_ports : set.shard_ports) {
+        for (size_t port : set.active_ports) {
+            EthernetPort& shard_port = *shard_ports[port];
+            snapshot.frame_heap_allocations_count += shard_port.frame_pool.heap_allocations();
+            snapshot.ports[port].kernel_drops_count += shard_port.kernel_drops();
+        }
+    }
+    for (const PortMetrics& port : snapshot.ports) {
+        snapshot.totals.kernel_drops_count += port.kernel_drops_count;
+    }
+
+    return snapshot;
+}
+
+/*
+ * Adds the given port to the switch while it's running, in the first free port slot. On a switch
+ * with VLANs, the port carries the given VLANs, or just the default VLAN if none are given. The
+ * port is published to the data path in one go, with every shard's socket on it ready, and frames
+ * start flowing through it right away. Returns what went wrong if the port couldn't be added.
+ */
+std::optional<std::string> Layer2Switch::add_port(
+    const std::shared_ptr<EthernetPort>& port, const std::optional<PortVlans>& vlans
+) {
+    std::lock_guard lock{port_set_mutex};
+
+    std::optional<size_t> free_slot;
+    for (size_t slot = 0; slot < ports.size(); ++slot) {
+        if (ports[slot] && ports[slot]->interface_name == port->interface_name) {
+            return "Port " + port->interface_name + " is already on the switch";
+        }
+        if (!ports[slot] && !free_slot.has_value()) {
+            free_slot = slot;
+        }
+    }
+
+    if (!free_slot.has_value()) {
+        return "All " + std::to_string(ports.size()) + " port slots are in use";
+    }
+    if (vlans.has_value() && config.port_vlans.empty()) {
+        return "Port " + port->interface_name + " has VLANs, but the switch doesn't";
+    }
+    if (vlans.has_value() && !valid_vlans(vlans.value())) {
+        return "Invalid VLAN on port " + port->interface_name + ". VLANs must be between " +
+               std::to_string(DEFAULT_VLAN) + " and " + std::to_string(MAX_VLAN);
+    }
+
+    const size_t slot = free_slot.value();
+    std::unique_ptr<PortSet> set = std::make_unique<PortSet>(*port_set.get());
+    if (!set->port_vlans.empty()) {
+        set->port_vlans[slot] = vlans.value_or(PortVlans{});
+        port->set_vlans(set->port_vlans[slot]);
+    }
+
+    // New ports go to whichever reactor owns the fewest
+    if (config.reactors > 0) {
+        std::vector<size_t> reactor_loads(config.reactors, 0);
+        for (size_t active_port : set->active_ports) {
+            ++reactor_loads[set->port_reactors[active_port]];
+        }
+        set->port_reactors[slot] = std::ranges::min_element(reactor_loads) - reactor_loads.begin();
+    }
+
+    ports[slot] = port;
+    std::optional<std::string> error = open_shard_ports(*set, slot);
+    if (!error.has_value() && config.reactors > 0 && started && !watch_port(*set, slot)) {
+        error = "Failed to add port " + port->interface_name + " to its reactor";
+    }
+    if (error.has_value()) {
+        ports[slot].reset();
+        return error;
+    }
+
+    if (multicast_snooping) {
+        multicast_snooping->reset_port(slot, port->interface_name);
+    }
+    publish_port_set(std::move(set));
+
+    if (!receivers.empty() && started) {
+        start_receiver(slot);
+    }
+
+    syslog(LOG_INFO, "Added port %s in slot %ld", port->interface_name.c_str(), slot);
+    return {};
+}
+
+/*
+ * Removes the port with the given interface name from the switch while it's running. The port
+ * stops receiving, is taken out of the data path, and is closed once no thread is switching with
+ * it anymore. Everything the switch learned about it is forgotten and its counters are reset, so
+ * its slot starts afresh when another port is added in it. Returns what went wrong if the port
+ * couldn't be removed.
+ */
+std::optional<std::string> Layer2Switch::remove_port(const std::string& interface_name) {
+    std::lock_guard lock{port_set_mutex};
+
+    // These index their settings by port, so ports can't come and go underneath them
+    if (spanning_tree || link_aggregation || !config.mirror_sessions.empty()) {
+        return "Ports can't be removed with spanning tree, link aggregation or mirroring";
+    }
+
+    const auto found = std::ranges::find_if(ports, [&](const std::shared_ptr<EthernetPort>& port) {
+        return port && port->interface_name == interface_name;
+    });
+    if (found == ports.end()) {
+        return "No port " + interface_name + " on the switch";
+    }
+
+    const size_t slot = found - ports.begin();
+    EthernetPort& port = *ports[slot];
+
+    // AF_XDP sockets hand their frames back to a UMEM shared by every port, which outlives them
+    if (strcmp(port.backend(), "xdp") == 0) {
+        return "Port " + interface_name + " is an XDP port, which can't be removed";
+    }
+
+    // Stop receiving first, so that nothing more is queued for the port
+    if (!receivers.empty() && receivers[slot].joinable()) {
+        if (receiver_stop_fds.empty()) {
+            return "Ports can only be removed from a switch with a control socket";
+        }
+
+        const uint64_t stops = 1;
+        if (write(receiver_stop_fds[slot], &stops, sizeof(stops)) < 0) {
+            return "Failed to stop the receiver on " + interface_name + ": " + strerror(errno);
+        }
+        receivers[slot].join();
+    }
+
+    std::unique_ptr<PortSet> set = std::make_unique<PortSet>(*port_set.get());
+    for (std::vector<std::shared_ptr<EthernetPort>>& shard_ports : set->shard_ports) {
+        shard_ports[slot].reset();
+    }
+    publish_port_set(std::move(set));
+
+    // No thread is switching with the port anymore, so whatever it left behind can be cleaned up
+    if (config.reactors > 0) {
+        const size_t reactor = port_set.get()->port_reactors[slot];
+        epoll_ctl(shards[reactor].epoll_fd, EPOLL_CTL_DEL, port.receive_fd(), nullptr);
+    }
+    for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT && !input_queues.empty();
+         ++traffic_class) {
+        const size_t queue = Layer2Switch::input_queue_index(slot, traffic_class);
+        input_queues[queue]->pop(input_queues[queue]->readable());
+        head_drop_requests[queue].store(0, std::memory_order_relaxed);
+    }
+
+    mac_address_table.flush_port(slot);
+    if (multicast_snooping) {
+        multicast_snooping->reset_port(slot, "");
+    }
+    port_shut_down[slot].store(false, std::memory_order_relaxed);
+    port_shut_down_until[slot] = 0;
+    last_storm_suppressed_counts[slot] = 0;
+    metrics.reset_port(slot);
+
+    syslog(LOG_INFO, "Removed port %s from slot %ld", interface_name.c_str(), slot);
+    ports[slot].reset();
+    return {};
+}
+
+// Describes the given VLAN settings the way a port spec gives them
+static std::string describe_vlans(const PortVlans& port_vlans) {
+    if (port_vlans.mode == VlanMode::ACCESS) {
+        return "access=" + std::to_string(port_vlans.native_vlan);
+    }
+
+    std::string description = "trunk=";
+    for (uint16_t vlan = DEFAULT_VLAN; vlan <= MAX_VLAN; ++vlan) {
+        if (port_vlans.tagged_vlans.test(vlan)) {
+            description += std::to_string(vlan) + ",";
+        }
+    }
+    description.pop_back();
+    return description + ":native=" + std::to_string(port_vlans.native_vlan);
+}
+
+// Parses a whole, non-negative number from a command. Returns false if it isn't one
+static bool parse_count(const std::string& text, size_t& value) {
+    char* end = nullptr;
+    value = strtoul(text.c_str(), &end, 10);
+    return !text.empty() && isdigit(text[0]) && *end == '\0';
+}
+
+/*
+ * Runs a single command sent to the control socket, and returns its reply. Replies to commands
+ * that change something are "ok", and replies to commands that fail start with "error: ". The
+ * commands are:
+ *
+ *   add-port <port spec>        Adds a port, given the same way as on the command line
+ *   remove-port <interface>     Removes a port
+ *   show-ports                  Lists every port and the slot it's in
+ *   show-mac-table              Lists every MAC address the switch knows about
+ *   flush-mac-table [<interface>]
+ *                               Forgets every MAC address, or those learned on one port
+ *   set mac-aging <seconds>     Changes how long MAC addresses are remembered. 0 is forever
+ *   set idle-polls <polls>|never
+ *                               Changes how long the main switch loop polls before it sleeps
+ *   set class-weights <w0>,<w1>,<w2>,<w3>
+ *                               Changes the deficit round robin weight of each traffic class
+ *   show-tunables               Lists the tunables that can be set
+ *   save-mac-table              Snapshots the MAC address table now, e.g. right before a restart
+ *   show-acl                    Lists every ACL rule with the number of frames that matched it
+ *   reload-acl                  Reads the ACL file again and swaps the new rules in
+ */
+std::string Layer2Switch::execute_command(const std::string& command) {
+    std::istringstream words{command};
+    std::string verb;
+    std::string argument;
+    std::string value;
+    words >> verb >> argument >> value;
+
+    std::string extra;
+    if (words >> extra) {
+        return "error: Unexpected '" + extra + "'\n";
+    }
+
+    if (verb == "add-port" && !argument.empty() && value.empty()) {
+        std::string error;
+        std::optional<PortSpec> spec = PortSpec::parse(argument, error);
+        if (!spec.has_value()) {
+            return "error: " + error + "\n";
+        }
+        if (spec->lag != LinkAggregation::NO_LAG) {
+            return "error: LAGs can't be changed while the switch is running\n";
+        }
+        if (spec->backend == "xdp") {
+            return "error: XDP ports can't be added while the switch is running\n";
+        }
+        if (if_nametoindex(spec->interface_name.c_str()) == 0) {
+            return "error: No interface named " + spec->interface_name + "\n";
+        }
+        if (spanning_tree || link_aggregation || !config.mirror_sessions.empty()) {
+            return "error: Ports can't be added with spanning tree, link aggregation or "
+                   "mirroring\n";
+        }
+
+        std::optional<std::string> add_error = add_port(spec->open(nullptr), spec->vlans);
+        return add_error.has_value() ? "error: " + add_error.value() + "\n" : "ok\n";
+    }
+
+    if (verb == "remove-port" && !argument.empty() && value.empty()) {
+        std::optional<std::string> remove_error = remove_port(argument);
+        return remove_error.has_value() ? "error: " + remove_error.value() + "\n" : "ok\n";
+    }
+
+    if (verb == "show-ports" && argument.empty()) {
+        std::lock_guard lock{port_set_mutex};
+        const PortSet& set = *port_set.get();
+        std::string reply;
+        for (size_t port : set.active_ports) {
+            reply += std::to_string(port) + " " + ports[port]->interface_name + " " +
+                     ports[port]->backend();
+            if (!set.port_vlans.empty()) {
+                reply += " " + describe_vlans(set.port_vlans[port]);
+            }
+            reply += "\n";
+        }
+        return reply;
+    }
+
+    if (verb == "show-mac-table" && argument.empty()) {
+        const std::vector<std::string> names = [&] {
+            std::lock_guard lock{port_set_mutex};
+            return port_names();
+        }();
+
+        std::string reply;
+        for (const MacTable::Entry& entry : mac_address_table.entries()) {
+            reply += entry.mac_address.readable_string() + " " + std::to_string(entry.vlan) + " " +
+                     names[entry.port] + " " + std::to_string(entry.age) + "\n";
+        }
+        return reply;
+    }
+
+    if (verb == "flush-mac-table" && value.empty()) {
+        if (argument.empty()) {
+            mac_address_table.flush();
+            return "ok\n";
+        }
+
+        std::lock_guard lock{port_set_mutex};
+        for (size_t port = 0; port < ports.size(); ++port) {
+            if (ports[port] && ports[port]->interface_name == argument) {
+                mac_address_table.flush_port(port);
+                return "ok\n";
+            }
+        }
+        return "error: No port " + argument + " on the switch\n";
+    }
+
+    if (verb == "show-acl" && argument.empty()) {
+        std::lock_guard lock{port_set_mutex};
+        const std::shared_ptr<const AccessList>& access_list = port_set.get()->access_list;
+        std::string reply;
+        for (size_t rule = 0; access_list && rule < access_list->size(); ++rule) {
+            reply += std::to_string(rule) + " " + std::to_string(access_list->hits(rule)) + " " +
+                     access_list->rule(rule).text + "\n";
+        }
+        return reply;
+    }
+
+    // The new rules are compiled before they're swapped in, so forwarding never waits on them
+    if (verb == "reload-acl" && argument.empty()) {
+        if (config.acl_path.empty()) {
+            return "error: No ACL path configured\n";
+        }
+
+        std::lock_guard lock{port_set_mutex};
+        std::unique_ptr<PortSet> set = std::make_unique<PortSet>(*port_set.get());
+        std::optional<std::string> error = load_access_list(set->access_list);
+        if (error.has_value()) {
+            return "error: " + error.value() + "\n";
+        }
+        publish_port_set(std::move(set));
+        return "ok\n";
+    }
+
+    if (verb == "save-mac-table" && argument.empty()) {
+        if (config.mac_snapshot_path.empty()) {
+            return "error: No MAC table snapshot path configured\n";
+        }
+        if (!save_mac_table()) {
+            return "error: Failed to write " + config.mac_snapshot_path + ": " + strerror(errno) +
+                   "\n";
+        }
+        return "ok\n";
+    }
+
+    if (verb == "set" && !value.empty()) {
+        size_t count = 0;
+        if (argument == "mac-aging") {
+            if (!parse_count(value, count) || count > UINT32_MAX) {
+                return "error: Invalid MAC aging time '" + value + "'\n";
+            }
+            mac_address_table.set_aging_timeout(count);
+            return "ok\n";
+        }
+
+        if (argument == "idle-polls") {
+            if (value == "never") {
+                count = SwitchConfig::NEVER_SLEEP;
+            } else if (!parse_count(value, count)) {
+                return "error: Invalid number of idle polls '" + value + "'\n";
+            }
+            idle_polls_before_sleep.store(count, std::memory_order_relaxed);
+            return "ok\n";
+        }
+
+        if (argument == "class-weights") {
+            std::array<size_t, TRAFFIC_CLASS_COUNT> weights;
+            size_t start = 0;
+            for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+                const size_t end = std::min(value.find(',', start), value.size());
+                const bool last = traffic_class + 1 == TRAFFIC_CLASS_COUNT;
+                if (!parse_count(value.substr(start, end - start), weights[traffic_class]) ||
+                    weights[traffic_class] == 0 || (end == value.size()) != last) {
+                    return "error: Expected " + std::to_string(TRAFFIC_CLASS_COUNT) +
+                           " traffic class weights of at least 1, but got '" + value + "'\n";
+                }
+                start = end + 1;
+            }
+
+            for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+                class_weights[traffic_class].store(
+                    weights[traffic_class], std::memory_order_relaxed
+                );
+            }
+            return "ok\n";
+        }
+    }
+
+    if (verb == "show-tunables" && argument.empty()) {
+        const size_t idle_polls = idle_polls_before_sleep.load(std::memory_order_relaxed);
+        std::string reply = "mac-aging " +
+                            std::to_string(mac_address_table.get_aging_timeout()) +
+                            "\nidle-polls " +
+                            (idle_polls == SwitchConfig::NEVER_SLEEP ? "never"
+                                                                     : std::to_string(idle_polls)) +
+                            "\nclass-weights ";
+        for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+            reply += std::to_string(class_weights[traffic_class].load(std::memory_order_relaxed));
+            reply += traffic_class + 1 < TRAFFIC_CLASS_COUNT ? "," : "\n";
+        }
+        return reply;
+    }
+
+    return "error: Unknown command '" + command +
+           "'. Expected add-port, remove-port, show-ports, show-mac-table, flush-mac-table, set "
+           "mac-aging|idle-polls|class-weights, show-tunables, save-mac-table, show-acl or "
+           "reload-acl\n";
+}
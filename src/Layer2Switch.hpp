@@ -1,20 +1,36 @@
 #pragma once
 
-#include <unordered_map>
 #include <vector>
-#include <queue>
-#include <mutex>
 #include <utility>
 #include <thread>
 #include <cstdint>
 #include <atomic>
 #include <memory>
+#include <optional>
+#include <mutex>
+#include <string>
 #include <gtest/gtest_prod.h>
 
 #include "MacAddress.hpp"
-#include "MacAddressHash.hpp"
+#include "MacTable.hpp"
 #include "EthernetPort.hpp"
 #include "Frame.hpp"
+#include "SpscRing.hpp"
+#include "IdleNotifier.hpp"
+#include "SwitchConfig.hpp"
+#include "TrafficClass.hpp"
+#include "Metrics.hpp"
+#include "MetricsServer.hpp"
+#include "StormControl.hpp"
+#include "SpanningTree.hpp"
+#include "MulticastSnooping.hpp"
+#include "LinkAggregation.hpp"
+#include "PacketCapture.hpp"
+#include "PortBitmap.hpp"
+#include "Vlan.hpp"
+#include "RcuPointer.hpp"
+#include "ControlServer.hpp"
+#include "AccessList.hpp"
 
 /*
  * Class encapsulating data structures and switching logic for a simulated layer 2 network switch.
@@ -23,52 +39,384 @@ class Layer2Switch {
     FRIEND_TEST(Layer2SwitchTests, SwitchImplTests);
     FRIEND_TEST(Layer2SwitchTests, ReceiveFrameFailureTests);
     FRIEND_TEST(Layer2SwitchTests, SendFrameFailureTests);
+    FRIEND_TEST(Layer2SwitchTests, BatchedFloodTests);
+    FRIEND_TEST(Layer2SwitchTests, ShardedForwardingTests);
+    FRIEND_TEST(Layer2SwitchTests, ReactorTests);
+    FRIEND_TEST(Layer2SwitchTests, HeadDropTests);
+    FRIEND_TEST(Layer2SwitchTests, PauseTests);
+    FRIEND_TEST(Layer2SwitchTests, StrictPriorityTests);
+    FRIEND_TEST(Layer2SwitchTests, DeficitRoundRobinTests);
+    FRIEND_TEST(Layer2SwitchTests, StormControlTests);
+    FRIEND_TEST(Layer2SwitchTests, StormShutdownTests);
+    FRIEND_TEST(Layer2SwitchTests, SpanningTreeTests);
+    FRIEND_TEST(Layer2SwitchTests, MulticastSnoopingTests);
+    FRIEND_TEST(Layer2SwitchTests, VlanTests);
+    FRIEND_TEST(Layer2SwitchTests, PartialFloodTests);
+    FRIEND_TEST(Layer2SwitchTests, LinkAggregationTests);
+    FRIEND_TEST(Layer2SwitchTests, MirrorTests);
+    FRIEND_TEST(Layer2SwitchTests, AddRemovePortTests);
+    FRIEND_TEST(Layer2SwitchTests, ControlCommandTests);
+    FRIEND_TEST(Layer2SwitchTests, MacSnapshotTests);
+    FRIEND_TEST(Layer2SwitchTests, AccessListTests);
+
+    // Drives the switch's workers directly on in-memory ports. See tests/bench
+    friend class Layer2SwitchBench;
 
 private:
+    // A frame switched to a port in the current batch, waiting to be handed to the port
+    struct QueuedFrame {
+        const Frame* frame;
+        TrafficClass traffic_class;
+
+        // Index into the shard's floods of the flood this frame is part of, if it was flooded
+        std::optional<uint32_t> flood;
+    };
+
+    // Where a port's received or sent frames are mirrored to
+    struct MirrorTargets {
+        PortBitmap ports;
+
+        // Indices into captures
+        std::vector<size_t> captures;
+    };
+
+    // A frame flooded in the current batch, and whether any port it was flooded to failed to send
+    struct Flood {
+        size_t ingress_port;
+        bool incomplete;
+    };
+
+    /*
+     * The ports the data path switches between, as one immutable snapshot. A port is added or
+     * removed by building a new snapshot and publishing it to every shard with read-copy-update, so
+     * no thread that switches frames ever takes a lock for it.
+     */
+    struct PortSet {
+        /*
+         * Each shard's socket (or, for a reactor, transmit handle) on each port slot, indexed by
+         * shard and then the same as Layer2Switch::ports. Null for slots that are free.
+         */
+        std::vector<std::vector<std::shared_ptr<EthernetPort>>> shard_ports;
+
+        // Slots that hold a port, in ascending order
+        std::vector<size_t> active_ports;
+
+        // VLANs each slot carries. Empty unless the switch has VLANs
+        std::vector<PortVlans> port_vlans;
+
+        // Reactor that owns each slot. Empty unless reactors are configured
+        std::vector<size_t> port_reactors;
+
+        /*
+         * Ports a frame is flooded to for every VLAN: every port carrying the VLAN, which flooding
+         * leaves the ingress port out of. Only VLANs some port carries get sets, so a switch
+         * without VLANs has a single set.
+         */
+        std::vector<PortBitmap> flood_sets;
+
+        // Index of each VLAN's set in flood_sets
+        std::vector<uint16_t> flood_set_vlans;
+
+        // ACL frames are classified by once they're in their VLAN. Null unless one's loaded
+        std::shared_ptr<const AccessList> access_list;
+
+        /*
+         * Slot each ACL rule redirects or mirrors frames to, if it names a port that's on the
+         * switch. Indexed the same as the ACL's rules.
+         */
+        std::vector<std::optional<size_t>> access_list_ports;
+
+        // Bumped by every change, so threads can tell when they need to pick up new sockets
+        uint64_t version = 0;
+    };
+
+    /*
+     * State owned by a single thread that switches frames. Each such thread transmits through its
+     * own port objects, so transmit batches are never shared between threads. The main switch loop
+     * uses the first shard, which holds the ports the switch was created with.
+     */
+    struct ForwardingShard {
+        // Index of this shard, which is also its reader index in port_set
+        size_t index;
+
+        /*
+         * The port set this shard is switching with, as of its last enter_port_set(). Only valid
+         * until the matching exit_port_set().
+         */
+        const PortSet* port_set;
+
+        // Wakes a forwarding worker up to pick up a new port set. Unused by other shards
+        int wake_fd = -1;
+
+        // Epoll instance a reactor waits on its ports with. Unused by other shards
+        int epoll_fd = -1;
+
+        // This shard's socket on the given port, which must be in its current port set
+        EthernetPort& port(size_t p) const {
+            return *port_set->shard_ports[index][p];
+        }
+
+        /*
+         * For each port, the frames switched to it in the current batch, by traffic class. They're
+         * handed to the port in the order the scheduler picks when the batch is flushed.
+         */
+        std::vector<std::array<std::vector<QueuedFrame>, TRAFFIC_CLASS_COUNT>> egress_queues;
+
+        // Frames being flushed to a single port, in the order they're handed to the port
+        std::vector<QueuedFrame> transmit_order;
+
+        /*
+         * Frames received by a sharded forwarding worker that are queued for transmit but haven't
+         * been flushed yet. Reserved up front and never grows past SWITCH_BATCH_SIZE so the
+         * frames don't move while ports hold pointers to them.
+         */
+        std::vector<Frame> received_frames;
+
+        // Every frame flooded in the current batch, so floods that missed a port can be counted
+        std::vector<Flood> floods;
+
+        // Ports the multicast frame being switched should go to, as picked by snooping
+        PortBitmap multicast_egress;
+
+        // Mirror destination ports the frame being switched should be copied to
+        PortBitmap mirror_egress;
+
+        // Metrics recorded by the thread that owns this shard
+        ThreadMetrics* metrics;
+    };
+
+    // Tunables this switch was created with
+    const SwitchConfig config;
+
     /*
-     * Maps a MAC address to a physical port. a.k.a, a CAM table. This table will be auto-populated
-     * as frames pass through the switch.
+     * Maximum number of frames pulled off the input queues and switched together. Output for a
+     * batch is gathered per destination port and flushed once, so each port must be able to hold a
+     * full batch.
      */
-    std::unordered_map<MacAddress, std::shared_ptr<EthernetPort>, MacAddressHash> mac_address_table;
+    static constexpr size_t SWITCH_BATCH_SIZE = EthernetPort::TX_BATCH_SIZE;
+
+    // Maximum number of ready ports a reactor picks up from a single epoll_wait()
+    static constexpr size_t REACTOR_EVENTS = 64;
 
-    // List of all simulated ethernet ports on this switch
+    // Bytes a traffic class of weight one may send per deficit round robin round: one full frame
+    static constexpr size_t DRR_QUANTUM = ETH_FRAME_LEN;
+
+    /*
+     * Maps a MAC address to the index of a physical port in ports. a.k.a, a CAM table. This table
+     * will be auto-populated as frames pass through the switch, and is shared by every forwarding
+     * worker.
+     */
+    MacTable mac_address_table;
+
+    /*
+     * Every port slot on this switch, holding the port in it or null if it's free. Only changed
+     * while holding port_set_mutex, and only read by the data path through port_set.
+     */
     std::vector<std::shared_ptr<EthernetPort>> ports;
 
-    // Queues up Frames acquired from various receiver threads
-    std::queue<std::pair<Frame, std::shared_ptr<EthernetPort>>> input_queue;
+    /*
+     * Serializes changes to the ports, and everything outside the data path that reads them: the
+     * control socket, the metrics collectors and the storm control worker
+     */
+    mutable std::mutex port_set_mutex;
+
+    // The ports the data path switches between, followed by one reader per shard
+    RcuPointer<PortSet> port_set;
+
+    /*
+     * One input queue per port and traffic class, indexed by input_queue_index(). Each queue is
+     * filled by its port's receiver thread and drained by the main switch loop, so no two receivers
+     * ever contend, and a class's frames never wait behind lower priority ones.
+     */
+    std::vector<std::unique_ptr<SpscRing<Frame>>> input_queues;
+
+    /*
+     * For each input queue, the number of frames its receiver has asked the main switch loop to
+     * drop from the front of the queue to make room. Only used with QueueFullPolicy::HEAD_DROP,
+     * since only the consumer of a queue can pop from it.
+     */
+    std::unique_ptr<std::atomic_size_t[]> head_drop_requests;
+
+    // Used by receiver threads to wake up the main switch loop when it's sleeping on empty queues
+    IdleNotifier idle_notifier;
+
+    /*
+     * Number of frames taken from each input queue for the batch currently being switched. Frames
+     * are switched in place and ports hold pointers to them until they're flushed, so they're only
+     * popped off the input queues once the whole batch is done.
+     */
+    std::vector<size_t> batch_counts;
+
+    /*
+     * Index into the active ports of the port the next batch starts from, rotated so that no port
+     * can starve the others
+     */
+    size_t next_input_queue;
+
+    /*
+     * Bytes each traffic class may still take from the input queues under deficit round robin,
+     * indexed by TrafficClass
+     */
+    std::array<size_t, TRAFFIC_CLASS_COUNT> ingress_deficits;
+
+    // One shard per thread that switches frames. See ForwardingShard
+    std::vector<ForwardingShard> shards;
+
+    /*
+     * Tunables that can be changed from the control socket while the switch is running, starting
+     * out as configured. The data path reads them relaxed, so a change is picked up within a batch.
+     */
+    std::atomic_size_t idle_polls_before_sleep;
+    std::array<std::atomic_size_t, TRAFFIC_CLASS_COUNT> class_weights;
+
+    /*
+     * Receiver thread of each port slot, and the eventfd that stops it so its port can be removed.
+     * Only used in queued mode, and the eventfds only when a control socket is configured.
+     */
+    std::vector<std::jthread> receivers;
+    std::vector<int> receiver_stop_fds;
+
+    // Whether start() has been called, after which ports that are added get started right away
+    bool started;
+
+    /*
+     * Every data path thread's metrics. Each thread only ever writes its own, so counting frames
+     * never bounces a cache line between threads.
+     */
+    SwitchMetrics metrics;
+
+    // Metrics for each port's receiver thread, indexed the same as ports. Only used in queued mode
+    std::vector<ThreadMetrics*> receiver_metrics;
 
-    // Mutex for the input queue
-    std::mutex input_queue_mutex;
+    // Serves metrics over a Unix socket. Only created when a metrics socket is configured
+    std::unique_ptr<MetricsServer> metrics_server;
 
-    // Counts the number of frames received
-    std::atomic_uint64_t received_frames_count;
+    // Rate limits on flooded traffic received on each port
+    StormControl storm_control;
+
+    /*
+     * Whether storm control has shut each port down, indexed the same as ports. Frames received on
+     * or switched to a port that's shut down are dropped.
+     */
+    std::unique_ptr<std::atomic_bool[]> port_shut_down;
 
-    // Counts the number of frames sent
-    std::atomic_uint64_t sent_frames_count;
+    /*
+     * State of the storm control worker, indexed the same as ports: the number of frames it last
+     * saw suppressed on each port, and the uptime at which each shut down port comes back
+     */
+    std::vector<uint64_t> last_storm_suppressed_counts;
+    std::vector<uint32_t> port_shut_down_until;
 
-    // Counts number of socket send errors while sending directly (i.e., not flooding)
-    std::atomic_uint64_t send_errors_count;
+    // Metrics recorded by the storm control worker
+    ThreadMetrics* storm_control_metrics;
 
-    // Counts number of socket send errors while flooding
-    std::atomic_uint64_t flood_errors_count;
+    /*
+     * Runs the Rapid Spanning Tree Protocol with the switch's neighbours. Only created when
+     * spanning tree is enabled. Every port forwards when it isn't.
+     */
+    std::unique_ptr<SpanningTree> spanning_tree;
 
     /*
-     * Counts the number of times frames are "flooded", either from a MAC table lookup miss or
-     * because a broadcast MAC was received.
+     * Transmit handles BPDUs and LACPDUs are sent through, indexed the same as ports, so control
+     * protocols never share a transmit batch with a data path thread. Empty unless spanning tree or
+     * link aggregation is enabled.
      */
-    std::atomic_uint64_t flood_count;
+    std::vector<std::shared_ptr<EthernetPort>> control_ports;
 
-    // Counts the number of socket read errors
-    std::atomic_uint64_t read_errors_count;
+    /*
+     * Which ports want which multicast groups, learned from IGMP and MLD. Only created when
+     * multicast snooping is enabled. Multicast is flooded when it isn't.
+     */
+    std::unique_ptr<MulticastSnooping> multicast_snooping;
 
+    /*
+     * Bundles ports into LAGs that the rest of the switch sees as their aggregate port. Only
+     * created when some port is in a LAG.
+     */
+    std::unique_ptr<LinkAggregation> link_aggregation;
+
+    /*
+     * Where the frames received and sent on each port are mirrored to, indexed the same as ports.
+     * Empty unless some mirror session is configured.
+     */
+    std::vector<MirrorTargets> ingress_mirrors;
+    std::vector<MirrorTargets> egress_mirrors;
+
+    // Ports that only send mirrored frames
+    PortBitmap mirror_destinations;
+
+    // pcapng files mirror sessions write to, each fed by every shard and written by capture_worker
+    std::vector<std::unique_ptr<PacketCapture>> captures;
+
+    // Takes commands over a Unix socket. Only created when a control socket is configured
+    std::unique_ptr<ControlServer> control_server;
+
+    size_t queued_frame_count() const;
+    MacAddress bridge_address() const;
+    bool port_forwarding(size_t) const;
+    static bool port_in_vlan(const PortSet&, size_t, uint16_t);
+    void build_flood_sets(PortSet&) const;
+    void build_mirror_targets();
+    static const PortBitmap& flood_set(const PortSet&, uint16_t);
+    std::optional<std::string> open_shard_ports(PortSet&, size_t) const;
+    std::optional<std::string> load_access_list(std::shared_ptr<const AccessList>&) const;
+    void resolve_access_list_ports(PortSet&) const;
+    void publish_port_set(std::unique_ptr<PortSet>);
+    bool watch_port(const PortSet&, size_t);
+    void enter_port_set(ForwardingShard&);
+    void exit_port_set(ForwardingShard&);
+    std::vector<std::string> port_names() const;
+    static size_t input_queue_index(size_t, size_t);
+    void wait_for_frames();
+    void drop_requested_frames();
+    void enqueue_received_frame(size_t, const FrameView&, uint64_t);
+    bool input_class_waiting(size_t) const;
+    size_t switch_input_class(size_t, size_t, uint64_t);
     void switch_impl();
+    void switch_frame(ForwardingShard&, Frame&, size_t, TrafficClass);
+    void forward_frame(ForwardingShard&, Frame&, size_t, TrafficClass);
+    void mirror_frame(
+        ForwardingShard&, const MirrorTargets&, const Frame&, size_t, bool, std::optional<uint16_t>
+    );
+    static bool acl_denies(const PortSet&, const Frame&, uint16_t);
+    bool acl_port_can_send(const PortSet&, size_t, size_t, uint16_t) const;
+    void flood_frame(ForwardingShard&, const PortBitmap&, const Frame&, size_t, TrafficClass);
+    void queue_frame(ForwardingShard&, size_t, const Frame&, TrafficClass, std::optional<uint32_t>);
+    void schedule_egress(ForwardingShard&, size_t);
+    void flush_ports(ForwardingShard&);
     void metric_worker();
-    void frame_receiver_worker_impl(const std::shared_ptr<EthernetPort>&);
-    void frame_receiver_worker(const std::shared_ptr<EthernetPort>&);
+    void metrics_server_worker();
+    void mac_aging_worker();
+    void restore_mac_table();
+    bool save_mac_table();
+    void mac_snapshot_worker();
+    void enforce_storm_shutdowns(uint32_t);
+    void storm_control_worker();
+    void spanning_tree_worker();
+    void send_bpdu(size_t, const Frame&);
+    void link_aggregation_worker();
+    void capture_worker();
+    void control_server_worker();
+    void start_receiver(size_t);
+    void frame_receiver_worker_impl(size_t);
+    void frame_receiver_worker(size_t);
+    size_t forwarding_worker_impl(size_t, size_t);
+    void pin_to_cpu(size_t, const char*);
+    void drain_port(size_t, size_t);
+    void forwarding_worker(size_t);
+    void reactor_worker(size_t);
 
 public:
-    Layer2Switch(const std::vector<std::shared_ptr<EthernetPort>>&);
+    Layer2Switch(const std::vector<std::shared_ptr<EthernetPort>>&, const SwitchConfig& = {});
     ~Layer2Switch();
 
     void start();
+
+    std::optional<std::string> add_port(
+        const std::shared_ptr<EthernetPort>&, const std::optional<PortVlans>& = {}
+    );
+    std::optional<std::string> remove_port(const std::string&);
+    std::string execute_command(const std::string&);
+
+    MetricsSnapshot collect_metrics() const;
 };
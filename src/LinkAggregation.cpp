@@ -0,0 +1,411 @@
+#include <syslog.h>
+#include <algorithm>
+#include <array>
+
+#include "LinkAggregation.hpp"
+
+// Slow protocols EtherType, and the LACP subtype and version within it
+static constexpr uint16_t SLOW_PROTOCOLS_ETHER_TYPE = 0x8809;
+static constexpr uint8_t LACP_SUBTYPE = 0x01;
+static constexpr uint8_t LACP_VERSION = 0x01;
+
+// Where each TLV starts in a LACPDU frame, and the type and length each one must have
+static constexpr size_t ACTOR_OFFSET = 16;
+static constexpr size_t PARTNER_OFFSET = 36;
+static constexpr size_t COLLECTOR_OFFSET = 56;
+static constexpr size_t TERMINATOR_OFFSET = 72;
+static constexpr uint8_t ACTOR_TLV = 0x01;
+static constexpr uint8_t PARTNER_TLV = 0x02;
+static constexpr uint8_t COLLECTOR_TLV = 0x03;
+static constexpr uint8_t INFO_TLV_SIZE = 20;
+static constexpr uint8_t COLLECTOR_TLV_SIZE = 16;
+
+// Number of LACPDU frames that can be in flight at once before falling back to the heap
+static constexpr size_t LACPDU_POOL_SIZE = 16;
+
+// Offsets of the IP headers and the transport ports the flow hash looks at
+static constexpr size_t IP_OFFSET = 14;
+static constexpr size_t IPV4_MIN_HEADER_SIZE = 20;
+static constexpr size_t IPV6_HEADER_SIZE = 40;
+static constexpr uint8_t IPPROTO_TCP_NUMBER = 6;
+static constexpr uint8_t IPPROTO_UDP_NUMBER = 17;
+
+static constexpr uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325;
+static constexpr uint64_t FNV_PRIME = 0x100000001B3;
+
+static uint64_t read_big_endian(const unsigned char* bytes, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) { value = value << 8 | bytes[i]; }
+    return value;
+}
+
+static void write_big_endian(unsigned char* bytes, uint64_t value, size_t size) {
+    for (size_t i = size; i-- > 0;) {
+        bytes[i] = (unsigned char)value;
+        value >>= 8;
+    }
+}
+
+// Reads the actor or partner information TLV at the given offset of a LACPDU
+static LacpInfo read_info(const unsigned char* tlv) {
+    return {
+        read_big_endian(tlv + 2, 8), (uint16_t)read_big_endian(tlv + 10, 2),
+        (uint32_t)read_big_endian(tlv + 12, 4), tlv[16]
+    };
+}
+
+static void write_info(unsigned char* tlv, uint8_t type, const LacpInfo& info) {
+    tlv[0] = type;
+    tlv[1] = INFO_TLV_SIZE;
+    write_big_endian(tlv + 2, info.system, 8);
+    write_big_endian(tlv + 10, info.key, 2);
+    write_big_endian(tlv + 12, info.port, 4);
+    tlv[16] = info.state;
+}
+
+/*
+ * Hashes the flow a frame belongs to: its MACs, plus its IP addresses and protocol if it's IPv4 or
+ * IPv6, plus its TCP or UDP ports if it has them. Fragments after the first have no ports, so IPv4
+ * fragments are only hashed down to the protocol, which keeps a fragmented datagram together.
+ */
+uint32_t LinkAggregation::flow_hash(std::span<const unsigned char> frame) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    auto mix = [&](size_t offset, size_t size) {
+        for (size_t i = offset; i < offset + size; ++i) { hash = (hash ^ frame[i]) * FNV_PRIME; }
+    };
+
+    if (frame.size() < IP_OFFSET) {
+        mix(0, frame.size());
+        return (uint32_t)(hash ^ hash >> 32);
+    }
+    mix(0, 12);
+
+    const uint16_t ether_type = read_big_endian(&frame[12], 2);
+    std::optional<size_t> transport_offset;
+    uint8_t protocol = 0;
+    if (ether_type == 0x0800 && frame.size() >= IP_OFFSET + IPV4_MIN_HEADER_SIZE) {
+        protocol = frame[IP_OFFSET + 9];
+        mix(IP_OFFSET + 9, 1);
+        mix(IP_OFFSET + 12, 8);
+
+        const bool fragment = (read_big_endian(&frame[IP_OFFSET + 6], 2) & 0x3FFF) != 0;
+        if (!fragment) {
+            transport_offset = IP_OFFSET + (frame[IP_OFFSET] & 0x0F) * 4;
+        }
+    } else if (ether_type == 0x86DD && frame.size() >= IP_OFFSET + IPV6_HEADER_SIZE) {
+        protocol = frame[IP_OFFSET + 6];
+        mix(IP_OFFSET + 6, 1);
+        mix(IP_OFFSET + 8, 32);
+        transport_offset = IP_OFFSET + IPV6_HEADER_SIZE;
+    }
+
+    if (transport_offset.has_value() &&
+        (protocol == IPPROTO_TCP_NUMBER || protocol == IPPROTO_UDP_NUMBER) &&
+        frame.size() >= transport_offset.value() + 4) {
+        mix(transport_offset.value(), 4);
+    }
+
+    return (uint32_t)(hash ^ hash >> 32);
+}
+
+/*
+ * Creates the LAGs the given ports are in, indexed the same as the given port names, for a switch
+ * with the given MAC. Ports in LAG NO_LAG aren't aggregated. Each LAG's number doubles as its LACP
+ * key. Static LAGs start out with every member active, and LACP LAGs with none.
+ */
+LinkAggregation::LinkAggregation(
+    MacAddress address, const std::vector<uint16_t>& port_lags,
+    const std::vector<std::string>& names, bool use_lacp, LacpduSender sender
+)
+    : system_address{address},
+      system_id{(uint64_t)LinkAggregation::DEFAULT_SYSTEM_PRIORITY << 48 |
+                address.int_representation()},
+      port_names{names},
+      lacp{use_lacp},
+      send_lacpdu{std::move(sender)},
+      aggregate_ports(names.size()),
+      lag_members(names.size()),
+      members(names.size()),
+      active_ports{std::make_unique<std::atomic_bool[]>(names.size())},
+      lacpdu_pool{LACPDU_POOL_SIZE} {
+    for (size_t port = 0; port < names.size(); ++port) {
+        members[port].lag = port_lags[port];
+        aggregate_ports[port] = port;
+        for (size_t other = 0; other < port && members[port].lag != LinkAggregation::NO_LAG;
+             ++other) {
+            if (members[other].lag == members[port].lag) {
+                aggregate_ports[port] = aggregate_ports[other];
+                break;
+            }
+        }
+        lag_members[aggregate_ports[port]].push_back(port);
+        active_ports[port].store(!lacp || !in_lag(port), std::memory_order_relaxed);
+    }
+}
+
+// Whether the given port is in a LAG
+bool LinkAggregation::in_lag(size_t port) const {
+    return members[port].lag != LinkAggregation::NO_LAG;
+}
+
+/*
+ * Picks the active member of the given aggregate port's LAG that a frame is sent out of, by its
+ * flow hash. Returns an empty optional if no member is active.
+ */
+std::optional<size_t> LinkAggregation::egress_port(
+    size_t port, std::span<const unsigned char> frame
+) const {
+    const std::vector<size_t>& lag = lag_members[port];
+    if (lag.size() == 1) {
+        return is_active(lag[0]) ? std::optional<size_t>{lag[0]} : std::nullopt;
+    }
+
+    const size_t active = active_members(port);
+    if (active == 0) {
+        return {};
+    }
+
+    // A member that goes inactive in the meantime just means the pick lands on the next one
+    size_t pick = active == 1 ? 0 : LinkAggregation::flow_hash(frame) % active;
+    std::optional<size_t> fallback;
+    for (size_t member : lag) {
+        if (!is_active(member)) {
+            continue;
+        }
+        if (pick-- == 0) {
+            return member;
+        }
+        fallback = member;
+    }
+    return fallback;
+}
+
+// Number of members of the given aggregate port's LAG that are currently active
+size_t LinkAggregation::active_members(size_t port) const {
+    size_t active = 0;
+    for (size_t member : lag_members[port]) { active += is_active(member); }
+    return active;
+}
+
+// What the given member says about itself in its LACPDUs. Must hold the lock
+LacpInfo LinkAggregation::actor_info(size_t port) const {
+    const Member& member = members[port];
+    uint8_t state = LinkAggregation::STATE_ACTIVITY | LinkAggregation::STATE_TIMEOUT |
+                    LinkAggregation::STATE_AGGREGATION;
+    if (member.selected) {
+        state |= LinkAggregation::STATE_SYNCHRONIZATION;
+    }
+    if (is_active(port)) {
+        state |= LinkAggregation::STATE_COLLECTING | LinkAggregation::STATE_DISTRIBUTING;
+    }
+    if (!member.partner.has_value()) {
+        state |= LinkAggregation::STATE_DEFAULTED;
+    }
+
+    return {
+        system_id, member.lag,
+        (uint32_t)LinkAggregation::DEFAULT_PORT_PRIORITY << 16 | (uint16_t)(port + 1), state
+    };
+}
+
+/*
+ * Reselects every LAG's members and works out which are active. A LAG's partner is the partner of
+ * its lowest numbered member that has one willing to aggregate, and only the members with that
+ * same partner are selected. A selected LACP member goes active once its partner has heard from it
+ * and says it's in sync too. Must hold the lock.
+ */
+void LinkAggregation::update() {
+    for (size_t port = 0; port < members.size(); ++port) {
+        if (!in_lag(port) || aggregate_ports[port] != port) {
+            continue;
+        }
+
+        std::optional<LacpInfo> lag_partner;
+        for (size_t member : lag_members[port]) {
+            const Member& info = members[member];
+            if (info.link_up && info.partner.has_value() &&
+                (info.partner->state & LinkAggregation::STATE_AGGREGATION)) {
+                lag_partner = info.partner;
+                break;
+            }
+        }
+
+        for (size_t member : lag_members[port]) {
+            Member& info = members[member];
+            if (!lacp) {
+                set_active(member, info.link_up);
+                continue;
+            }
+
+            const uint8_t previous_state = actor_info(member).state;
+            info.selected = info.link_up && info.partner.has_value() && lag_partner.has_value() &&
+                            (info.partner->state & LinkAggregation::STATE_AGGREGATION) &&
+                            info.partner->system == lag_partner->system &&
+                            info.partner->key == lag_partner->key;
+            set_active(
+                member, info.selected && info.partner_view_current &&
+                            (info.partner->state & LinkAggregation::STATE_SYNCHRONIZATION)
+            );
+
+            if (actor_info(member).state != previous_state) {
+                info.send_pending = true;
+            }
+        }
+    }
+}
+
+// Marks the given member active or not, logging the change. Must hold the lock
+void LinkAggregation::set_active(size_t port, bool active) {
+    if (is_active(port) == active) {
+        return;
+    }
+
+    active_ports[port].store(active, std::memory_order_relaxed);
+    syslog(
+        LOG_INFO, "Port %s %s LAG %d", port_names[port].c_str(), active ? "joined" : "left",
+        members[port].lag
+    );
+}
+
+// Sends a LACPDU describing the given member and its partner on it. Must hold the lock
+void LinkAggregation::transmit(size_t port) {
+    const Member& member = members[port];
+
+    std::array<unsigned char, LinkAggregation::LACPDU_FRAME_SIZE> frame{};
+    std::ranges::copy(LinkAggregation::SLOW_PROTOCOLS_ADDRESS.raw_octets(), frame.begin());
+    std::ranges::copy(system_address.raw_octets(), frame.begin() + 6);
+    write_big_endian(&frame[12], SLOW_PROTOCOLS_ETHER_TYPE, 2);
+    frame[14] = LACP_SUBTYPE;
+    frame[15] = LACP_VERSION;
+
+    write_info(&frame[ACTOR_OFFSET], ACTOR_TLV, actor_info(port));
+    write_info(&frame[PARTNER_OFFSET], PARTNER_TLV, member.partner.value_or(LacpInfo{}));
+    frame[COLLECTOR_OFFSET] = COLLECTOR_TLV;
+    frame[COLLECTOR_OFFSET + 1] = COLLECTOR_TLV_SIZE;
+
+    // The terminator TLV and the reserved bytes after it are all zero
+    send_lacpdu(port, Frame{lacpdu_pool, frame});
+}
+
+// Sends a LACPDU on every member that needs one after the current event. Must hold the lock
+void LinkAggregation::transmit_pending() {
+    for (size_t port = 0; port < members.size(); ++port) {
+        if (members[port].send_pending) {
+            members[port].send_pending = false;
+            if (members[port].link_up) {
+                transmit(port);
+            }
+        }
+    }
+}
+
+/*
+ * Tells the LAGs whether the given port's link is up. A member whose link goes down leaves its LAG
+ * straight away, and forgets its partner.
+ */
+void LinkAggregation::set_link_up(size_t port, bool link_up) {
+    std::lock_guard<std::mutex> g(mutex);
+    Member& member = members[port];
+    if (!in_lag(port) || member.link_up == link_up) {
+        return;
+    }
+
+    syslog(
+        LOG_INFO, "Link on LAG %d member %s went %s", member.lag, port_names[port].c_str(),
+        link_up ? "up" : "down"
+    );
+    member.link_up = link_up;
+    if (!link_up) {
+        member.partner.reset();
+        member.partner_view_current = false;
+    }
+    member.send_pending = lacp && link_up;
+
+    update();
+    transmit_pending();
+}
+
+/*
+ * Handles a frame sent to the slow protocols address on the given port. Frames that aren't valid
+ * LACPDUs, LACPDUs on ports that don't run LACP, and this switch's own LACPDUs looped back to it
+ * are ignored.
+ */
+void LinkAggregation::receive_lacpdu(size_t port, std::span<const unsigned char> frame) {
+    if (!lacp || !in_lag(port) || frame.size() < TERMINATOR_OFFSET ||
+        read_big_endian(&frame[12], 2) != SLOW_PROTOCOLS_ETHER_TYPE || frame[14] != LACP_SUBTYPE ||
+        frame[ACTOR_OFFSET] != ACTOR_TLV || frame[ACTOR_OFFSET + 1] != INFO_TLV_SIZE ||
+        frame[PARTNER_OFFSET] != PARTNER_TLV || frame[PARTNER_OFFSET + 1] != INFO_TLV_SIZE) {
+        return;
+    }
+
+    const LacpInfo actor = read_info(&frame[ACTOR_OFFSET]);
+    const LacpInfo partner = read_info(&frame[PARTNER_OFFSET]);
+    if (actor.system == system_id) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(mutex);
+    Member& member = members[port];
+    if (!member.link_up) {
+        return;
+    }
+
+    if (!member.partner.has_value()) {
+        syslog(
+            LOG_INFO, "LACP partner found on LAG %d member %s", member.lag, port_names[port].c_str()
+        );
+    }
+    member.partner = actor;
+    member.current_while = LinkAggregation::SHORT_TIMEOUT_TIME;
+
+    // The partner has to hear about this port as it is now before the port can join the LAG
+    const LacpInfo self = actor_info(port);
+    member.partner_view_current =
+        partner.system == self.system && partner.key == self.key && partner.port == self.port;
+    if (!member.partner_view_current || partner.state != self.state) {
+        member.send_pending = true;
+    }
+
+    update();
+    transmit_pending();
+}
+
+/*
+ * Advances every member's timers by a second, timing out partners that have gone quiet and sending
+ * periodic LACPDUs: every second while the partner asks for the short timeout, as this switch
+ * always does, or hasn't been heard from, and every 30 seconds otherwise
+ */
+void LinkAggregation::tick() {
+    std::lock_guard<std::mutex> g(mutex);
+    if (!lacp) {
+        return;
+    }
+
+    for (size_t port = 0; port < members.size(); ++port) {
+        Member& member = members[port];
+        if (!in_lag(port) || !member.link_up) {
+            continue;
+        }
+
+        if (member.partner.has_value() && --member.current_while == 0) {
+            syslog(
+                LOG_INFO, "LACP partner on LAG %d member %s timed out", member.lag,
+                port_names[port].c_str()
+            );
+            member.partner.reset();
+            member.partner_view_current = false;
+        }
+
+        if (--member.periodic_while == 0) {
+            member.send_pending = true;
+            member.periodic_while =
+                member.partner.has_value() &&
+                        !(member.partner->state & LinkAggregation::STATE_TIMEOUT)
+                    ? LinkAggregation::SLOW_PERIODIC_TIME
+                    : LinkAggregation::FAST_PERIODIC_TIME;
+        }
+    }
+
+    update();
+    transmit_pending();
+}
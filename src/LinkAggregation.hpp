@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Frame.hpp"
+#include "FramePool.hpp"
+#include "MacAddress.hpp"
+
+/*
+ * What one end of a link tells the other about itself in a LACPDU: the system it belongs to, the
+ * key of the aggregation it wants the link in, the port itself, and its LACP state bits
+ */
+struct LacpInfo {
+    // System priority in the upper 16 bits and system MAC in the lower 48
+    uint64_t system;
+    uint16_t key;
+
+    // Port priority in the upper 16 bits and port number in the lower 16
+    uint32_t port;
+    uint8_t state;
+};
+
+/*
+ * Link aggregation (802.1AX, formerly 802.3ad). Bundles ports into link aggregation groups (LAGs),
+ * each of which the rest of the switch treats as a single logical port: the LAG's aggregate port,
+ * which is its lowest numbered member. Frames received on any member are switched as if they came
+ * in on the aggregate port, and frames switched to the aggregate port go out of one of the members
+ * that's currently active, picked by a hash of the frame's flow so every flow stays in order.
+ *
+ * Static LAGs use every member whose link is up. With LACP, members are only used once the switch
+ * on the other end has agreed to aggregate them too. Every member sends LACPDUs asking for fast
+ * periodic LACPDUs and the short timeout, so a member whose partner goes quiet is dropped from its
+ * LAG within three seconds. Members whose partner isn't the LAG's partner, e.g. because they're
+ * cabled to a different switch, are left out. This covers the selection and mux logic of the
+ * standard with coupled control, i.e. collecting and distributing are always enabled together.
+ * The marker protocol isn't supported, so moving a flow between members may briefly reorder it.
+ *
+ * Like SpanningTree, this knows nothing about sockets. It hands LACPDUs to transmit to the given
+ * callback, and has to be told about received LACPDUs and link changes and ticked once a second.
+ * Every method is thread safe. Which members are active can be read on the fast path without
+ * taking the lock.
+ */
+class LinkAggregation {
+public:
+    // Destination MAC of every LACPDU, and of the other slow protocols
+    static constexpr MacAddress SLOW_PROTOCOLS_ADDRESS{0x01, 0x80, 0xC2, 0x00, 0x00, 0x02};
+
+    // LAG of a port that isn't in one
+    static constexpr uint16_t NO_LAG = 0;
+
+    static constexpr uint16_t DEFAULT_SYSTEM_PRIORITY = 32768;
+    static constexpr uint16_t DEFAULT_PORT_PRIORITY = 32768;
+
+    // Timers, in ticks of one second, with the 802.1AX defaults
+    static constexpr uint32_t FAST_PERIODIC_TIME = 1;
+    static constexpr uint32_t SLOW_PERIODIC_TIME = 30;
+    static constexpr uint32_t SHORT_TIMEOUT_TIME = 3;
+
+    // Bits of a LACPDU's actor and partner state
+    static constexpr uint8_t STATE_ACTIVITY = 0x01;
+    static constexpr uint8_t STATE_TIMEOUT = 0x02;
+    static constexpr uint8_t STATE_AGGREGATION = 0x04;
+    static constexpr uint8_t STATE_SYNCHRONIZATION = 0x08;
+    static constexpr uint8_t STATE_COLLECTING = 0x10;
+    static constexpr uint8_t STATE_DISTRIBUTING = 0x20;
+    static constexpr uint8_t STATE_DEFAULTED = 0x40;
+
+    // Transmits a LACPDU out of the given port
+    using LacpduSender = std::function<void(size_t, const Frame&)>;
+
+    static uint32_t flow_hash(std::span<const unsigned char>);
+
+private:
+    // Size of a frame carrying a LACPDU
+    static constexpr size_t LACPDU_FRAME_SIZE = 124;
+
+    struct Member {
+        uint16_t lag = LinkAggregation::NO_LAG;
+        bool link_up = true;
+
+        // What the partner last said about itself. Empty until it's heard from, or after a timeout
+        std::optional<LacpInfo> partner;
+
+        // Whether the partner's last LACPDU described this port as it is now
+        bool partner_view_current = false;
+
+        // Ticks until the partner's information times out
+        uint32_t current_while = 0;
+
+        // Ticks until the next periodic LACPDU
+        uint32_t periodic_while = LinkAggregation::FAST_PERIODIC_TIME;
+
+        // Whether the member's partner is the LAG's partner, so the member may join the LAG
+        bool selected = false;
+
+        // Whether a LACPDU should be sent on the member at the end of the current event
+        bool send_pending = false;
+    };
+
+    const MacAddress system_address;
+    const uint64_t system_id;
+    const std::vector<std::string> port_names;
+    const bool lacp;
+    const LacpduSender send_lacpdu;
+
+    // Each port's aggregate port: the lowest numbered member of its LAG, or the port itself
+    std::vector<size_t> aggregate_ports;
+
+    /*
+     * Members of each aggregate port's LAG, in ascending order. A port outside any LAG is the only
+     * member of its own. Empty for members that aren't their LAG's aggregate port.
+     */
+    std::vector<std::vector<size_t>> lag_members;
+
+    // Serializes every event. Which members are active is the only thing read without it
+    mutable std::mutex mutex;
+
+    std::vector<Member> members;
+
+    /*
+     * Whether each port may receive and send frames for its LAG, indexed the same as the switch's
+     * ports. Always set for ports outside any LAG. Written under the lock, read by anyone.
+     */
+    const std::unique_ptr<std::atomic_bool[]> active_ports;
+
+    // Pool LACPDUs are built in. Only allocated from under the lock
+    FramePool lacpdu_pool;
+
+    LacpInfo actor_info(size_t) const;
+    void update();
+    void set_active(size_t, bool);
+    void transmit(size_t);
+    void transmit_pending();
+
+public:
+    LinkAggregation(
+        MacAddress, const std::vector<uint16_t>&, const std::vector<std::string>&, bool,
+        LacpduSender
+    );
+
+    LinkAggregation(const LinkAggregation&) = delete;
+    LinkAggregation& operator=(const LinkAggregation&) = delete;
+
+    size_t aggregate_port(size_t port) const {
+        return aggregate_ports[port];
+    }
+
+    bool is_active(size_t port) const {
+        return active_ports[port].load(std::memory_order_relaxed);
+    }
+
+    std::optional<size_t> egress_port(size_t, std::span<const unsigned char>) const;
+    size_t active_members(size_t) const;
+    bool in_lag(size_t) const;
+
+    void set_link_up(size_t, bool);
+    void receive_lacpdu(size_t, std::span<const unsigned char>);
+    void tick();
+};
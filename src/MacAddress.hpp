@@ -1,16 +1,24 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <array>
+#include <bit>
 #include <string>
+#include <type_traits>
 
 #include "MacAddressHash.hpp"
 
 /*
  * Represents a MAC address.
+ *
+ * A MacAddress is just the 48-bit address packed into an integer, so it's 8 bytes, trivially
+ * copyable, and cheap enough to pass around by value on the hot path. Addresses are usually read
+ * straight out of a frame's ethernet header with a single unaligned load. The human-readable form
+ * is only built on demand, e.g. for logging.
  */
 class MacAddress {
-private:
+public:
     /*
      * Size of the string buffer used to hold the human-readable version of the MAC. It's written
      * this way for readability, and both clang and gcc will optimize this out to be a compile-time
@@ -18,27 +26,93 @@ private:
      */
     static constexpr size_t READABLE_STRING_BUFFER_SIZE = sizeof("00:00:00:00:00:00");
 
+private:
+    // The address in the low 48 bits, most significant octet first, e.g. 0x000000000000
+    uint64_t int_value;
+
+    // Bits of the first octet that mark group (multicast) and locally administered addresses
+    static constexpr uint64_t GROUP_BIT = 0x01ULL << 40;
+    static constexpr uint64_t LOCAL_BIT = 0x02ULL << 40;
+
+    static constexpr uint64_t BROADCAST = 0xFFFFFFFFFFFF;
+
+    static uint64_t load(const uint8_t* octets) {
+        // Compiles down to a single unaligned load (or a 4 + 2 byte pair) and a byte swap
+        uint64_t loaded = 0;
+        memcpy(&loaded, octets, 6);
+        if constexpr (std::endian::native == std::endian::little) {
+            return __builtin_bswap64(loaded) >> 16;
+        } else {
+            return loaded >> 16;
+        }
+    }
+
 public:
-    static std::string initialize_readable_string(const std::array<unsigned char, 6>&);
-    static uint64_t initialize_int_representation(const std::array<unsigned char, 6>&);
+    /*
+     * Constructs a new MacAddress object from each of the 6 octets of the address, most
+     * significant first. Mostly useful for constants and tests, e.g.:
+     *  constexpr MacAddress m(0x01, 0x80, 0xC2, 0x00, 0x00, 0x00);
+     */
+    constexpr MacAddress(
+        uint8_t octet1, uint8_t octet2, uint8_t octet3, uint8_t octet4, uint8_t octet5,
+        uint8_t octet6
+    )
+        : int_value{
+              (uint64_t)octet1 << 40 | (uint64_t)octet2 << 32 | (uint64_t)octet3 << 24 |
+              (uint64_t)octet4 << 16 | (uint64_t)octet5 << 8 | (uint64_t)octet6
+          } {
+    }
 
-    MacAddress(
-        unsigned char, unsigned char, unsigned char, unsigned char, unsigned char, unsigned char
-    );
+    /*
+     * Reads a MAC address from the 6 octets at the given location, e.g. the source or destination
+     * field of an ethernet header:
+     *  MacAddress m(eth_hdr->h_source);
+     */
+    explicit MacAddress(const uint8_t* octets)
+        : int_value{MacAddress::load(octets)} {
+    }
+
+    constexpr bool operator<(const MacAddress& other) const {
+        return int_value < other.int_value;
+    }
+
+    constexpr bool operator==(const MacAddress& other) const {
+        return int_value == other.int_value;
+    }
 
-    bool operator<(const MacAddress&) const;
-    bool operator==(const MacAddress&) const;
+    // Integer representation of the MAC, e.g. 0x000000000000
+    constexpr uint64_t int_representation() const {
+        return int_value;
+    }
 
     // Representation of the MAC via its 6 octets
-    const std::array<uint8_t, 6> raw_octets;
+    constexpr std::array<uint8_t, 6> raw_octets() const {
+        return {
+            (uint8_t)(int_value >> 40), (uint8_t)(int_value >> 32), (uint8_t)(int_value >> 24),
+            (uint8_t)(int_value >> 16), (uint8_t)(int_value >> 8), (uint8_t)int_value
+        };
+    }
 
     // A human-readable representation of the MAC, e.g. "00:00:00:00:00:00"
-    std::string readable_string;
+    std::string readable_string() const;
 
-    // Integer representation of the MAC, e.g. 0x000000000000
-    uint64_t int_representation;
+    // Whether this is the broadcast MAC, i.e. FF:FF:FF:FF:FF:FF
+    constexpr bool is_broadcast() const {
+        return int_value == MacAddress::BROADCAST;
+    }
 
-    bool is_broadcast() const;
+    // Whether this is a group address, i.e. multicast or broadcast
+    constexpr bool is_multicast() const {
+        return (int_value & MacAddress::GROUP_BIT) != 0;
+    }
+
+    // Whether this address was assigned locally rather than by the manufacturer
+    constexpr bool is_locally_administered() const {
+        return (int_value & MacAddress::LOCAL_BIT) != 0;
+    }
 
     friend struct MacAddressHash;
 };
+
+static_assert(sizeof(MacAddress) == 8);
+static_assert(std::is_trivially_copyable_v<MacAddress>);
@@ -1,5 +1,5 @@
 #include "MacAddressHash.hpp"
 
 size_t MacAddressHash::operator()(const MacAddress& mac_address) const {
-    return mac_address.int_representation;
+    return mac_address.int_value;
 }
@@ -0,0 +1,226 @@
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+
+#include "MacSnapshot.hpp"
+#include "Vlan.hpp"
+
+static constexpr char MAGIC[8] = {'L', '2', 'M', 'A', 'C', 'T', 'B', 'L'};
+static constexpr uint32_t VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t port_count;
+    uint32_t entry_count;
+    uint32_t reserved;
+
+    // Wall clock time the snapshot was written at, in seconds since the epoch
+    uint64_t written_at;
+
+    // Checksum of everything after the header
+    uint64_t checksum;
+};
+
+// Port names are stored in fixed size, NUL padded slots, the same size as the kernel's
+struct SnapshotPortName {
+    char name[IFNAMSIZ];
+};
+
+struct SnapshotRecord {
+    uint8_t mac_address[6];
+    uint16_t vlan;
+
+    // Index of the entry's port among the snapshot's port names
+    uint16_t port;
+    uint16_t reserved;
+    uint32_t age;
+};
+
+static_assert(sizeof(SnapshotHeader) == 40);
+static_assert(sizeof(SnapshotRecord) == 16);
+
+// 64-bit FNV-1a, which catches truncated and corrupted snapshots well enough
+static uint64_t checksum(const unsigned char* bytes, size_t length) {
+    uint64_t hash = 0xCBF29CE484222325;
+    for (size_t i = 0; i < length; ++i) { hash = (hash ^ bytes[i]) * 0x100000001B3; }
+    return hash;
+}
+
+// Writes the whole buffer to the given file, retrying short writes. Returns false on failure
+static bool write_file(int fd, const unsigned char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+/*
+ * Writes the given entries to a snapshot at the given path, recording that it was written at the
+ * given wall clock time in seconds. The snapshot only replaces the last one once it's been written
+ * out in full. Returns false and leaves errno set if it couldn't be written.
+ */
+bool MacSnapshot::write(const std::string& path, const std::vector<Entry>& entries, uint64_t now) {
+    std::vector<SnapshotPortName> names;
+    std::unordered_map<std::string, uint16_t> name_indices;
+    std::vector<SnapshotRecord> records;
+    records.reserve(entries.size());
+
+    for (const Entry& entry : entries) {
+        auto [name_index, inserted] = name_indices.try_emplace(entry.port_name, names.size());
+        if (inserted) {
+            if (entry.port_name.size() >= IFNAMSIZ || names.size() > UINT16_MAX) {
+                errno = EINVAL;
+                return false;
+            }
+            SnapshotPortName name{};
+            memcpy(name.name, entry.port_name.data(), entry.port_name.size());
+            names.push_back(name);
+        }
+
+        SnapshotRecord record{};
+        const std::array<uint8_t, 6> octets = entry.mac_address.raw_octets();
+        std::copy(octets.begin(), octets.end(), record.mac_address);
+        record.vlan = entry.vlan;
+        record.port = name_index->second;
+        record.age = entry.age;
+        records.push_back(record);
+    }
+
+    const size_t names_size = names.size() * sizeof(SnapshotPortName);
+    const size_t records_size = records.size() * sizeof(SnapshotRecord);
+    std::vector<unsigned char> file(sizeof(SnapshotHeader) + names_size + records_size);
+    unsigned char* body = file.data() + sizeof(SnapshotHeader);
+    memcpy(body, names.data(), names_size);
+    memcpy(body + names_size, records.data(), records_size);
+
+    SnapshotHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.port_count = names.size();
+    header.entry_count = records.size();
+    header.written_at = now;
+    header.checksum = checksum(body, names_size + records_size);
+    memcpy(file.data(), &header, sizeof(header));
+
+    // Renaming is atomic, so readers see either the whole old snapshot or the whole new one
+    const std::string temporary_path = path + ".tmp";
+    int fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool written = write_file(fd, file.data(), file.size()) && fsync(fd) == 0;
+    const int write_errno = errno;
+    close(fd);
+    if (!written || rename(temporary_path.c_str(), path.c_str()) != 0) {
+        const int failure_errno = written ? errno : write_errno;
+        unlink(temporary_path.c_str());
+        errno = failure_errno;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Reads the snapshot at the given path, adding the time between when it was written and the given
+ * wall clock time in seconds to every entry's age. Returns an empty optional and describes what's
+ * wrong in the given string if the snapshot couldn't be read or isn't valid.
+ */
+std::optional<std::vector<MacSnapshot::Entry>> MacSnapshot::read(
+    const std::string& path, uint64_t now, std::string& error
+) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = strerror(errno);
+        return {};
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        error = strerror(errno);
+        close(fd);
+        return {};
+    }
+    const size_t size = status.st_size;
+    if (size < sizeof(SnapshotHeader)) {
+        error = "too short to be a snapshot";
+        close(fd);
+        return {};
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = strerror(errno);
+        return {};
+    }
+    const unsigned char* file = (const unsigned char*)mapping;
+
+    std::optional<std::vector<Entry>> entries;
+    SnapshotHeader header;
+    memcpy(&header, file, sizeof(header));
+    const unsigned char* body = file + sizeof(SnapshotHeader);
+    const size_t names_size = (size_t)header.port_count * sizeof(SnapshotPortName);
+    const size_t records_size = (size_t)header.entry_count * sizeof(SnapshotRecord);
+
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        error = "not a snapshot";
+    } else if (header.version != VERSION) {
+        error = "unsupported snapshot version " + std::to_string(header.version);
+    } else if (size != sizeof(SnapshotHeader) + names_size + records_size) {
+        error = "wrong size for its entries";
+    } else if (checksum(body, names_size + records_size) != header.checksum) {
+        error = "checksum mismatch";
+    } else {
+        std::vector<std::string> names;
+        for (size_t port = 0; port < header.port_count; ++port) {
+            SnapshotPortName name;
+            memcpy(&name, body + port * sizeof(SnapshotPortName), sizeof(name));
+            names.emplace_back(name.name, strnlen(name.name, IFNAMSIZ));
+        }
+
+        // Entries keep aging while nothing's running, but a clock that went backwards adds nothing
+        const uint64_t downtime = now > header.written_at ? now - header.written_at : 0;
+
+        entries.emplace();
+        entries->reserve(header.entry_count);
+        for (size_t i = 0; i < header.entry_count; ++i) {
+            SnapshotRecord record;
+            memcpy(&record, body + names_size + i * sizeof(SnapshotRecord), sizeof(record));
+            if (record.port >= names.size()) {
+                error = "entry on an unknown port";
+                entries.reset();
+                break;
+            }
+            if (record.vlan < DEFAULT_VLAN || record.vlan > MAX_VLAN) {
+                error = "entry on an invalid VLAN " + std::to_string(record.vlan);
+                entries.reset();
+                break;
+            }
+
+            const uint64_t age = std::min<uint64_t>(record.age + downtime, UINT32_MAX);
+            entries->push_back(
+                {MacAddress{record.mac_address}, record.vlan, names[record.port], (uint32_t)age}
+            );
+        }
+    }
+
+    munmap(mapping, size);
+    return entries;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "MacAddress.hpp"
+
+/*
+ * A snapshot of the MAC address table on disk, so that a restarted switch can pick up where the
+ * last one left off rather than flooding every unicast frame until it's learned every MAC again.
+ *
+ * Ports are recorded by interface name rather than by index, since the restarted switch may have
+ * its ports in a different order. The file is a fixed size header, the names of the ports the
+ * entries are on, then a fixed size record per entry, all in the host's byte order and covered by
+ * a checksum. It's written to a temporary file that's renamed over the last snapshot, so a crash
+ * mid-write never leaves a torn snapshot behind, and it's read back with a single mmap().
+ *
+ * Ages are in seconds, and the time the snapshot was written is recorded alongside them, so that
+ * entries keep aging while the switch is down.
+ */
+class MacSnapshot {
+public:
+    struct Entry {
+        MacAddress mac_address;
+        uint16_t vlan;
+        std::string port_name;
+
+        // Seconds since the entry was last learned or refreshed
+        uint32_t age;
+    };
+
+    static bool write(const std::string&, const std::vector<Entry>&, uint64_t);
+    static std::optional<std::vector<Entry>> read(const std::string&, uint64_t, std::string&);
+};
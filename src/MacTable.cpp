@@ -0,0 +1,348 @@
+#include <bit>
+#include <algorithm>
+
+#include "MacTable.hpp"
+
+/*
+ * Creates a table that holds up to the given number of entries, aging out entries that haven't
+ * been seen for longer than the given timeout. A timeout of zero disables aging.
+ */
+MacTable::MacTable(size_t m, uint32_t a)
+    : max_entries{std::max<size_t>(m, 1)},
+      aging_timeout{a},
+      slot_count{std::bit_ceil(max_entries * 2)},
+      mask{slot_count - 1},
+      hash_shift{64 - std::countr_zero(slot_count)},
+      slots{std::make_unique<Slot[]>(slot_count)},
+      clock{0},
+      entry_count{0},
+      evictions_count{0},
+      eviction_cursor{0} {
+}
+
+uint64_t MacTable::make_key(const MacAddress& mac_address, uint16_t vlan) {
+    return (uint64_t)vlan << 48 | mac_address.int_representation();
+}
+
+// Fibonacci hashing, which spreads out MACs that only differ in their low octets or VLAN
+size_t MacTable::home_slot(uint64_t key) const {
+    return (size_t)((key * 0x9E3779B97F4A7C15) >> hash_shift) & mask;
+}
+
+bool MacTable::is_expired(uint32_t last_seen, uint32_t now) const {
+    const uint32_t timeout = aging_timeout.load(std::memory_order_relaxed);
+    return timeout != 0 && now - last_seen > timeout;
+}
+
+// Returns the slot holding the given key, if any. Safe to call without holding the writer mutex
+std::optional<size_t> MacTable::find_slot(uint64_t key) const {
+    // The table is never more than half full, so probing always ends at an empty slot
+    for (size_t slot = home_slot(key);; slot = (slot + 1) & mask) {
+        uint64_t slot_key = slots[slot].key.load(std::memory_order_acquire);
+        if (slot_key == MacTable::EMPTY) {
+            return {};
+        }
+        if (slot_key == key) {
+            return slot;
+        }
+    }
+}
+
+/*
+ * Returns the port of the entry in the given slot, or an empty optional if the slot stopped
+ * holding the given key while the port was being read. Lock-free.
+ */
+std::optional<uint16_t> MacTable::read_port(size_t slot, uint64_t key) const {
+    uint16_t port = slots[slot].port.load(std::memory_order_relaxed);
+
+    // Pairs with the fence in store_entry(): a port from a newer entry means the key changed too
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slots[slot].key.load(std::memory_order_relaxed) != key) {
+        return {};
+    }
+    return port;
+}
+
+/*
+ * Puts an entry in the given slot. The slot is marked busy first, so a reader that already matched
+ * the slot's old key sees the key change if it sees the new port. Must hold the writer mutex.
+ */
+void MacTable::store_entry(size_t slot, uint64_t key, uint16_t port, uint32_t last_seen) {
+    slots[slot].key.store(MacTable::BUSY, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Publish the port and timestamp before the key so readers never see a new key with stale ones
+    slots[slot].last_seen.store(last_seen, std::memory_order_relaxed);
+    slots[slot].port.store(port, std::memory_order_relaxed);
+    slots[slot].key.store(key, std::memory_order_release);
+}
+
+/*
+ * Removes the entry in the given slot, then shifts any later entries in the same probe run back
+ * into the hole so lookups never need tombstones. Must hold the writer mutex.
+ */
+void MacTable::remove_slot(size_t hole) {
+    for (size_t slot = (hole + 1) & mask;; slot = (slot + 1) & mask) {
+        uint64_t key = slots[slot].key.load(std::memory_order_relaxed);
+        if (key == MacTable::EMPTY) {
+            break;
+        }
+
+        // An entry can only move back if the hole is between its home slot and where it is now
+        size_t distance_from_home = (slot - home_slot(key)) & mask;
+        size_t distance_from_hole = (slot - hole) & mask;
+        if (distance_from_home >= distance_from_hole) {
+            store_entry(
+                hole, key, slots[slot].port.load(std::memory_order_relaxed),
+                slots[slot].last_seen.load(std::memory_order_relaxed)
+            );
+            hole = slot;
+        }
+    }
+
+    slots[hole].key.store(MacTable::EMPTY, std::memory_order_release);
+    entry_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/*
+ * Evicts the least recently seen of a small sample of entries, which approximates evicting the
+ * least recently seen entry in the whole table in constant time. Must hold the writer mutex.
+ */
+void MacTable::evict_one() {
+    std::optional<size_t> oldest_slot;
+    uint32_t oldest_age = 0;
+    const uint32_t now = clock.load(std::memory_order_relaxed);
+
+    size_t samples = 0;
+    for (; samples < MacTable::EVICTION_SAMPLES; eviction_cursor = (eviction_cursor + 1) & mask) {
+        if (slots[eviction_cursor].key.load(std::memory_order_relaxed) == MacTable::EMPTY) {
+            continue;
+        }
+
+        uint32_t age = now - slots[eviction_cursor].last_seen.load(std::memory_order_relaxed);
+        if (!oldest_slot.has_value() || age > oldest_age) {
+            oldest_slot = eviction_cursor;
+            oldest_age = age;
+        }
+        ++samples;
+    }
+
+    remove_slot(oldest_slot.value());
+    evictions_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+ * Returns the index of the port the given MAC was last seen on in the given VLAN, or an empty
+ * optional if the MAC is unknown or its entry has aged out. Lock-free.
+ */
+std::optional<uint16_t> MacTable::lookup(const MacAddress& mac_address, uint16_t vlan) const {
+    const uint64_t key = MacTable::make_key(mac_address, vlan);
+    std::optional<size_t> slot = find_slot(key);
+    if (!slot.has_value()) {
+        return {};
+    }
+
+    // The key was loaded before the timestamp, so the timestamp is at least as new as the entry
+    uint32_t last_seen = slots[slot.value()].last_seen.load(std::memory_order_relaxed);
+    std::optional<uint16_t> port = read_port(slot.value(), key);
+    if (!port.has_value() || is_expired(last_seen, clock.load(std::memory_order_relaxed))) {
+        return {};
+    }
+
+    return port;
+}
+
+/*
+ * Records that the given MAC was just seen on the given port in the given VLAN. Refreshing a MAC
+ * that's already known on that port is lock-free, and only writes to the table when the timestamp
+ * actually changes, so it's cheap to call for every frame.
+ */
+void MacTable::learn(const MacAddress& mac_address, uint16_t port, uint16_t vlan) {
+    const uint64_t key = MacTable::make_key(mac_address, vlan);
+    const uint32_t now = clock.load(std::memory_order_relaxed);
+
+    std::optional<size_t> slot = find_slot(key);
+    if (slot.has_value()) {
+        Slot& known = slots[slot.value()];
+        if (read_port(slot.value(), key) == port) {
+            if (known.last_seen.load(std::memory_order_relaxed) != now) {
+                known.last_seen.store(now, std::memory_order_relaxed);
+            }
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> g(writer_mutex);
+
+    // The MAC may have been learned or moved by another thread while we were waiting for the lock
+    slot = find_slot(key);
+    if (slot.has_value()) {
+        // Moving a MAC keeps its key, so readers see either port and both are fine
+        slots[slot.value()].last_seen.store(now, std::memory_order_relaxed);
+        slots[slot.value()].port.store(port, std::memory_order_relaxed);
+        return;
+    }
+
+    if (entry_count.load(std::memory_order_relaxed) >= max_entries) {
+        evict_one();
+    }
+
+    size_t free_slot = home_slot(key);
+    while (slots[free_slot].key.load(std::memory_order_relaxed) != MacTable::EMPTY) {
+        free_slot = (free_slot + 1) & mask;
+    }
+
+    store_entry(free_slot, key, port, now);
+    entry_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+ * Puts back an entry from an earlier table, e.g. one saved before a restart, as if it had last been
+ * seen the given time ago. Entries the table already has are newer, so they're left alone, and
+ * nothing is evicted to make room. Returns whether the entry was put back.
+ */
+bool MacTable::restore(const MacAddress& mac_address, uint16_t port, uint16_t vlan, uint32_t age) {
+    const uint64_t key = MacTable::make_key(mac_address, vlan);
+    std::lock_guard<std::mutex> g(writer_mutex);
+
+    if (find_slot(key).has_value() || entry_count.load(std::memory_order_relaxed) >= max_entries) {
+        return false;
+    }
+
+    size_t free_slot = home_slot(key);
+    while (slots[free_slot].key.load(std::memory_order_relaxed) != MacTable::EMPTY) {
+        free_slot = (free_slot + 1) & mask;
+    }
+
+    // Timestamps wrap around like the clock does, so an entry older than the clock still ages right
+    store_entry(free_slot, key, port, clock.load(std::memory_order_relaxed) - age);
+    entry_count.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+/*
+ * Advances the table's clock to the given time and removes every entry that hasn't been seen
+ * within the aging timeout. Time can be in any unit as long as it matches the timeout, and must
+ * never go backwards. Returns the number of entries removed.
+ */
+size_t MacTable::age_out(uint32_t now) {
+    clock.store(now, std::memory_order_relaxed);
+    if (aging_timeout.load(std::memory_order_relaxed) == 0) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> g(writer_mutex);
+
+    size_t removed = 0;
+    for (size_t slot = 0; slot < slot_count;) {
+        uint64_t key = slots[slot].key.load(std::memory_order_relaxed);
+        uint32_t last_seen = slots[slot].last_seen.load(std::memory_order_relaxed);
+
+        // Removing shifts a later entry into this slot, so look at the same slot again
+        if (key != MacTable::EMPTY && is_expired(last_seen, now)) {
+            remove_slot(slot);
+            ++removed;
+            continue;
+        }
+        ++slot;
+    }
+
+    return removed;
+}
+
+/*
+ * Removes every entry for the given port in every VLAN, e.g. when the spanning tree topology
+ * changes and the MACs behind the port may have moved. Returns the number of entries removed.
+ */
+size_t MacTable::flush_port(uint16_t port) {
+    std::lock_guard<std::mutex> g(writer_mutex);
+
+    size_t removed = 0;
+    for (size_t slot = 0; slot < slot_count;) {
+        uint64_t key = slots[slot].key.load(std::memory_order_relaxed);
+
+        // Removing shifts a later entry into this slot, so look at the same slot again
+        if (key != MacTable::EMPTY && slots[slot].port.load(std::memory_order_relaxed) == port) {
+            remove_slot(slot);
+            ++removed;
+            continue;
+        }
+        ++slot;
+    }
+
+    return removed;
+}
+
+/*
+ * Removes every entry, e.g. when hosts may have moved between ports without sending anything.
+ * Returns the number of entries removed.
+ */
+size_t MacTable::flush() {
+    std::lock_guard<std::mutex> g(writer_mutex);
+
+    size_t removed = 0;
+    for (size_t slot = 0; slot < slot_count; ++slot) {
+        if (slots[slot].key.load(std::memory_order_relaxed) != MacTable::EMPTY) {
+            slots[slot].key.store(MacTable::EMPTY, std::memory_order_release);
+            ++removed;
+        }
+    }
+
+    entry_count.fetch_sub(removed, std::memory_order_relaxed);
+    return removed;
+}
+
+/*
+ * Changes the aging timeout, in the units passed to age_out(). Takes effect for lookups straight
+ * away and for removal at the next age_out(). Zero disables aging.
+ */
+void MacTable::set_aging_timeout(uint32_t timeout) {
+    aging_timeout.store(timeout, std::memory_order_relaxed);
+}
+
+uint32_t MacTable::get_aging_timeout() const {
+    return aging_timeout.load(std::memory_order_relaxed);
+}
+
+/*
+ * Returns a copy of every entry that hasn't expired, in no particular order. Takes the writer
+ * mutex, so it never sees an entry half written, but learning carries on alongside it.
+ */
+std::vector<MacTable::Entry> MacTable::entries() const {
+    std::lock_guard<std::mutex> g(writer_mutex);
+    const uint32_t now = clock.load(std::memory_order_relaxed);
+
+    std::vector<MacTable::Entry> copies;
+    for (size_t slot = 0; slot < slot_count; ++slot) {
+        const uint64_t key = slots[slot].key.load(std::memory_order_relaxed);
+        const uint32_t last_seen = slots[slot].last_seen.load(std::memory_order_relaxed);
+        if (key == MacTable::EMPTY || is_expired(last_seen, now)) {
+            continue;
+        }
+
+        const uint8_t octets[] = {
+            (uint8_t)(key >> 40), (uint8_t)(key >> 32), (uint8_t)(key >> 24),
+            (uint8_t)(key >> 16), (uint8_t)(key >> 8),  (uint8_t)key
+        };
+        copies.push_back(
+            {MacAddress{octets}, (uint16_t)(key >> 48),
+             slots[slot].port.load(std::memory_order_relaxed), now - last_seen}
+        );
+    }
+    return copies;
+}
+
+// Returns the number of entries in the table, including ones that have expired but not been removed
+size_t MacTable::size() const {
+    return entry_count.load(std::memory_order_relaxed);
+}
+
+// Returns the maximum number of entries the table holds before it starts evicting
+size_t MacTable::capacity() const {
+    return max_entries;
+}
+
+// Returns the number of entries evicted to make room for new ones
+uint64_t MacTable::evictions() const {
+    return evictions_count.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "MacAddress.hpp"
+#include "Vlan.hpp"
+
+/*
+ * The switch's MAC address table, a.k.a. CAM table. Maps MAC addresses to the index of the port
+ * they were last seen on. MACs are learned per VLAN, so the same MAC can be on different ports in
+ * different VLANs without the VLANs seeing each other's traffic.
+ *
+ * The table is an open addressing hash table with linear probing, sized up front so it never holds
+ * more than half as many entries as it has slots. Each entry is keyed on a single 64-bit word that
+ * packs the VLAN above the 48-bit MAC, with the port index alongside it. Lookups are lock-free: a
+ * writer marks a slot busy before putting a different entry in it, and a reader checks the key
+ * again after reading the port, so it never pairs one entry's key with another's port. Writers
+ * (learning a new MAC, moving a MAC to another port, aging, and eviction) are serialized by a
+ * mutex, but learning a MAC that's already known on the same port only refreshes its timestamp and
+ * doesn't take the lock. Removed entries are filled in by shifting later entries back rather than
+ * leaving tombstones, so the table doesn't degrade as MACs churn. A reader racing with a removal
+ * may briefly miss an entry, which at worst floods a frame.
+ *
+ * Entries that haven't been seen for longer than the aging timeout are treated as unknown and are
+ * swept out by age_out(). The timeout can be changed while the table is in use. When the table is
+ * full, learning a new MAC evicts an old entry.
+ */
+class MacTable {
+public:
+    // Number of ports the table can address. Port indices must be less than this
+    static constexpr size_t MAX_PORTS = 0xFFFF;
+
+    // A point in time copy of a single entry
+    struct Entry {
+        MacAddress mac_address;
+        uint16_t vlan;
+        uint16_t port;
+
+        // Time since the entry was last learned or refreshed, in the units passed to age_out()
+        uint32_t age;
+    };
+
+private:
+    struct Slot {
+        /*
+         * The VLAN in the upper 16 bits and the MAC in the lower 48 bits. VLANs start at one, so
+         * zero means the slot is empty.
+         */
+        std::atomic_uint64_t key;
+
+        std::atomic_uint16_t port;
+
+        // Time the entry was last learned or refreshed, in the units passed to age_out()
+        std::atomic_uint32_t last_seen;
+    };
+
+    static constexpr uint64_t EMPTY = 0;
+
+    // Key of a slot a writer is putting a different entry in. Never matches a real key
+    static constexpr uint64_t BUSY = UINT64_MAX;
+
+    // Number of live entries looked at when picking one to evict
+    static constexpr size_t EVICTION_SAMPLES = 8;
+
+    const size_t max_entries;
+    std::atomic_uint32_t aging_timeout;
+    const size_t slot_count;
+    const size_t mask;
+    const int hash_shift;
+    const std::unique_ptr<Slot[]> slots;
+
+    // Current time as of the last call to age_out()
+    std::atomic_uint32_t clock;
+
+    // Serializes every write to the table other than timestamp refreshes
+    mutable std::mutex writer_mutex;
+
+    std::atomic_size_t entry_count;
+    std::atomic_uint64_t evictions_count;
+
+    // Slot the next eviction starts sampling from
+    size_t eviction_cursor;
+
+    static uint64_t make_key(const MacAddress&, uint16_t);
+
+    size_t home_slot(uint64_t) const;
+    bool is_expired(uint32_t, uint32_t) const;
+    std::optional<size_t> find_slot(uint64_t) const;
+    std::optional<uint16_t> read_port(size_t, uint64_t) const;
+    void store_entry(size_t, uint64_t, uint16_t, uint32_t);
+    void remove_slot(size_t);
+    void evict_one();
+
+public:
+    MacTable(size_t, uint32_t);
+
+    MacTable(const MacTable&) = delete;
+    MacTable& operator=(const MacTable&) = delete;
+
+    std::optional<uint16_t> lookup(const MacAddress&, uint16_t = DEFAULT_VLAN) const;
+    void learn(const MacAddress&, uint16_t, uint16_t = DEFAULT_VLAN);
+    bool restore(const MacAddress&, uint16_t, uint16_t, uint32_t);
+    size_t age_out(uint32_t);
+    size_t flush_port(uint16_t);
+    size_t flush();
+
+    void set_aging_timeout(uint32_t);
+    uint32_t get_aging_timeout() const;
+
+    std::vector<Entry> entries() const;
+
+    size_t size() const;
+    size_t capacity() const;
+    uint64_t evictions() const;
+};
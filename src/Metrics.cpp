@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <utility>
+
+#include "Metrics.hpp"
+
+// Largest power of two bucket bound reported to Prometheus, 2^36 ns or about 69 seconds
+static constexpr size_t PROMETHEUS_MAX_BUCKET_EXPONENT = 36;
+
+// Smallest power of two bucket bound reported to Prometheus, 2^8 ns or 256 ns
+static constexpr size_t PROMETHEUS_MIN_BUCKET_EXPONENT = 8;
+
+void HistogramSnapshot::merge(const LatencyHistogram& histogram) {
+    for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+        const uint64_t bucket_count = histogram.buckets[bucket].get();
+        buckets[bucket] += bucket_count;
+        count += bucket_count;
+    }
+    sum += histogram.sum.get();
+}
+
+/*
+ * Returns an upper bound on the given quantile (0 to 1) of the recorded values, accurate to within
+ * the width of a bucket. Returns 0 if nothing has been recorded.
+ */
+uint64_t HistogramSnapshot::quantile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(fraction * (double)count + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return LatencyHistogram::bucket_upper_bound(bucket);
+        }
+    }
+    return LatencyHistogram::bucket_upper_bound(LatencyHistogram::BUCKET_COUNT - 1);
+}
+
+// Returns the number of recorded values known to be no larger than the given value
+uint64_t HistogramSnapshot::count_at_most(uint64_t value) const {
+    uint64_t at_most = 0;
+    for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+        if (LatencyHistogram::bucket_upper_bound(bucket) > value) {
+            break;
+        }
+        at_most += buckets[bucket];
+    }
+    return at_most;
+}
+
+void PortMetrics::add(const PortCounters& counters) {
+    received_frames_count += counters.received_frames.get();
+    sent_frames_count += counters.sent_frames.get();
+    send_errors_count += counters.send_errors.get();
+    flood_errors_count += counters.flood_errors.get();
+    flood_count += counters.floods.get();
+    partial_floods_count += counters.partial_floods.get();
+    tail_drops_count += counters.tail_drops.get();
+    head_drops_count += counters.head_drops.get();
+    receiver_pauses_count += counters.receiver_pauses.get();
+    for (size_t type = 0; type < FLOOD_TYPE_COUNT; ++type) {
+        storm_suppressed_counts[type] += counters.storm_suppressed[type].get();
+    }
+    storm_shutdown_drops_count += counters.storm_shutdown_drops.get();
+    storm_shutdowns_count += counters.storm_shutdowns.get();
+    stp_discards_count += counters.stp_discards.get();
+    snooped_multicast_count += counters.snooped_multicast.get();
+    vlan_discards_count += counters.vlan_discards.get();
+    lag_discards_count += counters.lag_discards.get();
+    acl_drops_count += counters.acl_drops.get();
+    mirror_drops_count += counters.mirror_drops.get();
+    read_errors_count += counters.read_errors.get();
+}
+
+void PortMetrics::add(const PortMetrics& other) {
+    received_frames_count += other.received_frames_count;
+    sent_frames_count += other.sent_frames_count;
+    send_errors_count += other.send_errors_count;
+    flood_errors_count += other.flood_errors_count;
+    flood_count += other.flood_count;
+    partial_floods_count += other.partial_floods_count;
+    tail_drops_count += other.tail_drops_count;
+    head_drops_count += other.head_drops_count;
+    kernel_drops_count += other.kernel_drops_count;
+    receiver_pauses_count += other.receiver_pauses_count;
+    for (size_t type = 0; type < FLOOD_TYPE_COUNT; ++type) {
+        storm_suppressed_counts[type] += other.storm_suppressed_counts[type];
+    }
+    storm_shutdown_drops_count += other.storm_shutdown_drops_count;
+    storm_shutdowns_count += other.storm_shutdowns_count;
+    stp_discards_count += other.stp_discards_count;
+    snooped_multicast_count += other.snooped_multicast_count;
+    vlan_discards_count += other.vlan_discards_count;
+    lag_discards_count += other.lag_discards_count;
+    acl_drops_count += other.acl_drops_count;
+    mirror_drops_count += other.mirror_drops_count;
+    read_errors_count += other.read_errors_count;
+}
+
+// Appends a printf formatted line to the given string
+template <typename... Args>
+static void append_line(std::string& output, const char* format, Args... args) {
+    char line[256];
+    snprintf(line, sizeof(line), format, args...);
+    output += line;
+}
+
+// Appends the Prometheus counter of frames suppressed by storm control, by port and flood type
+static void append_storm_counter(
+    std::string& output, const MetricsSnapshot& snapshot, const std::vector<std::string>& port_names
+) {
+    output += "# HELP vswitch_storm_suppressed_frames_total Frames suppressed by storm control.\n";
+    output += "# TYPE vswitch_storm_suppressed_frames_total counter\n";
+    for (size_t port = 0; port < snapshot.ports.size(); ++port) {
+        if (port_names[port].empty()) {
+            continue;
+        }
+        for (size_t type = 0; type < FLOOD_TYPE_COUNT; ++type) {
+            append_line(
+                output,
+                "vswitch_storm_suppressed_frames_total{port=\"%s\",type=\"%s\"} %" PRIu64 "\n",
+                port_names[port].c_str(), flood_type_name((FloodType)type),
+                snapshot.ports[port].storm_suppressed_counts[type]
+            );
+        }
+    }
+}
+
+/*
+ * Appends a Prometheus histogram with one series per traffic class, with bounds converted from
+ * nanoseconds to seconds
+ */
+static void append_class_histogram(
+    std::string& output, const char* name, const char* help, const MetricsSnapshot& snapshot,
+    HistogramSnapshot ClassMetrics::*field
+) {
+    append_line(output, "# HELP %s %s\n", name, help);
+    append_line(output, "# TYPE %s histogram\n", name);
+
+    for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+        const char* class_name = traffic_class_name((TrafficClass)traffic_class);
+        const HistogramSnapshot& histogram = snapshot.classes[traffic_class].*field;
+
+        for (size_t exponent = PROMETHEUS_MIN_BUCKET_EXPONENT;
+             exponent <= PROMETHEUS_MAX_BUCKET_EXPONENT; ++exponent) {
+            const uint64_t bound = (uint64_t)1 << exponent;
+            append_line(
+                output, "%s_bucket{class=\"%s\",le=\"%.9f\"} %" PRIu64 "\n", name, class_name,
+                (double)bound / 1e9, histogram.count_at_most(bound - 1)
+            );
+        }
+
+        append_line(
+            output, "%s_bucket{class=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", name, class_name,
+            histogram.count
+        );
+        append_line(
+            output, "%s_sum{class=\"%s\"} %.9f\n", name, class_name, (double)histogram.sum / 1e9
+        );
+        append_line(
+            output, "%s_count{class=\"%s\"} %" PRIu64 "\n", name, class_name, histogram.count
+        );
+    }
+}
+
+// Appends a Prometheus counter with one sample per traffic class
+static void append_class_counter(
+    std::string& output, const char* name, const char* help, const MetricsSnapshot& snapshot,
+    uint64_t ClassMetrics::*field
+) {
+    append_line(output, "# HELP %s %s\n", name, help);
+    append_line(output, "# TYPE %s counter\n", name);
+    for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+        append_line(
+            output, "%s{class=\"%s\"} %" PRIu64 "\n", name,
+            traffic_class_name((TrafficClass)traffic_class), snapshot.classes[traffic_class].*field
+        );
+    }
+}
+
+// Appends a Prometheus counter with one sample per port
+template <typename Field>
+static void append_port_counter(
+    std::string& output, const char* name, const char* help, const MetricsSnapshot& snapshot,
+    const std::vector<std::string>& port_names, Field field
+) {
+    append_line(output, "# HELP %s %s\n", name, help);
+    append_line(output, "# TYPE %s counter\n", name);
+    for (size_t port = 0; port < snapshot.ports.size(); ++port) {
+        if (port_names[port].empty()) {
+            continue;
+        }
+        append_line(
+            output, "%s{port=\"%s\"} %" PRIu64 "\n", name, port_names[port].c_str(),
+            snapshot.ports[port].*field
+        );
+    }
+}
+
+// Appends the Prometheus counter of dropped frames, with one sample per port and drop reason
+static void append_drop_counter(
+    std::string& output, const MetricsSnapshot& snapshot, const std::vector<std::string>& port_names
+) {
+    static constexpr std::pair<const char*, uint64_t PortMetrics::*> REASONS[] = {
+        {"tail_drop", &PortMetrics::tail_drops_count},
+        {"head_drop", &PortMetrics::head_drops_count},
+        {"kernel", &PortMetrics::kernel_drops_count},
+    };
+
+    output += "# HELP vswitch_dropped_frames_total Received frames that were dropped.\n";
+    output += "# TYPE vswitch_dropped_frames_total counter\n";
+    for (size_t port = 0; port < snapshot.ports.size(); ++port) {
+        if (port_names[port].empty()) {
+            continue;
+        }
+        for (const auto& [reason, field] : REASONS) {
+            append_line(
+                output, "vswitch_dropped_frames_total{port=\"%s\",reason=\"%s\"} %" PRIu64 "\n",
+                port_names[port].c_str(), reason, snapshot.ports[port].*field
+            );
+        }
+    }
+}
+
+/*
+ * Renders the snapshot in the Prometheus text exposition format, labelling ports with their names.
+ * Ports with an empty name, e.g. free port slots, are left out.
+ */
+std::string MetricsSnapshot::to_prometheus(const std::vector<std::string>& port_names) const {
+    std::string output;
+
+    append_port_counter(
+        output, "vswitch_received_frames_total", "Frames received on the port.", *this, port_names,
+        &PortMetrics::received_frames_count
+    );
+    append_port_counter(
+        output, "vswitch_sent_frames_total", "Frames sent out of the port.", *this, port_names,
+        &PortMetrics::sent_frames_count
+    );
+    append_port_counter(
+        output, "vswitch_send_errors_total", "Frames switched to the port that failed to send.",
+        *this, port_names, &PortMetrics::send_errors_count
+    );
+    append_port_counter(
+        output, "vswitch_flood_errors_total", "Frames flooded to the port that failed to send.",
+        *this, port_names, &PortMetrics::flood_errors_count
+    );
+    append_port_counter(
+        output, "vswitch_floods_total", "Frames received on the port that were flooded.", *this,
+        port_names, &PortMetrics::flood_count
+    );
+    append_port_counter(
+        output, "vswitch_partial_floods_total",
+        "Frames flooded from the port that failed to send on some of the ports.", *this,
+        port_names, &PortMetrics::partial_floods_count
+    );
+    append_drop_counter(output, *this, port_names);
+    append_port_counter(
+        output, "vswitch_receiver_pauses_total",
+        "Times the port's receiver waited for room in its input queue.", *this, port_names,
+        &PortMetrics::receiver_pauses_count
+    );
+    append_storm_counter(output, *this, port_names);
+    append_port_counter(
+        output, "vswitch_storm_shutdown_drops_total",
+        "Frames received on or switched to the port while storm control had it shut down.", *this,
+        port_names, &PortMetrics::storm_shutdown_drops_count
+    );
+    append_port_counter(
+        output, "vswitch_storm_shutdowns_total", "Times storm control shut the port down.", *this,
+        port_names, &PortMetrics::storm_shutdowns_count
+    );
+    append_port_counter(
+        output, "vswitch_stp_discards_total",
+        "Frames received on or switched to the port while spanning tree had it blocked.", *this,
+        port_names, &PortMetrics::stp_discards_count
+    );
+    append_port_counter(
+        output, "vswitch_multicast_snooped_frames_total",
+        "Multicast frames received on the port that were only sent to interested ports.", *this,
+        port_names, &PortMetrics::snooped_multicast_count
+    );
+    append_port_counter(
+        output, "vswitch_vlan_discards_total",
+        "Frames received on the port for a VLAN the port doesn't carry.", *this, port_names,
+        &PortMetrics::vlan_discards_count
+    );
+    append_port_counter(
+        output, "vswitch_lag_discards_total",
+        "Frames received on the port while it wasn't active in its LAG, or switched to its LAG "
+        "while no member was.",
+        *this, port_names, &PortMetrics::lag_discards_count
+    );
+    append_port_counter(
+        output, "vswitch_acl_drops_total",
+        "Frames received on the port that the ACL denied, or redirected to a missing port.", *this,
+        port_names, &PortMetrics::acl_drops_count
+    );
+    append_port_counter(
+        output, "vswitch_mirror_drops_total",
+        "Frames received or sent on the port that a capture was too far behind to take.", *this,
+        port_names, &PortMetrics::mirror_drops_count
+    );
+    append_port_counter(
+        output, "vswitch_read_errors_total", "Failed reads from the port.", *this, port_names,
+        &PortMetrics::read_errors_count
+    );
+
+    append_class_counter(
+        output, "vswitch_class_received_frames_total", "Frames received in the traffic class.",
+        *this, &ClassMetrics::received_frames_count
+    );
+    append_class_counter(
+        output, "vswitch_class_sent_frames_total", "Frames of the traffic class sent to a port.",
+        *this, &ClassMetrics::sent_frames_count
+    );
+    append_class_counter(
+        output, "vswitch_class_dropped_frames_total",
+        "Frames of the traffic class dropped because an input queue was full.", *this,
+        &ClassMetrics::dropped_frames_count
+    );
+
+    append_class_histogram(
+        output, "vswitch_queue_residency_seconds",
+        "Time frames spent in an input queue before being switched.", *this,
+        &ClassMetrics::queue_residency
+    );
+    append_class_histogram(
+        output, "vswitch_forwarding_latency_seconds",
+        "Time from a frame being received to being sent out of every egress port.", *this,
+        &ClassMetrics::forwarding_latency
+    );
+
+    output += "# HELP vswitch_mac_table_entries MAC addresses in the MAC table.\n";
+    output += "# TYPE vswitch_mac_table_entries gauge\n";
+    append_line(output, "vswitch_mac_table_entries %zu\n", mac_table_entries);
+    output += "# HELP vswitch_mac_table_capacity Maximum entries in the MAC table.\n";
+    output += "# TYPE vswitch_mac_table_capacity gauge\n";
+    append_line(output, "vswitch_mac_table_capacity %zu\n", mac_table_capacity);
+    output += "# HELP vswitch_mac_table_evictions_total MAC table entries evicted when full.\n";
+    output += "# TYPE vswitch_mac_table_evictions_total counter\n";
+    append_line(
+        output, "vswitch_mac_table_evictions_total %" PRIu64 "\n", mac_table_evictions_count
+    );
+    output += "# HELP vswitch_frame_heap_allocations_total Frames not from a frame pool.\n";
+    output += "# TYPE vswitch_frame_heap_allocations_total counter\n";
+    append_line(
+        output, "vswitch_frame_heap_allocations_total %" PRIu64 "\n", frame_heap_allocations_count
+    );
+    output += "# HELP vswitch_capture_write_errors_total Captured frames that failed to write.\n";
+    output += "# TYPE vswitch_capture_write_errors_total counter\n";
+    append_line(
+        output, "vswitch_capture_write_errors_total %" PRIu64 "\n", capture_write_errors_count
+    );
+    output += "# HELP vswitch_stp_topology_changes_total Spanning tree topology changes seen.\n";
+    output += "# TYPE vswitch_stp_topology_changes_total counter\n";
+    append_line(
+        output, "vswitch_stp_topology_changes_total %" PRIu64 "\n", stp_topology_changes_count
+    );
+    output += "# HELP vswitch_multicast_groups Multicast groups with snooped members.\n";
+    output += "# TYPE vswitch_multicast_groups gauge\n";
+    append_line(output, "vswitch_multicast_groups %zu\n", multicast_groups);
+
+    if (!acl_rule_hits.empty()) {
+        output += "# HELP vswitch_acl_rule_hits_total Frames that matched the ACL rule.\n";
+        output += "# TYPE vswitch_acl_rule_hits_total counter\n";
+        for (size_t rule = 0; rule < acl_rule_hits.size(); ++rule) {
+            append_line(
+                output, "vswitch_acl_rule_hits_total{rule=\"%zu\"} %" PRIu64 "\n", rule,
+                acl_rule_hits[rule]
+            );
+        }
+    }
+
+    return output;
+}
+
+SwitchMetrics::SwitchMetrics(size_t p)
+    : port_count{p} {
+}
+
+// Creates the metrics for a new thread. Must be called before any thread starts recording
+ThreadMetrics& SwitchMetrics::add_thread() {
+    return *threads.emplace_back(std::make_unique<ThreadMetrics>(port_count));
+}
+
+/*
+ * Zeroes every thread's counters for the given port, so whatever port next takes its place starts
+ * from scratch. Nothing may be recording metrics for the port while it's reset.
+ */
+void SwitchMetrics::reset_port(size_t port) {
+    for (const std::unique_ptr<ThreadMetrics>& thread : threads) {
+        std::destroy_at(&thread->ports[port]);
+        std::construct_at(&thread->ports[port]);
+    }
+}
+
+// Sums every port's counters across every thread. Cheaper than collect() when that's all needed
+PortMetrics SwitchMetrics::totals() const {
+    PortMetrics totals;
+    for (const std::unique_ptr<ThreadMetrics>& thread : threads) {
+        for (size_t port = 0; port < port_count; ++port) { totals.add(thread->ports[port]); }
+    }
+    return totals;
+}
+
+/*
+ * Aggregates every thread's metrics. Each counter is read atomically, but the snapshot as a whole
+ * isn't, so counters that are updated together may be slightly out of step.
+ */
+MetricsSnapshot SwitchMetrics::collect() const {
+    MetricsSnapshot snapshot;
+    snapshot.ports.resize(port_count);
+
+    for (const std::unique_ptr<ThreadMetrics>& thread : threads) {
+        for (size_t port = 0; port < port_count; ++port) {
+            snapshot.ports[port].add(thread->ports[port]);
+        }
+
+        for (size_t traffic_class = 0; traffic_class < TRAFFIC_CLASS_COUNT; ++traffic_class) {
+            const ClassCounters& counters = thread->classes[traffic_class];
+            ClassMetrics& class_metrics = snapshot.classes[traffic_class];
+            class_metrics.received_frames_count += counters.received_frames.get();
+            class_metrics.sent_frames_count += counters.sent_frames.get();
+            class_metrics.dropped_frames_count += counters.dropped_frames.get();
+
+            class_metrics.queue_residency.merge(thread->queue_residency[traffic_class]);
+            class_metrics.forwarding_latency.merge(thread->forwarding_latency[traffic_class]);
+            snapshot.queue_residency.merge(thread->queue_residency[traffic_class]);
+            snapshot.forwarding_latency.merge(thread->forwarding_latency[traffic_class]);
+        }
+    }
+
+    for (const PortMetrics& port : snapshot.ports) { snapshot.totals.add(port); }
+    return snapshot;
+}
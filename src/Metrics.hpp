@@ -0,0 +1,290 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TrafficClass.hpp"
+#include "StormControl.hpp"
+
+// Current time for latency metrics, in nanoseconds since an arbitrary point in the past
+inline uint64_t metrics_clock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+/*
+ * A counter written by exactly one thread and read by any. Since there's only one writer, an
+ * increment is a plain load and store rather than a locked read-modify-write.
+ */
+class Counter {
+private:
+    std::atomic_uint64_t value{0};
+
+public:
+    void add(uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+/*
+ * An HDR-style histogram of nanosecond durations, written by exactly one thread. Values are
+ * bucketed log-linearly: every power of two is split into SUB_BUCKETS equal buckets, so any
+ * recorded value is known to within 1/SUB_BUCKETS of itself no matter how large it is, and
+ * recording is a couple of bit operations and a counter increment.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = 1 << LatencyHistogram::SUB_BUCKET_BITS;
+
+    // Enough buckets for any 64-bit value
+    static constexpr size_t BUCKET_COUNT =
+        (64 - LatencyHistogram::SUB_BUCKET_BITS + 1) * LatencyHistogram::SUB_BUCKETS;
+
+    static constexpr size_t bucket_of(uint64_t value) {
+        if (value < LatencyHistogram::SUB_BUCKETS) {
+            return value;
+        }
+
+        const size_t shift = std::bit_width(value) - 1 - LatencyHistogram::SUB_BUCKET_BITS;
+        return (shift + 1) * LatencyHistogram::SUB_BUCKETS +
+               ((value >> shift) & (LatencyHistogram::SUB_BUCKETS - 1));
+    }
+
+    // Largest value that falls in the given bucket
+    static constexpr uint64_t bucket_upper_bound(size_t bucket) {
+        if (bucket < LatencyHistogram::SUB_BUCKETS) {
+            return bucket;
+        }
+
+        const size_t shift = bucket / LatencyHistogram::SUB_BUCKETS - 1;
+        const uint64_t sub_bucket = bucket % LatencyHistogram::SUB_BUCKETS;
+        return ((LatencyHistogram::SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+    }
+
+private:
+    std::array<Counter, LatencyHistogram::BUCKET_COUNT> buckets;
+    Counter sum;
+
+public:
+    void record(uint64_t value) {
+        buckets[LatencyHistogram::bucket_of(value)].add(1);
+        sum.add(value);
+    }
+
+    friend struct HistogramSnapshot;
+};
+
+// Point in time copy of one or more LatencyHistograms merged together
+struct HistogramSnapshot {
+    std::array<uint64_t, LatencyHistogram::BUCKET_COUNT> buckets{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    void merge(const LatencyHistogram&);
+    uint64_t quantile(double) const;
+    uint64_t count_at_most(uint64_t) const;
+};
+
+/*
+ * Counters for a single port. Which counters a given thread bumps depends on what it does with the
+ * port, e.g. a receiver thread only ever counts received frames and drops.
+ */
+struct alignas(64) PortCounters {
+    Counter received_frames;
+    Counter sent_frames;
+    Counter send_errors;
+    Counter flood_errors;
+    Counter floods;
+
+    // Frames flooded from the port that failed to send on at least one of the ports they went to
+    Counter partial_floods;
+
+    // Frames dropped because the port's input queue was full, by which frame was dropped
+    Counter tail_drops;
+    Counter head_drops;
+
+    // Times the port's receiver stopped reading to wait for room in its input queue
+    Counter receiver_pauses;
+
+    // Frames received on the port that storm control suppressed, by FloodType
+    std::array<Counter, FLOOD_TYPE_COUNT> storm_suppressed;
+
+    // Frames received on or switched to the port while storm control had it shut down
+    Counter storm_shutdown_drops;
+
+    // Times storm control shut the port down
+    Counter storm_shutdowns;
+
+    // Frames received on or switched to the port while spanning tree had it blocked
+    Counter stp_discards;
+
+    /*
+     * Multicast frames received on the port that snooping sent only to interested ports rather than
+     * flooding
+     */
+    Counter snooped_multicast;
+
+    // Frames received on the port for a VLAN the port doesn't carry
+    Counter vlan_discards;
+
+    /*
+     * Frames received on the port while it's a LAG member that isn't active, or switched to the
+     * port's LAG while none of its members were
+     */
+    Counter lag_discards;
+
+    // Frames received on the port that the ACL denied, or redirected to a port that isn't there
+    Counter acl_drops;
+
+    // Frames received or sent on the port that a capture was too far behind to take
+    Counter mirror_drops;
+
+    Counter read_errors;
+};
+
+// Counters for a single traffic class, across every port
+struct alignas(64) ClassCounters {
+    Counter received_frames;
+    Counter sent_frames;
+
+    // Frames of the class dropped because an input queue was full
+    Counter dropped_frames;
+};
+
+/*
+ * Every metric a single thread records. Each thread that touches the data path gets its own, on its
+ * own cache lines, so recording a metric never contends with another thread. Metrics are only
+ * aggregated when they're read.
+ */
+struct alignas(64) ThreadMetrics {
+    // Indexed the same as the switch's ports
+    const std::unique_ptr<PortCounters[]> ports;
+
+    // Indexed by TrafficClass
+    std::array<ClassCounters, TRAFFIC_CLASS_COUNT> classes;
+
+    // Time frames spent waiting in an input queue before being switched, by TrafficClass
+    std::array<LatencyHistogram, TRAFFIC_CLASS_COUNT> queue_residency;
+
+    /*
+     * Time from a frame being received to it being handed to the kernel for every egress port, by
+     * TrafficClass
+     */
+    std::array<LatencyHistogram, TRAFFIC_CLASS_COUNT> forwarding_latency;
+
+    explicit ThreadMetrics(size_t port_count)
+        : ports{std::make_unique<PortCounters[]>(port_count)} {
+    }
+};
+
+// Point in time totals of a port's counters across every thread
+struct PortMetrics {
+    uint64_t received_frames_count = 0;
+    uint64_t sent_frames_count = 0;
+    uint64_t send_errors_count = 0;
+    uint64_t flood_errors_count = 0;
+    uint64_t flood_count = 0;
+    uint64_t partial_floods_count = 0;
+    uint64_t tail_drops_count = 0;
+    uint64_t head_drops_count = 0;
+    uint64_t kernel_drops_count = 0;
+    uint64_t receiver_pauses_count = 0;
+    std::array<uint64_t, FLOOD_TYPE_COUNT> storm_suppressed_counts{};
+    uint64_t storm_shutdown_drops_count = 0;
+    uint64_t storm_shutdowns_count = 0;
+    uint64_t stp_discards_count = 0;
+    uint64_t snooped_multicast_count = 0;
+    uint64_t vlan_discards_count = 0;
+    uint64_t lag_discards_count = 0;
+    uint64_t acl_drops_count = 0;
+    uint64_t mirror_drops_count = 0;
+    uint64_t read_errors_count = 0;
+
+    void add(const PortCounters&);
+    void add(const PortMetrics&);
+
+    // Received frames that were dropped for any reason before being switched
+    uint64_t dropped_frames_count() const {
+        return tail_drops_count + head_drops_count + kernel_drops_count;
+    }
+
+    // Received frames that storm control suppressed, of any FloodType
+    uint64_t storm_suppressed_count() const {
+        uint64_t suppressed = 0;
+        for (uint64_t count : storm_suppressed_counts) { suppressed += count; }
+        return suppressed;
+    }
+};
+
+// Point in time totals of a traffic class's metrics across every thread
+struct ClassMetrics {
+    uint64_t received_frames_count = 0;
+    uint64_t sent_frames_count = 0;
+    uint64_t dropped_frames_count = 0;
+
+    HistogramSnapshot queue_residency;
+    HistogramSnapshot forwarding_latency;
+};
+
+// Point in time copy of every metric the switch keeps
+struct MetricsSnapshot {
+    // Indexed the same as the switch's ports
+    std::vector<PortMetrics> ports;
+    PortMetrics totals;
+
+    // Indexed by TrafficClass
+    std::array<ClassMetrics, TRAFFIC_CLASS_COUNT> classes;
+
+    // Latencies of every traffic class together
+    HistogramSnapshot queue_residency;
+    HistogramSnapshot forwarding_latency;
+
+    size_t mac_table_entries = 0;
+    size_t mac_table_capacity = 0;
+    uint64_t mac_table_evictions_count = 0;
+    uint64_t frame_heap_allocations_count = 0;
+    uint64_t capture_write_errors_count = 0;
+    uint64_t stp_topology_changes_count = 0;
+    size_t multicast_groups = 0;
+
+    // Frames that matched each rule of the ACL. Empty unless one's loaded
+    std::vector<uint64_t> acl_rule_hits;
+
+    std::string to_prometheus(const std::vector<std::string>&) const;
+};
+
+/*
+ * The set of ThreadMetrics for every thread in the switch. Threads must all be added before any of
+ * them start recording.
+ */
+class SwitchMetrics {
+private:
+    const size_t port_count;
+    std::vector<std::unique_ptr<ThreadMetrics>> threads;
+
+public:
+    explicit SwitchMetrics(size_t);
+
+    SwitchMetrics(const SwitchMetrics&) = delete;
+    SwitchMetrics& operator=(const SwitchMetrics&) = delete;
+
+    ThreadMetrics& add_thread();
+    void reset_port(size_t);
+
+    PortMetrics totals() const;
+    MetricsSnapshot collect() const;
+};
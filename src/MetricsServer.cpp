@@ -0,0 +1,78 @@
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "MetricsServer.hpp"
+#include "UnixSocket.hpp"
+#include "panic.hpp"
+
+/*
+ * Helper function to create the listening socket. Any stale socket left at the path by a previous
+ * run is replaced. Panics if the socket could not be created.
+ */
+int MetricsServer::initialize_listen_socket(const std::string& path) {
+    int new_listen_fd = listen_unix_socket(path);
+    if (new_listen_fd < 0) {
+        PANIC("Failed to listen on metrics socket %s: %s\n", path.c_str(), strerror(errno));
+    }
+    return new_listen_fd;
+}
+
+MetricsServer::MetricsServer(const std::string& p)
+    : socket_path{p},
+      listen_fd{MetricsServer::initialize_listen_socket(socket_path)} {
+}
+
+MetricsServer::~MetricsServer() {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+}
+
+/*
+ * Accepts connections forever, writing whatever the given function renders to each one before
+ * closing it.
+ */
+void MetricsServer::serve(const std::function<std::string()>& render) {
+    while (true) {
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno != EINTR) {
+                syslog(LOG_ERR, "Failed to accept metrics connection: %m");
+            }
+            continue;
+        }
+
+        const std::string metrics = render();
+        write_all(client_fd, metrics.data(), metrics.size());
+        close(client_fd);
+    }
+}
+
+/*
+ * Connects to the metrics socket at the given path and copies everything it serves to the given
+ * file. Returns false if the socket couldn't be read.
+ */
+bool MetricsServer::dump(const std::string& path, FILE* output) {
+    int fd = connect_unix_socket(path);
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[4096];
+    ssize_t read_length;
+    while ((read_length = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (read_length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        fwrite(buffer, 1, read_length, output);
+    }
+
+    close(fd);
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+
+/*
+ * Serves the switch's metrics in the Prometheus text exposition format over a Unix domain socket.
+ * Every connection gets a fresh rendering of the metrics and is then closed, so the endpoint can be
+ * read with the switch's --dump-metrics option, or with anything that can read a Unix socket, e.g.
+ * `socat - UNIX-CONNECT:<path>`.
+ */
+class MetricsServer {
+private:
+    const std::string socket_path;
+    const int listen_fd;
+
+    static int initialize_listen_socket(const std::string&);
+
+public:
+    explicit MetricsServer(const std::string&);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    void serve(const std::function<std::string()>&);
+
+    static bool dump(const std::string&, FILE*);
+};
@@ -0,0 +1,452 @@
+#include <syslog.h>
+#include <algorithm>
+#include <mutex>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+
+#include "MulticastSnooping.hpp"
+
+static constexpr size_t IPV4_MIN_HEADER_SIZE = 20;
+static constexpr size_t IPV6_HEADER_SIZE = 40;
+
+// IGMP message types, and the size of the fixed part of each
+static constexpr uint8_t IGMP_QUERY = 0x11;
+static constexpr uint8_t IGMPV1_REPORT = 0x12;
+static constexpr uint8_t IGMPV2_REPORT = 0x16;
+static constexpr uint8_t IGMPV2_LEAVE = 0x17;
+static constexpr uint8_t IGMPV3_REPORT = 0x22;
+static constexpr size_t IGMP_SIZE = 8;
+
+// MLD message types, which are ICMPv6 types, and the size of the fixed part of each
+static constexpr uint8_t MLD_QUERY = 130;
+static constexpr uint8_t MLDV1_REPORT = 131;
+static constexpr uint8_t MLDV1_DONE = 132;
+static constexpr uint8_t MLDV2_REPORT = 143;
+static constexpr size_t MLDV1_SIZE = 24;
+static constexpr size_t MLDV2_REPORT_SIZE = 8;
+
+// IGMPv3 and MLDv2 group record types (RFC 3376 4.2.12)
+static constexpr uint8_t MODE_IS_INCLUDE = 1;
+static constexpr uint8_t CHANGE_TO_INCLUDE_MODE = 3;
+static constexpr uint8_t ALLOW_NEW_SOURCES = 5;
+static constexpr uint8_t BLOCK_OLD_SOURCES = 6;
+
+// Size of the fixed part of an IGMPv3 and an MLDv2 group record
+static constexpr size_t IGMPV3_RECORD_SIZE = 8;
+static constexpr size_t MLDV2_RECORD_SIZE = 20;
+
+static uint16_t read_u16(const unsigned char* bytes) {
+    return (uint16_t)(bytes[0] << 8 | bytes[1]);
+}
+
+// MAC an IPv4 multicast group is sent to: 01:00:5E followed by the low 23 bits of the group
+static MacAddress ipv4_group_mac(const unsigned char* group) {
+    return MacAddress{0x01, 0x00, 0x5E, (uint8_t)(group[1] & 0x7F), group[2], group[3]};
+}
+
+// MAC an IPv6 multicast group is sent to: 33:33 followed by the low 32 bits of the group
+static MacAddress ipv6_group_mac(const unsigned char* group) {
+    return MacAddress{0x33, 0x33, group[12], group[13], group[14], group[15]};
+}
+
+/*
+ * Whether a group record says the host wants any traffic for the group. Only a record that
+ * includes no sources at all leaves; blocking some sources still wants the rest.
+ */
+static bool record_joins(uint8_t type, uint16_t source_count) {
+    if (type == MODE_IS_INCLUDE || type == CHANGE_TO_INCLUDE_MODE || type == ALLOW_NEW_SOURCES) {
+        return source_count > 0;
+    }
+    return true;
+}
+
+/*
+ * Whether snooping decides where traffic to the given MAC goes: IPv4 and IPv6 multicast groups,
+ * other than those that share a MAC with the link-local groups in 224.0.0.0/24 and ff02::/120.
+ * Routing and discovery protocols send to those without reporting membership, so they're always
+ * flooded.
+ */
+bool MulticastSnooping::is_snooped_group(MacAddress mac) {
+    const uint64_t value = mac.int_representation();
+    if (value >> 23 == 0x01005E << 1) {
+        return (value & 0x7FFF00) != 0;
+    }
+    if (value >> 32 == 0x3333) {
+        return (value & 0xFFFFFF00) != 0;
+    }
+    return false;
+}
+
+// Key of the given group MAC in the given VLAN in the groups table
+uint64_t MulticastSnooping::group_key(uint16_t vlan, MacAddress group_mac) {
+    return (uint64_t)vlan << 48 | group_mac.int_representation();
+}
+
+/*
+ * Creates an empty table for ports with the given names, which are only used for logging, that the
+ * given number of forwarding threads snoop frames with
+ */
+MulticastSnooping::MulticastSnooping(const std::vector<std::string>& names, size_t readers)
+    : port_names{names},
+      router_ports{names.size()},
+      router_expiries(names.size(), 0),
+      clock{0},
+      membership_changed{false},
+      group_table{std::make_unique<const GroupTable>(GroupTable{{}, router_ports}), readers} {
+}
+
+// Adds or refreshes the given port's membership of the given group. Must hold the lock
+void MulticastSnooping::join(size_t port, uint16_t vlan, MacAddress group_mac) {
+    if (!MulticastSnooping::is_snooped_group(group_mac)) {
+        return;
+    }
+
+    const uint64_t key = MulticastSnooping::group_key(vlan, group_mac);
+    auto group = groups.find(key);
+    if (group == groups.end()) {
+        if (groups.size() >= MulticastSnooping::MAX_GROUPS) {
+            return;
+        }
+        Group new_group{
+            PortBitmap{port_names.size()}, std::vector<uint32_t>(port_names.size(), 0)
+        };
+        group = groups.emplace(key, std::move(new_group)).first;
+    }
+
+    if (!group->second.members.test(port)) {
+        group->second.members.set(port);
+        membership_changed = true;
+    }
+    group->second.expiries[port] = clock + MulticastSnooping::MEMBERSHIP_INTERVAL;
+}
+
+/*
+ * Cuts the given port's membership of the given group short, leaving a host that's still interested
+ * just long enough to answer the router's group specific query. Must hold the lock.
+ */
+void MulticastSnooping::leave(size_t port, uint16_t vlan, MacAddress group_mac) {
+    auto group = groups.find(MulticastSnooping::group_key(vlan, group_mac));
+    if (group == groups.end() || !group->second.members.test(port)) {
+        return;
+    }
+
+    uint32_t& expiry = group->second.expiries[port];
+    expiry = std::min(expiry, clock + MulticastSnooping::LAST_MEMBER_QUERY_TIME);
+}
+
+// Must hold the lock
+void MulticastSnooping::refresh_router_port(size_t port) {
+    if (!router_ports.test(port)) {
+        syslog(LOG_INFO, "Multicast router detected on %s", port_names[port].c_str());
+        router_ports.set(port);
+        membership_changed = true;
+    }
+    router_expiries[port] = clock + MulticastSnooping::ROUTER_INTERVAL;
+}
+
+/*
+ * Publishes the groups and router ports for forwarding to look up, if membership changed since they
+ * were last published, and waits until no forwarding thread can still see the old ones. Refreshes
+ * and leaves that are still counting down publish nothing. Must hold the lock.
+ */
+void MulticastSnooping::publish_group_table() {
+    if (!membership_changed) {
+        return;
+    }
+
+    auto table = std::make_unique<GroupTable>(GroupTable{{}, router_ports});
+    table->members.reserve(groups.size());
+    for (const auto& [key, group] : groups) { table->members.emplace(key, group.members); }
+
+    group_table.publish(std::move(table));
+    membership_changed = false;
+}
+
+// Learns from an IGMP message received on the given port
+MulticastSnooping::MessageKind MulticastSnooping::snoop_igmp(
+    size_t port, uint16_t vlan, std::span<const unsigned char> igmp
+) {
+    if (igmp.size() < IGMP_SIZE) {
+        return MessageKind::DATA;
+    }
+
+    std::lock_guard<std::mutex> g(mutex);
+    switch (igmp[0]) {
+    case IGMP_QUERY:
+        refresh_router_port(port);
+        publish_group_table();
+        return MessageKind::ROUTER;
+    case IGMPV1_REPORT:
+    case IGMPV2_REPORT:
+        join(port, vlan, ipv4_group_mac(&igmp[4]));
+        publish_group_table();
+        return MessageKind::MEMBERSHIP;
+    case IGMPV2_LEAVE:
+        leave(port, vlan, ipv4_group_mac(&igmp[4]));
+        return MessageKind::MEMBERSHIP;
+    case IGMPV3_REPORT:
+        break;
+    default:
+        // Some other multicast routing protocol, e.g. DVMRP, that every router should hear
+        return MessageKind::ROUTER;
+    }
+
+    const uint16_t record_count = read_u16(&igmp[6]);
+    size_t offset = IGMP_SIZE;
+    for (uint16_t record = 0; record < record_count; ++record) {
+        if (offset + IGMPV3_RECORD_SIZE > igmp.size()) {
+            break;
+        }
+
+        const uint8_t type = igmp[offset];
+        const uint16_t source_count = read_u16(&igmp[offset + 2]);
+        const MacAddress group_mac = ipv4_group_mac(&igmp[offset + 4]);
+        if (type != BLOCK_OLD_SOURCES) {
+            record_joins(type, source_count) ? join(port, vlan, group_mac)
+                                             : leave(port, vlan, group_mac);
+        }
+
+        // Skip the sources and the auxiliary data, which is counted in 32-bit words
+        offset += IGMPV3_RECORD_SIZE + 4 * (size_t)source_count + 4 * (size_t)igmp[offset + 1];
+    }
+    publish_group_table();
+    return MessageKind::MEMBERSHIP;
+}
+
+// Learns from an ICMPv6 message received on the given port, if it's MLD
+MulticastSnooping::MessageKind MulticastSnooping::snoop_mld(
+    size_t port, uint16_t vlan, std::span<const unsigned char> icmp
+) {
+    if (icmp.empty()) {
+        return MessageKind::DATA;
+    }
+
+    const uint8_t type = icmp[0];
+    if (type == MLD_QUERY && icmp.size() >= MLDV1_SIZE) {
+        std::lock_guard<std::mutex> g(mutex);
+        refresh_router_port(port);
+        publish_group_table();
+        return MessageKind::ROUTER;
+    }
+    if ((type == MLDV1_REPORT || type == MLDV1_DONE) && icmp.size() >= MLDV1_SIZE) {
+        std::lock_guard<std::mutex> g(mutex);
+        const MacAddress group_mac = ipv6_group_mac(&icmp[8]);
+        type == MLDV1_REPORT ? join(port, vlan, group_mac) : leave(port, vlan, group_mac);
+        publish_group_table();
+        return MessageKind::MEMBERSHIP;
+    }
+    if (type != MLDV2_REPORT || icmp.size() < MLDV2_REPORT_SIZE) {
+        // Everything else, e.g. neighbour discovery, is just traffic to a group
+        return MessageKind::DATA;
+    }
+
+    std::lock_guard<std::mutex> g(mutex);
+    const uint16_t record_count = read_u16(&icmp[6]);
+    size_t offset = MLDV2_REPORT_SIZE;
+    for (uint16_t record = 0; record < record_count; ++record) {
+        if (offset + MLDV2_RECORD_SIZE > icmp.size()) {
+            break;
+        }
+
+        const uint8_t record_type = icmp[offset];
+        const uint16_t source_count = read_u16(&icmp[offset + 2]);
+        const MacAddress group_mac = ipv6_group_mac(&icmp[offset + 4]);
+        if (record_type != BLOCK_OLD_SOURCES) {
+            record_joins(record_type, source_count) ? join(port, vlan, group_mac)
+                                                    : leave(port, vlan, group_mac);
+        }
+
+        offset += MLDV2_RECORD_SIZE + 16 * (size_t)source_count + 4 * (size_t)icmp[offset + 1];
+    }
+    publish_group_table();
+    return MessageKind::MEMBERSHIP;
+}
+
+// Learns from an IPv4 packet received on the given port, if it's IGMP or PIM
+MulticastSnooping::MessageKind MulticastSnooping::snoop_ipv4(
+    size_t port, uint16_t vlan, std::span<const unsigned char> packet
+) {
+    if (packet.size() < IPV4_MIN_HEADER_SIZE || packet[0] >> 4 != 4) {
+        return MessageKind::DATA;
+    }
+
+    // Only the first fragment of a packet has its header, and control messages are never fragmented
+    const size_t header_size = 4 * (size_t)(packet[0] & 0x0F);
+    const size_t total_length = std::min<size_t>(read_u16(&packet[2]), packet.size());
+    if (header_size < IPV4_MIN_HEADER_SIZE || total_length < header_size ||
+        (read_u16(&packet[6]) & 0x1FFF) != 0) {
+        return MessageKind::DATA;
+    }
+
+    switch (packet[9]) {
+    case IPPROTO_IGMP:
+        return snoop_igmp(port, vlan, packet.subspan(header_size, total_length - header_size));
+    case IPPROTO_PIM: {
+        std::lock_guard<std::mutex> g(mutex);
+        refresh_router_port(port);
+        publish_group_table();
+        return MessageKind::ROUTER;
+    }
+    default:
+        return MessageKind::DATA;
+    }
+}
+
+/*
+ * Learns from an IPv6 packet received on the given port, if it's MLD or PIM. MLD messages always
+ * come after a hop-by-hop options header carrying a router alert, so extension headers are skipped.
+ */
+MulticastSnooping::MessageKind MulticastSnooping::snoop_ipv6(
+    size_t port, uint16_t vlan, std::span<const unsigned char> packet
+) {
+    if (packet.size() < IPV6_HEADER_SIZE || packet[0] >> 4 != 6) {
+        return MessageKind::DATA;
+    }
+
+    const size_t end = std::min(packet.size(), IPV6_HEADER_SIZE + read_u16(&packet[4]));
+    uint8_t next_header = packet[6];
+    size_t offset = IPV6_HEADER_SIZE;
+    while (next_header == IPPROTO_HOPOPTS || next_header == IPPROTO_DSTOPTS) {
+        if (offset + 2 > end) {
+            return MessageKind::DATA;
+        }
+        next_header = packet[offset];
+        offset += 8 * ((size_t)packet[offset + 1] + 1);
+    }
+    if (offset > end) {
+        return MessageKind::DATA;
+    }
+
+    switch (next_header) {
+    case IPPROTO_ICMPV6:
+        return snoop_mld(port, vlan, packet.subspan(offset, end - offset));
+    case IPPROTO_PIM: {
+        std::lock_guard<std::mutex> g(mutex);
+        refresh_router_port(port);
+        publish_group_table();
+        return MessageKind::ROUTER;
+    }
+    default:
+        return MessageKind::DATA;
+    }
+}
+
+/*
+ * Learns from the given multicast frame received on the given port in the given VLAN, then works
+ * out where it should go. Returns false if the frame should be flooded as usual. Otherwise, fills
+ * in the ports the frame should go to, which may include the port it came from and may be empty,
+ * and returns true.
+ *
+ * Membership reports and leaves only go to multicast routers, so that hosts on other ports don't
+ * hear them and hold back their own reports. Queries are flooded so every host hears them.
+ * Traffic for a reported group goes to its members and to every multicast router.
+ *
+ * Where the frame goes is looked up in the published group table as the given reader, which is
+ * the index of the calling forwarding thread, without taking the lock.
+ */
+bool MulticastSnooping::snoop(
+    size_t ingress_port, std::span<const unsigned char> frame, PortBitmap& egress, uint16_t vlan,
+    size_t reader
+) {
+    MessageKind kind = MessageKind::DATA;
+    if (frame.size() > ETH_HLEN) {
+        const uint16_t ether_type = read_u16(&frame[12]);
+        if (ether_type == ETHERTYPE_IP) {
+            kind = snoop_ipv4(ingress_port, vlan, frame.subspan(ETH_HLEN));
+        } else if (ether_type == ETHERTYPE_IPV6) {
+            kind = snoop_ipv6(ingress_port, vlan, frame.subspan(ETH_HLEN));
+        }
+    }
+
+    if (kind == MessageKind::ROUTER) {
+        return false;
+    }
+
+    const GroupTable& table = *group_table.enter(reader);
+    bool snooped = kind == MessageKind::MEMBERSHIP;
+    if (snooped) {
+        egress = table.router_ports;
+    } else {
+        const uint64_t key = MulticastSnooping::group_key(vlan, MacAddress{frame.data()});
+        auto group = table.members.find(key);
+        if (group != table.members.end()) {
+            egress = group->second;
+            egress |= table.router_ports;
+            snooped = true;
+        }
+    }
+    group_table.exit(reader);
+
+    return snooped;
+}
+
+/*
+ * Advances the table's clock to the given time in seconds, and removes every membership and router
+ * port that ran out by then. Returns the number of memberships removed.
+ */
+size_t MulticastSnooping::age_out(uint32_t now) {
+    std::lock_guard<std::mutex> g(mutex);
+    clock = now;
+
+    router_ports.for_each([&](size_t port) {
+        if (now >= router_expiries[port]) {
+            syslog(LOG_INFO, "Multicast router on %s timed out", port_names[port].c_str());
+            router_ports.reset(port);
+            membership_changed = true;
+        }
+    });
+
+    size_t removed = 0;
+    for (auto group = groups.begin(); group != groups.end();) {
+        Group& info = group->second;
+        info.members.for_each([&](size_t port) {
+            if (now >= info.expiries[port]) {
+                info.members.reset(port);
+                ++removed;
+            }
+        });
+
+        group = info.members.none() ? groups.erase(group) : std::next(group);
+    }
+
+    membership_changed |= removed > 0;
+    publish_group_table();
+    return removed;
+}
+
+/*
+ * Forgets every membership and multicast router on the given port and renames it, for when the
+ * port is removed from the switch or a new port takes its place
+ */
+void MulticastSnooping::reset_port(size_t port, const std::string& name) {
+    std::lock_guard<std::mutex> g(mutex);
+    port_names[port] = name;
+    router_ports.reset(port);
+
+    for (auto group = groups.begin(); group != groups.end();) {
+        group->second.members.reset(port);
+        group = group->second.members.none() ? groups.erase(group) : std::next(group);
+    }
+
+    membership_changed = true;
+    publish_group_table();
+}
+
+// Whether the given port is a member of the group sent to the given MAC in the given VLAN
+bool MulticastSnooping::is_member(MacAddress group_mac, size_t port, uint16_t vlan) const {
+    std::lock_guard<std::mutex> g(mutex);
+    auto group = groups.find(MulticastSnooping::group_key(vlan, group_mac));
+    return group != groups.end() && group->second.members.test(port);
+}
+
+// Whether a multicast router was heard on the given port recently
+bool MulticastSnooping::is_router_port(size_t port) const {
+    std::lock_guard<std::mutex> g(mutex);
+    return router_ports.test(port);
+}
+
+// Number of groups with at least one member port
+size_t MulticastSnooping::group_count() const {
+    std::lock_guard<std::mutex> g(mutex);
+    return groups.size();
+}
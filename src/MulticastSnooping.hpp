@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MacAddress.hpp"
+#include "PortBitmap.hpp"
+#include "RcuPointer.hpp"
+#include "Vlan.hpp"
+
+/*
+ * IGMP and MLD snooping (RFC 4541). Listens in on the membership reports hosts send to multicast
+ * routers to learn which ports want which multicast groups, and on router queries to learn which
+ * ports lead to a multicast router, so that multicast can be sent only where it's wanted instead of
+ * flooded everywhere.
+ *
+ * Groups are keyed on their VLAN and MAC, since that's what the switch forwards on, so a report in
+ * one VLAN never draws another VLAN's traffic. Router ports aren't tracked per VLAN; the switch
+ * only sends a VLAN's traffic to the router ports in that VLAN. IP groups that share a MAC share
+ * their members, which at worst sends a port a group it didn't ask for. IGMPv3 and MLDv2 source
+ * filters aren't tracked: any report that wants some traffic for a group joins it. Traffic for a
+ * group nobody has reported, or for the link-local groups that control protocols use, is left to
+ * be flooded as before. Memberships and router ports age out with the protocols' default
+ * timers, and a leave ages a membership out after the last member query time unless a host answers
+ * the router's follow up query.
+ *
+ * Everything is keyed on port indices, with no sockets involved. Every method is thread safe:
+ * reports, queries and aging take the lock, and publish the group table through read-copy-update
+ * whenever a port joins or leaves a group or becomes or stops being a router port. Forwarding
+ * lookups only read the published table, so multicast data never takes the lock.
+ */
+class MulticastSnooping {
+public:
+    /*
+     * Timers, in seconds, with the IGMPv3 and MLDv2 defaults: robustness variable 2, query interval
+     * 125s, query response interval 10s, and last member query interval 1s
+     */
+    static constexpr uint32_t MEMBERSHIP_INTERVAL = 260;
+    static constexpr uint32_t ROUTER_INTERVAL = 255;
+    static constexpr uint32_t LAST_MEMBER_QUERY_TIME = 2;
+
+    /*
+     * Number of groups the table holds at most. Reports for more groups are ignored, so traffic for
+     * those groups is flooded.
+     */
+    static constexpr size_t MAX_GROUPS = 4096;
+
+    static bool is_snooped_group(MacAddress);
+
+private:
+    // What a frame means to snooping, and so where it may be sent
+    enum class MessageKind {
+        // Anything that isn't a snooped control message
+        DATA,
+
+        // A membership report or leave, which only multicast routers need to hear
+        MEMBERSHIP,
+
+        // A query or other router message, which every port needs to hear
+        ROUTER,
+    };
+
+    struct Group {
+        PortBitmap members;
+
+        // Time each member port's membership runs out, indexed the same as the switch's ports
+        std::vector<uint32_t> expiries;
+    };
+
+    // Who the data path sends a group's traffic to, as of the last change in membership
+    struct GroupTable {
+        // Member ports by group, keyed the same as groups
+        std::unordered_map<uint64_t, PortBitmap> members;
+
+        PortBitmap router_ports;
+    };
+
+    // Serializes changes to the port names and the tables below, and publishing group_table
+    mutable std::mutex mutex;
+
+    std::vector<std::string> port_names;
+
+    // Groups by VLAN and MAC, as packed by group_key()
+    std::unordered_map<uint64_t, Group> groups;
+
+    // Ports a multicast router was heard on, and the time each one runs out
+    PortBitmap router_ports;
+    std::vector<uint32_t> router_expiries;
+
+    // Current time as of the last call to age_out()
+    uint32_t clock;
+
+    // Whether membership changed since group_table was last published
+    bool membership_changed;
+
+    // The groups and router ports as forwarding sees them, followed by one reader per shard
+    RcuPointer<GroupTable> group_table;
+
+    static uint64_t group_key(uint16_t, MacAddress);
+
+    void join(size_t, uint16_t, MacAddress);
+    void leave(size_t, uint16_t, MacAddress);
+    void refresh_router_port(size_t);
+    void publish_group_table();
+    MessageKind snoop_igmp(size_t, uint16_t, std::span<const unsigned char>);
+    MessageKind snoop_mld(size_t, uint16_t, std::span<const unsigned char>);
+    MessageKind snoop_ipv4(size_t, uint16_t, std::span<const unsigned char>);
+    MessageKind snoop_ipv6(size_t, uint16_t, std::span<const unsigned char>);
+
+public:
+    explicit MulticastSnooping(const std::vector<std::string>&, size_t = 1);
+
+    MulticastSnooping(const MulticastSnooping&) = delete;
+    MulticastSnooping& operator=(const MulticastSnooping&) = delete;
+
+    bool snoop(
+        size_t, std::span<const unsigned char>, PortBitmap&, uint16_t = DEFAULT_VLAN, size_t = 0
+    );
+    size_t age_out(uint32_t);
+    void reset_port(size_t, const std::string&);
+
+    bool is_member(MacAddress, size_t, uint16_t = DEFAULT_VLAN) const;
+    bool is_router_port(size_t) const;
+    size_t group_count() const;
+};
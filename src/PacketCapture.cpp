@@ -0,0 +1,248 @@
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+
+#include "PacketCapture.hpp"
+#include "panic.hpp"
+
+// pcapng block types
+static constexpr uint32_t SECTION_HEADER_BLOCK = 0x0A0D0D0A;
+static constexpr uint32_t INTERFACE_DESCRIPTION_BLOCK = 1;
+static constexpr uint32_t ENHANCED_PACKET_BLOCK = 6;
+
+static constexpr uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+static constexpr uint16_t LINKTYPE_ETHERNET = 1;
+
+// Option codes: end of options, an interface's name and timestamp resolution, and a frame's flags
+static constexpr uint16_t OPT_ENDOFOPT = 0;
+static constexpr uint16_t IF_NAME = 2;
+static constexpr uint16_t IF_TSRESOL = 9;
+static constexpr uint16_t EPB_FLAGS = 2;
+
+// Timestamps are in units of 10^-9 seconds
+static constexpr uint8_t NANOSECOND_RESOLUTION = 9;
+
+// Directions a frame can be flagged with
+static constexpr uint32_t EPB_INBOUND = 1;
+static constexpr uint32_t EPB_OUTBOUND = 2;
+
+// pcapng is written in the host's byte order, which readers work out from the byte order magic
+template <typename T>
+static void put(unsigned char* destination, T value) {
+    memcpy(destination, &value, sizeof(T));
+}
+
+template <typename T>
+static void append(std::vector<unsigned char>& block, T value) {
+    block.resize(block.size() + sizeof(T));
+    put(block.data() + block.size() - sizeof(T), value);
+}
+
+// Number of bytes of padding that bring the given length up to a multiple of four
+static size_t padding(size_t length) {
+    return (4 - length % 4) % 4;
+}
+
+// Appends an option to the given block, padded to a multiple of four bytes
+static void append_option(
+    std::vector<unsigned char>& block, uint16_t code, const void* value, size_t length
+) {
+    append(block, code);
+    append(block, (uint16_t)length);
+    block.insert(block.end(), (const unsigned char*)value, (const unsigned char*)value + length);
+    block.resize(block.size() + padding(length), 0);
+}
+
+// Fills in the total length a block starts and ends with, once everything else is in the block
+static void finish_block(std::vector<unsigned char>& block, size_t start) {
+    append(block, (uint32_t)0);
+    const uint32_t block_length = block.size() - start;
+    put(block.data() + start + sizeof(uint32_t), block_length);
+    put(block.data() + block.size() - sizeof(uint32_t), block_length);
+}
+
+/*
+ * Opens the capture file, replacing whatever was there. Panics if the file could not be opened.
+ * Returns the file descriptor.
+ */
+int PacketCapture::open_file(const std::string& path) {
+    int new_file_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (new_file_fd < 0) {
+        PANIC("Failed to open capture file %s: %s\n", path.c_str(), strerror(errno));
+    }
+    return new_file_fd;
+}
+
+/*
+ * Opens a capture at the given path with an interface for each of the given ports, and a queue
+ * for each of the given number of producers. Panics if the capture could not be started.
+ */
+PacketCapture::PacketCapture(
+    const std::string& p, const std::vector<std::string>& port_names, size_t producers
+)
+    : path{p},
+      file_fd{PacketCapture::open_file(p)},
+      write_errors_count{0} {
+    for (size_t producer = 0; producer < producers; ++producer) {
+        queues.push_back(std::make_unique<SpscRing<CapturedFrame>>(PacketCapture::QUEUE_DEPTH));
+    }
+
+    // A single section of unspecified length, so the writer never has to seek back
+    std::vector<unsigned char> blocks;
+    append(blocks, SECTION_HEADER_BLOCK);
+    append(blocks, (uint32_t)0);
+    append(blocks, BYTE_ORDER_MAGIC);
+    append(blocks, (uint16_t)1);
+    append(blocks, (uint16_t)0);
+    append(blocks, (int64_t)-1);
+    finish_block(blocks, 0);
+
+    for (const std::string& port_name : port_names) {
+        const size_t start = blocks.size();
+        append(blocks, INTERFACE_DESCRIPTION_BLOCK);
+        append(blocks, (uint32_t)0);
+        append(blocks, LINKTYPE_ETHERNET);
+        append(blocks, (uint16_t)0);
+        append(blocks, (uint32_t)0);
+        append_option(blocks, IF_NAME, port_name.data(), port_name.size());
+        append_option(blocks, IF_TSRESOL, &NANOSECOND_RESOLUTION, sizeof(uint8_t));
+        append_option(blocks, OPT_ENDOFOPT, nullptr, 0);
+        finish_block(blocks, start);
+    }
+
+    iovec header{blocks.data(), blocks.size()};
+    if (!write_all(&header, 1)) {
+        PANIC("Failed to write capture file %s: %s\n", path.c_str(), strerror(errno));
+    }
+}
+
+PacketCapture::~PacketCapture() {
+    close(file_fd);
+}
+
+/*
+ * Queues the given frame, received or sent on the given port with the given VLAN tag, to be
+ * written by the given producer. Producer only. Never blocks, and returns false if the frame
+ * couldn't be queued because the producer's queue is full.
+ */
+bool PacketCapture::capture(
+    size_t producer, const Frame& frame, size_t port, bool egress, std::optional<uint16_t> vlan_tci
+) {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const uint64_t timestamp = (uint64_t)now.tv_sec * 1'000'000'000 + now.tv_nsec;
+    return queues[producer]->try_emplace(frame, (uint32_t)port, egress, vlan_tci, timestamp);
+}
+
+/*
+ * Writes the given iovecs to the capture file, picking up where a short write left off. Returns
+ * false if the file couldn't be written.
+ */
+bool PacketCapture::write_all(iovec* remaining, size_t count) {
+    while (count > 0) {
+        ssize_t written = writev(file_fd, remaining, std::min<size_t>(count, IOV_MAX));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+
+        while (count > 0 && (size_t)written >= remaining->iov_len) {
+            written -= remaining->iov_len;
+            ++remaining;
+            --count;
+        }
+        if (count > 0) {
+            remaining->iov_base = (unsigned char*)remaining->iov_base + written;
+            remaining->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+/*
+ * Points the given iovecs at the enhanced packet block for the given frame, building its header
+ * and trailer in the given slot of the batch. The frame's bytes are never copied; a VLAN tag is
+ * pushed back between its MACs and the rest of it with an iovec of its own. Returns the number of
+ * iovecs used.
+ */
+size_t PacketCapture::gather_frame(
+    const CapturedFrame& captured, size_t slot, iovec* frame_iovecs
+) {
+    const std::span<const unsigned char> data = captured.frame.buffer();
+    const bool tagged = captured.vlan_tci.has_value() && data.size() >= 2 * ETH_ALEN;
+    const uint32_t length = data.size() + (tagged ? VLAN_TAG_SIZE : 0);
+    const size_t frame_padding = padding(length);
+    const uint32_t block_length = PACKET_HEADER_SIZE + length + frame_padding + 16;
+
+    unsigned char* header = headers[slot].data();
+    put(header, ENHANCED_PACKET_BLOCK);
+    put(header + 4, block_length);
+    put(header + 8, captured.port);
+    put(header + 12, (uint32_t)(captured.timestamp >> 32));
+    put(header + 16, (uint32_t)captured.timestamp);
+    put(header + 20, length);
+    put(header + 24, length);
+
+    unsigned char* trailer = trailers[slot].data();
+    memset(trailer, 0, frame_padding);
+    put(trailer + frame_padding, EPB_FLAGS);
+    put(trailer + frame_padding + 2, (uint16_t)sizeof(uint32_t));
+    put(trailer + frame_padding + 4, captured.egress ? EPB_OUTBOUND : EPB_INBOUND);
+    put(trailer + frame_padding + 8, (uint32_t)OPT_ENDOFOPT);
+    put(trailer + frame_padding + 12, block_length);
+
+    size_t count = 0;
+    frame_iovecs[count++] = {header, PACKET_HEADER_SIZE};
+    if (tagged) {
+        tags[slot] = {
+            ETHERTYPE_VLAN >> 8, ETHERTYPE_VLAN & 0xFF,
+            (unsigned char)(captured.vlan_tci.value() >> 8),
+            (unsigned char)(captured.vlan_tci.value() & 0xFF)
+        };
+        frame_iovecs[count++] = {(void*)data.data(), 2 * ETH_ALEN};
+        frame_iovecs[count++] = {tags[slot].data(), VLAN_TAG_SIZE};
+        frame_iovecs[count++] = {(void*)(data.data() + 2 * ETH_ALEN), data.size() - 2 * ETH_ALEN};
+    } else {
+        frame_iovecs[count++] = {(void*)data.data(), data.size()};
+    }
+    frame_iovecs[count++] = {trailer, frame_padding + 16};
+    return count;
+}
+
+/*
+ * Writes out every frame queued so far, a batch at a time, and releases them. Writer only. Frames
+ * that fail to write are dropped and counted. Returns the number of frames taken off the queues.
+ */
+size_t PacketCapture::write_pending() {
+    size_t taken = 0;
+    for (const std::unique_ptr<SpscRing<CapturedFrame>>& queue : queues) {
+        size_t readable = queue->readable();
+        while (readable > 0) {
+            const size_t batch_size = std::min(readable, PacketCapture::WRITE_BATCH_SIZE);
+            size_t iovec_count = 0;
+            for (size_t i = 0; i < batch_size; ++i) {
+                iovec_count += gather_frame(queue->peek(i), i, iovecs.data() + iovec_count);
+            }
+
+            if (!write_all(iovecs.data(), iovec_count)) {
+                write_errors_count.fetch_add(batch_size, std::memory_order_relaxed);
+                syslog(
+                    LOG_ERR, "Failed to write %ld frame(s) to capture file %s: %s", batch_size,
+                    path.c_str(), strerror(errno)
+                );
+            }
+
+            queue->pop(batch_size);
+            readable -= batch_size;
+            taken += batch_size;
+        }
+    }
+    return taken;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <sys/uio.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Frame.hpp"
+#include "SpscRing.hpp"
+
+/*
+ * Writes mirrored frames to a pcapng file, e.g. for Wireshark, from a thread of its own so that
+ * nothing on the forwarding path ever waits on the disk.
+ *
+ * Every thread that switches frames is a producer with its own lock-free ring into the capture.
+ * A captured frame is queued by reference, so capturing never copies the frame's bytes; the frame's
+ * buffer simply stays out of its pool until it's been written. If a ring is full because the writer
+ * can't keep up, the frame isn't captured and the producer is told, so mirroring never blocks.
+ *
+ * The writer gathers the pcapng blocks of everything queued straight from the frame buffers with
+ * writev(), so the file is written sequentially in large chunks. Each port is an interface of the
+ * capture, and each frame records whether it was received or sent on its port, with nanosecond
+ * timestamps. Frames are written with the VLAN tag they had on the wire.
+ */
+class PacketCapture {
+public:
+    // Frames each producer can have queued before the capture starts dropping its frames
+    static constexpr size_t QUEUE_DEPTH = 8192;
+
+private:
+    struct CapturedFrame {
+        Frame frame;
+        uint32_t port;
+        bool egress;
+        std::optional<uint16_t> vlan_tci;
+
+        // Wall clock time the frame was captured at, in nanoseconds since the epoch
+        uint64_t timestamp;
+    };
+
+    // Frames written by a single writev(), each of which takes up to five iovecs
+    static constexpr size_t WRITE_BATCH_SIZE = 200;
+    static constexpr size_t IOVECS_PER_FRAME = 5;
+
+    // Fixed size parts of an enhanced packet block: everything before the frame, and after it
+    static constexpr size_t PACKET_HEADER_SIZE = 28;
+    static constexpr size_t PACKET_TRAILER_SIZE = 20;
+
+    const std::string path;
+    const int file_fd;
+    std::vector<std::unique_ptr<SpscRing<CapturedFrame>>> queues;
+
+    // Frames lost to failed writes
+    std::atomic_uint64_t write_errors_count;
+
+    // Block headers and trailers of the batch being written, which the iovecs point into
+    std::array<std::array<unsigned char, PACKET_HEADER_SIZE>, WRITE_BATCH_SIZE> headers;
+    std::array<std::array<unsigned char, VLAN_TAG_SIZE>, WRITE_BATCH_SIZE> tags;
+    std::array<std::array<unsigned char, PACKET_TRAILER_SIZE>, WRITE_BATCH_SIZE> trailers;
+    std::array<iovec, WRITE_BATCH_SIZE * IOVECS_PER_FRAME> iovecs;
+
+    static int open_file(const std::string&);
+    bool write_all(iovec*, size_t);
+    size_t gather_frame(const CapturedFrame&, size_t, iovec*);
+
+public:
+    PacketCapture(const std::string&, const std::vector<std::string>&, size_t);
+    ~PacketCapture();
+
+    PacketCapture(const PacketCapture&) = delete;
+    PacketCapture& operator=(const PacketCapture&) = delete;
+
+    bool capture(size_t, const Frame&, size_t, bool, std::optional<uint16_t>);
+    size_t write_pending();
+
+    uint64_t write_errors() const {
+        return write_errors_count.load(std::memory_order_relaxed);
+    }
+};
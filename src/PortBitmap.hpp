@@ -0,0 +1,82 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * A set of port indices, one bit per port. Bitmaps for the same switch are always sized for the
+ * same number of ports, so combining them is a loop over a handful of words, and copying one into
+ * another of the same size never allocates. Members are visited in ascending order by counting
+ * trailing zeros, so sparse sets cost next to nothing to walk no matter how many ports there are.
+ */
+class PortBitmap {
+private:
+    static constexpr size_t WORD_BITS = 64;
+
+    std::vector<uint64_t> words;
+
+public:
+    PortBitmap() = default;
+
+    // Creates an empty set that can hold ports below the given count
+    explicit PortBitmap(size_t port_count)
+        : words((port_count + PortBitmap::WORD_BITS - 1) / PortBitmap::WORD_BITS, 0) {
+    }
+
+    void set(size_t port) {
+        words[port / PortBitmap::WORD_BITS] |= 1ULL << (port % PortBitmap::WORD_BITS);
+    }
+
+    void reset(size_t port) {
+        words[port / PortBitmap::WORD_BITS] &= ~(1ULL << (port % PortBitmap::WORD_BITS));
+    }
+
+    bool test(size_t port) const {
+        return (words[port / PortBitmap::WORD_BITS] >> (port % PortBitmap::WORD_BITS)) & 1;
+    }
+
+    // Whether the set is empty
+    bool none() const {
+        for (uint64_t word : words) {
+            if (word != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t count() const {
+        size_t count = 0;
+        for (uint64_t word : words) { count += std::popcount(word); }
+        return count;
+    }
+
+    // Adds every port in the other set, which must be sized for the same number of ports
+    PortBitmap& operator|=(const PortBitmap& other) {
+        for (size_t i = 0; i < words.size(); ++i) { words[i] |= other.words[i]; }
+        return *this;
+    }
+
+    // Keeps only the ports also in the other set, which must be sized for the same number of ports
+    PortBitmap& operator&=(const PortBitmap& other) {
+        for (size_t i = 0; i < words.size(); ++i) { words[i] &= other.words[i]; }
+        return *this;
+    }
+
+    bool operator==(const PortBitmap&) const = default;
+
+    /*
+     * Calls the given function with every port in the set, in ascending order. Each word is read
+     * before any of its ports are visited, so the function may remove ports from the set.
+     */
+    template <typename Function>
+    void for_each(Function function) const {
+        for (size_t i = 0; i < words.size(); ++i) {
+            for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                function(i * PortBitmap::WORD_BITS + std::countr_zero(word));
+            }
+        }
+    }
+};
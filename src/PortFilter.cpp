@@ -0,0 +1,84 @@
+#include <net/ethernet.h>
+#include <charconv>
+
+#include "PortFilter.hpp"
+
+// Offsets of the EtherType of an untagged frame, and of the inner EtherType of a tagged one
+static constexpr uint32_t ETHER_TYPE_OFFSET = 12;
+static constexpr uint32_t INNER_ETHER_TYPE_OFFSET = 16;
+
+// What a classic BPF program returns to accept a frame whole, or to drop it
+static constexpr uint32_t ACCEPT = 0xFFFFFFFF;
+static constexpr uint32_t DROP = 0;
+
+// Largest program the kernel accepts
+static constexpr size_t MAX_PROGRAM_SIZE = BPF_MAXINSNS;
+
+/*
+ * Returns the classic BPF program to attach to a port's socket: the given program as is, or one
+ * that loads the frame's EtherType, looking past an 802.1Q tag if there is one, and drops the frame
+ * if it's any of the dropped EtherTypes
+ */
+std::vector<sock_filter> PortFilter::compile() const {
+    if (!program.empty()) {
+        return program;
+    }
+
+    std::vector<sock_filter> compiled = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, ETHER_TYPE_OFFSET),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_VLAN, 0, 1),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, INNER_ETHER_TYPE_OFFSET),
+    };
+
+    // Each comparison jumps over the ones after it and the accept to get to the drop at the end
+    for (size_t i = 0; i < dropped_ether_types.size(); ++i) {
+        const uint8_t to_drop = dropped_ether_types.size() - i;
+        compiled.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, dropped_ether_types[i], to_drop, 0));
+    }
+    compiled.push_back(BPF_STMT(BPF_RET | BPF_K, ACCEPT));
+    compiled.push_back(BPF_STMT(BPF_RET | BPF_K, DROP));
+    return compiled;
+}
+
+/*
+ * Parses a classic BPF program in the format tcpdump -ddd prints: the number of instructions on the
+ * first line, then one instruction per line as its code, jump if true, jump if false, and constant,
+ * all in decimal. Returns an empty optional if the text isn't a well formed program.
+ */
+std::optional<std::vector<sock_filter>> PortFilter::parse_program(std::string_view text) {
+    const char* next = text.data();
+    const char* end = text.data() + text.size();
+    auto parse_number = [&](uint32_t& value) {
+        while (next != end && (*next == ' ' || *next == '\t' || *next == '\n' || *next == ',')) {
+            ++next;
+        }
+        std::from_chars_result result = std::from_chars(next, end, value);
+        next = result.ptr;
+        return result.ec == std::errc{};
+    };
+
+    uint32_t size;
+    if (!parse_number(size) || size == 0 || size > MAX_PROGRAM_SIZE) {
+        return {};
+    }
+
+    std::vector<sock_filter> program(size);
+    for (sock_filter& instruction : program) {
+        uint32_t code, jump_true, jump_false;
+        if (!parse_number(code) || !parse_number(jump_true) || !parse_number(jump_false) ||
+            !parse_number(instruction.k) || code > UINT16_MAX || jump_true > UINT8_MAX ||
+            jump_false > UINT8_MAX) {
+            return {};
+        }
+        instruction.code = code;
+        instruction.jt = jump_true;
+        instruction.jf = jump_false;
+    }
+
+    // Anything left over but whitespace means the count was wrong
+    while (next != end && (*next == ' ' || *next == '\t' || *next == '\n')) { ++next; }
+    if (next != end) {
+        return {};
+    }
+    return program;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <linux/filter.h>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+/*
+ * Frames a port's socket drops in the kernel, so they never cost the switch a syscall or a copy.
+ * Either a list of EtherTypes to drop, or a whole classic BPF program.
+ *
+ * EtherTypes are matched on untagged frames, and on the inner EtherType of frames with a single
+ * 802.1Q tag. When the kernel strips tags on receive, the filter only ever sees the inner
+ * EtherType, so either way a dropped EtherType is dropped in every VLAN.
+ */
+struct PortFilter {
+    // Most EtherTypes a filter can drop, since each one's jump to the drop has to fit in a byte
+    static constexpr size_t MAX_DROPPED_ETHER_TYPES = 255;
+
+    std::vector<uint16_t> dropped_ether_types;
+
+    /*
+     * Classic BPF program run on every frame instead, which accepts a frame by returning non-zero.
+     * Typically generated with tcpdump -ddd.
+     */
+    std::vector<sock_filter> program;
+
+    // Whether the filter lets every frame through, so no program needs to be attached
+    bool empty() const {
+        return dropped_ether_types.empty() && program.empty();
+    }
+
+    std::vector<sock_filter> compile() const;
+
+    static std::optional<std::vector<sock_filter>> parse_program(std::string_view);
+};
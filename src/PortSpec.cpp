@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "PortSpec.hpp"
+#include "RingEthernetPort.hpp"
+
+// Formats an error message into the given string. Always returns false
+template <typename... Args>
+static bool fail(std::string& error, const char* format, Args... args) {
+    char message[256];
+    snprintf(message, sizeof(message), format, args...);
+    error = message;
+    return false;
+}
+
+// Parses a VLAN ID from a port spec. Returns false if it isn't a usable VLAN
+static bool parse_vlan(
+    const std::string& value, const std::string& interface_name, uint16_t& vlan, std::string& error
+) {
+    char* end = nullptr;
+    unsigned long parsed = strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || parsed < DEFAULT_VLAN || parsed > MAX_VLAN) {
+        return fail(
+            error, "Invalid VLAN '%s' for interface %s", value.c_str(), interface_name.c_str()
+        );
+    }
+    vlan = (uint16_t)parsed;
+    return true;
+}
+
+// Parses a comma separated list of EtherTypes from a port spec, e.g. "0x86dd,0x88cc"
+static bool parse_ether_types(
+    const std::string& value, const std::string& interface_name,
+    std::vector<uint16_t>& ether_types, std::string& error
+) {
+    for (size_t start = 0; start <= value.size();) {
+        const size_t end = std::min(value.find(',', start), value.size());
+        const std::string ether_type = value.substr(start, end - start);
+
+        char* parsed_end = nullptr;
+        unsigned long parsed = strtoul(ether_type.c_str(), &parsed_end, 0);
+        if (ether_type.empty() || *parsed_end != '\0' || parsed > UINT16_MAX) {
+            return fail(
+                error, "Invalid EtherType '%s' for interface %s", ether_type.c_str(),
+                interface_name.c_str()
+            );
+        }
+        ether_types.push_back((uint16_t)parsed);
+        start = end + 1;
+    }
+
+    if (ether_types.size() > PortFilter::MAX_DROPPED_ETHER_TYPES) {
+        return fail(
+            error, "Too many EtherTypes for interface %s. At most %ld can be dropped",
+            interface_name.c_str(), PortFilter::MAX_DROPPED_ETHER_TYPES
+        );
+    }
+    return true;
+}
+
+// Reads a classic BPF program in tcpdump -ddd format from the given file
+static bool read_bpf_program(
+    const std::string& path, const std::string& interface_name, std::vector<sock_filter>& program,
+    std::string& error
+) {
+    std::ifstream file{path};
+    std::stringstream text;
+    text << file.rdbuf();
+
+    std::optional<std::vector<sock_filter>> parsed = PortFilter::parse_program(text.str());
+    if (!file || !parsed.has_value()) {
+        return fail(
+            error, "Failed to read a BPF program for interface %s from %s",
+            interface_name.c_str(), path.c_str()
+        );
+    }
+    program = parsed.value();
+    return true;
+}
+
+// Parses a LAG number from a port spec. Returns false if it isn't a usable LAG
+static bool parse_lag(
+    const std::string& value, const std::string& interface_name, uint16_t& lag, std::string& error
+) {
+    char* end = nullptr;
+    unsigned long parsed = strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || parsed == LinkAggregation::NO_LAG ||
+        parsed > UINT16_MAX) {
+        return fail(
+            error, "Invalid LAG '%s' for interface %s", value.c_str(), interface_name.c_str()
+        );
+    }
+    lag = (uint16_t)parsed;
+    return true;
+}
+
+/*
+ * Parses a port spec. Returns an empty optional and describes what's wrong with the spec in the
+ * given string if it's invalid.
+ */
+std::optional<PortSpec> PortSpec::parse(const std::string& text, std::string& error) {
+    PortSpec spec;
+    size_t separator = text.find(':');
+    spec.interface_name = text.substr(0, separator);
+    bool native_given = false;
+
+    if (spec.interface_name.empty()) {
+        fail(error, "Invalid port '%s'. Ports start with an interface name", text.c_str());
+        return {};
+    }
+
+    while (separator != std::string::npos) {
+        const size_t start = separator + 1;
+        separator = text.find(':', start);
+        const std::string setting = text.substr(start, separator - start);
+        const size_t equals = setting.find('=');
+        const std::string name = setting.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : setting.substr(equals + 1);
+        const std::string& interface_name = spec.interface_name;
+
+        bool valid = true;
+        if (setting == "raw" || setting == "mmap" || setting == "xdp") {
+            spec.backend = setting;
+        } else if (name == "lag") {
+            valid = parse_lag(value, interface_name, spec.lag, error);
+        } else if (name == "drop") {
+            valid = parse_ether_types(
+                value, interface_name, spec.filter.dropped_ether_types, error
+            );
+        } else if (name == "bpf") {
+            valid = read_bpf_program(value, interface_name, spec.filter.program, error);
+        } else if (name == "access" || name == "trunk" || name == "native") {
+            if (!spec.vlans.has_value()) {
+                spec.vlans = PortVlans{};
+            }
+
+            if (name == "access") {
+                spec.vlans->mode = VlanMode::ACCESS;
+                valid = parse_vlan(value, interface_name, spec.vlans->native_vlan, error);
+            } else if (name == "native") {
+                valid = parse_vlan(value, interface_name, spec.vlans->native_vlan, error);
+                native_given = true;
+            } else {
+                spec.vlans->mode = VlanMode::TRUNK;
+                for (size_t vlan_start = 0; vlan_start <= value.size() && valid;) {
+                    const size_t vlan_end = std::min(value.find(',', vlan_start), value.size());
+                    uint16_t vlan = 0;
+                    valid = parse_vlan(
+                        value.substr(vlan_start, vlan_end - vlan_start), interface_name, vlan,
+                        error
+                    );
+                    spec.vlans->tagged_vlans.set(vlan);
+                    vlan_start = vlan_end + 1;
+                }
+            }
+        } else {
+            valid = fail(
+                error, "Unknown port setting '%s' for interface %s", setting.c_str(),
+                interface_name.c_str()
+            );
+        }
+
+        if (!valid) {
+            return {};
+        }
+    }
+
+    if (native_given && spec.vlans->mode != VlanMode::TRUNK) {
+        fail(
+            error, "Only trunk ports have a native VLAN, but %s isn't one",
+            spec.interface_name.c_str()
+        );
+        return {};
+    }
+    if (!spec.filter.dropped_ether_types.empty() && !spec.filter.program.empty()) {
+        fail(
+            error, "Interface %s can't have both dropped EtherTypes and a BPF program",
+            spec.interface_name.c_str()
+        );
+        return {};
+    }
+    return spec;
+}
+
+/*
+ * Opens the port the spec describes, with the spec's filter. XDP ports carve their chunks out of
+ * the given UMEM. Panics if the port can't be opened.
+ */
+std::shared_ptr<EthernetPort> PortSpec::open(const std::shared_ptr<XdpUmem>& umem) const {
+    if (backend == "mmap") {
+        return std::make_shared<RingEthernetPort>(interface_name, filter);
+    }
+    if (backend == "xdp") {
+        return XdpEthernetPort::create(interface_name, filter, umem);
+    }
+    return std::make_shared<EthernetPort>(interface_name, filter);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "EthernetPort.hpp"
+#include "LinkAggregation.hpp"
+#include "PortFilter.hpp"
+#include "Vlan.hpp"
+#include "XdpEthernetPort.hpp"
+
+/*
+ * A port as given on the command line or to the control socket, of the form
+ * <interface name>[:<backend>][:access=<vlan> | :trunk=<vlan>,...[:native=<vlan>]][:lag=<lag>]
+ * [:drop=<ethertype>,... | :bpf=<path>]. The raw socket backend is used when no backend is given.
+ */
+struct PortSpec {
+    std::string interface_name;
+
+    // "raw", "mmap" or "xdp"
+    std::string backend = "raw";
+
+    // VLAN settings, if the spec has any
+    std::optional<PortVlans> vlans;
+
+    uint16_t lag = LinkAggregation::NO_LAG;
+
+    PortFilter filter;
+
+    static std::optional<PortSpec> parse(const std::string&, std::string&);
+
+    std::shared_ptr<EthernetPort> open(const std::shared_ptr<XdpUmem>&) const;
+};
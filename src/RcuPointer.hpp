@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/*
+ * A pointer to an immutable T that a fixed set of reader threads follow without ever taking a lock
+ * or waiting, and that a writer replaces with read-copy-update: the writer builds a whole new T,
+ * publishes it, and frees the old one only once no reader can still be looking at it.
+ *
+ * Each reader wraps its use of the pointer in enter() and exit(), e.g. around a batch of frames,
+ * and announces the epoch it entered in on a cache line of its own. Entering and exiting are a
+ * store each, plus a load of the pointer. The writer bumps the epoch whenever it publishes, then
+ * waits out the grace period: until every reader has either exited or entered again since the
+ * bump. A reader that's outside of enter() and exit(), e.g. while it's blocked waiting for frames,
+ * never holds up a writer.
+ *
+ * Readers must not hold on to the pointer past exit(). Writers must be serialized by the caller,
+ * and must not be readers themselves.
+ */
+template <typename T>
+class RcuPointer {
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // Epoch a reader announces while it's outside of enter() and exit()
+    static constexpr uint64_t OUTSIDE = 0;
+
+    struct alignas(CACHE_LINE_SIZE) Reader {
+        std::atomic_uint64_t epoch{RcuPointer::OUTSIDE};
+    };
+
+    std::atomic<const T*> current;
+    alignas(CACHE_LINE_SIZE) std::atomic_uint64_t epoch;
+
+    const size_t reader_count;
+    const std::unique_ptr<Reader[]> readers;
+
+public:
+    // Creates a pointer to the given T, followed by the given number of readers
+    RcuPointer(std::unique_ptr<const T> initial, size_t r)
+        : current{initial.release()},
+          epoch{1},
+          reader_count{r},
+          readers{std::make_unique<Reader[]>(r)} {
+    }
+
+    ~RcuPointer() {
+        delete current.load();
+    }
+
+    RcuPointer(const RcuPointer&) = delete;
+    RcuPointer& operator=(const RcuPointer&) = delete;
+
+    /*
+     * Announces that the given reader is about to use the pointer, and returns it. Whatever it
+     * points to stays alive until the reader calls exit().
+     */
+    const T* enter(size_t reader) {
+        // Sequentially consistent, so a writer either sees this or the reader sees its new pointer
+        readers[reader].epoch.store(epoch.load(std::memory_order_acquire));
+        return current.load();
+    }
+
+    // Announces that the given reader is done with whatever enter() returned
+    void exit(size_t reader) {
+        readers[reader].epoch.store(RcuPointer::OUTSIDE, std::memory_order_release);
+    }
+
+    /*
+     * Returns the current pointer to a writer, or to anything else serialized with the writers.
+     * Readers must use enter() instead.
+     */
+    const T* get() const {
+        return current.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Replaces the pointer with the given one, then waits for every reader that could still be
+     * using the old one to be done with it, and frees it. Readers are never blocked by this, but
+     * the writer waits for as long as a reader takes to exit.
+     */
+    void publish(std::unique_ptr<const T> replacement) {
+        const T* old = current.exchange(replacement.release());
+        const uint64_t grace_epoch = epoch.fetch_add(1) + 1;
+
+        for (size_t reader = 0; reader < reader_count; ++reader) {
+            while (true) {
+                const uint64_t reader_epoch = readers[reader].epoch.load();
+                if (reader_epoch == RcuPointer::OUTSIDE || reader_epoch >= grace_epoch) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        delete old;
+    }
+};
@@ -0,0 +1,222 @@
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <poll.h>
+#include <cstring>
+#include <cerrno>
+
+#include "RingEthernetPort.hpp"
+#include "panic.hpp"
+
+/*
+ * Constructs a ring-backed ethernet port on the given interface. The raw socket is opened the same
+ * way as a regular EthernetPort, then switched to TPACKET_V3 and given a receive ring which is
+ * mapped into this process. Panics if the ring could not be set up.
+ */
+RingEthernetPort::RingEthernetPort(const std::string& i, const PortFilter& f)
+    : EthernetPort{i, EthernetPort::initialize_raw_socket(i, f)},
+      ring{nullptr},
+      current_block{0},
+      next_packet{nullptr},
+      remaining_packets{0} {
+    int version = TPACKET_V3;
+    if (setsockopt(socket_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        PANIC(
+            "Failed to enable TPACKET_V3 on interface %s: %s\n", interface_name.c_str(),
+            strerror(errno)
+        );
+    }
+
+    tpacket_req3 request;
+    memset(&request, 0, sizeof(tpacket_req3));
+    request.tp_block_size = RingEthernetPort::BLOCK_SIZE;
+    request.tp_block_nr = RingEthernetPort::BLOCK_COUNT;
+    request.tp_frame_size = RingEthernetPort::FRAME_SIZE;
+    request.tp_frame_nr = (RingEthernetPort::BLOCK_SIZE / RingEthernetPort::FRAME_SIZE) *
+                          RingEthernetPort::BLOCK_COUNT;
+    request.tp_retire_blk_tov = RingEthernetPort::BLOCK_TIMEOUT_MS;
+
+    if (setsockopt(socket_fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0) {
+        PANIC(
+            "Failed to create receive ring on interface %s: %s\n", interface_name.c_str(),
+            strerror(errno)
+        );
+    }
+
+    void* mapping = mmap(
+        nullptr, (size_t)RingEthernetPort::BLOCK_SIZE * RingEthernetPort::BLOCK_COUNT,
+        PROT_READ | PROT_WRITE, MAP_SHARED, socket_fd, 0
+    );
+    if (mapping == MAP_FAILED) {
+        PANIC(
+            "Failed to map receive ring on interface %s: %s\n", interface_name.c_str(),
+            strerror(errno)
+        );
+    }
+    ring = (uint8_t*)mapping;
+    filter = f;
+    owns_socket = true;
+}
+
+RingEthernetPort::~RingEthernetPort() {
+    munmap(ring, (size_t)RingEthernetPort::BLOCK_SIZE * RingEthernetPort::BLOCK_COUNT);
+}
+
+const char* RingEthernetPort::backend() const {
+    return "mmap";
+}
+
+std::shared_ptr<EthernetPort> RingEthernetPort::clone() const {
+    std::shared_ptr<RingEthernetPort> port =
+        std::make_shared<RingEthernetPort>(interface_name, filter);
+    port->vlans = vlans;
+    return port;
+}
+
+/*
+ * Returns the tag control information of the VLAN tag the kernel stripped off the given frame in
+ * the ring, or an empty optional if the frame wasn't tagged
+ */
+std::optional<uint16_t> RingEthernetPort::packet_vlan_tci(const tpacket3_hdr* packet) {
+    if (packet->hv1.tp_vlan_tci == 0 && !(packet->tp_status & TP_STATUS_VLAN_VALID)) {
+        return {};
+    }
+    return packet->hv1.tp_vlan_tci;
+}
+
+/*
+ * Returns the offloads of the given frame in the ring, which the kernel puts right in front of the
+ * frame if the socket takes them, or no offloads if it doesn't
+ */
+FrameOffload RingEthernetPort::packet_offload(const tpacket3_hdr* packet) const {
+    FrameOffload offload{};
+    if (vnet_header) {
+        memcpy(
+            &offload, (const uint8_t*)packet + packet->tp_mac - sizeof(FrameOffload),
+            sizeof(FrameOffload)
+        );
+    }
+    return offload;
+}
+
+tpacket_block_desc* RingEthernetPort::block_at(uint32_t index) const {
+    return (tpacket_block_desc*)(ring + (size_t)index * RingEthernetPort::BLOCK_SIZE);
+}
+
+// Returns true if the kernel has handed the current block over to user space
+bool RingEthernetPort::block_ready() const {
+    // The kernel publishes the block status with a release store, so it has to be read as acquire
+    uint32_t* block_status = &block_at(current_block)->hdr.bh1.block_status;
+    return (__atomic_load_n(block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) != 0;
+}
+
+/*
+ * Blocks until the kernel hands the current block over to user space, then points the packet
+ * cursor at its first frame. Returns false if polling the socket failed.
+ */
+bool RingEthernetPort::wait_for_block() {
+    tpacket_block_desc* block = block_at(current_block);
+
+    while (!block_ready()) {
+        pollfd poll_config{socket_fd, POLLIN | POLLERR, 0};
+        if (poll(&poll_config, 1, -1) < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+
+    next_packet = (tpacket3_hdr*)((uint8_t*)block + block->hdr.bh1.offset_to_first_pkt);
+    remaining_packets = block->hdr.bh1.num_pkts;
+    return true;
+}
+
+// Hands the current block back to the kernel and moves on to the next block in the ring
+void RingEthernetPort::release_block() {
+    __atomic_store_n(
+        &block_at(current_block)->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE
+    );
+    current_block = (current_block + 1) % RingEthernetPort::BLOCK_COUNT;
+    next_packet = nullptr;
+    remaining_packets = 0;
+}
+
+/*
+ * Receives a single frame from the ring and copies it into a Frame from this port's pool. Prefer
+ * receive_frames(), which avoids the copy.
+ */
+std::optional<Frame> RingEthernetPort::receive_frame() {
+    while (true) {
+        while (remaining_packets == 0) {
+            if (!wait_for_block()) {
+                return {};
+            }
+
+            // Blocks retired by the timeout can be empty
+            if (remaining_packets == 0) {
+                release_block();
+            }
+        }
+
+        tpacket3_hdr* packet = next_packet;
+        next_packet = (tpacket3_hdr*)((uint8_t*)next_packet + next_packet->tp_next_offset);
+        --remaining_packets;
+
+        // Runts are skipped, as in receive_frames(), since they don't even hold an ethernet header
+        std::optional<Frame> frame;
+        if (packet->tp_snaplen >= sizeof(ethhdr)) {
+            frame.emplace(
+                frame_pool,
+                FrameView{
+                    {(uint8_t*)packet + packet->tp_mac, packet->tp_snaplen},
+                    RingEthernetPort::packet_vlan_tci(packet),
+                    nullptr,
+                    packet_offload(packet)
+                }
+            );
+        }
+        if (remaining_packets == 0) {
+            release_block();
+        }
+        if (frame.has_value()) {
+            return frame;
+        }
+    }
+}
+
+/*
+ * Receives the next block of frames from the ring and hands each one to the given callback as a
+ * view directly into the ring. The block is returned to the kernel once every frame in it has been
+ * handed out, so views must not be held onto after the callback returns. Returns the number of
+ * frames received, or an empty optional if waiting on the socket failed.
+ */
+std::optional<size_t> RingEthernetPort::receive_frames(const FrameViewCallback& callback) {
+    if (remaining_packets == 0) {
+        if (nonblocking && !block_ready()) {
+            return 0;
+        }
+        if (!wait_for_block()) {
+            return {};
+        }
+    }
+
+    size_t received = 0;
+    for (; remaining_packets > 0; --remaining_packets) {
+        tpacket3_hdr* packet = next_packet;
+        next_packet = (tpacket3_hdr*)((uint8_t*)next_packet + next_packet->tp_next_offset);
+
+        if (packet->tp_snaplen < sizeof(ethhdr)) {
+            continue;
+        }
+
+        callback(FrameView{
+            {(uint8_t*)packet + packet->tp_mac, packet->tp_snaplen},
+            RingEthernetPort::packet_vlan_tci(packet),
+            nullptr,
+            packet_offload(packet)
+        });
+        ++received;
+    }
+
+    release_block();
+    return received;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <optional>
+#include <linux/if_packet.h>
+
+#include "EthernetPort.hpp"
+#include "Frame.hpp"
+#include "FrameOffload.hpp"
+
+/*
+ * An EthernetPort that receives frames through a PACKET_MMAP (TPACKET_V3) ring shared with the
+ * kernel instead of doing one recvfrom() per frame. The kernel fills whole blocks of frames, and
+ * this port walks each block in user space, handing frames to the caller as views into the ring
+ * before giving the block back to the kernel. Sending still goes through the regular raw socket.
+ */
+class RingEthernetPort : public EthernetPort {
+private:
+    /*
+     * Geometry of the receive ring. Blocks must be a multiple of the page size, and frames can't
+     * straddle blocks, so blocks are big enough for a few 64 KiB GSO frames each. The block timeout
+     * bounds how long a partially filled block can sit in the kernel before it's retired to user
+     * space, which bounds the latency added under light load.
+     */
+    static constexpr uint32_t BLOCK_SIZE = 1 << 18;
+    static constexpr uint32_t BLOCK_COUNT = 16;
+    static constexpr uint32_t FRAME_SIZE = 1 << 11;
+    static constexpr uint32_t BLOCK_TIMEOUT_MS = 1;
+
+    // Start of the memory mapped ring
+    uint8_t* ring;
+
+    // Index of the next block to be consumed from the ring
+    uint32_t current_block;
+
+    /*
+     * Cursor into the current block, used by receive_frame() to hand out frames one at a time. The
+     * cursor is empty when no block is currently owned by user space.
+     */
+    tpacket3_hdr* next_packet;
+    uint32_t remaining_packets;
+
+    static std::optional<uint16_t> packet_vlan_tci(const tpacket3_hdr*);
+    FrameOffload packet_offload(const tpacket3_hdr*) const;
+
+    tpacket_block_desc* block_at(uint32_t) const;
+    bool block_ready() const;
+    bool wait_for_block();
+    void release_block();
+
+public:
+    RingEthernetPort(const std::string&, const PortFilter& = {});
+    ~RingEthernetPort() override;
+
+    RingEthernetPort(const RingEthernetPort&) = delete;
+    RingEthernetPort& operator=(const RingEthernetPort&) = delete;
+
+    const char* backend() const override;
+    std::shared_ptr<EthernetPort> clone() const override;
+
+    std::optional<Frame> receive_frame() override;
+    std::optional<size_t> receive_frames(const FrameViewCallback&) override;
+};
@@ -0,0 +1,269 @@
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <algorithm>
+#include <cstring>
+
+#include "Segmenter.hpp"
+#include "Vlan.hpp"
+
+// EtherType of an 802.1ad service VLAN tag, which a frame can still have in front of its IP header
+static constexpr uint16_t ETHERTYPE_SERVICE_VLAN = 0x88A8;
+
+static constexpr size_t IPV4_MIN_HEADER_SIZE = 20;
+static constexpr size_t IPV6_HEADER_SIZE = 40;
+static constexpr size_t TCP_MIN_HEADER_SIZE = 20;
+static constexpr size_t UDP_HEADER_SIZE = 8;
+
+// Where the checksum is in a TCP and a UDP header
+static constexpr size_t TCP_CHECKSUM_OFFSET = 16;
+static constexpr size_t UDP_CHECKSUM_OFFSET = 6;
+
+// TCP flags that only the last segment keeps, and that only the first one keeps
+static constexpr uint8_t TCP_FIN = 0x01;
+static constexpr uint8_t TCP_PSH = 0x08;
+static constexpr uint8_t TCP_CWR = 0x80;
+
+static uint32_t read_big_endian(const unsigned char* bytes, size_t size) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; ++i) { value = value << 8 | bytes[i]; }
+    return value;
+}
+
+static void write_big_endian(unsigned char* bytes, uint32_t value, size_t size) {
+    for (size_t i = size; i-- > 0;) {
+        bytes[i] = (unsigned char)value;
+        value >>= 8;
+    }
+}
+
+// Adds the given bytes to a ones' complement sum as big endian 16-bit words
+static uint64_t sum_words(const unsigned char* bytes, size_t length, uint64_t sum = 0) {
+    for (; length > 1; bytes += 2, length -= 2) { sum += (uint32_t)(bytes[0] << 8 | bytes[1]); }
+    if (length > 0) {
+        sum += (uint32_t)(bytes[0] << 8);
+    }
+    return sum;
+}
+
+// Folds a ones' complement sum down to 16 bits and complements it, giving the checksum
+static uint16_t fold(uint64_t sum) {
+    while (sum >> 16) { sum = (sum & 0xFFFF) + (sum >> 16); }
+    return (uint16_t)~sum;
+}
+
+/*
+ * Works out how the given frame has to be split up, if it's a GSO frame, or whether its checksum
+ * can be filled in, if it only needs that
+ */
+Segmenter::Segmenter(std::span<const unsigned char> f, const FrameOffload& o)
+    : frame{f},
+      offload{o},
+      is_valid{false},
+      is_ipv4{false},
+      is_tcp{false},
+      network_offset{0},
+      transport_offset{0},
+      payload_offset{f.size()},
+      count{1} {
+    if (offload.gso()) {
+        is_valid = parse_gso();
+        return;
+    }
+
+    const size_t checksum_end =
+        (size_t)offload.checksum_start + offload.checksum_offset + sizeof(uint16_t);
+    is_valid = !offload.needs_checksum() || checksum_end <= frame.size();
+}
+
+// Whether a frame with the given offloads has to go through a Segmenter to be sent as is
+bool Segmenter::needed(const FrameOffload& offload) {
+    return offload.gso() || offload.needs_checksum();
+}
+
+/*
+ * Finds the IP and TCP or UDP headers of a GSO frame and the payload behind them, checking that
+ * they're what the frame's offloads say they are. Returns false if they aren't.
+ */
+bool Segmenter::parse_gso() {
+    if (!offload.needs_checksum() || offload.gso_size == 0) {
+        return false;
+    }
+
+    std::optional<bool> needs_ipv4;
+    switch (offload.gso_type & ~FrameOffload::GSO_ECN) {
+    case FrameOffload::GSO_TCPV4:
+        is_tcp = true;
+        needs_ipv4 = true;
+        break;
+    case FrameOffload::GSO_TCPV6:
+        is_tcp = true;
+        needs_ipv4 = false;
+        break;
+    case FrameOffload::GSO_UDP_L4:
+        is_tcp = false;
+        break;
+    default:
+        return false;
+    }
+
+    // Service tags, and 802.1Q tags that weren't popped, stay in front of the IP header
+    size_t ether_type_offset = 2 * ETH_ALEN;
+    while (ether_type_offset + sizeof(uint16_t) <= frame.size()) {
+        const uint16_t ether_type = read_big_endian(frame.data() + ether_type_offset, 2);
+        if (ether_type != ETHERTYPE_VLAN && ether_type != ETHERTYPE_SERVICE_VLAN) {
+            break;
+        }
+        ether_type_offset += VLAN_TAG_SIZE;
+    }
+    if (ether_type_offset + sizeof(uint16_t) > frame.size()) {
+        return false;
+    }
+    const uint16_t ether_type = read_big_endian(frame.data() + ether_type_offset, 2);
+    if (ether_type != ETHERTYPE_IP && ether_type != ETHERTYPE_IPV6) {
+        return false;
+    }
+    is_ipv4 = ether_type == ETHERTYPE_IP;
+    if (needs_ipv4.has_value() && needs_ipv4.value() != is_ipv4) {
+        return false;
+    }
+
+    // The transport header is where the checksum starts, which has to be right behind the IP one
+    network_offset = ether_type_offset + sizeof(uint16_t);
+    transport_offset = offload.checksum_start;
+    const size_t transport_header_size = is_tcp ? TCP_MIN_HEADER_SIZE : UDP_HEADER_SIZE;
+    if (transport_offset + transport_header_size > frame.size()) {
+        return false;
+    }
+    if (is_ipv4) {
+        const size_t header_size = (frame[network_offset] & 0x0F) * 4;
+        if (header_size < IPV4_MIN_HEADER_SIZE ||
+            network_offset + header_size != transport_offset) {
+            return false;
+        }
+    } else if (transport_offset < network_offset + IPV6_HEADER_SIZE) {
+        return false;
+    }
+
+    payload_offset = transport_offset + transport_header_size;
+    if (is_tcp) {
+        const size_t header_size = (frame[transport_offset + 12] >> 4) * 4;
+        if (header_size < TCP_MIN_HEADER_SIZE || transport_offset + header_size > frame.size()) {
+            return false;
+        }
+        payload_offset = transport_offset + header_size;
+    }
+
+    const size_t payload_size = frame.size() - payload_offset;
+    count = std::max<size_t>(1, (payload_size + offload.gso_size - 1) / offload.gso_size);
+    return true;
+}
+
+// Length of the given segment, with a VLAN tag if it's tagged
+size_t Segmenter::segment_length(size_t index, bool tagged) const {
+    const size_t payload_size = frame.size() - payload_offset;
+    const size_t segment_payload_size =
+        count > 1 ? std::min<size_t>(offload.gso_size, payload_size - index * offload.gso_size)
+                  : payload_size;
+    return payload_offset + segment_payload_size + (tagged ? VLAN_TAG_SIZE : 0);
+}
+
+// Combined length of every segment, with VLAN tags if they're tagged
+size_t Segmenter::total_length(bool tagged) const {
+    return count * (payload_offset + (tagged ? VLAN_TAG_SIZE : 0)) + frame.size() - payload_offset;
+}
+
+/*
+ * Writes the given segment out to the given destination, which must have room for its length,
+ * with a VLAN tag carrying the given tag control information if there is one. Must only be called
+ * on a valid Segmenter. Returns the segment's length.
+ */
+size_t Segmenter::write_segment(
+    size_t index, std::optional<uint16_t> tci, unsigned char* destination
+) const {
+    const size_t length = segment_length(index, tci.has_value());
+
+    /*
+     * Every segment gets a copy of the headers, which are then fixed up for the segment. Past the
+     * MACs, offsets from the start of the segment are the same as in the frame either way.
+     */
+    unsigned char* segment = destination;
+    if (tci.has_value()) {
+        memcpy(destination, frame.data(), 2 * ETH_ALEN);
+        write_big_endian(destination + 2 * ETH_ALEN, ETHERTYPE_VLAN, 2);
+        write_big_endian(destination + 2 * ETH_ALEN + 2, tci.value(), 2);
+        segment = destination + VLAN_TAG_SIZE;
+        memcpy(segment + 2 * ETH_ALEN, frame.data() + 2 * ETH_ALEN, payload_offset - 2 * ETH_ALEN);
+    } else {
+        memcpy(destination, frame.data(), payload_offset);
+    }
+
+    const size_t segment_length = length - (segment - destination);
+    memcpy(
+        segment + payload_offset, frame.data() + payload_offset + index * offload.gso_size,
+        segment_length - payload_offset
+    );
+
+    if (offload.gso()) {
+        fix_headers(segment, index, segment_length);
+    } else if (offload.needs_checksum()) {
+        finish_checksum(segment, segment_length);
+    }
+    return length;
+}
+
+/*
+ * Fills in the checksum of a frame that only needed that, the way a NIC would: summing everything
+ * from where the checksum starts, which includes the pseudo header sum the sender already left in
+ * the checksum field
+ */
+void Segmenter::finish_checksum(unsigned char* segment, size_t length) const {
+    const uint16_t checksum =
+        fold(sum_words(segment + offload.checksum_start, length - offload.checksum_start));
+    unsigned char* checksum_field = segment + offload.checksum_start + offload.checksum_offset;
+    write_big_endian(checksum_field, checksum != 0 ? checksum : 0xFFFF, 2);
+}
+
+/*
+ * Fixes up the headers copied into the given segment of a GSO frame, of the given length: the IP
+ * lengths and ID, the TCP sequence number and flags or the UDP length, and every checksum, which
+ * are computed from scratch
+ */
+void Segmenter::fix_headers(unsigned char* segment, size_t index, size_t length) const {
+    unsigned char* network = segment + network_offset;
+    unsigned char* transport = segment + transport_offset;
+    const size_t transport_length = length - transport_offset;
+
+    // Sum of the pseudo header the TCP or UDP checksum covers
+    uint64_t sum = transport_length + (is_tcp ? IPPROTO_TCP : IPPROTO_UDP);
+    if (is_ipv4) {
+        write_big_endian(network + 2, length - network_offset, 2);
+        write_big_endian(network + 4, read_big_endian(network + 4, 2) + index, 2);
+        write_big_endian(network + 10, 0, 2);
+        const size_t header_size = transport_offset - network_offset;
+        write_big_endian(network + 10, fold(sum_words(network, header_size)), 2);
+        sum = sum_words(network + 12, 8, sum);
+    } else {
+        write_big_endian(network + 4, length - network_offset - IPV6_HEADER_SIZE, 2);
+        sum = sum_words(network + 8, 32, sum);
+    }
+
+    size_t checksum_offset = UDP_CHECKSUM_OFFSET;
+    if (is_tcp) {
+        write_big_endian(
+            transport + 4, read_big_endian(transport + 4, 4) + index * offload.gso_size, 4
+        );
+        if (index + 1 < count) {
+            transport[13] &= ~(TCP_FIN | TCP_PSH);
+        }
+        if (index > 0) {
+            transport[13] &= ~TCP_CWR;
+        }
+        checksum_offset = TCP_CHECKSUM_OFFSET;
+    } else {
+        write_big_endian(transport + 4, transport_length, 2);
+    }
+
+    write_big_endian(transport + checksum_offset, 0, 2);
+    const uint16_t checksum = fold(sum_words(transport, transport_length, sum));
+    write_big_endian(transport + checksum_offset, checksum != 0 || is_tcp ? checksum : 0xFFFF, 2);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "FrameOffload.hpp"
+
+/*
+ * Does in software what a frame's offloads leave for whoever sends it, for ports that can't hand
+ * them to the kernel, e.g. AF_XDP sockets. A GSO frame is split into the frames it stands for, each
+ * with its own IP and TCP or UDP headers and checksums, the way the kernel's own GSO would split
+ * it. A frame that only needs its checksum filled in becomes a single frame with the checksum done.
+ * A frame with no offloads is copied as is.
+ *
+ * Segments are written out with a VLAN tag pushed between the MACs and the rest of the frame if the
+ * port tags it. The frame itself is never written to, so it can still be shared with other ports.
+ *
+ * TCP over IPv4 and IPv6 and UDP (USO) GSO frames are supported. Frames with any other kind of GSO,
+ * e.g. UDP fragmentation offload, or whose headers don't match their offloads aren't valid.
+ */
+class Segmenter {
+private:
+    const std::span<const unsigned char> frame;
+    const FrameOffload offload;
+
+    bool is_valid;
+    bool is_ipv4;
+    bool is_tcp;
+
+    // Offsets of the IP and TCP or UDP headers, and of the payload that gets split up
+    size_t network_offset;
+    size_t transport_offset;
+    size_t payload_offset;
+
+    size_t count;
+
+    bool parse_gso();
+    void finish_checksum(unsigned char*, size_t) const;
+    void fix_headers(unsigned char*, size_t, size_t) const;
+
+public:
+    Segmenter(std::span<const unsigned char>, const FrameOffload&);
+
+    static bool needed(const FrameOffload&);
+
+    bool valid() const {
+        return is_valid;
+    }
+
+    // Number of frames the frame turns into
+    size_t segments() const {
+        return count;
+    }
+
+    size_t segment_length(size_t, bool) const;
+    size_t total_length(bool) const;
+    size_t write_segment(size_t, std::optional<uint16_t>, unsigned char*) const;
+};
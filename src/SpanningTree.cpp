@@ -0,0 +1,552 @@
+#include <syslog.h>
+#include <algorithm>
+#include <array>
+
+#include "SpanningTree.hpp"
+
+// Where the LLC header and the BPDU itself start in a BPDU frame
+static constexpr size_t LLC_OFFSET = 14;
+static constexpr size_t BPDU_OFFSET = 17;
+
+// LLC header of every BPDU: the spanning tree SAP, as an unnumbered information frame
+static constexpr std::array<unsigned char, 3> LLC_HEADER = {0x42, 0x42, 0x03};
+
+// BPDU types, and the size of each, not counting the ethernet and LLC headers
+static constexpr uint8_t CONFIG_BPDU = 0x00;
+static constexpr uint8_t RST_BPDU = 0x02;
+static constexpr uint8_t TCN_BPDU = 0x80;
+static constexpr size_t CONFIG_BPDU_SIZE = 35;
+static constexpr size_t RST_BPDU_SIZE = 36;
+static constexpr size_t TCN_BPDU_SIZE = 4;
+
+static constexpr uint8_t RST_VERSION = 2;
+
+// Bits of a BPDU's flags field
+static constexpr uint8_t FLAG_TOPOLOGY_CHANGE = 0x01;
+static constexpr uint8_t FLAG_PROPOSAL = 0x02;
+static constexpr uint8_t FLAG_LEARNING = 0x10;
+static constexpr uint8_t FLAG_FORWARDING = 0x20;
+static constexpr uint8_t FLAG_AGREEMENT = 0x40;
+
+// Port role encoded in bits 2 and 3 of a BPDU's flags field
+static constexpr uint8_t ROLE_SHIFT = 2;
+static constexpr uint8_t ROLE_MASK = 0x03;
+static constexpr uint8_t ROLE_ALTERNATE_OR_BACKUP = 1;
+static constexpr uint8_t ROLE_ROOT = 2;
+static constexpr uint8_t ROLE_DESIGNATED = 3;
+
+// Number of BPDU frames that can be in flight at once before falling back to the heap
+static constexpr size_t BPDU_POOL_SIZE = 16;
+
+static uint64_t read_big_endian(const unsigned char* bytes, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) { value = value << 8 | bytes[i]; }
+    return value;
+}
+
+static void write_big_endian(unsigned char* bytes, uint64_t value, size_t size) {
+    for (size_t i = size; i-- > 0;) {
+        bytes[i] = (unsigned char)value;
+        value >>= 8;
+    }
+}
+
+const char* port_role_name(PortRole role) {
+    switch (role) {
+    case PortRole::ROOT:
+        return "root";
+    case PortRole::DESIGNATED:
+        return "designated";
+    case PortRole::ALTERNATE:
+        return "alternate";
+    case PortRole::BACKUP:
+        return "backup";
+    }
+    return "unknown";
+}
+
+const char* port_state_name(PortState state) {
+    switch (state) {
+    case PortState::DISCARDING:
+        return "discarding";
+    case PortState::LEARNING:
+        return "learning";
+    case PortState::FORWARDING:
+        return "forwarding";
+    }
+    return "unknown";
+}
+
+/*
+ * Creates a bridge with the given MAC and priority, whose ports all have the given path cost. The
+ * bridge's ports are named for logging, and are indexed the same as the given names. Every port
+ * starts out as a discarding designated port, proposing to whatever is on the other end.
+ */
+SpanningTree::SpanningTree(
+    MacAddress address, uint16_t priority, uint32_t cost, const std::vector<std::string>& names,
+    BpduSender sender, MacFlusher flusher
+)
+    : bridge_address{address},
+      bridge_id{(uint64_t)priority << 48 | address.int_representation()},
+      port_path_cost{cost},
+      port_names{names},
+      send_bpdu{std::move(sender)},
+      flush_macs{std::move(flusher)},
+      ports(names.size()),
+      port_states{std::make_unique<std::atomic<PortState>[]>(names.size())},
+      root_priority{bridge_id, 0, bridge_id, 0},
+      root_message_age{0},
+      hello_while{1},
+      topology_changes_count{0},
+      bpdu_pool{BPDU_POOL_SIZE} {
+    std::lock_guard<std::mutex> g(mutex);
+    update_roles();
+}
+
+// Port identifier of the port at the given index, with the default port priority
+uint16_t SpanningTree::port_id(size_t port) {
+    return (uint16_t)(0x8000 | ((port + 1) & 0x0FFF));
+}
+
+// What this bridge sends on the given port while it's designated for the port's segment
+PriorityVector SpanningTree::designated_priority(size_t port) const {
+    return {
+        root_priority.root_bridge_id, root_priority.root_path_cost, bridge_id,
+        SpanningTree::port_id(port)
+    };
+}
+
+/*
+ * Recomputes the root bridge and the role of every port from the information each port holds, and
+ * moves every port to the state its role allows. Must hold the lock.
+ */
+void SpanningTree::update_roles() {
+    // The root port is whichever port offers the best path to a root that isn't this bridge
+    PriorityVector best{bridge_id, 0, bridge_id, 0};
+    std::optional<size_t> best_port;
+    for (size_t port = 0; port < ports.size(); ++port) {
+        const Port& info = ports[port];
+        if (!info.received_info || info.port_priority.designated_bridge_id == bridge_id) {
+            continue;
+        }
+
+        PriorityVector candidate = info.port_priority;
+        candidate.root_path_cost += port_path_cost;
+        if (candidate < best) {
+            best = candidate;
+            best_port = port;
+        }
+    }
+
+    // Agreements only hold for the root they were made for
+    const bool root_changed =
+        best.root_bridge_id != root_priority.root_bridge_id || best_port != root_port;
+    if (root_changed) {
+        syslog(
+            LOG_INFO, "Spanning tree root bridge is now %016lx, through %s", best.root_bridge_id,
+            best_port.has_value() ? port_names[best_port.value()].c_str() : "no port"
+        );
+        for (Port& info : ports) {
+            info.agreed = false;
+            info.agree = false;
+        }
+    }
+    root_priority = best;
+    root_port = best_port;
+    root_message_age = best_port.has_value() ? ports[best_port.value()].message_age + 1 : 0;
+
+    for (size_t port = 0; port < ports.size(); ++port) {
+        Port& info = ports[port];
+        const PriorityVector designated = designated_priority(port);
+
+        PortRole role;
+        if (port == root_port) {
+            role = PortRole::ROOT;
+        } else if (!info.received_info || designated < info.port_priority) {
+            // This bridge offers the segment a better path than anything it's heard on it
+            role = PortRole::DESIGNATED;
+            if (info.received_info || info.port_priority != designated) {
+                info.send_pending = true;
+            }
+            info.received_info = false;
+            info.port_priority = designated;
+        } else if (info.port_priority.designated_bridge_id == bridge_id) {
+            role = PortRole::BACKUP;
+        } else {
+            role = PortRole::ALTERNATE;
+        }
+
+        if (role != info.role) {
+            syslog(
+                LOG_INFO, "Spanning tree port %s role is now %s", port_names[port].c_str(),
+                port_role_name(role)
+            );
+            info.role = role;
+            info.forward_delay_while = SpanningTree::FORWARD_DELAY;
+            info.proposing = false;
+            info.agreed = false;
+            info.send_pending = true;
+        }
+    }
+
+    // The root port can only forward right away once no designated port can close a loop with it
+    const bool proposed = root_port.has_value() && ports[root_port.value()].proposed;
+    if (root_changed || proposed) {
+        sync();
+    }
+
+    for (size_t port = 0; port < ports.size(); ++port) { apply_state(port); }
+}
+
+/*
+ * Blocks every designated port that leads to another bridge and hasn't been agreed to under the
+ * current root, so they have to propose again before forwarding. Must hold the lock.
+ */
+void SpanningTree::sync() {
+    for (size_t port = 0; port < ports.size(); ++port) {
+        Port& info = ports[port];
+        if (info.role != PortRole::DESIGNATED || info.edge || info.agreed) {
+            continue;
+        }
+
+        if (port_state(port) != PortState::DISCARDING) {
+            set_state(port, PortState::DISCARDING);
+            info.forward_delay_while = SpanningTree::FORWARD_DELAY;
+            info.proposing = false;
+        }
+    }
+}
+
+// Moves the given port as far towards forwarding as its role allows right now. Must hold the lock
+void SpanningTree::apply_state(size_t port) {
+    Port& info = ports[port];
+    switch (info.role) {
+    case PortRole::ROOT:
+        set_state(port, PortState::FORWARDING);
+        break;
+    case PortRole::ALTERNATE:
+    case PortRole::BACKUP:
+        set_state(port, PortState::DISCARDING);
+        break;
+    case PortRole::DESIGNATED:
+        if (info.edge || info.agreed) {
+            info.proposing = false;
+            set_state(port, PortState::FORWARDING);
+        } else if (port_state(port) != PortState::FORWARDING && !info.proposing) {
+            info.proposing = true;
+            info.edge_delay_while = SpanningTree::EDGE_DELAY;
+            info.send_pending = true;
+        }
+        break;
+    }
+
+    // Agree to the designated bridge's proposal, now that nothing here can close a loop
+    if (info.proposed && info.role != PortRole::DESIGNATED) {
+        info.proposed = false;
+        info.agree = true;
+        info.send_pending = true;
+    }
+}
+
+// Must hold the lock
+void SpanningTree::set_state(size_t port, PortState state) {
+    if (port_state(port) == state) {
+        return;
+    }
+
+    port_states[port].store(state, std::memory_order_relaxed);
+    syslog(
+        LOG_INFO, "Spanning tree port %s state is now %s", port_names[port].c_str(),
+        port_state_name(state)
+    );
+
+    if (state == PortState::FORWARDING && !ports[port].edge) {
+        detect_topology_change(port);
+    }
+}
+
+/*
+ * Handles the given port starting to forward, which may have opened a better path to some MACs.
+ * Forgets every MAC learned behind the bridge's other ports and tells the rest of the tree to do
+ * the same. Must hold the lock.
+ */
+void SpanningTree::detect_topology_change(size_t port) {
+    topology_changes_count.fetch_add(1, std::memory_order_relaxed);
+    for (size_t other = 0; other < ports.size(); ++other) {
+        Port& info = ports[other];
+        if (info.edge) {
+            continue;
+        }
+
+        if (other != port) {
+            flush_macs(other);
+        }
+        if (info.role == PortRole::ROOT || info.role == PortRole::DESIGNATED) {
+            info.topology_change_while = SpanningTree::TOPOLOGY_CHANGE_TIME;
+            info.send_pending = true;
+        }
+    }
+}
+
+/*
+ * Handles a topology change announced by a neighbour on the given port: forgets every MAC learned
+ * behind the bridge's other ports and passes the announcement on through them. Must hold the lock.
+ */
+void SpanningTree::propagate_topology_change(size_t port) {
+    topology_changes_count.fetch_add(1, std::memory_order_relaxed);
+    for (size_t other = 0; other < ports.size(); ++other) {
+        Port& info = ports[other];
+        if (other == port || info.edge) {
+            continue;
+        }
+
+        flush_macs(other);
+        if ((info.role == PortRole::ROOT || info.role == PortRole::DESIGNATED) &&
+            info.topology_change_while == 0) {
+            info.topology_change_while = SpanningTree::TOPOLOGY_CHANGE_TIME;
+            info.send_pending = true;
+        }
+    }
+}
+
+// Sends an RST BPDU describing the given port on it. Must hold the lock
+void SpanningTree::transmit(size_t port) {
+    const Port& info = ports[port];
+    const PortState state = port_state(port);
+
+    std::array<unsigned char, SpanningTree::BPDU_FRAME_SIZE> frame{};
+    std::ranges::copy(SpanningTree::BRIDGE_GROUP_ADDRESS.raw_octets(), frame.begin());
+    std::ranges::copy(bridge_address.raw_octets(), frame.begin() + 6);
+    write_big_endian(&frame[12], LLC_HEADER.size() + RST_BPDU_SIZE, 2);
+    std::ranges::copy(LLC_HEADER, frame.begin() + LLC_OFFSET);
+
+    uint8_t role = ROLE_DESIGNATED;
+    if (info.role == PortRole::ROOT) {
+        role = ROLE_ROOT;
+    } else if (info.role != PortRole::DESIGNATED) {
+        role = ROLE_ALTERNATE_OR_BACKUP;
+    }
+
+    uint8_t flags = role << ROLE_SHIFT;
+    if (info.topology_change_while > 0) {
+        flags |= FLAG_TOPOLOGY_CHANGE;
+    }
+    if (info.role == PortRole::DESIGNATED && info.proposing) {
+        flags |= FLAG_PROPOSAL;
+    }
+    if (info.role != PortRole::DESIGNATED && info.agree) {
+        flags |= FLAG_AGREEMENT;
+    }
+    if (state != PortState::DISCARDING) {
+        flags |= FLAG_LEARNING;
+    }
+    if (state == PortState::FORWARDING) {
+        flags |= FLAG_FORWARDING;
+    }
+
+    const PriorityVector priority = designated_priority(port);
+    unsigned char* bpdu = frame.data() + BPDU_OFFSET;
+    bpdu[2] = RST_VERSION;
+    bpdu[3] = RST_BPDU;
+    bpdu[4] = flags;
+    write_big_endian(bpdu + 5, priority.root_bridge_id, 8);
+    write_big_endian(bpdu + 13, priority.root_path_cost, 4);
+    write_big_endian(bpdu + 17, priority.designated_bridge_id, 8);
+    write_big_endian(bpdu + 25, priority.designated_port_id, 2);
+
+    // Times are in 1/256ths of a second
+    write_big_endian(bpdu + 27, std::min<uint32_t>(root_message_age, 0xFF) << 8, 2);
+    write_big_endian(bpdu + 29, SpanningTree::MAX_AGE << 8, 2);
+    write_big_endian(bpdu + 31, SpanningTree::HELLO_TIME << 8, 2);
+    write_big_endian(bpdu + 33, SpanningTree::FORWARD_DELAY << 8, 2);
+
+    send_bpdu(port, Frame{bpdu_pool, frame});
+}
+
+// Sends a BPDU on every port that needs one after the current event. Must hold the lock
+void SpanningTree::transmit_pending() {
+    for (size_t port = 0; port < ports.size(); ++port) {
+        if (ports[port].send_pending) {
+            ports[port].send_pending = false;
+            transmit(port);
+        }
+    }
+}
+
+PortRole SpanningTree::port_role(size_t port) const {
+    std::lock_guard<std::mutex> g(mutex);
+    return ports[port].role;
+}
+
+// Whether the given port was found to only face hosts
+bool SpanningTree::is_edge(size_t port) const {
+    std::lock_guard<std::mutex> g(mutex);
+    return ports[port].edge;
+}
+
+// This bridge's identifier: its priority in the upper 16 bits and its MAC in the lower 48
+uint64_t SpanningTree::id() const {
+    return bridge_id;
+}
+
+// Identifier of the bridge this bridge currently believes is the root
+uint64_t SpanningTree::root_id() const {
+    std::lock_guard<std::mutex> g(mutex);
+    return root_priority.root_bridge_id;
+}
+
+// Number of topology changes this bridge has detected or been told about
+uint64_t SpanningTree::topology_changes() const {
+    return topology_changes_count.load(std::memory_order_relaxed);
+}
+
+/*
+ * Handles a frame sent to the bridge group address on the given port. Frames that aren't valid
+ * BPDUs are ignored.
+ */
+void SpanningTree::receive_bpdu(size_t port, std::span<const unsigned char> frame) {
+    if (frame.size() < BPDU_OFFSET + TCN_BPDU_SIZE ||
+        !std::equal(LLC_HEADER.begin(), LLC_HEADER.end(), frame.begin() + LLC_OFFSET)) {
+        return;
+    }
+
+    const unsigned char* bpdu = frame.data() + BPDU_OFFSET;
+    const size_t bpdu_size = frame.size() - BPDU_OFFSET;
+    const uint8_t type = bpdu[3];
+    if (read_big_endian(bpdu, 2) != 0 ||
+        (type != TCN_BPDU && !(type == CONFIG_BPDU && bpdu_size >= CONFIG_BPDU_SIZE) &&
+         !(type == RST_BPDU && bpdu_size >= RST_BPDU_SIZE))) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> g(mutex);
+    Port& info = ports[port];
+
+    // Only bridges send BPDUs, so whatever is on the other end isn't just hosts
+    info.edge_delay_while = SpanningTree::EDGE_DELAY;
+    if (info.edge) {
+        syslog(
+            LOG_INFO, "Spanning tree port %s is no longer an edge port", port_names[port].c_str()
+        );
+        info.edge = false;
+    }
+
+    if (type == TCN_BPDU) {
+        if (info.role == PortRole::DESIGNATED) {
+            propagate_topology_change(port);
+        }
+        transmit_pending();
+        return;
+    }
+
+    const uint8_t flags = bpdu[4];
+    const PriorityVector message{
+        read_big_endian(bpdu + 5, 8), (uint32_t)read_big_endian(bpdu + 13, 4),
+        read_big_endian(bpdu + 17, 8), (uint16_t)read_big_endian(bpdu + 25, 2)
+    };
+    const uint32_t message_age = read_big_endian(bpdu + 27, 2) >> 8;
+    const uint32_t max_age = read_big_endian(bpdu + 29, 2) >> 8;
+
+    // Ignore this port's own BPDUs looped straight back, and information that's too old
+    if ((message.designated_bridge_id == bridge_id &&
+         message.designated_port_id == SpanningTree::port_id(port)) ||
+        message_age >= max_age) {
+        return;
+    }
+
+    // Legacy configuration BPDUs are only ever sent by designated ports
+    const uint8_t role = type == RST_BPDU ? (flags >> ROLE_SHIFT) & ROLE_MASK : ROLE_DESIGNATED;
+
+    const bool same_designated =
+        info.received_info &&
+        message.designated_bridge_id == info.port_priority.designated_bridge_id &&
+        message.designated_port_id == info.port_priority.designated_port_id;
+
+    if (role == ROLE_DESIGNATED && (message < info.port_priority || same_designated)) {
+        // Better information for the segment, or an update from its designated bridge
+        info.port_priority = message;
+        info.received_info = true;
+        info.message_age = message_age;
+        info.info_while = 3 * SpanningTree::HELLO_TIME;
+        info.proposed = (flags & FLAG_PROPOSAL) != 0;
+        update_roles();
+    } else if (role == ROLE_DESIGNATED && info.role == PortRole::DESIGNATED) {
+        // A neighbour that thinks it's designated but knows a worse path. Set it straight
+        info.send_pending = true;
+    } else if (role != ROLE_DESIGNATED && (flags & FLAG_AGREEMENT) != 0 &&
+               info.role == PortRole::DESIGNATED &&
+               message.root_bridge_id == root_priority.root_bridge_id) {
+        // The neighbour has blocked everything that could close a loop through this port
+        info.agreed = true;
+        apply_state(port);
+    }
+
+    if ((flags & FLAG_TOPOLOGY_CHANGE) != 0 &&
+        (info.role == PortRole::ROOT || info.role == PortRole::DESIGNATED)) {
+        propagate_topology_change(port);
+    }
+
+    transmit_pending();
+}
+
+/*
+ * Advances every timer by a second: ages out information that's stopped being refreshed, finds
+ * edge ports, moves designated ports nobody agreed to through their forward delay, and sends hellos
+ * on designated ports.
+ */
+void SpanningTree::tick() {
+    std::lock_guard<std::mutex> g(mutex);
+
+    bool info_aged = false;
+    for (size_t port = 0; port < ports.size(); ++port) {
+        Port& info = ports[port];
+        if (info.topology_change_while > 0) {
+            --info.topology_change_while;
+        }
+
+        if (info.received_info && info.info_while > 0 && --info.info_while == 0) {
+            syslog(
+                LOG_INFO, "Spanning tree information on port %s aged out", port_names[port].c_str()
+            );
+            info.received_info = false;
+            info_aged = true;
+        }
+
+        if (info.role != PortRole::DESIGNATED || info.edge ||
+            port_state(port) == PortState::FORWARDING) {
+            continue;
+        }
+
+        if (info.proposing && info.edge_delay_while > 0 && --info.edge_delay_while == 0) {
+            syslog(LOG_INFO, "Spanning tree port %s is an edge port", port_names[port].c_str());
+            info.edge = true;
+            apply_state(port);
+            continue;
+        }
+
+        if (info.forward_delay_while > 0 && --info.forward_delay_while == 0) {
+            info.forward_delay_while = SpanningTree::FORWARD_DELAY;
+            if (port_state(port) == PortState::DISCARDING) {
+                set_state(port, PortState::LEARNING);
+            } else {
+                info.proposing = false;
+                set_state(port, PortState::FORWARDING);
+            }
+        }
+    }
+
+    if (info_aged) {
+        update_roles();
+    }
+
+    if (--hello_while == 0) {
+        hello_while = SpanningTree::HELLO_TIME;
+        for (Port& info : ports) {
+            if (info.role == PortRole::DESIGNATED) {
+                info.send_pending = true;
+            }
+        }
+    }
+
+    transmit_pending();
+}
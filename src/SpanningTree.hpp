@@ -0,0 +1,212 @@
+#pragma once
+
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Frame.hpp"
+#include "FramePool.hpp"
+#include "MacAddress.hpp"
+
+// Role a port plays in the spanning tree
+enum class PortRole : uint8_t {
+    // The port with the best path to the root bridge
+    ROOT,
+
+    // The port through which its segment has its best path to the root bridge
+    DESIGNATED,
+
+    // A blocked port with a worse path to the root bridge, ready to take over as the root port
+    ALTERNATE,
+
+    // A blocked port on a segment this bridge is already designated for through another port
+    BACKUP,
+};
+
+// What a port does with the frames it receives and the frames switched to it
+enum class PortState : uint8_t {
+    // Drops every frame but BPDUs, a.k.a. blocking
+    DISCARDING,
+
+    // Learns the source MAC of received frames, but still drops them
+    LEARNING,
+
+    FORWARDING,
+};
+
+const char* port_role_name(PortRole);
+const char* port_state_name(PortState);
+
+/*
+ * What a BPDU says about a path to the root bridge (802.1D-2004 17.6). Compared field by field,
+ * lower is better.
+ */
+struct PriorityVector {
+    uint64_t root_bridge_id;
+    uint32_t root_path_cost;
+    uint64_t designated_bridge_id;
+    uint16_t designated_port_id;
+
+    auto operator<=>(const PriorityVector&) const = default;
+};
+
+/*
+ * A Rapid Spanning Tree Protocol (802.1w, as merged into 802.1D-2004) bridge. Picks a role for
+ * every port from the BPDUs received on it so that the switch and its neighbours form a loop-free
+ * tree, and says which ports may forward frames.
+ *
+ * This is the computational core of the standard's state machines rather than a literal
+ * transcription: every event recomputes the root and every port's role at once. Convergence is
+ * rapid the RSTP way. A new designated port proposes to its neighbour, which blocks its own
+ * downstream ports before agreeing, so both ends forward after a single round trip instead of
+ * waiting out the forward delay. A root port that loses its information is replaced by an
+ * alternate port immediately. Ports that never hear a BPDU are found to be edge ports, facing
+ * only hosts, and forward without taking part. Legacy STP bridges aren't supported.
+ *
+ * The bridge knows nothing about sockets. It hands BPDUs to transmit and MAC table flushes to the
+ * given callbacks, and has to be told about received BPDUs and ticked once a second. Every method
+ * is thread safe. Port states can be read on the fast path without taking the lock.
+ */
+class SpanningTree {
+public:
+    // Destination MAC of every BPDU
+    static constexpr MacAddress BRIDGE_GROUP_ADDRESS{0x01, 0x80, 0xC2, 0x00, 0x00, 0x00};
+
+    // Timers, in ticks of one second, with the 802.1D defaults
+    static constexpr uint32_t HELLO_TIME = 2;
+    static constexpr uint32_t MAX_AGE = 20;
+    static constexpr uint32_t FORWARD_DELAY = 15;
+
+    // Time a proposing port waits to hear a BPDU before deciding it only faces hosts
+    static constexpr uint32_t EDGE_DELAY = 3;
+
+    static constexpr uint16_t DEFAULT_BRIDGE_PRIORITY = 32768;
+
+    // 802.1D-2004 path cost of a 1Gbps link
+    static constexpr uint32_t DEFAULT_PORT_PATH_COST = 20000;
+
+    // Transmits a BPDU out of the given port
+    using BpduSender = std::function<void(size_t, const Frame&)>;
+
+    // Removes every MAC address learned on the given port
+    using MacFlusher = std::function<void(size_t)>;
+
+private:
+    // Size of a frame carrying an RST BPDU, padded to the minimum ethernet frame size
+    static constexpr size_t BPDU_FRAME_SIZE = 60;
+
+    // Time a topology change is advertised for after it's detected
+    static constexpr uint32_t TOPOLOGY_CHANGE_TIME = 2 * SpanningTree::HELLO_TIME;
+
+    struct Port {
+        PortRole role = PortRole::DESIGNATED;
+
+        /*
+         * Best information about the port's segment: what the segment's designated bridge sent, if
+         * received_info is set, or what this bridge sends while it's designated
+         */
+        PriorityVector port_priority{};
+        bool received_info = false;
+
+        // Message age of the received information, in ticks
+        uint32_t message_age = 0;
+
+        // Ticks until received information ages out
+        uint32_t info_while = 0;
+
+        // Ticks until a designated port that hasn't been agreed to moves to its next state
+        uint32_t forward_delay_while = SpanningTree::FORWARD_DELAY;
+
+        // Ticks until a proposing port that hasn't heard a BPDU becomes an edge port
+        uint32_t edge_delay_while = SpanningTree::EDGE_DELAY;
+
+        // Ticks left advertising a topology change in this port's BPDUs
+        uint32_t topology_change_while = 0;
+
+        // Whether only hosts are connected to the port, so it never takes part in the tree
+        bool edge = false;
+
+        // Designated port: waiting for the neighbour to agree to this port forwarding right away
+        bool proposing = false;
+
+        // Designated port: the neighbour agreed to this port forwarding
+        bool agreed = false;
+
+        // Root or alternate port: the designated bridge proposed and hasn't been answered yet
+        bool proposed = false;
+
+        // Root or alternate port: this bridge agreed to the designated bridge's proposal
+        bool agree = false;
+
+        // Whether a BPDU should be sent on the port at the end of the current event
+        bool send_pending = false;
+    };
+
+    const MacAddress bridge_address;
+    const uint64_t bridge_id;
+    const uint32_t port_path_cost;
+    const std::vector<std::string> port_names;
+    const BpduSender send_bpdu;
+    const MacFlusher flush_macs;
+
+    // Serializes every event. Port states are the only thing read without it
+    mutable std::mutex mutex;
+
+    std::vector<Port> ports;
+
+    // Each port's PortState, indexed the same as ports. Written under the lock, read by anyone
+    const std::unique_ptr<std::atomic<PortState>[]> port_states;
+
+    // Best path to the root bridge, through root_port. This bridge is the root when it's empty
+    PriorityVector root_priority;
+    std::optional<size_t> root_port;
+    uint32_t root_message_age;
+
+    // Ticks until designated ports send their next hello
+    uint32_t hello_while;
+
+    std::atomic_uint64_t topology_changes_count;
+
+    // Pool BPDUs are built in. Only allocated from under the lock
+    FramePool bpdu_pool;
+
+    static uint16_t port_id(size_t);
+    PriorityVector designated_priority(size_t) const;
+    void update_roles();
+    void sync();
+    void apply_state(size_t);
+    void set_state(size_t, PortState);
+    void detect_topology_change(size_t);
+    void propagate_topology_change(size_t);
+    void transmit(size_t);
+    void transmit_pending();
+
+public:
+    SpanningTree(
+        MacAddress, uint16_t, uint32_t, const std::vector<std::string>&, BpduSender, MacFlusher
+    );
+
+    SpanningTree(const SpanningTree&) = delete;
+    SpanningTree& operator=(const SpanningTree&) = delete;
+
+    PortState port_state(size_t port) const {
+        return port_states[port].load(std::memory_order_relaxed);
+    }
+
+    PortRole port_role(size_t) const;
+    bool is_edge(size_t) const;
+    uint64_t id() const;
+    uint64_t root_id() const;
+    uint64_t topology_changes() const;
+
+    void receive_bpdu(size_t, std::span<const unsigned char>);
+    void tick();
+};
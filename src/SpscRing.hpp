@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+/*
+ * A bounded, lock-free, single-producer/single-consumer ring buffer. Exactly one thread may push
+ * and exactly one (other) thread may peek and pop at a time.
+ *
+ * The producer and consumer indices live on separate cache lines so the two threads don't false
+ * share, and the producer keeps a cached copy of the consumer's index so it only has to touch the
+ * consumer's cache line when the ring looks full. Elements are constructed in place and can be read
+ * by the consumer without being moved out of the ring; they're only destroyed once they're popped.
+ */
+template <typename T>
+class SpscRing {
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // Raw, suitably aligned storage for a single element
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    const size_t capacity;
+    const size_t mask;
+    const std::unique_ptr<Slot[]> slots;
+
+    // Index of the next slot to be popped. Written only by the consumer
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t head;
+
+    // Index of the next slot to be pushed into. Written only by the producer
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t tail;
+
+    // Producer's last observed value of head
+    size_t cached_head;
+
+    T* slot_at(size_t index) const {
+        return std::launder(reinterpret_cast<T*>(slots[index & mask].storage));
+    }
+
+public:
+    // Creates a ring that can hold at least the given number of elements
+    explicit SpscRing(size_t c)
+        : capacity{std::bit_ceil(c)},
+          mask{capacity - 1},
+          slots{std::make_unique<Slot[]>(capacity)},
+          head{0},
+          tail{0},
+          cached_head{0} {
+    }
+
+    ~SpscRing() {
+        pop(size());
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /*
+     * Constructs a new element at the back of the ring. Producer only. Returns false if the ring is
+     * full, in which case nothing is constructed.
+     */
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        const size_t current_tail = tail.load(std::memory_order_relaxed);
+        if (current_tail - cached_head == capacity) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (current_tail - cached_head == capacity) {
+                return false;
+            }
+        }
+
+        new (slots[current_tail & mask].storage) T(std::forward<Args>(args)...);
+        tail.store(current_tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * Returns the number of elements the consumer can currently read. Consumer only; the count can
+     * only grow until the consumer pops.
+     */
+    size_t readable() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * Returns the element the given number of places from the front of the ring. Consumer only, and
+     * the offset must be less than what readable() last returned.
+     */
+    T& peek(size_t offset) const {
+        return *slot_at(head.load(std::memory_order_relaxed) + offset);
+    }
+
+    // Destroys the given number of elements from the front of the ring. Consumer only
+    void pop(size_t count) {
+        const size_t current_head = head.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i) { slot_at(current_head + i)->~T(); }
+        head.store(current_head + count, std::memory_order_release);
+    }
+
+    // Approximate number of elements in the ring. Exact when called from the producer or consumer
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+};
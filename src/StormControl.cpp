@@ -0,0 +1,42 @@
+#include <algorithm>
+
+#include "StormControl.hpp"
+
+// Bits in a full sized frame, the smallest burst a bit rate limit allows
+static constexpr uint64_t FULL_FRAME_BITS = 1518 * 8;
+
+StormControl::StormControl(
+    const std::array<StormControlLimit, FLOOD_TYPE_COUNT>& limits, size_t port_count
+)
+    : limiters{std::make_unique<RateLimiter[]>(port_count * FLOOD_TYPE_COUNT)} {
+    for (size_t type = 0; type < FLOOD_TYPE_COUNT; ++type) {
+        const StormControlLimit& limit = limits[type];
+        limited[type] = limit.rate > 0;
+        in_bits[type] = limit.rate_in_bits;
+        if (!limited[type]) {
+            unit_costs[type] = 0;
+            bursts[type] = 0;
+            continue;
+        }
+
+        // A burst has to fit at least one frame, or nothing would ever get through
+        uint64_t burst = limit.burst > 0 ? limit.burst : limit.rate / 10;
+        burst = std::max(burst, limit.rate_in_bits ? FULL_FRAME_BITS : 1);
+
+        unit_costs[type] = ((uint64_t)1'000'000'000 << 16) / limit.rate;
+        bursts[type] = (burst * unit_costs[type]) >> 16;
+    }
+}
+
+// Short name of the given flood type, used in metrics labels and on the command line
+const char* flood_type_name(FloodType type) {
+    switch (type) {
+    case BROADCAST:
+        return "broadcast";
+    case MULTICAST:
+        return "multicast";
+    case UNKNOWN_UNICAST:
+        return "unknown_unicast";
+    }
+    return "unknown";
+}
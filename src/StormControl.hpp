@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Kinds of traffic that get flooded, and so can turn into a storm
+enum FloodType : uint8_t {
+    BROADCAST,
+    MULTICAST,
+    UNKNOWN_UNICAST,
+};
+
+static constexpr size_t FLOOD_TYPE_COUNT = 3;
+
+const char* flood_type_name(FloodType);
+
+// Rate limit on one FloodType of traffic received on a port
+struct StormControlLimit {
+    // Frames (or bits, if rate_in_bits is set) per second. Zero means unlimited
+    uint64_t rate = 0;
+    bool rate_in_bits = false;
+
+    // Frames (or bits) that may arrive at once before the rate kicks in. Zero picks a tenth of rate
+    uint64_t burst = 0;
+};
+
+/*
+ * A token bucket, implemented as a generic cell rate algorithm so that its whole state is a single
+ * timestamp: the time at which the bucket will be full again. Taking tokens is one compare and
+ * swap, so any number of threads can share a bucket without a lock.
+ */
+class RateLimiter {
+private:
+    std::atomic_uint64_t full_at{0};
+
+public:
+    /*
+     * Takes tokens worth the given number of nanoseconds of the rate at the given time, if the
+     * bucket, which holds burst nanoseconds worth of tokens, has enough. Returns whether it did.
+     */
+    bool allow(uint64_t now, uint64_t cost, uint64_t burst) {
+        uint64_t current = full_at.load(std::memory_order_relaxed);
+        while (true) {
+            const uint64_t next = (current > now ? current : now) + cost;
+            if (next - now > burst) {
+                return false;
+            }
+            if (full_at.compare_exchange_weak(current, next, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+};
+
+/*
+ * Per-port, per-FloodType rate limits on traffic that would otherwise be flooded to every port, so
+ * that one misbehaving host or a loop can't saturate every port. Every port has its own bucket for
+ * each type, shared by every thread that switches frames received on that port.
+ */
+class StormControl {
+private:
+    // Nanoseconds of rate per frame or bit, in 1/2^16 ns, and bucket sizes in ns, by FloodType
+    std::array<uint64_t, FLOOD_TYPE_COUNT> unit_costs;
+    std::array<uint64_t, FLOOD_TYPE_COUNT> bursts;
+    std::array<bool, FLOOD_TYPE_COUNT> limited;
+    std::array<bool, FLOOD_TYPE_COUNT> in_bits;
+
+    // Indexed by port * FLOOD_TYPE_COUNT + FloodType
+    const std::unique_ptr<RateLimiter[]> limiters;
+
+public:
+    StormControl(const std::array<StormControlLimit, FLOOD_TYPE_COUNT>&, size_t);
+
+    /*
+     * Returns whether a frame of the given type and length received on the given port at the given
+     * metrics_clock() time is within its rate limit, taking tokens for it if so
+     */
+    bool allow(size_t port, FloodType type, size_t length, uint64_t now) {
+        if (!limited[type]) {
+            return true;
+        }
+
+        const uint64_t units = in_bits[type] ? length * 8 : 1;
+        return limiters[port * FLOOD_TYPE_COUNT + type].allow(
+            now, (units * unit_costs[type]) >> 16, bursts[type]
+        );
+    }
+};
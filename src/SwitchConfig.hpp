@@ -0,0 +1,216 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "TrafficClass.hpp"
+#include "StormControl.hpp"
+#include "SpanningTree.hpp"
+#include "LinkAggregation.hpp"
+#include "Vlan.hpp"
+
+// What a port's receiver does with a frame that arrives while the port's input queue is full
+enum class QueueFullPolicy {
+    // Drop the frame that just arrived
+    TAIL_DROP,
+
+    // Drop the oldest frame in the queue to make room, favouring fresh traffic over stale traffic
+    HEAD_DROP,
+
+    /*
+     * Stop reading until the queue has room, leaving the burst in the kernel's socket buffer.
+     * Frames are only dropped, by the kernel, once that buffer fills up too.
+     */
+    PAUSE,
+};
+
+// How frames of different traffic classes share the switch loop and each port's transmit batches
+enum class TrafficScheduler {
+    // Always serve the highest priority class that has frames waiting
+    STRICT_PRIORITY,
+
+    /*
+     * Serve every class that has frames waiting, in proportion to its weight in bytes, so lower
+     * classes can't be starved
+     */
+    DEFICIT_ROUND_ROBIN,
+};
+
+/*
+ * A port mirroring (SPAN) session: copies of the frames received on some ports and sent on others,
+ * sent out of a destination port, written to a pcapng file, or both
+ */
+struct MirrorSession {
+    // Ports whose received frames are mirrored, indexed the same as the switch's ports
+    std::vector<size_t> ingress_ports;
+
+    // Ports whose sent frames are mirrored
+    std::vector<size_t> egress_ports;
+
+    /*
+     * Port mirrored frames are sent out of. A destination port is only used for mirroring: frames
+     * received on it are dropped, and nothing is switched to it.
+     */
+    std::optional<size_t> destination_port;
+
+    // Path of the pcapng file mirrored frames are written to. Nothing is written when empty
+    std::string capture_path;
+};
+
+/*
+ * Tunables for a Layer2Switch. The defaults are reasonable for most setups, and most can be
+ * overridden on the command line.
+ */
+struct SwitchConfig {
+    // Value for idle_polls_before_sleep that keeps the main switch loop busy polling forever
+    static constexpr size_t NEVER_SLEEP = SIZE_MAX;
+
+    /*
+     * Number of frames each port's input queue can hold before queue_full_policy kicks in, rounded
+     * up to a power of two
+     */
+    size_t input_queue_depth = 1024;
+
+    // Input queue depth of each port, indexed the same as the switch's ports. Overrides the above
+    std::vector<size_t> port_queue_depths;
+
+    QueueFullPolicy queue_full_policy = QueueFullPolicy::TAIL_DROP;
+
+    TrafficScheduler traffic_scheduler = TrafficScheduler::STRICT_PRIORITY;
+
+    /*
+     * Relative share of each traffic class under TrafficScheduler::DEFICIT_ROUND_ROBIN, indexed by
+     * TrafficClass. A class with weight n may send up to n full sized frames' worth of bytes per
+     * round.
+     */
+    std::array<size_t, TRAFFIC_CLASS_COUNT> class_weights = {1, 2, 4, 8};
+
+    // Rate limit on each FloodType of traffic received on each port. Unlimited by default
+    std::array<StormControlLimit, FLOOD_TYPE_COUNT> storm_control;
+
+    /*
+     * Number of seconds a port is shut down for when storm control suppresses more than
+     * storm_shutdown_threshold frames received on it within a second. Zero never shuts ports down.
+     */
+    uint32_t storm_shutdown_seconds = 0;
+    uint64_t storm_shutdown_threshold = 1000;
+
+    /*
+     * Number of consecutive polls that find every input queue empty before the main switch loop
+     * goes to sleep until a receiver wakes it up. Sleeping sooner saves CPU while the switch is
+     * idle, and sleeping later avoids paying for a wakeup between bursts of frames.
+     */
+    size_t idle_polls_before_sleep = 4096;
+
+    /*
+     * Whether to run the Rapid Spanning Tree Protocol, blocking ports as needed so that redundant
+     * links between switches don't form loops
+     */
+    bool spanning_tree = false;
+
+    // Spanning tree priority of this switch. The switch with the lowest becomes the root
+    uint16_t bridge_priority = SpanningTree::DEFAULT_BRIDGE_PRIORITY;
+
+    // Spanning tree cost of reaching a neighbouring switch through any port
+    uint32_t port_path_cost = SpanningTree::DEFAULT_PORT_PATH_COST;
+
+    /*
+     * Whether to snoop IGMP and MLD to learn which ports want which multicast groups, and send
+     * multicast only to those ports and multicast routers rather than flooding it
+     */
+    bool multicast_snooping = false;
+
+    /*
+     * VLANs each port carries, indexed the same as the switch's ports. When empty, the switch
+     * doesn't look at VLANs at all: every port is in one broadcast domain, and frames leave tagged
+     * exactly as they arrived.
+     */
+    std::vector<PortVlans> port_vlans;
+
+    /*
+     * Link aggregation group each port is in, indexed the same as the switch's ports, or
+     * LinkAggregation::NO_LAG. The members of a LAG are switched as a single port, and must have
+     * the same VLANs. When empty, no ports are aggregated.
+     */
+    std::vector<uint16_t> port_lags;
+
+    /*
+     * Whether LAG members are negotiated with the switch on the other end using LACP. Otherwise
+     * every member whose link is up is used.
+     */
+    bool lacp = false;
+
+    std::vector<MirrorSession> mirror_sessions;
+
+    // Maximum number of MAC addresses the MAC address table can hold before it evicts old entries
+    size_t mac_table_size = 8192;
+
+    /*
+     * Number of seconds a MAC address table entry lives without seeing traffic from its MAC. Zero
+     * keeps entries forever.
+     */
+    uint32_t mac_aging_seconds = 300;
+
+    /*
+     * Path of the file the MAC address table is snapshotted to, and preloaded from when the switch
+     * starts, so that a restarted switch doesn't flood until it's relearned every MAC. Nothing is
+     * snapshotted when empty.
+     */
+    std::string mac_snapshot_path;
+
+    // Number of seconds between MAC address table snapshots. Zero only snapshots on command
+    uint32_t mac_snapshot_interval_seconds = 30;
+
+    /*
+     * Number of sharded forwarding workers. When zero, every port gets a receiver thread feeding
+     * the input queues of a single main switch loop. Otherwise, every port is opened once per
+     * worker in a PACKET_FANOUT group and each worker receives, looks up, and transmits frames on
+     * its own, with no central queue.
+     */
+    size_t forwarding_workers = 0;
+
+    /*
+     * Number of reactor threads. When non-zero, every port's socket is owned by exactly one
+     * reactor, which waits on all of its sockets at once with epoll and receives, looks up, and
+     * transmits frames inline. This scales to far more ports than a receiver thread per port.
+     * Can't be combined with forwarding_workers.
+     */
+    size_t reactors = 0;
+
+    /*
+     * Reactor that owns each port, indexed the same as the switch's ports. Ports are assigned to
+     * reactors round robin when empty.
+     */
+    std::vector<size_t> port_reactors;
+
+    /*
+     * CPUs to pin forwarding workers or reactors to, assigned round robin. Threads aren't pinned
+     * when empty.
+     */
+    std::vector<int> worker_cpus;
+
+    /*
+     * Path of the file the ACL is read from, with one rule per line. Every frame is switched when
+     * empty.
+     */
+    std::string acl_path;
+
+    // Path of the Unix socket metrics are served on. Metrics aren't served when empty
+    std::string metrics_socket_path;
+
+    /*
+     * Number of port slots the switch has room for, so that ports can be added while it's running.
+     * Zero, or anything below the number of ports the switch is created with, leaves no room.
+     */
+    size_t max_ports = 0;
+
+    /*
+     * Path of the Unix socket the switch takes commands on, e.g. to add or remove ports while it's
+     * running. Commands aren't taken when empty.
+     */
+    std::string control_socket_path;
+};
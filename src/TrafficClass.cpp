@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <array>
+#include <net/ethernet.h>
+
+#include "TrafficClass.hpp"
+
+// Traffic class of each 802.1p priority code point
+static constexpr std::array<TrafficClass, 8> PCP_TRAFFIC_CLASSES{
+    BEST_EFFORT, BACKGROUND,  BACKGROUND,      BEST_EFFORT,
+    INTERACTIVE, INTERACTIVE, NETWORK_CONTROL, NETWORK_CONTROL,
+};
+
+// EtherType of IEEE 802.3 slow protocols, e.g. LACP
+static constexpr uint16_t ETHERTYPE_SLOW_PROTOCOLS = 0x8809;
+
+// EtherType of an 802.1ad service VLAN tag, which carries a priority code point like an 802.1Q tag
+static constexpr uint16_t ETHERTYPE_SERVICE_VLAN = 0x88A8;
+
+// Reads a big endian 16-bit value
+static uint16_t read_u16(const unsigned char* bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+/*
+ * Picks the traffic class of a frame. VLAN tagged frames are classified by their priority code
+ * point, whether the tag is still in the frame or was taken off it and is given separately.
+ * Untagged frames are classified by destination MAC and EtherType, so that control traffic that's
+ * never tagged still gets ahead of bulk transfers.
+ */
+TrafficClass classify_frame(std::span<const unsigned char> buffer, std::optional<uint16_t> tci) {
+    if (tci.has_value()) {
+        return PCP_TRAFFIC_CLASSES[tci.value() >> 13];
+    }
+    if (buffer.size() < sizeof(ethhdr)) {
+        return BEST_EFFORT;
+    }
+
+    const uint16_t ether_type = read_u16(buffer.data() + 2 * ETH_ALEN);
+    if ((ether_type == ETHERTYPE_VLAN || ether_type == ETHERTYPE_SERVICE_VLAN) &&
+        buffer.size() >= sizeof(ethhdr) + 2) {
+        return PCP_TRAFFIC_CLASSES[read_u16(buffer.data() + sizeof(ethhdr)) >> 13];
+    }
+
+    // Bridge group addresses 01:80:C2:00:00:00 through 0F carry STP, LACP, LLDP and the like
+    static constexpr std::array<unsigned char, 5> LINK_LOCAL_PREFIX{0x01, 0x80, 0xC2, 0x00, 0x00};
+    if (std::equal(LINK_LOCAL_PREFIX.begin(), LINK_LOCAL_PREFIX.end(), buffer.begin()) &&
+        buffer[5] <= 0x0F) {
+        return NETWORK_CONTROL;
+    }
+
+    switch (ether_type) {
+    case ETHERTYPE_SLOW_PROTOCOLS:
+        return NETWORK_CONTROL;
+    case ETHERTYPE_ARP:
+        return INTERACTIVE;
+    default:
+        return BEST_EFFORT;
+    }
+}
+
+// Short name of the given traffic class, used as a metrics label
+const char* traffic_class_name(TrafficClass traffic_class) {
+    switch (traffic_class) {
+    case BACKGROUND:
+        return "background";
+    case BEST_EFFORT:
+        return "best_effort";
+    case INTERACTIVE:
+        return "interactive";
+    case NETWORK_CONTROL:
+        return "network_control";
+    }
+    return "unknown";
+}
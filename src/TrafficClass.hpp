@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+/*
+ * Traffic classes frames are scheduled by, from lowest to highest priority. These follow the
+ * 802.1Q recommended mapping of the eight 802.1p priority code points onto four classes.
+ */
+enum TrafficClass : uint8_t {
+    // PCP 1 and 2
+    BACKGROUND,
+
+    // PCP 0 and 3, and untagged frames that aren't otherwise recognized
+    BEST_EFFORT,
+
+    // PCP 4 and 5, e.g. voice and video, and untagged ARP
+    INTERACTIVE,
+
+    // PCP 6 and 7, and untagged link-local control protocols such as STP and LACP
+    NETWORK_CONTROL,
+};
+
+static constexpr size_t TRAFFIC_CLASS_COUNT = 4;
+
+TrafficClass classify_frame(std::span<const unsigned char>, std::optional<uint16_t> = {});
+const char* traffic_class_name(TrafficClass);
@@ -0,0 +1,82 @@
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "UnixSocket.hpp"
+
+// Fills in the address of the Unix socket at the given path. Returns false if the path is too long
+bool make_socket_address(const std::string& path, sockaddr_un& address) {
+    memset(&address, 0, sizeof(sockaddr_un));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return true;
+}
+
+/*
+ * Creates a stream socket listening at the given path. Any stale socket left at the path by a
+ * previous run is replaced. Returns -1 with errno set if it can't, or ENAMETOOLONG if the path
+ * doesn't fit in a socket address.
+ */
+int listen_unix_socket(const std::string& path) {
+    sockaddr_un address;
+    if (!make_socket_address(path, address)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr*)&address, sizeof(sockaddr_un)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        const int bind_errno = errno;
+        close(fd);
+        errno = bind_errno;
+        return -1;
+    }
+    return fd;
+}
+
+// Connects to the stream socket at the given path. Returns -1 with errno set if it can't
+int connect_unix_socket(const std::string& path) {
+    sockaddr_un address;
+    if (!make_socket_address(path, address)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (sockaddr*)&address, sizeof(sockaddr_un)) < 0) {
+        const int connect_errno = errno;
+        close(fd);
+        errno = connect_errno;
+        return -1;
+    }
+    return fd;
+}
+
+// Writes the whole buffer to the given socket. Returns false if the peer went away
+bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <sys/un.h>
+#include <cstddef>
+#include <string>
+
+/*
+ * Helpers shared by the servers the switch runs on Unix domain sockets, and by the command line
+ * clients that talk to them
+ */
+bool make_socket_address(const std::string&, sockaddr_un&);
+int listen_unix_socket(const std::string&);
+int connect_unix_socket(const std::string&);
+bool write_all(int, const char*, size_t);
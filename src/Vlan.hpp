@@ -0,0 +1,71 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/*
+ * VLAN a port's untagged traffic belongs to unless configured otherwise. VLAN IDs 0 and 4095 are
+ * reserved: a tag with VLAN ID 0 only carries a priority, and the frame belongs to no VLAN.
+ */
+static constexpr uint16_t DEFAULT_VLAN = 1;
+static constexpr uint16_t MAX_VLAN = 4094;
+static constexpr size_t VLAN_COUNT = 4096;
+
+// Size of an 802.1Q tag: the 0x8100 TPID followed by the 16-bit tag control information
+static constexpr size_t VLAN_TAG_SIZE = 4;
+
+// The VLAN ID in the low 12 bits of a tag's control information
+static constexpr uint16_t VLAN_ID_MASK = 0x0FFF;
+
+// How a port carries VLANs
+enum class VlanMode {
+    // The port is in a single VLAN and sends and receives it untagged
+    ACCESS,
+
+    // The port carries several VLANs, tagged, apart from its native VLAN which is untagged
+    TRUNK,
+};
+
+/*
+ * A port's VLAN membership. Frames received untagged or priority tagged belong to the port's
+ * native VLAN, which is the only VLAN an access port carries. Tagged frames for a VLAN the port
+ * doesn't carry are dropped.
+ */
+struct PortVlans {
+    VlanMode mode = VlanMode::ACCESS;
+
+    // VLAN of an access port, or the VLAN a trunk port carries untagged
+    uint16_t native_vlan = DEFAULT_VLAN;
+
+    // VLANs a trunk port carries tagged. Ignored for access ports
+    std::bitset<VLAN_COUNT> tagged_vlans;
+
+    bool carries(uint16_t vlan) const {
+        return vlan == native_vlan || (mode == VlanMode::TRUNK && tagged_vlans.test(vlan));
+    }
+
+    // Whether frames in the given VLAN are sent tagged on this port. Frames in no VLAN never are
+    bool tags(uint16_t vlan) const {
+        return mode == VlanMode::TRUNK && vlan != 0 && vlan != native_vlan;
+    }
+
+    /*
+     * Returns the VLAN a frame received on this port with the given tag control information, if
+     * any, belongs to: the port's native VLAN if the frame was untagged or priority tagged, or the
+     * tag's VLAN if the port carries it. Returns an empty optional if it doesn't.
+     */
+    std::optional<uint16_t> ingress_vlan(std::optional<uint16_t> tci) const {
+        const uint16_t vlan = tci.has_value() ? tci.value() & VLAN_ID_MASK : 0;
+        if (vlan == 0) {
+            return native_vlan;
+        }
+        if (!carries(vlan)) {
+            return {};
+        }
+        return vlan;
+    }
+
+    bool operator==(const PortVlans&) const = default;
+};
@@ -0,0 +1,817 @@
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+
+#include "Segmenter.hpp"
+#include "XdpEthernetPort.hpp"
+#include "panic.hpp"
+
+// Queue of the interface the AF_XDP socket is bound to
+static constexpr uint32_t XSK_QUEUE = 0;
+
+/*
+ * Maps the given ring of an AF_XDP socket into this process, at the given page offset and with the
+ * given offsets of its indexes and slots. Returns false if the ring couldn't be mapped.
+ */
+template <typename T>
+static bool map_ring(int xsk_fd, XdpRing<T>& ring, const xdp_ring_offset& offsets, off_t page) {
+    const size_t mapping_length = offsets.desc + XdpEthernetPort::RING_SIZE * sizeof(T);
+    void* mapping = mmap(
+        nullptr, mapping_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd, page
+    );
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    unsigned char* start = (unsigned char*)mapping;
+    ring.producer = (uint32_t*)(start + offsets.producer);
+    ring.consumer = (uint32_t*)(start + offsets.consumer);
+    ring.flags = (uint32_t*)(start + offsets.flags);
+    ring.descriptors = (T*)(start + offsets.desc);
+    ring.mapping = mapping;
+    ring.mapping_length = mapping_length;
+    return true;
+}
+
+template <typename T>
+static void unmap_ring(XdpRing<T>& ring) {
+    if (ring.mapping != nullptr) {
+        munmap(ring.mapping, ring.mapping_length);
+    }
+    ring = {};
+}
+
+// There's no libbpf to lean on, so maps and programs are made with the bpf() syscall directly
+static int bpf(int command, bpf_attr& attributes) {
+    return syscall(__NR_bpf, command, &attributes, sizeof(bpf_attr));
+}
+
+// Creates the map the program looks sockets up in by queue. Returns its file descriptor, or -1
+static int create_xsk_map() {
+    bpf_attr attributes;
+    memset(&attributes, 0, sizeof(bpf_attr));
+    attributes.map_type = BPF_MAP_TYPE_XSKMAP;
+    attributes.key_size = sizeof(uint32_t);
+    attributes.value_size = sizeof(uint32_t);
+    attributes.max_entries = XSK_QUEUE + 1;
+    return bpf(BPF_MAP_CREATE, attributes);
+}
+
+// Puts the given socket in the given map for the queue it's bound to. Returns false on failure
+static bool insert_socket(int xsk_map_fd, int xsk_fd) {
+    const uint32_t queue = XSK_QUEUE;
+    const uint32_t socket = xsk_fd;
+
+    bpf_attr attributes;
+    memset(&attributes, 0, sizeof(bpf_attr));
+    attributes.map_fd = xsk_map_fd;
+    attributes.key = (uint64_t)&queue;
+    attributes.value = (uint64_t)&socket;
+    attributes.flags = BPF_ANY;
+    return bpf(BPF_MAP_UPDATE_ELEM, attributes) == 0;
+}
+
+/*
+ * Loads the XDP program that drops frames with any of the given EtherTypes, the same way a
+ * PortFilter does, and redirects every other frame to the socket in the given map for the queue the
+ * frame arrived on. Frames are let on up the stack as usual if there's no socket for their queue.
+ * Hand assembled, it's the equivalent of
+ *
+ *     if (ether_type(context) is dropped) {
+ *         return XDP_DROP;
+ *     }
+ *     return bpf_redirect_map(&xsk_map, context->rx_queue_index, XDP_PASS);
+ *
+ * Returns the program's file descriptor, or -1 if it couldn't be loaded.
+ */
+static int load_redirect_program(int xsk_map_fd, const std::vector<uint16_t>& dropped_ether_types) {
+    std::vector<bpf_insn> program;
+    if (!dropped_ether_types.empty()) {
+        // Frames are read in network byte order, so EtherTypes are compared byte swapped
+        const int32_t vlan = htons(ETHERTYPE_VLAN);
+        const int16_t count = dropped_ether_types.size();
+        program = {
+            // r2 = context->data, r3 = context->data_end
+            {BPF_LDX | BPF_W | BPF_MEM, 2, 1, offsetof(xdp_md, data), 0},
+            {BPF_LDX | BPF_W | BPF_MEM, 3, 1, offsetof(xdp_md, data_end), 0},
+
+            // r5 = EtherType, if the frame is long enough to have one
+            {BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0},
+            {BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, ETHER_HDR_LEN},
+            {BPF_JMP | BPF_JGT | BPF_X, 4, 3, (int16_t)(count + 8), 0},
+            {BPF_LDX | BPF_H | BPF_MEM, 5, 2, 2 * ETH_ALEN, 0},
+
+            // r5 = inner EtherType, if it's tagged and long enough to have one
+            {BPF_JMP | BPF_JNE | BPF_K, 5, 0, 3, vlan},
+            {BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, VLAN_TAG_SIZE},
+            {BPF_JMP | BPF_JGT | BPF_X, 4, 3, (int16_t)(count + 4), 0},
+            {BPF_LDX | BPF_H | BPF_MEM, 5, 2, 2 * ETH_ALEN + VLAN_TAG_SIZE, 0},
+        };
+
+        // Each comparison jumps over the ones after it, and the jump to the redirect, to the drop
+        for (int16_t i = 0; i < count; ++i) {
+            const int16_t to_drop = count - i;
+            const int32_t ether_type = htons(dropped_ether_types[i]);
+            program.push_back({BPF_JMP | BPF_JEQ | BPF_K, 5, 0, to_drop, ether_type});
+        }
+        program.push_back({BPF_JMP | BPF_JA, 0, 0, 2, 0});
+
+        // return XDP_DROP
+        program.push_back({BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_DROP});
+        program.push_back({BPF_JMP | BPF_EXIT, 0, 0, 0, 0});
+    }
+
+    program.insert(
+        program.end(),
+        {
+            // r2 = context->rx_queue_index
+            {BPF_LDX | BPF_W | BPF_MEM, 2, 1, offsetof(xdp_md, rx_queue_index), 0},
+
+            // r1 = &xsk_map, which takes up two instructions
+            {BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, xsk_map_fd},
+            {0, 0, 0, 0, 0},
+
+            // r3 = XDP_PASS
+            {BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS},
+
+            // return bpf_redirect_map(r1, r2, r3)
+            {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map},
+            {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+        }
+    );
+    static const char LICENSE[] = "GPL";
+
+    bpf_attr attributes;
+    memset(&attributes, 0, sizeof(bpf_attr));
+    attributes.prog_type = BPF_PROG_TYPE_XDP;
+    attributes.insn_cnt = program.size();
+    attributes.insns = (uint64_t)program.data();
+    attributes.license = (uint64_t)LICENSE;
+    attributes.expected_attach_type = BPF_XDP;
+    return bpf(BPF_PROG_LOAD, attributes);
+}
+
+/*
+ * Attaches the given XDP program to the given interface with a link, which detaches it again as
+ * soon as the link is closed, even if the switch crashes. Returns the link's file descriptor, or -1
+ * if the program couldn't be attached in the given mode.
+ */
+static int attach_program(int program_fd, unsigned int interface_index, uint32_t mode) {
+    bpf_attr attributes;
+    memset(&attributes, 0, sizeof(bpf_attr));
+    attributes.link_create.prog_fd = program_fd;
+    attributes.link_create.target_ifindex = interface_index;
+    attributes.link_create.attach_type = BPF_XDP;
+    attributes.link_create.flags = mode;
+    return bpf(BPF_LINK_CREATE, attributes);
+}
+
+/*
+ * Maps an anonymous region big enough for the given number of chunks to use as the UMEM. The
+ * kernel pins it once it's registered. Panics if the memory couldn't be mapped.
+ */
+XdpUmem::XdpUmem(size_t c)
+    : chunk_count{c},
+      next_chunk{0},
+      owner_fd{-1} {
+    void* mapping = mmap(
+        nullptr, size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+    );
+    if (mapping == MAP_FAILED) {
+        PANIC("Failed to map %ld byte(s) of UMEM: %s\n", size(), strerror(errno));
+    }
+    memory = (unsigned char*)mapping;
+}
+
+XdpUmem::~XdpUmem() {
+    if (owner_fd >= 0) {
+        close(owner_fd);
+    }
+    munmap(memory, size());
+}
+
+/*
+ * Sets aside the given number of chunks for a port, reusing chunks a port that's gone gave back
+ * where there's a run long enough. Returns the first of them, or null if there aren't that many
+ * left.
+ */
+unsigned char* XdpUmem::carve(size_t chunks) {
+    for (auto run = released_runs.begin(); run != released_runs.end(); ++run) {
+        auto& [first_chunk, run_chunks] = *run;
+        if (run_chunks >= chunks) {
+            unsigned char* carved = memory + first_chunk * FramePool::SLOT_SIZE;
+            first_chunk += chunks;
+            run_chunks -= chunks;
+            if (run_chunks == 0) {
+                released_runs.erase(run);
+            }
+            return carved;
+        }
+    }
+
+    if (chunk_count - next_chunk < chunks) {
+        return nullptr;
+    }
+
+    unsigned char* carved = memory + next_chunk * FramePool::SLOT_SIZE;
+    next_chunk += chunks;
+    return carved;
+}
+
+// Gives back the given number of chunks carve() set aside, starting at the given one
+void XdpUmem::release(unsigned char* carved, size_t chunks) {
+    released_runs.emplace_back((carved - memory) / FramePool::SLOT_SIZE, chunks);
+}
+
+// Returns the socket the UMEM is registered on, or -1 if it hasn't been registered yet
+int XdpUmem::owner() const {
+    return owner_fd;
+}
+
+// Keeps a duplicate of the given socket, which the UMEM was just registered on, for sharing it
+void XdpUmem::set_owner(int xsk_fd) {
+    owner_fd = fcntl(xsk_fd, F_DUPFD_CLOEXEC, 0);
+}
+
+void XdpUmem::add_port(XdpEthernetPort* port) {
+    std::lock_guard<std::mutex> g(ports_mutex);
+    ports.push_back(port);
+}
+
+// Forgets the given port. Once this returns, no other port will reap its completions
+void XdpUmem::remove_port(XdpEthernetPort* port) {
+    std::lock_guard<std::mutex> g(ports_mutex);
+    std::erase(ports, port);
+}
+
+/*
+ * Releases every frame any port sharing the UMEM has finished sending. A port only refills its
+ * fill ring from its own chunks, and those can be held by whichever port sent the frame received
+ * into them, so a port that's run dry calls this rather than waiting on ports that may never send
+ * again.
+ */
+void XdpUmem::reap_completions() {
+    std::lock_guard<std::mutex> g(ports_mutex);
+    for (XdpEthernetPort* port : ports) { port->try_reap_completions(); }
+}
+
+/*
+ * Opens the port's raw socket. The AF_XDP socket is set up separately by attach(), since a failure
+ * there isn't fatal.
+ */
+XdpEthernetPort::XdpEthernetPort(
+    const std::string& i, const PortFilter& f, const std::shared_ptr<XdpUmem>& u
+)
+    : EthernetPort{i, EthernetPort::initialize_raw_socket(i, f)},
+      umem{u} {
+    filter = f;
+
+    // The raw socket is only ever read when it has something, however the port waits for frames
+    EthernetPort::set_nonblocking();
+}
+
+/*
+ * Creates an XDP port on the given interface, with its chunks carved out of the given UMEM. If the
+ * AF_XDP socket can't be set up, e.g. because the kernel or driver doesn't support it or the
+ * switch is missing a capability, falls back to a regular raw socket port.
+ */
+std::shared_ptr<EthernetPort> XdpEthernetPort::create(
+    const std::string& interface_name, const PortFilter& filter,
+    const std::shared_ptr<XdpUmem>& umem
+) {
+    // Only the raw socket can run a classic BPF program, so only it can filter with one
+    if (!filter.program.empty()) {
+        syslog(
+            LOG_WARNING, "XDP can't run BPF programs. Falling back to a raw socket on %s",
+            interface_name.c_str()
+        );
+        return std::make_shared<EthernetPort>(interface_name, filter);
+    }
+
+    std::shared_ptr<XdpEthernetPort> port{new XdpEthernetPort{interface_name, filter, umem}};
+    if (port->attach()) {
+        return port;
+    }
+
+    syslog(LOG_WARNING, "Falling back to a raw socket on %s", interface_name.c_str());
+    port.reset();
+    return std::make_shared<EthernetPort>(interface_name, filter);
+}
+
+XdpEthernetPort::~XdpEthernetPort() {
+    umem->remove_port(this);
+
+    // Detach the program first so nothing else is redirected to the socket
+    for (int fd : {link_fd, program_fd, xsk_map_fd, wait_fd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    close_socket();
+
+    // With the socket gone the kernel is done with the chunks, including when attach() failed
+    if (chunks != nullptr) {
+        umem->release(chunks, XdpEthernetPort::CHUNKS_PER_PORT);
+    }
+}
+
+/*
+ * Opens the port's AF_XDP socket, sets up its rings, and binds it to the given interface with the
+ * given flags. The first socket registers the UMEM and every later one shares it. Returns false if
+ * any of it failed, in which case the socket has to be closed with close_socket().
+ */
+bool XdpEthernetPort::open_socket(unsigned int interface_index, uint16_t bind_flags) {
+    xsk_fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (xsk_fd < 0) {
+        return false;
+    }
+
+    // No extra headroom, so the kernel puts frames the usual XDP headroom into their chunks
+    if (umem->owner() < 0) {
+        xdp_umem_reg registration;
+        memset(&registration, 0, sizeof(xdp_umem_reg));
+        registration.addr = (uint64_t)umem->base();
+        registration.len = umem->size();
+        registration.chunk_size = FramePool::SLOT_SIZE;
+        if (setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_REG, &registration, sizeof(xdp_umem_reg)) < 0) {
+            return false;
+        }
+    }
+
+    // Sockets sharing a UMEM across interfaces still need fill and completion rings of their own
+    const uint32_t ring_size = XdpEthernetPort::RING_SIZE;
+    for (int ring : {XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING, XDP_TX_RING}) {
+        if (setsockopt(xsk_fd, SOL_XDP, ring, &ring_size, sizeof(uint32_t)) < 0) {
+            return false;
+        }
+    }
+
+    xdp_mmap_offsets offsets;
+    socklen_t offsets_length = sizeof(xdp_mmap_offsets);
+    if (getsockopt(xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &offsets_length) < 0 ||
+        !map_ring(xsk_fd, fill_ring, offsets.fr, XDP_UMEM_PGOFF_FILL_RING) ||
+        !map_ring(xsk_fd, completion_ring, offsets.cr, XDP_UMEM_PGOFF_COMPLETION_RING) ||
+        !map_ring(xsk_fd, rx_ring, offsets.rx, XDP_PGOFF_RX_RING) ||
+        !map_ring(xsk_fd, tx_ring, offsets.tx, XDP_PGOFF_TX_RING)) {
+        return false;
+    }
+
+    sockaddr_xdp address;
+    memset(&address, 0, sizeof(sockaddr_xdp));
+    address.sxdp_family = AF_XDP;
+    address.sxdp_flags = bind_flags;
+    address.sxdp_ifindex = interface_index;
+    address.sxdp_queue_id = XSK_QUEUE;
+    if (bind_flags & XDP_SHARED_UMEM) {
+        address.sxdp_shared_umem_fd = umem->owner();
+    }
+    return bind(xsk_fd, (sockaddr*)&address, sizeof(sockaddr_xdp)) == 0;
+}
+
+// Unmaps the AF_XDP socket's rings and closes it, if it's open
+void XdpEthernetPort::close_socket() {
+    unmap_ring(fill_ring);
+    unmap_ring(completion_ring);
+    unmap_ring(rx_ring);
+    unmap_ring(tx_ring);
+    if (xsk_fd >= 0) {
+        close(xsk_fd);
+        xsk_fd = -1;
+    }
+}
+
+/*
+ * Sets up the port's AF_XDP socket and attaches the program that redirects frames to it. Returns
+ * false, having logged why, if any of it failed.
+ */
+bool XdpEthernetPort::attach() {
+    const unsigned int interface_index = if_nametoindex(interface_name.c_str());
+    if (interface_index == 0) {
+        syslog(LOG_WARNING, "Failed to find interface %s: %m", interface_name.c_str());
+        return false;
+    }
+
+    // Frames have to fit in a chunk behind the headroom the kernel leaves, so jumbo frames can't
+    const std::optional<uint32_t> mtu = EthernetPort::interface_mtu(interface_name, socket_fd);
+    if (mtu.has_value() && ETH_HLEN + 2 * VLAN_TAG_SIZE + mtu.value() >
+                               FramePool::SLOT_SIZE - XDP_PACKET_HEADROOM) {
+        syslog(
+            LOG_WARNING, "MTU %u of %s is too large for AF_XDP chunks", mtu.value(),
+            interface_name.c_str()
+        );
+        return false;
+    }
+
+    /*
+     * The first socket tries zero-copy, then copy mode. Every later socket shares the UMEM, and
+     * with it the first socket's mode, so a port whose driver can't work in that mode falls back.
+     */
+    const bool shared = umem->owner() >= 0;
+    std::vector<uint16_t> bind_attempts = {XDP_SHARED_UMEM};
+    if (!shared) {
+        bind_attempts = {XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP, XDP_COPY | XDP_USE_NEED_WAKEUP};
+    }
+    bool bound = false;
+    for (uint16_t bind_flags : bind_attempts) {
+        bound = open_socket(interface_index, bind_flags);
+        if (bound) {
+            break;
+        }
+        close_socket();
+    }
+    if (!bound) {
+        syslog(LOG_WARNING, "Failed to bind AF_XDP socket on %s: %m", interface_name.c_str());
+        return false;
+    }
+    if (!shared) {
+        umem->set_owner(xsk_fd);
+    }
+
+    xdp_options options{};
+    socklen_t options_length = sizeof(xdp_options);
+    zero_copy = getsockopt(xsk_fd, SOL_XDP, XDP_OPTIONS, &options, &options_length) == 0 &&
+                (options.flags & XDP_OPTIONS_ZEROCOPY);
+
+    chunks = umem->carve(XdpEthernetPort::CHUNKS_PER_PORT);
+    if (chunks == nullptr) {
+        syslog(LOG_WARNING, "No UMEM left for %s", interface_name.c_str());
+        return false;
+    }
+    rx_pool = std::make_unique<FramePool>(chunks, XdpEthernetPort::RX_CHUNKS);
+    tx_pool = std::make_unique<FramePool>(
+        chunks + XdpEthernetPort::RX_CHUNKS * FramePool::SLOT_SIZE, XdpEthernetPort::TX_CHUNKS
+    );
+    in_flight.resize(umem->chunks());
+
+    // The fill ring has to be stocked before any frame is redirected to the socket
+    refill();
+
+    xsk_map_fd = create_xsk_map();
+    if (xsk_map_fd < 0 || !insert_socket(xsk_map_fd, xsk_fd)) {
+        syslog(LOG_WARNING, "Failed to create XSKMAP for %s: %m", interface_name.c_str());
+        return false;
+    }
+
+    program_fd = load_redirect_program(xsk_map_fd, filter.dropped_ether_types);
+    if (program_fd < 0) {
+        syslog(LOG_WARNING, "Failed to load XDP program for %s: %m", interface_name.c_str());
+        return false;
+    }
+
+    // Native mode if the driver supports XDP, generic mode otherwise
+    const char* attach_mode = "native";
+    link_fd = attach_program(program_fd, interface_index, XDP_FLAGS_DRV_MODE);
+    if (link_fd < 0) {
+        attach_mode = "generic";
+        link_fd = attach_program(program_fd, interface_index, XDP_FLAGS_SKB_MODE);
+    }
+    if (link_fd < 0) {
+        syslog(LOG_WARNING, "Failed to attach XDP program to %s: %m", interface_name.c_str());
+        return false;
+    }
+
+    wait_fd = epoll_create1(EPOLL_CLOEXEC);
+    for (int fd : {xsk_fd, socket_fd}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        if (wait_fd < 0 || epoll_ctl(wait_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            syslog(LOG_WARNING, "Failed to wait on %s: %m", interface_name.c_str());
+            return false;
+        }
+    }
+
+    syslog(
+        LOG_INFO, "Port %s is using AF_XDP in %s mode, with the XDP program in %s mode",
+        interface_name.c_str(), zero_copy ? "zero-copy" : "copy", attach_mode
+    );
+    umem->add_port(this);
+    return true;
+}
+
+// Whether the driver is reading and writing frames in the UMEM directly
+bool XdpEthernetPort::zero_copy_enabled() const {
+    return zero_copy;
+}
+
+const char* XdpEthernetPort::backend() const {
+    return "xdp";
+}
+
+// Makes receives return no frames instead of waiting when nothing has arrived yet
+void XdpEthernetPort::set_nonblocking() {
+    waits_for_frames = false;
+}
+
+/*
+ * Returns the file descriptor that becomes readable when either the AF_XDP socket or the raw
+ * socket has frames waiting
+ */
+int XdpEthernetPort::receive_fd() const {
+    return wait_fd;
+}
+
+/*
+ * Returns the number of frames the kernel has dropped on this port, on the raw socket as well as
+ * the AF_XDP socket because there was no room on the RX ring or no chunk to receive into. Safe to
+ * call from any thread.
+ */
+uint64_t XdpEthernetPort::kernel_drops() {
+    uint64_t drops = EthernetPort::kernel_drops();
+
+    // Unlike the raw socket's, these are never reset
+    xdp_statistics statistics{};
+    socklen_t statistics_length = sizeof(xdp_statistics);
+    if (getsockopt(xsk_fd, SOL_XDP, XDP_STATISTICS, &statistics, &statistics_length) == 0) {
+        drops += statistics.rx_dropped + statistics.rx_ring_full;
+    }
+    return drops;
+}
+
+/*
+ * Hands the kernel as many free chunks from the RX pool as fit on the fill ring. If the pool runs
+ * dry, gets every port to let go of the chunks it's finished sending, and tries again. Returns
+ * false if the fill ring couldn't be filled up because the switch is holding on to every other
+ * chunk.
+ */
+bool XdpEthernetPort::refill() {
+    const uint32_t producer = *fill_ring.producer;
+    const uint32_t consumer = __atomic_load_n(fill_ring.consumer, __ATOMIC_ACQUIRE);
+    const uint32_t free_slots = XdpEthernetPort::RING_SIZE - (producer - consumer);
+
+    uint32_t filled = 0;
+    for (bool reaped = false; filled < free_slots; ++filled) {
+        FrameBuffer* buffer = rx_pool->allocate_slot(0);
+        if (buffer == nullptr && !reaped) {
+            umem->reap_completions();
+            reaped = true;
+            buffer = rx_pool->allocate_slot(0);
+        }
+        if (buffer == nullptr) {
+            break;
+        }
+        fill_ring.descriptors[(producer + filled) & (XdpEthernetPort::RING_SIZE - 1)] =
+            (unsigned char*)buffer - umem->base();
+    }
+
+    if (filled > 0) {
+        __atomic_store_n(fill_ring.producer, producer + filled, __ATOMIC_RELEASE);
+    }
+
+    // A driver that ran out of chunks has to be told there are more
+    if (__atomic_load_n(fill_ring.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) {
+        recvfrom(xsk_fd, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+    }
+    return filled == free_slots;
+}
+
+// Releases every frame the kernel has finished sending. Must hold transmit_mutex
+void XdpEthernetPort::reap_completions() {
+    const uint32_t consumer = *completion_ring.consumer;
+    const uint32_t completed = __atomic_load_n(completion_ring.producer, __ATOMIC_ACQUIRE) -
+                               consumer;
+
+    for (uint32_t i = 0; i < completed; ++i) {
+        const uint64_t address =
+            completion_ring.descriptors[(consumer + i) & (XdpEthernetPort::RING_SIZE - 1)];
+        in_flight[address / FramePool::SLOT_SIZE].reset();
+    }
+
+    if (completed > 0) {
+        __atomic_store_n(completion_ring.consumer, consumer + completed, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Releases every frame the kernel has finished sending, unless the port is being flushed, which
+ * reaps them anyway. Safe to call from any thread, so a port that isn't sending anything still
+ * gives back the chunks it sent from.
+ */
+void XdpEthernetPort::try_reap_completions() {
+    const uint32_t consumer = __atomic_load_n(completion_ring.consumer, __ATOMIC_RELAXED);
+    if (__atomic_load_n(completion_ring.producer, __ATOMIC_ACQUIRE) == consumer) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock{transmit_mutex, std::try_to_lock};
+    if (lock.owns_lock()) {
+        reap_completions();
+    }
+}
+
+/*
+ * Takes up to the given number of frames off the RX ring and hands each one to the given callback
+ * as a view of the Frame its chunk became. Chunks go back to the RX pool once the last Frame
+ * referencing them is gone. Returns the number of frames handed to the callback.
+ */
+size_t XdpEthernetPort::receive_batch(const FrameViewCallback& callback, size_t limit) {
+    try_reap_completions();
+    refill();
+
+    const uint32_t consumer = *rx_ring.consumer;
+    const uint32_t available = __atomic_load_n(rx_ring.producer, __ATOMIC_ACQUIRE) - consumer;
+    const uint32_t batch_size = std::min<size_t>(available, limit);
+
+    size_t received = 0;
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        const xdp_desc& descriptor =
+            rx_ring.descriptors[(consumer + i) & (XdpEthernetPort::RING_SIZE - 1)];
+
+        // The kernel puts the frame somewhere past the start of the chunk, which holds its header
+        unsigned char* chunk =
+            umem->base() + descriptor.addr - descriptor.addr % FramePool::SLOT_SIZE;
+        FrameBuffer* buffer = (FrameBuffer*)chunk;
+        buffer->headroom = descriptor.addr % FramePool::SLOT_SIZE - FrameBuffer::HEADER_SIZE;
+        buffer->length = descriptor.len;
+
+        Frame frame{buffer};
+        if (descriptor.len < sizeof(ethhdr)) {
+            continue;
+        }
+
+        // XDP sees frames before the kernel strips their tags, so the tag is still in the frame
+        frame.take_vlan_tag({});
+        callback(FrameView{frame.buffer(), frame.vlan_tci(), &frame});
+        ++received;
+    }
+
+    if (batch_size > 0) {
+        __atomic_store_n(rx_ring.consumer, consumer + batch_size, __ATOMIC_RELEASE);
+    }
+    return received;
+}
+
+/*
+ * Waits for either socket to have frames. If the fill ring couldn't be filled up, only waits a
+ * little while, since the kernel can't receive anything on the AF_XDP socket until it's refilled.
+ * Returns false if waiting failed.
+ */
+bool XdpEthernetPort::wait_for_frames() {
+    const int timeout = refill() ? -1 : XdpEthernetPort::REFILL_RETRY_MS;
+    epoll_event event;
+    return epoll_wait(wait_fd, &event, 1, timeout) >= 0 || errno == EINTR;
+}
+
+/*
+ * Receives a single frame. Frames received on the AF_XDP socket are handed out in their chunk as
+ * is, and frames received on the raw socket are copied into a Frame from this port's pool.
+ */
+std::optional<Frame> XdpEthernetPort::receive_frame() {
+    std::optional<Frame> frame;
+    const FrameViewCallback keep_frame = [&](const FrameView& frame_view) {
+        frame.emplace(frame_pool, frame_view);
+    };
+
+    while (receive_batch(keep_frame, 1) == 0) {
+        if (!EthernetPort::receive_frames(keep_frame).has_value()) {
+            return {};
+        }
+        if (frame.has_value()) {
+            break;
+        }
+        if (!waits_for_frames || !wait_for_frames()) {
+            return {};
+        }
+    }
+    return frame;
+}
+
+/*
+ * Receives everything waiting on the RX ring, then anything waiting on the raw socket, which gets
+ * frames that arrived on other queues. Frames from the RX ring are views of Frames that already
+ * hold them, so making Frames of them never copies. Returns the number of frames received, or an
+ * empty optional if receiving failed. Blocks until a frame arrives unless the port is non-blocking.
+ */
+std::optional<size_t> XdpEthernetPort::receive_frames(const FrameViewCallback& callback) {
+    while (true) {
+        size_t received = receive_batch(callback, XdpEthernetPort::RING_SIZE);
+
+        std::optional<size_t> raw_received = EthernetPort::receive_frames(callback);
+        if (!raw_received.has_value()) {
+            return {};
+        }
+        received += raw_received.value();
+
+        if (received > 0 || !waits_for_frames) {
+            return received;
+        }
+        if (!wait_for_frames()) {
+            return {};
+        }
+    }
+}
+
+/*
+ * Puts the given frame on the TX ring as it should go out on this port, starting at the given
+ * producer index and taking up at most the given number of slots. A frame that's already in the
+ * UMEM and goes out as is is sent straight from its chunk. Anything else is copied into chunks from
+ * the TX pool first, with a VLAN tag pushed if the port tags it. Since an AF_XDP socket can't pass
+ * offloads on, GSO frames are segmented and checksums are filled in as they're copied. Either way,
+ * the frame is held until the kernel has sent it. Returns the number of slots used, or zero if the
+ * frame couldn't be staged because the ring or the TX pool is full, a segment doesn't fit in a
+ * chunk, or the frame's offloads don't add up.
+ */
+uint32_t XdpEthernetPort::stage_frame(const Frame& frame, uint32_t producer, uint32_t free_slots) {
+    const std::span<const unsigned char> buffer = frame.buffer();
+    const std::optional<uint16_t> tci = egress_vlan_tci(frame);
+
+    // A frame can only be on the ring once at a time, so sending it again means copying it
+    if (umem->contains(buffer.data()) && !tci.has_value() && !Segmenter::needed(frame.offload())) {
+        const uint64_t address = buffer.data() - umem->base();
+        std::optional<Frame>& held = in_flight[address / FramePool::SLOT_SIZE];
+        if (!held.has_value()) {
+            held = frame;
+            tx_ring.descriptors[producer & (XdpEthernetPort::RING_SIZE - 1)] = {
+                address, (uint32_t)buffer.size(), 0
+            };
+            return 1;
+        }
+    }
+
+    const Segmenter segmenter{buffer, frame.offload()};
+    if (!segmenter.valid() || segmenter.segments() > free_slots) {
+        return 0;
+    }
+
+    for (uint32_t segment = 0; segment < segmenter.segments(); ++segment) {
+        const size_t length = segmenter.segment_length(segment, tci.has_value());
+        FrameBuffer* copy =
+            length <= FramePool::SLOT_CAPACITY ? tx_pool->allocate_slot(length) : nullptr;
+        if (copy == nullptr) {
+            // Segments that were already copied never made it onto the ring, so they go back now
+            for (uint32_t staged = 0; staged < segment; ++staged) {
+                const xdp_desc& descriptor =
+                    tx_ring.descriptors[(producer + staged) & (XdpEthernetPort::RING_SIZE - 1)];
+                in_flight[descriptor.addr / FramePool::SLOT_SIZE].reset();
+            }
+            return 0;
+        }
+
+        segmenter.write_segment(segment, tci, copy->data());
+        const uint64_t address = copy->data() - umem->base();
+        in_flight[address / FramePool::SLOT_SIZE].emplace(copy);
+        tx_ring.descriptors[(producer + segment) & (XdpEthernetPort::RING_SIZE - 1)] = {
+            address, (uint32_t)length, 0
+        };
+    }
+    return segmenter.segments();
+}
+
+/*
+ * Puts every queued frame on the TX ring, in the order they were queued, and wakes the kernel up
+ * to send them if it needs it. Frames the kernel finished sending that no receive has reaped yet
+ * are released first. A GSO frame takes a slot for every segment. Staging stops at the first frame
+ * that doesn't fit on the ring or can't be copied, and that frame and everything queued after it
+ * are dropped. Returns the number of frames put on the ring. The batch is empty once this returns.
+ */
+size_t XdpEthernetPort::flush_frames() {
+    std::lock_guard<std::mutex> g(transmit_mutex);
+    reap_completions();
+
+    const uint32_t producer = *tx_ring.producer;
+    const uint32_t consumer = __atomic_load_n(tx_ring.consumer, __ATOMIC_ACQUIRE);
+    const uint32_t free_slots = XdpEthernetPort::RING_SIZE - (producer - consumer);
+
+    size_t sent = 0;
+    uint32_t staged = 0;
+    while (sent < tx_batch.size()) {
+        const uint32_t staged_now =
+            stage_frame(*tx_batch[sent], producer + staged, free_slots - staged);
+        if (staged_now == 0) {
+            break;
+        }
+        staged += staged_now;
+        ++sent;
+    }
+    tx_batch.clear();
+    if (staged == 0) {
+        return 0;
+    }
+    __atomic_store_n(tx_ring.producer, producer + staged, __ATOMIC_RELEASE);
+
+    // Copy mode only sends so many frames per wakeup, and says so by failing with EAGAIN
+    for (size_t wakeups = 0; wakeups < XdpEthernetPort::MAX_TRANSMIT_WAKEUPS; ++wakeups) {
+        if (!(__atomic_load_n(tx_ring.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)) {
+            break;
+        }
+        if (sendto(xsk_fd, nullptr, 0, MSG_DONTWAIT, nullptr, 0) >= 0 ||
+            (errno != EAGAIN && errno != EBUSY)) {
+            break;
+        }
+        reap_completions();
+    }
+    return sent;
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <linux/if_xdp.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "EthernetPort.hpp"
+#include "Frame.hpp"
+#include "FramePool.hpp"
+
+class XdpEthernetPort;
+
+/*
+ * Memory shared by every AF_XDP port as a single UMEM, divided into chunks the size of a FramePool
+ * slot. Each port carves its own chunks out of it to receive into and to copy frames into on
+ * transmit, but since the kernel knows all of it as one UMEM, a frame received on one port can be
+ * sent on any other straight from the chunk it was received into.
+ */
+class XdpUmem {
+private:
+    unsigned char* memory;
+    const size_t chunk_count;
+
+    // Index of the first chunk that hasn't been carved out for a port yet
+    size_t next_chunk;
+
+    // Chunks given back by ports that are gone, as runs of their first chunk and how many there are
+    std::vector<std::pair<size_t, size_t>> released_runs;
+
+    /*
+     * AF_XDP socket the UMEM was registered on, which every other port's socket binds to share it,
+     * or -1 until a port has been bound. Kept open here so ports can come and go in any order.
+     */
+    int owner_fd;
+
+    // Every attached port, so any of them can get the others to reap their completions
+    std::mutex ports_mutex;
+    std::vector<XdpEthernetPort*> ports;
+
+public:
+    explicit XdpUmem(size_t);
+    ~XdpUmem();
+
+    XdpUmem(const XdpUmem&) = delete;
+    XdpUmem& operator=(const XdpUmem&) = delete;
+
+    unsigned char* carve(size_t);
+    void release(unsigned char*, size_t);
+
+    int owner() const;
+    void set_owner(int);
+
+    void add_port(XdpEthernetPort*);
+    void remove_port(XdpEthernetPort*);
+    void reap_completions();
+
+    // Start of the UMEM, which is address zero as far as the kernel's rings are concerned
+    unsigned char* base() const {
+        return memory;
+    }
+
+    size_t size() const {
+        return chunk_count * FramePool::SLOT_SIZE;
+    }
+
+    size_t chunks() const {
+        return chunk_count;
+    }
+
+    bool contains(const void* address) const {
+        return address >= memory && address < memory + size();
+    }
+};
+
+/*
+ * One of the rings an AF_XDP socket shares with the kernel, holding either UMEM addresses (fill and
+ * completion rings) or descriptors (RX and TX rings). The producer and consumer indexes only ever
+ * count up and are masked to find a slot, so the ring is empty when they're equal.
+ */
+template <typename T>
+struct XdpRing {
+    uint32_t* producer = nullptr;
+    uint32_t* consumer = nullptr;
+    uint32_t* flags = nullptr;
+    T* descriptors = nullptr;
+
+    void* mapping = nullptr;
+    size_t mapping_length = 0;
+};
+
+/*
+ * An EthernetPort that receives and sends frames through an AF_XDP socket instead of going through
+ * the kernel's networking stack. A small XDP program attached to the interface redirects every
+ * frame received on the socket's queue straight into a UMEM chunk, which becomes the frame's
+ * buffer, so received frames are never copied. Frames are sent by handing the kernel the address
+ * of their chunk, so a frame received on one XDP port and sent on another isn't copied either. Only
+ * frames from other ports, or that have to be tagged on the way out, are copied into a chunk first.
+ *
+ * Zero-copy mode is used where the driver supports it, and copy mode everywhere else, e.g. on veth
+ * pairs. The program is attached in native mode where the driver supports it, and generic mode
+ * otherwise.
+ *
+ * A port's dropped EtherTypes are dropped by the XDP program, before they ever reach the socket.
+ * Classic BPF programs can only run on the raw socket, so a port filtering with one can't use XDP.
+ *
+ * AF_XDP has no way to pass offloads along with a frame, so GSO frames from other ports are
+ * segmented in software as they're copied into chunks, and their checksums are filled in. Frames
+ * have to fit in a chunk, so an interface with a jumbo MTU can't use XDP.
+ *
+ * The socket only covers the interface's first queue. The port's raw socket is still open, and
+ * still receives whatever arrives on other queues, as well as being what clones and transmit
+ * handles of the port send through.
+ */
+class XdpEthernetPort : public EthernetPort {
+public:
+    // Slots in each of the socket's rings. Must be a power of two
+    static constexpr uint32_t RING_SIZE = 2048;
+
+    /*
+     * Chunks each port receives into, which bounds how many frames received on the port can be
+     * held by the switch at once, and chunks it copies frames into to send them
+     */
+    static constexpr size_t RX_CHUNKS = EthernetPort::FRAME_POOL_SIZE;
+    static constexpr size_t TX_CHUNKS = XdpEthernetPort::RING_SIZE;
+    static constexpr size_t CHUNKS_PER_PORT =
+        XdpEthernetPort::RX_CHUNKS + XdpEthernetPort::TX_CHUNKS;
+
+private:
+    /*
+     * How long a blocking receive waits before trying to refill the fill ring again, when there
+     * were no chunks to refill it with because the switch was holding on to all of them
+     */
+    static constexpr int REFILL_RETRY_MS = 1;
+
+    // Most times a flush wakes the kernel up to send, since copy mode only sends a few per wakeup
+    static constexpr size_t MAX_TRANSMIT_WAKEUPS = 8;
+
+    const std::shared_ptr<XdpUmem> umem;
+
+    int xsk_fd = -1;
+    int xsk_map_fd = -1;
+    int program_fd = -1;
+    int link_fd = -1;
+
+    // epoll instance covering both the AF_XDP socket and the raw socket
+    int wait_fd = -1;
+
+    bool zero_copy = false;
+    bool waits_for_frames = true;
+
+    XdpRing<uint64_t> fill_ring;
+    XdpRing<uint64_t> completion_ring;
+    XdpRing<xdp_desc> rx_ring;
+    XdpRing<xdp_desc> tx_ring;
+
+    /*
+     * Pools over this port's chunks of the UMEM. Chunks from the RX pool are handed to the kernel
+     * on the fill ring, and go back to the pool once the last Frame received into them goes away.
+     * The TX pool is only ever allocated from by the thread flushing the port.
+     */
+    std::unique_ptr<FramePool> rx_pool;
+    std::unique_ptr<FramePool> tx_pool;
+
+    /*
+     * Frames on the TX ring the kernel hasn't completed yet, by UMEM chunk. Holding on to them
+     * keeps their chunks from being reused while the kernel is still sending them.
+     */
+    std::vector<std::optional<Frame>> in_flight;
+
+    /*
+     * Held while touching the TX and completion rings or in_flight. The thread flushing the port
+     * takes it, and any other thread only ever tries to, to reap completions the flusher hasn't.
+     */
+    std::mutex transmit_mutex;
+
+    // First of the chunks carved out of the UMEM for this port, which go back to it with the port
+    unsigned char* chunks = nullptr;
+
+    XdpEthernetPort(const std::string&, const PortFilter&, const std::shared_ptr<XdpUmem>&);
+
+    bool open_socket(unsigned int, uint16_t);
+    void close_socket();
+    bool attach();
+
+    bool refill();
+    void reap_completions();
+    uint32_t stage_frame(const Frame&, uint32_t, uint32_t);
+    size_t receive_batch(const FrameViewCallback&, size_t);
+    bool wait_for_frames();
+
+public:
+    static std::shared_ptr<EthernetPort> create(
+        const std::string&, const PortFilter&, const std::shared_ptr<XdpUmem>&
+    );
+    ~XdpEthernetPort() override;
+
+    XdpEthernetPort(const XdpEthernetPort&) = delete;
+    XdpEthernetPort& operator=(const XdpEthernetPort&) = delete;
+
+    bool zero_copy_enabled() const;
+    void try_reap_completions();
+
+    const char* backend() const override;
+    void set_nonblocking() override;
+    int receive_fd() const override;
+    uint64_t kernel_drops() override;
+
+    std::optional<Frame> receive_frame() override;
+    std::optional<size_t> receive_frames(const FrameViewCallback&) override;
+    size_t flush_frames() override;
+};
@@ -1,20 +1,417 @@
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <getopt.h>
+#include <optional>
 
 #include "Layer2Switch.hpp"
 #include "MacAddress.hpp"
 #include "EthernetPort.hpp"
+#include "XdpEthernetPort.hpp"
+#include "SwitchConfig.hpp"
+#include "Vlan.hpp"
+#include "LinkAggregation.hpp"
+#include "PortSpec.hpp"
+#include "MetricsServer.hpp"
+#include "ControlServer.hpp"
 #include "panic.hpp"
 
+// Parses a non-negative integer command line option value. Panics if the value isn't a number
+static size_t parse_count(const char* value, const char* option_name) {
+    char* end = nullptr;
+    unsigned long long count = strtoull(value, &end, 10);
+    if (*value == '\0' || *end != '\0') {
+        PANIC("Invalid value '%s' for --%s\n", value, option_name);
+    }
+    return count;
+}
+
+// Parses a comma separated list of non-negative integers, e.g. "0,2,4". Panics on anything else
+static std::vector<size_t> parse_count_list(const char* value, const char* option_name) {
+    std::vector<size_t> counts;
+    std::string list = value;
+
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+
+        counts.push_back(parse_count(list.substr(start, end - start).c_str(), option_name));
+        start = end + 1;
+    }
+
+    return counts;
+}
+
+// Parses the name of a QueueFullPolicy. Panics on an unknown name
+static QueueFullPolicy parse_queue_full_policy(const char* value, const char* option_name) {
+    const std::string policy = value;
+    if (policy == "tail-drop") {
+        return QueueFullPolicy::TAIL_DROP;
+    }
+    if (policy == "head-drop") {
+        return QueueFullPolicy::HEAD_DROP;
+    }
+    if (policy == "pause") {
+        return QueueFullPolicy::PAUSE;
+    }
+
+    PANIC("Invalid value '%s' for --%s\n", value, option_name);
+}
+
+// Parses the name of a TrafficScheduler. Panics on an unknown name
+static TrafficScheduler parse_traffic_scheduler(const char* value, const char* option_name) {
+    const std::string scheduler = value;
+    if (scheduler == "strict") {
+        return TrafficScheduler::STRICT_PRIORITY;
+    }
+    if (scheduler == "drr") {
+        return TrafficScheduler::DEFICIT_ROUND_ROBIN;
+    }
+
+    PANIC("Invalid value '%s' for --%s\n", value, option_name);
+}
+
+/*
+ * Parses a storm control limit of the form <type>:<rate>pps|bps[:<burst>] into the given config,
+ * where the burst is in frames or bits to match the rate. Panics on anything else.
+ */
+static void parse_storm_control(const char* value, const char* option_name, SwitchConfig& config) {
+    const std::string spec = value;
+    const size_t type_end = spec.find(':');
+    const size_t rate_end = type_end == std::string::npos ? std::string::npos
+                                                          : spec.find(':', type_end + 1);
+    if (type_end == std::string::npos) {
+        PANIC("Invalid value '%s' for --%s\n", value, option_name);
+    }
+
+    const std::string type = spec.substr(0, type_end);
+    StormControlLimit* limit = nullptr;
+    for (size_t flood_type = 0; flood_type < FLOOD_TYPE_COUNT; ++flood_type) {
+        if (type == flood_type_name((FloodType)flood_type)) {
+            limit = &config.storm_control[flood_type];
+        }
+    }
+
+    std::string rate = spec.substr(type_end + 1, rate_end - type_end - 1);
+    if (limit == nullptr || rate.size() < 3 ||
+        (!rate.ends_with("pps") && !rate.ends_with("bps"))) {
+        PANIC("Invalid value '%s' for --%s\n", value, option_name);
+    }
+
+    limit->rate_in_bits = rate.ends_with("bps");
+    rate.resize(rate.size() - 3);
+    limit->rate = parse_count(rate.c_str(), option_name);
+    if (rate_end != std::string::npos) {
+        limit->burst = parse_count(spec.substr(rate_end + 1).c_str(), option_name);
+    }
+}
+
+// Returns the index of the port on the given interface. Panics if the switch has no such port
+static size_t find_port(
+    const std::vector<std::shared_ptr<EthernetPort>>& ports, const std::string& interface_name,
+    const char* option_name
+) {
+    for (size_t port = 0; port < ports.size(); ++port) {
+        if (ports[port]->interface_name == interface_name) {
+            return port;
+        }
+    }
+    PANIC("Unknown interface '%s' for --%s\n", interface_name.c_str(), option_name);
+}
+
+/*
+ * Parses a mirror session of the form <interface>,...:rx|tx|both:<destination>, where the
+ * destination is an interface for --mirror and a pcapng file path for --capture. Panics on
+ * anything else.
+ */
+static MirrorSession parse_mirror_session(
+    const std::string& spec, const std::string& option_name,
+    const std::vector<std::shared_ptr<EthernetPort>>& ports
+) {
+    const size_t sources_end = spec.find(':');
+    const size_t direction_end =
+        sources_end == std::string::npos ? sources_end : spec.find(':', sources_end + 1);
+    if (direction_end == std::string::npos || direction_end + 1 == spec.size()) {
+        PANIC("Invalid value '%s' for --%s\n", spec.c_str(), option_name.c_str());
+    }
+
+    const std::string direction = spec.substr(sources_end + 1, direction_end - sources_end - 1);
+    if (direction != "rx" && direction != "tx" && direction != "both") {
+        PANIC("Invalid value '%s' for --%s\n", spec.c_str(), option_name.c_str());
+    }
+
+    MirrorSession session;
+    for (size_t start = 0; start <= sources_end;) {
+        const size_t end = std::min(spec.find(',', start), sources_end);
+        const size_t port = find_port(ports, spec.substr(start, end - start), option_name.c_str());
+        if (direction != "tx") {
+            session.ingress_ports.push_back(port);
+        }
+        if (direction != "rx") {
+            session.egress_ports.push_back(port);
+        }
+        start = end + 1;
+    }
+
+    const std::string destination = spec.substr(direction_end + 1);
+    if (option_name == "capture") {
+        session.capture_path = destination;
+    } else {
+        session.destination_port = find_port(ports, destination, option_name.c_str());
+    }
+    return session;
+}
+
+#define USAGE                                                                                      \
+    "Usage: %s [--queue-depth=<frames> | --queue-depths=<frames>,...] "                            \
+    "[--queue-policy=tail-drop|head-drop|pause] [--idle-polls=<polls> | --busy-poll] "             \
+    "[--scheduler=strict|drr] [--class-weights=<weight>,<weight>,<weight>,<weight>] "              \
+    "[--workers=<count> | --reactors=<count> [--port-reactors=<reactor>,...]] "                    \
+    "[--cpus=<cpu>,...] [--mac-table-size=<entries>] [--mac-aging=<seconds>] "                     \
+    "[--mac-snapshot=<path> [--mac-snapshot-interval=<seconds>]] "                                 \
+    "[--storm-control=broadcast|multicast|unknown_unicast:<rate>pps|bps[:<burst>]]... "            \
+    "[--storm-shutdown=<seconds> [--storm-shutdown-threshold=<frames>]] "                          \
+    "[--spanning-tree [--bridge-priority=<priority>] [--port-path-cost=<cost>]] "                  \
+    "[--multicast-snooping] [--lacp] "                                                             \
+    "[--mirror=<interface>,...:rx|tx|both:<interface>]... "                                        \
+    "[--capture=<interface>,...:rx|tx|both:<path>]... "                                            \
+    "[--acl=<path>] [--metrics-socket=<path>] [--control-socket=<path> [--max-ports=<ports>]] "    \
+    "<interface name>[:raw|:mmap|:xdp][:access=<vlan>|:trunk=<vlan>,...[:native=<vlan>]]"          \
+    "[:lag=<lag>][:drop=<ethertype>,...|:bpf=<path>]...\n"                                         \
+    "       %s --dump-metrics=<path>\n"                                                          \
+    "       %s --control=<path> <command>...\n"
+
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        PANIC("Too few arguments. Usage: %s <interface name>...\n", argv[0]);
+    static const option LONG_OPTIONS[] = {
+        {"queue-depth", required_argument, nullptr, 'q'},
+        {"queue-depths", required_argument, nullptr, 'Q'},
+        {"queue-policy", required_argument, nullptr, 'P'},
+        {"scheduler", required_argument, nullptr, 'S'},
+        {"class-weights", required_argument, nullptr, 'W'},
+        {"idle-polls", required_argument, nullptr, 'i'},
+        {"busy-poll", no_argument, nullptr, 'b'},
+        {"workers", required_argument, nullptr, 'w'},
+        {"reactors", required_argument, nullptr, 'r'},
+        {"port-reactors", required_argument, nullptr, 'p'},
+        {"cpus", required_argument, nullptr, 'c'},
+        {"mac-table-size", required_argument, nullptr, 'm'},
+        {"mac-aging", required_argument, nullptr, 'a'},
+        {"mac-snapshot", required_argument, nullptr, 'n'},
+        {"mac-snapshot-interval", required_argument, nullptr, 'I'},
+        {"storm-control", required_argument, nullptr, 'C'},
+        {"storm-shutdown", required_argument, nullptr, 'x'},
+        {"storm-shutdown-threshold", required_argument, nullptr, 'T'},
+        {"spanning-tree", no_argument, nullptr, 't'},
+        {"bridge-priority", required_argument, nullptr, 'B'},
+        {"port-path-cost", required_argument, nullptr, 'R'},
+        {"multicast-snooping", no_argument, nullptr, 'g'},
+        {"lacp", no_argument, nullptr, 'l'},
+        {"mirror", required_argument, nullptr, 'M'},
+        {"capture", required_argument, nullptr, 'K'},
+        {"acl", required_argument, nullptr, 'A'},
+        {"metrics-socket", required_argument, nullptr, 's'},
+        {"dump-metrics", required_argument, nullptr, 'd'},
+        {"control-socket", required_argument, nullptr, 'k'},
+        {"max-ports", required_argument, nullptr, 'N'},
+        {"control", required_argument, nullptr, 'o'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    SwitchConfig config;
+
+    // Mirror sessions name interfaces, so they're parsed once the ports are known
+    std::vector<std::pair<std::string, std::string>> mirror_specs;
+
+    // Control socket of an already running switch to send a command to, rather than starting one
+    std::optional<std::string> control_path;
+
+    int option_index = 0;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", LONG_OPTIONS, &option_index)) != -1) {
+        switch (opt) {
+        case 'q':
+            config.input_queue_depth = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'Q':
+            config.port_queue_depths = parse_count_list(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'P':
+            config.queue_full_policy =
+                parse_queue_full_policy(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'S':
+            config.traffic_scheduler =
+                parse_traffic_scheduler(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'W': {
+            std::vector<size_t> weights = parse_count_list(optarg, LONG_OPTIONS[option_index].name);
+            if (weights.size() != TRAFFIC_CLASS_COUNT) {
+                PANIC(
+                    "Expected %ld weights for --%s, one per traffic class\n", TRAFFIC_CLASS_COUNT,
+                    LONG_OPTIONS[option_index].name
+                );
+            }
+            std::ranges::copy(weights, config.class_weights.begin());
+            break;
+        }
+        case 'i':
+            config.idle_polls_before_sleep = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'b':
+            config.idle_polls_before_sleep = SwitchConfig::NEVER_SLEEP;
+            break;
+        case 'w':
+            config.forwarding_workers = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'r':
+            config.reactors = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'p':
+            config.port_reactors = parse_count_list(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'c': {
+            std::vector<size_t> cpus = parse_count_list(optarg, LONG_OPTIONS[option_index].name);
+            config.worker_cpus = {cpus.begin(), cpus.end()};
+            break;
+        }
+        case 'm':
+            config.mac_table_size = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'a':
+            config.mac_aging_seconds = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'n':
+            config.mac_snapshot_path = optarg;
+            break;
+        case 'I':
+            config.mac_snapshot_interval_seconds =
+                parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'C':
+            parse_storm_control(optarg, LONG_OPTIONS[option_index].name, config);
+            break;
+        case 'x':
+            config.storm_shutdown_seconds = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'T':
+            config.storm_shutdown_threshold = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 't':
+            config.spanning_tree = true;
+            break;
+        case 'B': {
+            size_t priority = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            if (priority > UINT16_MAX) {
+                PANIC("Invalid value '%s' for --%s\n", optarg, LONG_OPTIONS[option_index].name);
+            }
+            config.bridge_priority = priority;
+            break;
+        }
+        case 'R':
+            config.port_path_cost = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'g':
+            config.multicast_snooping = true;
+            break;
+        case 'l':
+            config.lacp = true;
+            break;
+        case 'M':
+        case 'K':
+            mirror_specs.emplace_back(LONG_OPTIONS[option_index].name, optarg);
+            break;
+        case 'A':
+            config.acl_path = optarg;
+            break;
+        case 's':
+            config.metrics_socket_path = optarg;
+            break;
+        case 'd':
+            // Print the metrics of an already running switch rather than starting one
+            if (!MetricsServer::dump(optarg, stdout)) {
+                PANIC("Failed to read metrics from %s: %s\n", optarg, strerror(errno));
+            }
+            return 0;
+        case 'k':
+            config.control_socket_path = optarg;
+            break;
+        case 'N':
+            config.max_ports = parse_count(optarg, LONG_OPTIONS[option_index].name);
+            break;
+        case 'o':
+            control_path = optarg;
+            break;
+        default:
+            PANIC(USAGE, argv[0], argv[0], argv[0]);
+        }
+    }
+
+    if (optind >= argc) {
+        PANIC("Too few arguments. " USAGE, argv[0], argv[0], argv[0]);
+    }
+
+    // The rest of the arguments are the command, whose reply is printed as is
+    if (control_path.has_value()) {
+        std::string command = argv[optind];
+        for (int i = optind + 1; i < argc; ++i) { command += std::string{" "} + argv[i]; }
+
+        std::optional<std::string> reply = ControlServer::send(control_path.value(), command);
+        if (!reply.has_value()) {
+            PANIC("Failed to send a command to %s: %s\n", control_path->c_str(), strerror(errno));
+        }
+        fputs(reply->c_str(), stdout);
+        return reply->starts_with("error") ? 1 : 0;
+    }
+
+    // Every XDP port shares one UMEM, so frames can be sent between them without copying
+    const size_t xdp_ports = std::count_if(argv + optind, argv + argc, [](const char* spec) {
+        return (std::string{spec} + ":").find(":xdp:") != std::string::npos;
+    });
+    std::shared_ptr<XdpUmem> umem;
+    if (xdp_ports > 0) {
+        umem = std::make_shared<XdpUmem>(xdp_ports * XdpEthernetPort::CHUNKS_PER_PORT);
     }
 
     // Consume the list of interfaces to bind the switch to
     std::vector<std::shared_ptr<EthernetPort>> ports;
-    for (int i = 1; i < argc; ++i) { ports.push_back(std::make_shared<EthernetPort>(argv[i])); }
+    std::vector<std::optional<PortVlans>> port_vlans;
+    std::vector<uint16_t> port_lags;
+    for (int i = optind; i < argc; ++i) {
+        std::string error;
+        std::optional<PortSpec> spec = PortSpec::parse(argv[i], error);
+        if (!spec.has_value()) {
+            PANIC("%s\n", error.c_str());
+        }
+
+        ports.push_back(spec->open(umem));
+        port_vlans.push_back(spec->vlans);
+        port_lags.push_back(spec->lag);
+    }
+
+    // Once any port has VLAN settings, ports without any are access ports in the default VLAN
+    if (std::ranges::any_of(port_vlans, [](const auto& vlans) { return vlans.has_value(); })) {
+        for (const std::optional<PortVlans>& vlans : port_vlans) {
+            config.port_vlans.push_back(vlans.value_or(PortVlans{}));
+        }
+    }
+
+    // Ports without a LAG are left alone, and no LAGs at all leaves link aggregation off
+    const auto in_lag = [](uint16_t lag) { return lag != LinkAggregation::NO_LAG; };
+    if (std::ranges::any_of(port_lags, in_lag)) {
+        config.port_lags = port_lags;
+    }
+
+    for (const auto& [option_name, spec] : mirror_specs) {
+        config.mirror_sessions.push_back(parse_mirror_session(spec, option_name, ports));
+    }
 
-    Layer2Switch l2_switch(ports);
+    Layer2Switch l2_switch(ports, config);
     l2_switch.start();
 
     return 0;
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <array>
+#include <string>
+
+/*
+ * The original MacAddress implementation, which eagerly formats the readable string and keeps the
+ * octets, the string, and an integer around. Only kept so the benchmarks can compare against it.
+ */
+class LegacyMacAddress {
+private:
+    static constexpr size_t READABLE_STRING_BUFFER_SIZE = sizeof("00:00:00:00:00:00");
+
+public:
+    static std::string initialize_readable_string(const std::array<unsigned char, 6>& raw_octets) {
+        char raw_readable_string_buffer[LegacyMacAddress::READABLE_STRING_BUFFER_SIZE];
+        snprintf(
+            raw_readable_string_buffer, LegacyMacAddress::READABLE_STRING_BUFFER_SIZE,
+            "%.2X:%.2X:%.2X:%.2X:%.2X:%.2X", raw_octets.at(0), raw_octets.at(1), raw_octets.at(2),
+            raw_octets.at(3), raw_octets.at(4), raw_octets.at(5)
+        );
+
+        return {raw_readable_string_buffer};
+    }
+
+    static uint64_t initialize_int_representation(const std::array<unsigned char, 6>& raw_octets) {
+        return (uint64_t)raw_octets.at(0) << 40 | (uint64_t)raw_octets.at(1) << 32 |
+               (uint64_t)raw_octets.at(2) << 24 | (uint64_t)raw_octets.at(3) << 16 |
+               (uint64_t)raw_octets.at(4) << 8 | (uint64_t)raw_octets.at(5);
+    }
+
+    LegacyMacAddress(
+        unsigned char octet1, unsigned char octet2, unsigned char octet3, unsigned char octet4,
+        unsigned char octet5, unsigned char octet6
+    )
+        : raw_octets{{octet1, octet2, octet3, octet4, octet5, octet6}},
+          readable_string{LegacyMacAddress::initialize_readable_string(raw_octets)},
+          int_representation{LegacyMacAddress::initialize_int_representation(raw_octets)} {
+    }
+
+    bool operator==(const LegacyMacAddress& other) const {
+        return int_representation == other.int_representation;
+    }
+
+    bool is_broadcast() const {
+        return int_representation == 0xFFFFFFFFFFFF;
+    }
+
+    const std::array<uint8_t, 6> raw_octets;
+    std::string readable_string;
+    uint64_t int_representation;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "EthernetPort.hpp"
+#include "Frame.hpp"
+#include "SpscRing.hpp"
+
+/*
+ * An EthernetPort that lives entirely in memory, so the switch can be benchmarked without raw
+ * sockets or CAP_NET_RAW. Each port is a pair of lock-free rings: a receive ring that a traffic
+ * generator injects frames into, and a transmit ring that whatever the switch sends ends up in,
+ * ready to be drained by a sink. Frames are shared by reference on the way out, just like they are
+ * when handed to the kernel.
+ *
+ * Receives never block. When nothing is waiting they yield instead, so a benchmark with more busy
+ * threads than cores still makes progress.
+ */
+class MemoryEthernetPort : public EthernetPort {
+private:
+    // Largest number of frames handed out by a single receive_frames() call
+    static constexpr size_t RECEIVE_BATCH_SIZE = 64;
+
+    // Frames injected by the generator, waiting to be received by the switch
+    SpscRing<Frame> rx_ring;
+
+    // Frames sent by the switch, waiting to be drained
+    SpscRing<Frame> tx_ring;
+
+public:
+    MemoryEthernetPort(const std::string& i, size_t ring_depth)
+        : EthernetPort{i, -1},
+          rx_ring{ring_depth},
+          tx_ring{ring_depth} {
+    }
+
+    // Queues a frame to be received by the switch. Generator only. Returns false if the ring's full
+    bool inject(const Frame& frame) {
+        return rx_ring.try_emplace(frame);
+    }
+
+    // Hands every frame sent on this port so far to the given callback. Sink only
+    template <typename Callback>
+    size_t drain(Callback&& callback) {
+        const size_t count = tx_ring.readable();
+        for (size_t i = 0; i < count; ++i) { callback(std::as_const(tx_ring.peek(i))); }
+        tx_ring.pop(count);
+        return count;
+    }
+
+    std::optional<Frame> receive_frame() override {
+        if (rx_ring.readable() == 0) {
+            std::this_thread::yield();
+            return {};
+        }
+
+        Frame frame{frame_pool, rx_ring.peek(0).buffer()};
+        rx_ring.pop(1);
+        return frame;
+    }
+
+    /*
+     * Copies whatever is waiting into the switch, the same way frames are copied out of a
+     * PACKET_MMAP ring.
+     */
+    std::optional<size_t> receive_frames(const FrameViewCallback& callback) override {
+        const size_t count = std::min(rx_ring.readable(), MemoryEthernetPort::RECEIVE_BATCH_SIZE);
+        if (count == 0) {
+            std::this_thread::yield();
+            return 0;
+        }
+
+        for (size_t i = 0; i < count; ++i) { callback(FrameView{rx_ring.peek(i).buffer()}); }
+        rx_ring.pop(count);
+        return count;
+    }
+
+    bool send_frame(const Frame& frame) override {
+        return tx_ring.try_emplace(frame);
+    }
+
+    size_t flush_frames() override {
+        size_t sent = 0;
+        for (const Frame* frame : tx_batch) {
+            if (!tx_ring.try_emplace(*frame)) {
+                break;
+            }
+            ++sent;
+        }
+
+        tx_batch.clear();
+        return sent;
+    }
+};
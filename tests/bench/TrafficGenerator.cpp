@@ -0,0 +1,83 @@
+#include <net/ethernet.h>
+#include <algorithm>
+#include <random>
+
+#include "TrafficGenerator.hpp"
+
+// EtherType IEEE 802 sets aside for local experiments, so nothing else on the wire claims it
+static constexpr uint16_t ETHERTYPE_EXPERIMENTAL = 0x88B5;
+
+static constexpr size_t MINIMUM_FRAME_SIZE = 60;
+static constexpr size_t MAXIMUM_FRAME_SIZE = 1514;
+static constexpr size_t IMIX_MEDIUM_FRAME_SIZE = 590;
+
+// Builds a frame of the given size from the given host to the given MAC
+GeneratedFrame TrafficGenerator::make_frame(
+    size_t source_host, const MacAddress& destination, size_t size, size_t expected_deliveries
+) const {
+    GeneratedFrame frame{source_host % profile.port_count, expected_deliveries, {}};
+    frame.bytes.resize(size);
+
+    std::ranges::copy(destination.raw_octets(), frame.bytes.begin());
+    std::ranges::copy(hosts[source_host].raw_octets(), frame.bytes.begin() + ETH_ALEN);
+    frame.bytes[2 * ETH_ALEN] = ETHERTYPE_EXPERIMENTAL >> 8;
+    frame.bytes[2 * ETH_ALEN + 1] = ETHERTYPE_EXPERIMENTAL & 0xFF;
+    return frame;
+}
+
+TrafficGenerator::TrafficGenerator(const TrafficProfile& p)
+    : profile{p} {
+    constexpr MacAddress broadcast(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF);
+
+    // Every host gets a locally administered unicast MAC derived from its index
+    for (size_t host = 0; host < profile.host_count; ++host) {
+        hosts.emplace_back(
+            0x02, 0x00, (uint8_t)(host >> 24), (uint8_t)(host >> 16), (uint8_t)(host >> 8),
+            (uint8_t)host
+        );
+    }
+
+    for (size_t host = 0; host < profile.host_count; ++host) {
+        learning.push_back(make_frame(host, broadcast, MINIMUM_FRAME_SIZE, profile.port_count - 1));
+    }
+
+    std::mt19937_64 random{profile.seed};
+    std::bernoulli_distribution is_broadcast{profile.broadcast_ratio};
+    std::uniform_int_distribution<size_t> any_host{0, profile.host_count - 1};
+    std::discrete_distribution<size_t> imix_size{7, 4, 1};
+    const size_t imix_sizes[] = {MINIMUM_FRAME_SIZE, IMIX_MEDIUM_FRAME_SIZE, MAXIMUM_FRAME_SIZE};
+
+    for (size_t i = 0; i < TrafficGenerator::PATTERN_SIZE; ++i) {
+        size_t size = MINIMUM_FRAME_SIZE;
+        if (profile.frame_sizes == FrameSizes::IMIX) {
+            size = imix_sizes[imix_size(random)];
+        } else if (profile.frame_sizes == FrameSizes::MAXIMUM) {
+            size = MAXIMUM_FRAME_SIZE;
+        }
+
+        const size_t source = any_host(random);
+        if (is_broadcast(random)) {
+            pattern.push_back(make_frame(source, broadcast, size, profile.port_count - 1));
+            continue;
+        }
+
+        // Hosts on the same port never go through the switch, so pick one on another port
+        size_t destination = any_host(random);
+        while (destination % profile.port_count == source % profile.port_count) {
+            destination = any_host(random);
+        }
+        pattern.push_back(make_frame(source, hosts[destination], size, 1));
+    }
+}
+
+const std::vector<GeneratedFrame>& TrafficGenerator::learning_frames() const {
+    return learning;
+}
+
+const std::vector<GeneratedFrame>& TrafficGenerator::frames() const {
+    return pattern;
+}
+
+const TrafficProfile& TrafficGenerator::get_profile() const {
+    return profile;
+}
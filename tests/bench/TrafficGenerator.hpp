@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MacAddress.hpp"
+
+// Distribution of the sizes of generated frames, not counting the FCS
+enum class FrameSizes {
+    // Every frame is the minimum ethernet frame size, the worst case for per-frame overhead
+    MINIMUM,
+
+    // The simple IMIX: 60, 590, and 1514 byte frames in a 7:4:1 ratio
+    IMIX,
+
+    // Every frame is the largest standard ethernet frame
+    MAXIMUM,
+};
+
+// Shape of the traffic a TrafficGenerator produces
+struct TrafficProfile {
+    // Number of switch ports traffic is spread across. Must be at least two
+    size_t port_count = 4;
+
+    // Number of distinct hosts (i.e. MACs), spread round robin across the ports. Must be at least
+    // as many as there are ports
+    size_t host_count = 64;
+
+    // Fraction of frames sent to the broadcast MAC rather than unicast to another host
+    double broadcast_ratio = 0.0;
+
+    FrameSizes frame_sizes = FrameSizes::MINIMUM;
+
+    // Rate frames are offered to the switch at, or zero to offer them as fast as they're accepted
+    uint64_t frames_per_second = 0;
+
+    uint64_t seed = 1;
+};
+
+// A frame to inject into the switch
+struct GeneratedFrame {
+    // Port the frame is received on
+    size_t ingress_port;
+
+    // Number of ports the switch should send the frame out of once every MAC has been learned
+    size_t expected_deliveries;
+
+    // The whole frame, ethernet header included. Bytes after the header are free for timestamps
+    std::vector<unsigned char> bytes;
+};
+
+/*
+ * Synthetic traffic for benchmarking the switch. Hosts live on fixed ports, and unicast frames are
+ * always sent to a host on another port so every frame is actually switched. Traffic is generated
+ * up front as a repeating pattern so that generating it costs nothing while the switch is timed.
+ */
+class TrafficGenerator {
+public:
+    // Offset of the bytes in every generated frame that are free for the caller to use
+    static constexpr size_t PAYLOAD_OFFSET = 14;
+
+private:
+    const TrafficProfile profile;
+    std::vector<MacAddress> hosts;
+    std::vector<GeneratedFrame> learning;
+    std::vector<GeneratedFrame> pattern;
+
+    GeneratedFrame make_frame(size_t, const MacAddress&, size_t, size_t) const;
+
+public:
+    // Number of frames in the repeating pattern
+    static constexpr size_t PATTERN_SIZE = 4096;
+
+    explicit TrafficGenerator(const TrafficProfile&);
+
+    /*
+     * One broadcast from every host, so the switch learns where each host lives before anything is
+     * measured.
+     */
+    const std::vector<GeneratedFrame>& learning_frames() const;
+
+    // The repeating pattern of frames to measure the switch with
+    const std::vector<GeneratedFrame>& frames() const;
+
+    const TrafficProfile& get_profile() const;
+};
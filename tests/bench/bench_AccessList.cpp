@@ -0,0 +1,117 @@
+#include <benchmark/benchmark.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AccessList.hpp"
+
+// Number of distinct frames the benchmarks cycle through, so nothing gets constant folded
+static constexpr size_t FRAME_COUNT = 1024;
+
+// Prefix lengths and port matches the mixed rule sets are spread across, one mask per combination
+static constexpr int PREFIX_LENGTHS[] = {32, 24, 16, 8};
+
+// Builds an untagged TCP over IPv4 frame to the given address and port
+static std::vector<unsigned char> make_frame(uint32_t destination_ip, uint16_t destination_port) {
+    std::vector<unsigned char> frame(sizeof(ethhdr) + 20 + 20, 0);
+    frame[12] = 0x08;
+
+    unsigned char* ip = frame.data() + sizeof(ethhdr);
+    ip[0] = 0x45;
+    ip[9] = IPPROTO_TCP;
+    for (int i = 0; i < 4; ++i) { ip[16 + i] = destination_ip >> (24 - 8 * i); }
+    ip[22] = destination_port >> 8;
+    ip[23] = destination_port;
+    return frame;
+}
+
+static std::string format_ip(uint32_t ip) {
+    return std::to_string(ip >> 24) + "." + std::to_string(ip >> 16 & 0xFF) + "." +
+           std::to_string(ip >> 8 & 0xFF) + "." + std::to_string(ip & 0xFF);
+}
+
+/*
+ * Builds the given number of deny rules on destination addresses in 10.0.0.0/8 and TCP ports.
+ * With mixed masks, rules cycle through every prefix length with and without a port, as an ACL
+ * that grew by hand over the years would; otherwise every rule is an exact address and port.
+ */
+static std::vector<AclRule> make_rules(size_t count, bool mixed_masks) {
+    std::mt19937 random{42};
+    std::string text;
+    for (size_t rule = 0; rule < count; ++rule) {
+        const size_t shape = mixed_masks ? rule % (2 * std::size(PREFIX_LENGTHS)) : 0;
+        const int prefix_length = PREFIX_LENGTHS[shape / 2];
+        const uint32_t mask = 0xFFFFFFFF << (32 - prefix_length);
+        const uint32_t destination = (0x0A000000 | (random() & 0x00FFFFFF)) & mask;
+
+        text += "deny dst-ip " + format_ip(destination) + "/" + std::to_string(prefix_length);
+        if (shape % 2 == 0) {
+            text += " ip-proto 6 dst-port " + std::to_string(random() % 1024);
+        }
+        text += "\n";
+    }
+
+    std::string error;
+    return AccessList::parse(text, error).value();
+}
+
+// Frames to random addresses in and around the rules' range, so lookups both hit and miss
+static std::vector<std::vector<unsigned char>> make_frames() {
+    std::mt19937 random{7};
+    std::vector<std::vector<unsigned char>> frames;
+    for (size_t i = 0; i < FRAME_COUNT; ++i) {
+        frames.push_back(make_frame(0x0A000000 | (random() & 0x01FFFFFF), random() % 1024));
+    }
+    return frames;
+}
+
+static const std::vector<std::vector<unsigned char>> FRAMES = make_frames();
+
+// What an ACL costs without compiling it: checking every rule in order until one matches
+static void BM_AccessListLinearScan(benchmark::State& state, bool mixed_masks) {
+    const std::vector<AclRule> rules = make_rules(state.range(0), mixed_masks);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const FlowKey key = AccessList::flow_key(FRAMES[i++ % FRAME_COUNT], 1);
+        size_t match = rules.size();
+        for (size_t rule = 0; rule < rules.size() && match == rules.size(); ++rule) {
+            bool matches = true;
+            for (size_t word = 0; word < key.words.size(); ++word) {
+                matches &= (key.words[word] & rules[rule].mask.words[word]) ==
+                           rules[rule].key.words[word];
+            }
+            match = matches ? rule : match;
+        }
+        benchmark::DoNotOptimize(match);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_AccessListLinearScan, exact, false)->Arg(100)->Arg(1000)->Arg(10000);
+BENCHMARK_CAPTURE(BM_AccessListLinearScan, mixed, true)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Classifying a frame against the compiled ACL, which the switch does for every frame
+static void BM_AccessListClassify(benchmark::State& state, bool mixed_masks) {
+    const AccessList access_list{make_rules(state.range(0), mixed_masks), 1};
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(access_list.classify(FRAMES[i++ % FRAME_COUNT], 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["tables"] = access_list.tuple_count();
+}
+BENCHMARK_CAPTURE(BM_AccessListClassify, exact, false)->Arg(100)->Arg(1000)->Arg(10000);
+BENCHMARK_CAPTURE(BM_AccessListClassify, mixed, true)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Compiling an ACL, which happens off the data path whenever it's loaded
+static void BM_AccessListCompile(benchmark::State& state) {
+    const std::vector<AclRule> rules = make_rules(state.range(0), true);
+    for (auto _ : state) {
+        const AccessList access_list{rules, 4};
+        benchmark::DoNotOptimize(access_list.tuple_count());
+    }
+}
+BENCHMARK(BM_AccessListCompile)->Arg(10000);
@@ -0,0 +1,327 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Layer2Switch.hpp"
+#include "FramePool.hpp"
+#include "MemoryEthernetPort.hpp"
+#include "TrafficGenerator.hpp"
+
+// How the switch under test is run
+enum class SwitchMode {
+    // A receiver thread per port feeding the main switch loop through the input queues
+    QUEUED,
+
+    // A single sharded forwarding worker that receives, switches, and sends inline
+    INLINE,
+};
+
+/*
+ * Runs a Layer2Switch end to end over in-memory ports. The switch's workers are driven the same
+ * way start() drives them, but on threads this harness can stop. Traffic is injected by a generator
+ * thread and drained by whichever thread calls run(), which records the forwarding latency of every
+ * delivered frame from a timestamp the generator writes into its payload.
+ *
+ * Only a single forwarding worker is supported in INLINE mode, since spreading traffic across more
+ * would need PACKET_FANOUT, which in-memory ports don't emulate.
+ */
+class Layer2SwitchBench {
+private:
+    // Depth of each port's receive and transmit rings
+    static constexpr size_t RING_DEPTH = 4096;
+
+    const TrafficGenerator generator;
+
+    // Frames injected by the generator. Declared before the ports, whose rings hold its frames
+    FramePool generator_pool;
+
+    std::vector<std::shared_ptr<MemoryEthernetPort>> ports;
+    Layer2Switch l2switch;
+
+    // Forwarding latency of every frame delivered so far, in nanoseconds
+    std::vector<uint64_t> latencies;
+
+    std::atomic_bool running;
+
+    // Number of times the switching thread has gone around its loop
+    std::atomic_uint64_t completed_passes;
+
+    // Declared last so the workers are stopped before anything they use is destroyed
+    std::vector<std::jthread> threads;
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()
+        )
+            .count();
+    }
+
+    static std::vector<std::shared_ptr<EthernetPort>> as_ethernet_ports(
+        const std::vector<std::shared_ptr<MemoryEthernetPort>>& ports
+    ) {
+        return {ports.begin(), ports.end()};
+    }
+
+    static std::vector<std::shared_ptr<MemoryEthernetPort>> make_ports(size_t count) {
+        std::vector<std::shared_ptr<MemoryEthernetPort>> ports;
+        for (size_t port = 0; port < count; ++port) {
+            ports.push_back(std::make_shared<MemoryEthernetPort>(
+                "mem" + std::to_string(port), Layer2SwitchBench::RING_DEPTH
+            ));
+        }
+        return ports;
+    }
+
+    static SwitchConfig make_config(const TrafficProfile& profile, SwitchMode mode) {
+        SwitchConfig config;
+        config.forwarding_workers = mode == SwitchMode::INLINE ? 1 : 0;
+        config.idle_polls_before_sleep = SwitchConfig::NEVER_SLEEP;
+        config.mac_table_size = std::max(config.mac_table_size, profile.host_count);
+        config.mac_aging_seconds = 0;
+        return config;
+    }
+
+    void queued_receiver(size_t port) {
+        while (running.load(std::memory_order_relaxed)) {
+            l2switch.frame_receiver_worker_impl(port);
+        }
+    }
+
+    void queued_switch() {
+        while (running.load(std::memory_order_relaxed)) {
+            // Only switch when there's something to switch, since switch_impl() waits otherwise
+            if (l2switch.queued_frame_count() > 0) {
+                l2switch.switch_impl();
+            }
+            completed_passes.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    void inline_worker() {
+        while (running.load(std::memory_order_relaxed)) {
+            for (size_t port = 0; port < ports.size(); ++port) {
+                l2switch.forwarding_worker_impl(0, port);
+            }
+            l2switch.flush_ports(l2switch.shards[0]);
+            completed_passes.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    // Offers the given number of frames to the switch, cycling through the given pattern
+    void generate(const std::vector<GeneratedFrame>& frames, size_t count) {
+        const uint64_t frames_per_second = generator.get_profile().frames_per_second;
+        const uint64_t start_time = now();
+
+        for (size_t i = 0; i < count; ++i) {
+            const GeneratedFrame& generated = frames[i % frames.size()];
+
+            if (frames_per_second > 0) {
+                const uint64_t due = start_time + i * 1'000'000'000 / frames_per_second;
+                while (now() < due) { std::this_thread::yield(); }
+            }
+
+            FrameBuffer* frame_buffer = generator_pool.allocate(generated.bytes.size());
+            memcpy(frame_buffer->data(), generated.bytes.data(), generated.bytes.size());
+            const uint64_t timestamp = now();
+            memcpy(frame_buffer->data() + TrafficGenerator::PAYLOAD_OFFSET, &timestamp, 8);
+
+            const Frame frame{frame_buffer};
+            while (!ports[generated.ingress_port]->inject(frame)) { std::this_thread::yield(); }
+        }
+    }
+
+    // Drains every port's transmit ring. Returns the time the last frame was drained, if any was
+    std::optional<uint64_t> drain() {
+        std::optional<uint64_t> drained_at;
+        for (const std::shared_ptr<MemoryEthernetPort>& port : ports) {
+            const uint64_t drain_time = now();
+            size_t drained = port->drain([&](const Frame& frame) {
+                uint64_t timestamp;
+                memcpy(&timestamp, frame.buffer().data() + TrafficGenerator::PAYLOAD_OFFSET, 8);
+                latencies.push_back(drain_time - timestamp);
+            });
+
+            if (drained > 0) {
+                drained_at = drain_time;
+            }
+        }
+        return drained_at;
+    }
+
+public:
+    Layer2SwitchBench(const TrafficProfile& profile, SwitchMode mode)
+        : generator{profile},
+          generator_pool{Layer2SwitchBench::RING_DEPTH * profile.port_count},
+          ports{make_ports(profile.port_count)},
+          l2switch{as_ethernet_ports(ports), make_config(profile, mode)},
+          running{true},
+          completed_passes{0} {
+        if (mode == SwitchMode::QUEUED) {
+            for (size_t port = 0; port < ports.size(); ++port) {
+                threads.emplace_back(&Layer2SwitchBench::queued_receiver, this, port);
+            }
+            threads.emplace_back(&Layer2SwitchBench::queued_switch, this);
+        } else {
+            threads.emplace_back(&Layer2SwitchBench::inline_worker, this);
+        }
+    }
+
+    ~Layer2SwitchBench() {
+        running = false;
+    }
+
+    /*
+     * Offers the given number of frames to the switch and waits for the switch to finish with all
+     * of them. Returns the time from the first frame being offered to the last one being
+     * delivered.
+     */
+    std::chrono::nanoseconds run(const std::vector<GeneratedFrame>& frames, size_t count) {
+        const uint64_t target_received = l2switch.metrics.totals().received_frames_count + count;
+        const uint64_t start_time = now();
+        uint64_t last_delivery = start_time;
+
+        std::jthread generator_thread(&Layer2SwitchBench::generate, this, std::cref(frames), count);
+
+        // Keep draining until every frame has been received, and then switched or dropped
+        while (l2switch.metrics.totals().received_frames_count < target_received ||
+               l2switch.queued_frame_count() > 0) {
+            std::optional<uint64_t> drained_at = drain();
+            if (drained_at.has_value()) {
+                last_delivery = drained_at.value();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        // Frames may still be waiting to be flushed until the switching thread goes around again
+        const uint64_t passes = completed_passes.load(std::memory_order_acquire);
+        while (completed_passes.load(std::memory_order_acquire) < passes + 2) {
+            std::this_thread::yield();
+        }
+        last_delivery = drain().value_or(last_delivery);
+
+        return std::chrono::nanoseconds(last_delivery - start_time);
+    }
+
+    const TrafficGenerator& get_generator() const {
+        return generator;
+    }
+
+    std::vector<uint64_t>& get_latencies() {
+        return latencies;
+    }
+
+    // Frames dropped because the switch couldn't keep up with receiving them
+    uint64_t dropped_frames() const {
+        return l2switch.metrics.totals().dropped_frames_count();
+    }
+
+    // Copies of frames that the switch failed to send out of a port
+    uint64_t failed_sends() const {
+        const PortMetrics totals = l2switch.metrics.totals();
+        return totals.send_errors_count + totals.flood_errors_count;
+    }
+};
+
+// Returns the given percentile (0 to 1) of the given samples, reordering them in the process
+static uint64_t percentile(std::vector<uint64_t>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+
+    auto nth = samples.begin() + (size_t)(fraction * (samples.size() - 1));
+    std::nth_element(samples.begin(), nth, samples.end());
+    return *nth;
+}
+
+/*
+ * Offers bursts of generated traffic to the switch and reports throughput and the distribution of
+ * forwarding latency, from the generator handing a frame to its ingress port to the frame being
+ * drained from its egress port.
+ */
+static void BM_Layer2Switch(benchmark::State& state, TrafficProfile profile, SwitchMode mode) {
+    constexpr size_t BURST_SIZE = 1 << 16;
+
+    Layer2SwitchBench bench{profile, mode};
+    const TrafficGenerator& generator = bench.get_generator();
+
+    // Teach the switch where every host lives so that unicast frames aren't flooded
+    bench.run(generator.learning_frames(), generator.learning_frames().size());
+    bench.get_latencies().clear();
+
+    const uint64_t dropped_before = bench.dropped_frames();
+    const uint64_t failed_sends_before = bench.failed_sends();
+
+    uint64_t frames = 0;
+    std::chrono::nanoseconds elapsed{0};
+    for (auto _ : state) {
+        std::chrono::nanoseconds burst_elapsed = bench.run(generator.frames(), BURST_SIZE);
+        state.SetIterationTime(std::chrono::duration<double>(burst_elapsed).count());
+
+        frames += BURST_SIZE;
+        elapsed += burst_elapsed;
+    }
+
+    // Only frames that actually made it into the switch count towards its throughput
+    const uint64_t dropped = bench.dropped_frames() - dropped_before;
+    const uint64_t forwarded = frames - dropped;
+
+    std::vector<uint64_t>& latencies = bench.get_latencies();
+    state.counters["frames_per_second"] = (double)forwarded * 1e9 / (double)elapsed.count();
+    state.counters["ns_per_frame"] = (double)elapsed.count() / (double)forwarded;
+    state.counters["p50_ns"] = (double)percentile(latencies, 0.5);
+    state.counters["p99_ns"] = (double)percentile(latencies, 0.99);
+    state.counters["p999_ns"] = (double)percentile(latencies, 0.999);
+    state.counters["dropped"] = (double)dropped;
+    state.counters["failed_sends"] = (double)(bench.failed_sends() - failed_sends_before);
+}
+
+BENCHMARK_CAPTURE(
+    BM_Layer2Switch, queued_unicast, TrafficProfile{.port_count = 4, .host_count = 64},
+    SwitchMode::QUEUED
+)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(
+    BM_Layer2Switch, inline_unicast, TrafficProfile{.port_count = 4, .host_count = 64},
+    SwitchMode::INLINE
+)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(
+    BM_Layer2Switch, queued_broadcast_mix,
+    TrafficProfile{.port_count = 4, .host_count = 64, .broadcast_ratio = 0.1}, SwitchMode::QUEUED
+)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(
+    BM_Layer2Switch, queued_imix,
+    TrafficProfile{.port_count = 4, .host_count = 64, .frame_sizes = FrameSizes::IMIX},
+    SwitchMode::QUEUED
+)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(
+    BM_Layer2Switch, queued_many_hosts, TrafficProfile{.port_count = 8, .host_count = 4096},
+    SwitchMode::QUEUED
+)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Latency at a fixed load well below saturation, rather than with queues full
+BENCHMARK_CAPTURE(
+    BM_Layer2Switch, queued_paced,
+    TrafficProfile{.port_count = 4, .host_count = 64, .frames_per_second = 200'000},
+    SwitchMode::QUEUED
+)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
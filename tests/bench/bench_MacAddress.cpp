@@ -0,0 +1,103 @@
+#include <benchmark/benchmark.h>
+#include <net/ethernet.h>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "MacAddress.hpp"
+#include "LegacyMacAddress.hpp"
+
+// Number of distinct ethernet headers the benchmarks cycle through, so nothing gets constant folded
+static constexpr size_t HEADER_COUNT = 1024;
+
+static std::vector<std::array<uint8_t, sizeof(ethhdr)>> make_headers() {
+    std::mt19937_64 random{42};
+    std::vector<std::array<uint8_t, sizeof(ethhdr)>> headers(HEADER_COUNT);
+    for (std::array<uint8_t, sizeof(ethhdr)>& header : headers) {
+        for (uint8_t& octet : header) { octet = (uint8_t)random(); }
+    }
+    return headers;
+}
+
+static const std::vector<std::array<uint8_t, sizeof(ethhdr)>> HEADERS = make_headers();
+
+static LegacyMacAddress parse_legacy(const uint8_t* octets) {
+    return LegacyMacAddress(octets[0], octets[1], octets[2], octets[3], octets[4], octets[5]);
+}
+
+// Parsing both addresses out of a frame's header, which the switch does for every frame
+static void BM_LegacyMacAddressParse(benchmark::State& state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        const uint8_t* header = HEADERS[i++ % HEADER_COUNT].data();
+        const LegacyMacAddress destination = parse_legacy(header);
+        const LegacyMacAddress source = parse_legacy(header + ETH_ALEN);
+        benchmark::DoNotOptimize(destination);
+        benchmark::DoNotOptimize(source);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LegacyMacAddressParse);
+
+static void BM_MacAddressParse(benchmark::State& state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        const uint8_t* header = HEADERS[i++ % HEADER_COUNT].data();
+        const MacAddress destination(header);
+        const MacAddress source(header + ETH_ALEN);
+        benchmark::DoNotOptimize(destination);
+        benchmark::DoNotOptimize(source);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MacAddressParse);
+
+// Parsing, copying, and classifying both addresses, roughly what switching a frame needs
+static void BM_LegacyMacAddressSwitchPath(benchmark::State& state) {
+    std::vector<LegacyMacAddress> learned;
+    learned.reserve(HEADER_COUNT);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const uint8_t* header = HEADERS[i++ % HEADER_COUNT].data();
+        const LegacyMacAddress destination = parse_legacy(header);
+        learned.push_back(parse_legacy(header + ETH_ALEN));
+        benchmark::DoNotOptimize(destination.is_broadcast() || destination == learned.back());
+
+        if (learned.size() == HEADER_COUNT) {
+            learned.clear();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LegacyMacAddressSwitchPath);
+
+static void BM_MacAddressSwitchPath(benchmark::State& state) {
+    std::vector<MacAddress> learned;
+    learned.reserve(HEADER_COUNT);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const uint8_t* header = HEADERS[i++ % HEADER_COUNT].data();
+        const MacAddress destination(header);
+        learned.push_back(MacAddress(header + ETH_ALEN));
+        benchmark::DoNotOptimize(destination.is_broadcast() || destination == learned.back());
+
+        if (learned.size() == HEADER_COUNT) {
+            learned.clear();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MacAddressSwitchPath);
+
+// Formatting is now only paid for when something actually wants the string
+static void BM_MacAddressReadableString(benchmark::State& state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        MacAddress mac_address(HEADERS[i++ % HEADER_COUNT].data());
+        benchmark::DoNotOptimize(mac_address.readable_string());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MacAddressReadableString);
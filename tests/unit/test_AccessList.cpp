@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <vector>
+#include "AccessList.hpp"
+
+// Builds an untagged IPv4 frame with the given addresses, protocol, and TCP or UDP ports
+static std::vector<unsigned char> make_ipv4_frame(
+    uint32_t source_ip, uint32_t destination_ip, uint8_t protocol, uint16_t source_port,
+    uint16_t destination_port, uint16_t fragment_offset = 0
+) {
+    std::vector<unsigned char> frame(sizeof(ethhdr) + 20 + 8, 0);
+    const unsigned char header[] = {
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00
+    };
+    std::copy(std::begin(header), std::end(header), frame.begin());
+
+    unsigned char* ip = frame.data() + sizeof(ethhdr);
+    ip[0] = 0x45;
+    ip[6] = fragment_offset >> 8;
+    ip[7] = fragment_offset;
+    ip[9] = protocol;
+    for (int i = 0; i < 4; ++i) {
+        ip[12 + i] = source_ip >> (24 - 8 * i);
+        ip[16 + i] = destination_ip >> (24 - 8 * i);
+    }
+    ip[20] = source_port >> 8;
+    ip[21] = source_port;
+    ip[22] = destination_port >> 8;
+    ip[23] = destination_port;
+    return frame;
+}
+
+// Builds an untagged frame with the given MACs and EtherType, and no payload to speak of
+static std::vector<unsigned char> make_frame(
+    uint8_t destination_octet, uint8_t source_octet, uint16_t ether_type
+) {
+    return {
+        0x02, 0x00, 0x00, 0x00, 0x00, destination_octet, 0x02, 0x00, 0x00, 0x00, 0x00,
+        source_octet, (unsigned char)(ether_type >> 8), (unsigned char)ether_type
+    };
+}
+
+static AccessList compile(const std::string& text, size_t shards = 1) {
+    std::string error;
+    std::optional<std::vector<AclRule>> rules = AccessList::parse(text, error);
+    EXPECT_TRUE(rules.has_value()) << error;
+    return AccessList{rules.value_or(std::vector<AclRule>{}), shards};
+}
+
+TEST(AccessListTests, ParseTests) {
+    std::string error;
+    std::optional<std::vector<AclRule>> rules = AccessList::parse(
+        "# Comments and blank lines are skipped\n"
+        "\n"
+        "deny ether-type 0x86dd  # Trailing comments too\n"
+        "redirect eth2 dst-ip 10.0.0.0/8 ip-proto 6 dst-port 80\n"
+        "mirror eth3 src-mac 02:00:00:00:00:00/ff:ff:ff:00:00:00\n"
+        "priority interactive vlan 10 ip-proto 17\n"
+        "permit\n",
+        error
+    );
+    ASSERT_TRUE(rules.has_value()) << error;
+    ASSERT_EQ(rules->size(), 5);
+
+    EXPECT_EQ((*rules)[0].action, AclAction::DENY);
+    EXPECT_EQ((*rules)[0].text, "deny ether-type 0x86dd");
+    EXPECT_EQ((*rules)[1].action, AclAction::REDIRECT);
+    EXPECT_EQ((*rules)[1].port_name, "eth2");
+    EXPECT_EQ((*rules)[2].action, AclAction::MIRROR);
+    EXPECT_EQ((*rules)[2].port_name, "eth3");
+    EXPECT_EQ((*rules)[3].action, AclAction::SET_PRIORITY);
+    EXPECT_EQ((*rules)[3].traffic_class, INTERACTIVE);
+    EXPECT_EQ((*rules)[4].action, AclAction::PERMIT);
+
+    // Matching an IPv4 address implies matching IPv4's EtherType
+    EXPECT_EQ((*rules)[1].key.words[0], 0x0800);
+    EXPECT_EQ((*rules)[1].mask.words[0], 0xFFFF);
+    EXPECT_EQ((*rules)[1].mask.words[2], 0xFF000000);
+
+    // Every bad rule is reported with its line
+    for (const char* invalid : {
+             "drop", "redirect", "priority urgent", "deny colour red", "deny vlan 0",
+             "deny vlan 4095", "deny ether-type 0x10000", "deny ip-proto 256", "deny dst-port 1/2",
+             "deny src-ip 10.0.0.0/33", "deny src-ip 10.0.0", "deny src-mac 02:00:00:00:00",
+             "deny vlan", "deny vlan 10 vlan 20", "deny ether-type 0x86dd src-ip 10.0.0.1"
+         }) {
+        EXPECT_FALSE(AccessList::parse(std::string{"permit\n"} + invalid, error).has_value())
+            << invalid;
+        EXPECT_TRUE(error.starts_with("Line 2: ")) << error;
+    }
+}
+
+TEST(AccessListTests, FlowKeyTests) {
+    const std::vector<unsigned char> frame =
+        make_ipv4_frame(0x0A000001, 0x0A000002, IPPROTO_TCP, 1234, 80);
+    const FlowKey key = AccessList::flow_key(frame, 10);
+    EXPECT_EQ(key.words[0], 0x020000000002ULL << 16 | 0x0800);
+    EXPECT_EQ(key.words[1], 0x020000000001ULL << 16 | 10);
+    EXPECT_EQ(key.words[2], 0x0A000001ULL << 32 | 0x0A000002);
+    EXPECT_EQ(key.words[3], (uint64_t)IPPROTO_TCP << 32 | 1234 << 16 | 80);
+
+    // IP headers are only parsed when asked to
+    EXPECT_EQ(AccessList::flow_key(frame, 10, false).words[2], 0);
+
+    // Only the first fragment of a packet carries its ports
+    const FlowKey fragment =
+        AccessList::flow_key(make_ipv4_frame(1, 2, IPPROTO_UDP, 53, 53, 0x0010), 1);
+    EXPECT_EQ(fragment.words[3], (uint64_t)IPPROTO_UDP << 32);
+
+    // Frames too short for their headers just leave those fields out
+    const std::vector<unsigned char> truncated(frame.begin(), frame.begin() + sizeof(ethhdr) + 8);
+    EXPECT_EQ(AccessList::flow_key(truncated, 1).words[2], 0);
+    EXPECT_EQ(AccessList::flow_key(std::vector<unsigned char>(6), 1), FlowKey{});
+}
+
+TEST(AccessListTests, ClassifyTests) {
+    const AccessList access_list = compile(
+        "permit src-ip 10.0.0.1\n"
+        "deny dst-ip 10.1.0.0/16\n"
+        "redirect eth2 ip-proto 6 dst-port 80\n"
+        "deny ether-type 0x86dd\n"
+        "priority network_control dst-mac 02:00:00:00:00:09\n"
+        "deny src-mac 02:00:00:00:00:00/ff:ff:ff:ff:ff:f0 vlan 20\n"
+        "deny dst-ip 10.3.0.0/16\n"
+    );
+    EXPECT_EQ(access_list.size(), 7);
+
+    // The first rule a frame matches applies, whichever table it's in
+    EXPECT_EQ(access_list.classify(make_ipv4_frame(0x0A000001, 0x0A010203, 6, 1, 80), 1), 0);
+    EXPECT_EQ(access_list.classify(make_ipv4_frame(0x0A000002, 0x0A010203, 6, 1, 80), 1), 1);
+    EXPECT_EQ(access_list.classify(make_ipv4_frame(0x0A000002, 0x0A020203, 6, 1, 80), 1), 2);
+    EXPECT_EQ(
+        access_list.classify(make_ipv4_frame(0x0A000002, 0x0A020203, 17, 1, 80), 1), std::nullopt
+    );
+
+    EXPECT_EQ(access_list.classify(make_ipv4_frame(0x0A000002, 0x0A030203, 6, 1, 22), 1), 6);
+
+    EXPECT_EQ(access_list.classify(make_frame(0x01, 0x01, 0x86DD), 1), 3);
+    EXPECT_EQ(access_list.classify(make_frame(0x09, 0x01, 0x0806), 1), 4);
+    EXPECT_EQ(access_list.classify(make_frame(0x01, 0x0F, 0x0806), 20), 5);
+    EXPECT_EQ(access_list.classify(make_frame(0x01, 0x1F, 0x0806), 20), std::nullopt);
+    EXPECT_EQ(access_list.classify(make_frame(0x01, 0x0F, 0x0806), 10), std::nullopt);
+
+    // Rules with the same fields and masks share a table
+    EXPECT_EQ(access_list.tuple_count(), 6);
+}
+
+TEST(AccessListTests, HitCounterTests) {
+    const AccessList access_list = compile("deny ether-type 0x86dd\npermit\n", 2);
+    access_list.count_hit(0, 0);
+    access_list.count_hit(1, 0);
+    access_list.count_hit(1, 1);
+    EXPECT_EQ(access_list.hits(0), 2);
+    EXPECT_EQ(access_list.hits(1), 1);
+
+    // An empty ACL permits everything
+    const AccessList empty = compile("");
+    EXPECT_EQ(empty.classify(make_frame(0x01, 0x02, 0x0800), 1), std::nullopt);
+}
+
+TEST(AccessListTests, ManyRulesTests) {
+    // Thousands of exact rules still resolve to the right one
+    std::string text;
+    for (uint32_t rule = 0; rule < 5000; ++rule) {
+        text += "deny dst-ip 10." + std::to_string(rule >> 8) + "." + std::to_string(rule & 0xFF) +
+                ".1 ip-proto 6 dst-port " + std::to_string(rule % 1000) + "\n";
+    }
+    const AccessList access_list = compile(text);
+    EXPECT_EQ(access_list.tuple_count(), 1);
+    for (uint32_t rule = 0; rule < 5000; rule += 97) {
+        const uint32_t destination = 0x0A000001 | rule << 8;
+        EXPECT_EQ(
+            access_list.classify(make_ipv4_frame(1, destination, 6, 9, rule % 1000), 1), rule
+        );
+        EXPECT_EQ(
+            access_list.classify(make_ipv4_frame(1, destination, 6, 9, rule % 1000 + 1), 1),
+            std::nullopt
+        );
+    }
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <array>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "EthernetPort.hpp"
+
+// An EthernetPort on one end of a Unix datagram socket pair, so frames can be sent without a NIC
+class SocketPairEthernetPort : public EthernetPort {
+public:
+    SocketPairEthernetPort(const std::string& i, int s) : EthernetPort{i, s} {}
+};
+
+// A port and the socket at the other end of its wire
+struct Wire {
+    std::array<int, 2> sockets;
+    std::shared_ptr<SocketPairEthernetPort> port;
+
+    Wire() {
+        socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets.data());
+        port = std::make_shared<SocketPairEthernetPort>("eth0", sockets[0]);
+    }
+
+    ~Wire() {
+        close(sockets[0]);
+        close(sockets[1]);
+    }
+
+    // Takes the next frame the port sent
+    std::vector<unsigned char> take_sent() {
+        std::vector<unsigned char> bytes(2048);
+        bytes.resize(recv(sockets[1], bytes.data(), bytes.size(), 0));
+        return bytes;
+    }
+};
+
+// A frame from 02:00:00:00:00:02 to 02:00:00:00:00:01 with the given bytes after the MACs
+static std::vector<unsigned char> make_bytes(std::initializer_list<unsigned char> rest) {
+    std::vector<unsigned char> bytes = {0x02, 0, 0, 0, 0, 0x01, 0x02, 0, 0, 0, 0, 0x02};
+    for (unsigned char byte : rest) { bytes.push_back(byte); }
+    return bytes;
+}
+
+TEST(EthernetPortTests, VlanPopTests) {
+    Wire wire;
+    std::vector<unsigned char> tagged = make_bytes({0x81, 0x00, 0xA0, 0x0A, 0x08, 0x00, 0xEE});
+    ASSERT_EQ(send(wire.sockets[1], tagged.data(), tagged.size(), 0), (ssize_t)tagged.size());
+
+    // The tag comes off in place, leaving the MACs in front of the EtherType
+    std::optional<Frame> frame = wire.port->receive_frame();
+    ASSERT_TRUE(frame.has_value());
+    std::span<const unsigned char> buffer = frame->buffer();
+    ASSERT_EQ(
+        std::vector<unsigned char>(buffer.begin(), buffer.end()), make_bytes({0x08, 0x00, 0xEE})
+    );
+    ASSERT_EQ(frame->vlan_tci(), 0xA00A);
+    ASSERT_EQ(frame->traffic_class(), INTERACTIVE);
+
+    // Without VLANs configured, the port sends it out just as it came in
+    ASSERT_TRUE(wire.port->send_frame(frame.value()));
+    ASSERT_EQ(wire.take_sent(), tagged);
+}
+
+TEST(EthernetPortTests, VlanPushTests) {
+    Wire wire;
+    PortVlans trunk;
+    trunk.mode = VlanMode::TRUNK;
+    trunk.tagged_vlans.set(10);
+    wire.port->set_vlans(trunk);
+
+    FramePool pool{4};
+    Frame in_vlan_10{pool, make_bytes({0x08, 0x00, 0xEE})};
+    in_vlan_10.set_vlan(10);
+    Frame in_native_vlan{pool, make_bytes({0x08, 0x00, 0xEE})};
+    in_native_vlan.set_vlan(DEFAULT_VLAN);
+
+    // Only the frame outside the native VLAN gets a tag, and the shared buffer is left untouched
+    ASSERT_TRUE(wire.port->enqueue_frame(in_vlan_10));
+    ASSERT_TRUE(wire.port->enqueue_frame(in_native_vlan));
+    ASSERT_EQ(wire.port->flush_frames(), 2);
+    ASSERT_EQ(wire.take_sent(), make_bytes({0x81, 0x00, 0x00, 0x0A, 0x08, 0x00, 0xEE}));
+    ASSERT_EQ(wire.take_sent(), make_bytes({0x08, 0x00, 0xEE}));
+    ASSERT_EQ(in_vlan_10.buffer().size(), 15);
+}
+
+TEST(EthernetPortTests, SoftwareSegmentationTests) {
+    Wire wire;
+
+    // A UDP GSO frame over IPv4 with 2000 bytes of payload, to be sent in 1000-byte segments
+    std::vector<unsigned char> bytes = make_bytes({0x08, 0x00, 0x45, 0, 0x07, 0xEC, 0, 1, 0, 0});
+    bytes.insert(bytes.end(), {64, 17, 0, 0, 10, 0, 0, 1, 10, 0, 0, 2, 0x03, 0xE8, 0x07, 0xD0});
+    bytes.insert(bytes.end(), {0x07, 0xD8, 0, 0});
+    bytes.resize(bytes.size() + 2000, 0xEE);
+
+    FramePool pool{4};
+    Frame gso{pool, bytes};
+    gso.set_offload({FrameOffload::NEEDS_CHECKSUM, FrameOffload::GSO_UDP_L4, 42, 1000, 34, 6});
+    Frame plain{pool, make_bytes({0x08, 0x00, 0xEE})};
+
+    // A socket that can't take offloads gets the segments instead, still in order
+    ASSERT_TRUE(wire.port->enqueue_frame(gso));
+    ASSERT_TRUE(wire.port->enqueue_frame(plain));
+    ASSERT_EQ(wire.port->flush_frames(), 2);
+    for (unsigned char id : {1, 2}) {
+        const std::vector<unsigned char> segment = wire.take_sent();
+        ASSERT_EQ(segment.size(), 1042);
+        ASSERT_EQ(segment[17], 0x04);
+        ASSERT_EQ(segment[19], id);
+        ASSERT_EQ(segment[39], 0xF0);
+    }
+    ASSERT_EQ(wire.take_sent(), make_bytes({0x08, 0x00, 0xEE}));
+    ASSERT_EQ(gso.buffer().size(), bytes.size());
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
+#include "Frame.hpp"
+#include "FramePool.hpp"
+
+static const std::array<unsigned char, 14> HEADER{
+    0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x08, 0x00
+};
+
+TEST(FramePoolTests, FrameContentsTests) {
+    FramePool pool{4};
+    Frame frame{pool, HEADER};
+
+    EXPECT_EQ(frame.buffer().size(), HEADER.size());
+    EXPECT_TRUE(std::equal(HEADER.begin(), HEADER.end(), frame.buffer().begin()));
+    EXPECT_EQ(frame.source_mac_address(), MacAddress(0x11, 0x11, 0x11, 0x11, 0x11, 0x11));
+    EXPECT_EQ(frame.destination_mac_address(), MacAddress(0x22, 0x22, 0x22, 0x22, 0x22, 0x22));
+}
+
+TEST(FramePoolTests, ReferenceCountTests) {
+    FramePool pool{1};
+    Frame frame{pool, HEADER};
+    const unsigned char* data = frame.buffer().data();
+
+    {
+        // Copies share the same buffer instead of copying the bytes
+        Frame copy = frame;
+        EXPECT_EQ(copy.buffer().data(), data);
+        EXPECT_EQ(frame.reference_count(), 2);
+
+        Frame moved = std::move(copy);
+        EXPECT_EQ(frame.reference_count(), 2);
+    }
+    EXPECT_EQ(frame.reference_count(), 1);
+
+    // The only slot is still in use, so the next frame has to come from the heap
+    Frame overflow{pool, HEADER};
+    EXPECT_NE(overflow.buffer().data(), data);
+    EXPECT_EQ(pool.heap_allocations(), 1);
+}
+
+TEST(FramePoolTests, ReuseTests) {
+    FramePool pool{2};
+
+    const unsigned char* data;
+    {
+        Frame frame{pool, HEADER};
+        data = frame.buffer().data();
+    }
+
+    // Released buffers are handed out again rather than allocating more
+    for (int i = 0; i < 100; ++i) {
+        Frame frame{pool, HEADER};
+        EXPECT_EQ(frame.buffer().data(), data);
+    }
+    EXPECT_EQ(pool.heap_allocations(), 0);
+
+    // Frames too large for a slot always come from the heap
+    std::vector<unsigned char> jumbo(FramePool::SLOT_CAPACITY + 1);
+    Frame frame{pool, jumbo};
+    EXPECT_EQ(frame.buffer().size(), jumbo.size());
+    EXPECT_EQ(pool.heap_allocations(), 1);
+}
+
+TEST(FramePoolTests, CrossThreadReleaseTests) {
+    FramePool pool{8};
+
+    // Frames allocated on this thread and dropped on another go back to the pool
+    for (int round = 0; round < 100; ++round) {
+        std::vector<Frame> frames;
+        for (int i = 0; i < 8; ++i) { frames.emplace_back(pool, HEADER); }
+        std::thread releaser([frames = std::move(frames)]() mutable { frames.clear(); });
+        releaser.join();
+    }
+    EXPECT_EQ(pool.heap_allocations(), 0);
+}
+
+TEST(FramePoolTests, ExternalMemoryTests) {
+    alignas(FrameBuffer::HEADER_SIZE) static unsigned char memory[2 * FramePool::SLOT_SIZE];
+    FramePool pool{memory, 2};
+
+    // Slots are carved out of the given memory, and never fall back to the heap
+    FrameBuffer* first = pool.allocate_slot(HEADER.size());
+    FrameBuffer* second = pool.allocate_slot(HEADER.size());
+    EXPECT_EQ((unsigned char*)first, memory);
+    EXPECT_EQ((unsigned char*)second, memory + FramePool::SLOT_SIZE);
+    EXPECT_EQ(pool.allocate_slot(HEADER.size()), nullptr);
+    EXPECT_EQ(pool.heap_allocations(), 0);
+
+    // A view of a frame that's already in a buffer shares the buffer rather than copying it
+    Frame frame{first};
+    memcpy(first->data(), HEADER.data(), HEADER.size());
+    Frame shared{pool, FrameView{frame.buffer(), frame.vlan_tci(), &frame}, 1};
+    EXPECT_EQ(shared.buffer().data(), frame.buffer().data());
+    EXPECT_EQ(frame.reference_count(), 2);
+    EXPECT_EQ(frame.received_at(), 1);
+
+    Frame{second};
+    EXPECT_EQ(pool.allocate_slot(HEADER.size()), second);
+}
@@ -1,11 +1,36 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <array>
+#include <chrono>
 #include <memory>
 #include <optional>
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <net/ethernet.h>
+#include <unistd.h>
 #include "Layer2Switch.hpp"
+#include "MacSnapshot.hpp"
 
 using ::testing::Return;
 using ::testing::AtLeast;
+using ::testing::InSequence;
+using ::testing::Truly;
+
+// Pool that frames handed out by the mocked ports are allocated from
+static FramePool test_frame_pool{64};
+
+// Builds a header-only frame with the given MACs
+static Frame make_frame(const MacAddress& source, const MacAddress& destination) {
+    std::array<unsigned char, sizeof(ethhdr)> header{};
+    std::ranges::copy(destination.raw_octets(), header.begin());
+    std::ranges::copy(source.raw_octets(), header.begin() + ETH_ALEN);
+    return Frame{test_frame_pool, header};
+}
 
 class MockEthernetPort : public EthernetPort {
 private:
@@ -15,6 +40,120 @@ public:
     MockEthernetPort(const std::string& i) : EthernetPort{i, mock_socket_fd++} {}
     MOCK_METHOD(std::optional<Frame>, receive_frame, (), (override));
     MOCK_METHOD(bool, send_frame, (const Frame&), (override));
+
+    // Route batched receives through the mocked single frame receive
+    std::optional<size_t> receive_frames(const FrameViewCallback& callback) override {
+        std::optional<Frame> frame = receive_frame();
+        if (!frame.has_value()) {
+            return {};
+        }
+
+        callback(FrameView{frame->buffer()});
+        return 1;
+    }
+
+    // Route batched sends through the mocked single frame send
+    size_t flush_frames() override {
+        ++flush_count;
+
+        size_t sent = 0;
+        for (const Frame* frame : tx_batch) {
+            if (!send_frame(*frame)) {
+                break;
+            }
+            ++sent;
+        }
+
+        tx_batch.clear();
+        return sent;
+    }
+
+    // Number of times this port has been flushed
+    size_t flush_count = 0;
+};
+
+/*
+ * One end of an in-memory cable. Frames sent out of one end are received on the other, so several
+ * switches can be wired together in one process. Frames sent while the cable is cut are lost.
+ */
+class LinkedEthernetPort : public EthernetPort {
+public:
+    using Wire = std::deque<std::vector<unsigned char>>;
+
+private:
+    std::shared_ptr<Wire> inbox;
+    std::shared_ptr<Wire> outbox;
+    std::shared_ptr<bool> connected;
+
+public:
+    LinkedEthernetPort(
+        const std::string& i, std::shared_ptr<Wire> in, std::shared_ptr<Wire> out,
+        std::shared_ptr<bool> c
+    )
+        : EthernetPort{i, -1},
+          inbox{in},
+          outbox{out},
+          connected{c} {
+    }
+
+    // Creates both ends of a new cable
+    static std::pair<std::shared_ptr<LinkedEthernetPort>, std::shared_ptr<LinkedEthernetPort>>
+    make_cable(const std::string& a, const std::string& b) {
+        auto a_to_b = std::make_shared<Wire>();
+        auto b_to_a = std::make_shared<Wire>();
+        auto connected = std::make_shared<bool>(true);
+        return {
+            std::make_shared<LinkedEthernetPort>(a, b_to_a, a_to_b, connected),
+            std::make_shared<LinkedEthernetPort>(b, a_to_b, b_to_a, connected)
+        };
+    }
+
+    void cut() {
+        *connected = false;
+        inbox->clear();
+        outbox->clear();
+    }
+
+    // Takes every frame waiting to be received on this end that isn't a BPDU
+    std::vector<std::vector<unsigned char>> take_data_frames() {
+        std::vector<std::vector<unsigned char>> frames;
+        for (const std::vector<unsigned char>& frame : *inbox) {
+            if (MacAddress{frame.data()} != SpanningTree::BRIDGE_GROUP_ADDRESS) {
+                frames.push_back(frame);
+            }
+        }
+        inbox->clear();
+        return frames;
+    }
+
+    std::shared_ptr<EthernetPort> transmit_handle() const override {
+        return std::make_shared<LinkedEthernetPort>(interface_name, inbox, outbox, connected);
+    }
+
+    std::optional<size_t> receive_frames(const FrameViewCallback& callback) override {
+        size_t count = 0;
+        while (!inbox->empty()) {
+            std::vector<unsigned char> frame = std::move(inbox->front());
+            inbox->pop_front();
+            callback(FrameView{frame});
+            ++count;
+        }
+        return count;
+    }
+
+    bool send_frame(const Frame& frame) override {
+        if (*connected) {
+            outbox->emplace_back(frame.buffer().begin(), frame.buffer().end());
+        }
+        return true;
+    }
+
+    size_t flush_frames() override {
+        for (const Frame* frame : tx_batch) { send_frame(*frame); }
+        const size_t sent = tx_batch.size();
+        tx_batch.clear();
+        return sent;
+    }
 };
 
 TEST(Layer2SwitchTests, SwitchImplTests) {
@@ -28,26 +167,16 @@ TEST(Layer2SwitchTests, SwitchImplTests) {
 
     EXPECT_CALL(*mock_eth0, receive_frame)
         .WillOnce(Return(
-            Frame{
-                MacAddress{
-                    0x11, 0x11, 0x11, 0x11, 0x11, 0x11
-                },
-                MacAddress{
-                    0x22, 0x22, 0x22, 0x22, 0x22, 0x22
-                },
-                {}
-            }
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22}
+            )
         ))
         .WillOnce(Return(
-            Frame{
-                MacAddress{
-                    0x22, 0x22, 0x22, 0x22, 0x22, 0x22
-                },
-                MacAddress{
-                    0x11, 0x11, 0x11, 0x11, 0x11, 0x11
-                },
-                {}
-            }
+            make_frame(
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22},
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11}
+            )
         ));
 
     EXPECT_CALL(*mock_eth0, send_frame)
@@ -56,29 +185,30 @@ TEST(Layer2SwitchTests, SwitchImplTests) {
     EXPECT_CALL(*mock_eth1, send_frame)
         .WillOnce(Return(true));
 
-    // Fake out receiving a few frames and ensure they end up in the input queue
-    l2switch.frame_receiver_worker_impl(l2switch.ports.at(0));
-    l2switch.frame_receiver_worker_impl(l2switch.ports.at(0));
+    // Fake out receiving a frame and ensure it ends up in the input queue
+    l2switch.frame_receiver_worker_impl(0);
 
-    ASSERT_EQ(l2switch.read_errors_count, 0);
-    ASSERT_EQ(l2switch.received_frames_count, 2);
-    ASSERT_EQ(l2switch.input_queue.size(), 2);
+    ASSERT_EQ(l2switch.metrics.totals().read_errors_count, 0);
+    ASSERT_EQ(l2switch.metrics.totals().received_frames_count, 1);
+    ASSERT_EQ(l2switch.queued_frame_count(), 1);
 
     // Check that first frame gets dequeued and flooded
     l2switch.switch_impl();
-    ASSERT_EQ(l2switch.input_queue.size(), 1);
-    ASSERT_EQ(l2switch.sent_frames_count, 1);
-    ASSERT_EQ(l2switch.flood_count, 1);
-    ASSERT_EQ(l2switch.send_errors_count, 0);
-    ASSERT_EQ(l2switch.flood_errors_count, 0);
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 1);
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 1);
+    ASSERT_EQ(l2switch.metrics.totals().send_errors_count, 0);
+    ASSERT_EQ(l2switch.metrics.totals().flood_errors_count, 0);
 
     // Check that second frame is not flooded, since we have the MAC entry from the first time
+    l2switch.frame_receiver_worker_impl(0);
+    ASSERT_EQ(l2switch.metrics.totals().received_frames_count, 2);
     l2switch.switch_impl();
-    ASSERT_EQ(l2switch.input_queue.size(), 0);
-    ASSERT_EQ(l2switch.sent_frames_count, 2);
-    ASSERT_EQ(l2switch.flood_count, 1);
-    ASSERT_EQ(l2switch.send_errors_count, 0);
-    ASSERT_EQ(l2switch.flood_errors_count, 0);
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 2);
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 1);
+    ASSERT_EQ(l2switch.metrics.totals().send_errors_count, 0);
+    ASSERT_EQ(l2switch.metrics.totals().flood_errors_count, 0);
 }
 
 TEST(Layer2SwitchTests, ReceiveFrameFailureTests) {
@@ -92,10 +222,10 @@ TEST(Layer2SwitchTests, ReceiveFrameFailureTests) {
         .WillOnce(Return(std::nullopt));
 
     // Ensure that counters work in the event of a receive failure
-    l2switch.frame_receiver_worker_impl(l2switch.ports.at(0));
-    ASSERT_EQ(l2switch.input_queue.size(), 0);
-    ASSERT_EQ(l2switch.received_frames_count, 0);
-    ASSERT_EQ(l2switch.read_errors_count, 1);
+    l2switch.frame_receiver_worker_impl(0);
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_EQ(l2switch.metrics.totals().received_frames_count, 0);
+    ASSERT_EQ(l2switch.metrics.totals().read_errors_count, 1);
 }
 
 TEST(Layer2SwitchTests, SendFrameFailureTests) {
@@ -109,50 +239,1147 @@ TEST(Layer2SwitchTests, SendFrameFailureTests) {
 
     EXPECT_CALL(*mock_eth0, receive_frame)
         .WillOnce(Return(
-            Frame{
-                MacAddress{
-                    0x11, 0x11, 0x11, 0x11, 0x11, 0x11
-                },
-                MacAddress{
-                    0x22, 0x22, 0x22, 0x22, 0x22, 0x22
-                },
-                {}
-            }
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22}
+            )
         ))
         .WillOnce(Return(
-            Frame{
-                MacAddress{
-                    0x22, 0x22, 0x22, 0x22, 0x22, 0x22
-                },
-                MacAddress{
-                    0x11, 0x11, 0x11, 0x11, 0x11, 0x11
-                },
-                {}
-            }
+            make_frame(
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22},
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11}
+            )
         ));
 
     EXPECT_CALL(*mock_eth0, send_frame)
+        .WillOnce(Return(false));
+
+    EXPECT_CALL(*mock_eth1, send_frame)
+        .WillOnce(Return(false));
+
+    // Ensure that failure on flooding increments metrics
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 0);
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 1);
+    ASSERT_EQ(l2switch.metrics.totals().send_errors_count, 0);
+    ASSERT_EQ(l2switch.metrics.totals().flood_errors_count, 1);
+
+    // Ensure that error on regular send increments metrics
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 0);
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 1);
+    ASSERT_EQ(l2switch.metrics.totals().send_errors_count, 1);
+    ASSERT_EQ(l2switch.metrics.totals().flood_errors_count, 1);
+}
+
+TEST(Layer2SwitchTests, BatchedFloodTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1,
+        mock_eth2
+    };
+    Layer2Switch l2switch{mock_ports};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .Times(3)
+        .WillRepeatedly(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}
+            )
+        ));
+
+    EXPECT_CALL(*mock_eth0, send_frame).Times(0);
+    EXPECT_CALL(*mock_eth1, send_frame).Times(3).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_eth2, send_frame).Times(3).WillRepeatedly(Return(true));
+
+    for (int i = 0; i < 3; ++i) { l2switch.frame_receiver_worker_impl(0); }
+
+    // All three broadcasts are switched as one batch, so each egress port is flushed exactly once
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 6);
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 3);
+    ASSERT_EQ(mock_eth0->flush_count, 0);
+    ASSERT_EQ(mock_eth1->flush_count, 1);
+    ASSERT_EQ(mock_eth2->flush_count, 1);
+}
+
+TEST(Layer2SwitchTests, PartialFloodTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1,
+        mock_eth2
+    };
+    Layer2Switch l2switch{mock_ports};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .Times(2)
+        .WillRepeatedly(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}
+            )
+        ));
+
+    // eth1 only takes the first broadcast, which doesn't stop eth2 from getting both
+    EXPECT_CALL(*mock_eth1, send_frame).WillOnce(Return(true)).WillOnce(Return(false));
+    EXPECT_CALL(*mock_eth2, send_frame).Times(2).WillRepeatedly(Return(true));
+
+    for (int i = 0; i < 2; ++i) { l2switch.frame_receiver_worker_impl(0); }
+    l2switch.switch_impl();
+
+    const MetricsSnapshot snapshot = l2switch.collect_metrics();
+    ASSERT_EQ(snapshot.totals.sent_frames_count, 3);
+    ASSERT_EQ(snapshot.totals.flood_count, 2);
+    ASSERT_EQ(snapshot.ports[1].flood_errors_count, 1);
+    ASSERT_EQ(snapshot.ports[0].partial_floods_count, 1);
+    ASSERT_EQ(snapshot.totals.partial_floods_count, 1);
+}
+
+TEST(Layer2SwitchTests, ShardedForwardingTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1
+    };
+
+    // A single worker uses the given ports directly, so there's nothing to clone or fan out
+    SwitchConfig config;
+    config.forwarding_workers = 1;
+    Layer2Switch l2switch{mock_ports, config};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .WillOnce(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22}
+            )
+        ));
+    EXPECT_CALL(*mock_eth1, receive_frame)
+        .WillOnce(Return(
+            make_frame(
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22},
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11}
+            )
+        ));
+
+    EXPECT_CALL(*mock_eth0, send_frame).WillOnce(Return(true));
+    EXPECT_CALL(*mock_eth1, send_frame).WillOnce(Return(true));
+
+    // Frames are switched inline by the worker, without going through the input queues
+    ASSERT_EQ(l2switch.forwarding_worker_impl(0, 0), 1);
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 1);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 0);
+
+    // Nothing is sent until the worker flushes
+    l2switch.flush_ports(l2switch.shards[0]);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 1);
+    ASSERT_EQ(mock_eth1->flush_count, 1);
+
+    // The reply is unicast since the worker learned the first frame's source MAC
+    ASSERT_EQ(l2switch.forwarding_worker_impl(0, 1), 1);
+    l2switch.flush_ports(l2switch.shards[0]);
+    ASSERT_EQ(l2switch.metrics.totals().received_frames_count, 2);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 2);
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 1);
+    ASSERT_EQ(mock_eth0->flush_count, 1);
+}
+
+TEST(Layer2SwitchTests, ReactorTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1,
+        mock_eth2
+    };
+
+    SwitchConfig config;
+    config.reactors = 2;
+    config.port_reactors = {1, 0, 1};
+    Layer2Switch l2switch{mock_ports, config};
+
+    // Each reactor receives on the ports it owns and only holds transmit handles for the others
+    const auto& shard_ports = l2switch.port_set.get()->shard_ports;
+    ASSERT_EQ(l2switch.shards.size(), 2);
+    ASSERT_EQ(shard_ports[0][1], mock_eth1);
+    ASSERT_EQ(shard_ports[1][0], mock_eth0);
+    ASSERT_EQ(shard_ports[1][2], mock_eth2);
+    ASSERT_NE(shard_ports[0][0], mock_eth0);
+    ASSERT_EQ(shard_ports[0][0]->get_socket_fd(), mock_eth0->get_socket_fd());
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .WillOnce(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22}
+            )
+        ));
+
+    // The flood is queued on the reactor's own port and, through a handle, on the other reactor's
+    ASSERT_EQ(l2switch.forwarding_worker_impl(1, 0), 1);
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 1);
+    ASSERT_EQ(l2switch.shards[1].egress_queues[1][BEST_EFFORT].size(), 1);
+    ASSERT_EQ(l2switch.shards[1].egress_queues[2][BEST_EFFORT].size(), 1);
+}
+
+TEST(Layer2SwitchTests, HeadDropTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1
+    };
+
+    SwitchConfig config;
+    config.port_queue_depths = {1, 1};
+    config.queue_full_policy = QueueFullPolicy::HEAD_DROP;
+    Layer2Switch l2switch{mock_ports, config};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .WillOnce(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22}
+            )
+        ))
+        .WillOnce(Return(
+            make_frame(
+                MacAddress{0x33, 0x33, 0x33, 0x33, 0x33, 0x33},
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22}
+            )
+        ));
+    EXPECT_CALL(*mock_eth1, send_frame).WillOnce(Return(true));
+
+    // The second frame doesn't fit, so its receiver asks for the first one to be dropped
+    l2switch.frame_receiver_worker_impl(0);
+    std::jthread receiver([&] { l2switch.frame_receiver_worker_impl(0); });
+    const size_t queue = Layer2Switch::input_queue_index(0, BEST_EFFORT);
+    while (l2switch.head_drop_requests[queue].load() == 0) { std::this_thread::yield(); }
+
+    l2switch.switch_impl();
+    receiver.join();
+    ASSERT_EQ(l2switch.metrics.totals().head_drops_count, 1);
+    ASSERT_EQ(l2switch.queued_frame_count(), 1);
+
+    // Only the newer frame is ever switched
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.metrics.totals().received_frames_count, 2);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 1);
+    ASSERT_EQ(l2switch.metrics.totals().tail_drops_count, 0);
+    ASSERT_FALSE(l2switch.mac_address_table.lookup({0x11, 0x11, 0x11, 0x11, 0x11, 0x11}));
+    ASSERT_EQ(l2switch.mac_address_table.lookup({0x33, 0x33, 0x33, 0x33, 0x33, 0x33}), 0);
+}
+
+TEST(Layer2SwitchTests, PauseTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1
+    };
+
+    SwitchConfig config;
+    config.port_queue_depths = {1, 1};
+    config.queue_full_policy = QueueFullPolicy::PAUSE;
+    Layer2Switch l2switch{mock_ports, config};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .Times(2)
+        .WillRepeatedly(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}
+            )
+        ));
+    EXPECT_CALL(*mock_eth1, send_frame).Times(2).WillRepeatedly(Return(true));
+
+    // The second frame doesn't fit, so its receiver waits until the first one has been switched
+    l2switch.frame_receiver_worker_impl(0);
+    std::jthread receiver([&] { l2switch.frame_receiver_worker_impl(0); });
+    while (l2switch.metrics.totals().receiver_pauses_count == 0) { std::this_thread::yield(); }
+
+    l2switch.switch_impl();
+    receiver.join();
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_EQ(l2switch.metrics.totals().received_frames_count, 2);
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 2);
+    ASSERT_EQ(l2switch.metrics.totals().dropped_frames_count(), 0);
+}
+
+// Builds a broadcast frame of the given size with an 802.1Q tag carrying the given priority
+static Frame make_priority_frame(const MacAddress& source, uint8_t pcp, size_t size) {
+    std::vector<unsigned char> bytes(size, 0);
+    std::ranges::fill_n(bytes.begin(), ETH_ALEN, 0xFF);
+    std::ranges::copy(source.raw_octets(), bytes.begin() + ETH_ALEN);
+    bytes[12] = 0x81;
+    bytes[13] = 0x00;
+    bytes[14] = pcp << 5;
+    return Frame{test_frame_pool, bytes};
+}
+
+TEST(Layer2SwitchTests, StrictPriorityTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1,
+        mock_eth2
+    };
+    Layer2Switch l2switch{mock_ports};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .Times(3)
+        .WillRepeatedly(Return(make_priority_frame({0x11, 0x11, 0x11, 0x11, 0x11, 0x11}, 0, 64)));
+    EXPECT_CALL(*mock_eth1, receive_frame)
+        .WillOnce(Return(make_priority_frame({0x22, 0x22, 0x22, 0x22, 0x22, 0x22}, 7, 64)));
+    EXPECT_CALL(*mock_eth0, send_frame).WillOnce(Return(true));
+    EXPECT_CALL(*mock_eth1, send_frame).Times(3).WillRepeatedly(Return(true));
+
+    // The network control frame arrived last, but goes out first
+    {
+        InSequence sequence;
+        EXPECT_CALL(*mock_eth2, send_frame(Truly([](const Frame& frame) {
+                        return frame.traffic_class() == NETWORK_CONTROL;
+                    })))
+            .WillOnce(Return(true));
+        EXPECT_CALL(*mock_eth2, send_frame(Truly([](const Frame& frame) {
+                        return frame.traffic_class() == BEST_EFFORT;
+                    })))
+            .Times(3)
+            .WillRepeatedly(Return(true));
+    }
+
+    for (int i = 0; i < 3; ++i) { l2switch.frame_receiver_worker_impl(0); }
+    l2switch.frame_receiver_worker_impl(1);
+    l2switch.switch_impl();
+
+    MetricsSnapshot snapshot = l2switch.collect_metrics();
+    ASSERT_EQ(snapshot.classes[NETWORK_CONTROL].received_frames_count, 1);
+    ASSERT_EQ(snapshot.classes[NETWORK_CONTROL].sent_frames_count, 2);
+    ASSERT_EQ(snapshot.classes[NETWORK_CONTROL].forwarding_latency.count, 1);
+    ASSERT_EQ(snapshot.classes[BEST_EFFORT].received_frames_count, 3);
+    ASSERT_EQ(snapshot.classes[BEST_EFFORT].sent_frames_count, 6);
+}
+
+TEST(Layer2SwitchTests, DeficitRoundRobinTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1
+    };
+
+    SwitchConfig config;
+    config.traffic_scheduler = TrafficScheduler::DEFICIT_ROUND_ROBIN;
+    config.class_weights = {1, 1, 1, 1};
+    Layer2Switch l2switch{mock_ports, config};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .Times(Layer2Switch::SWITCH_BATCH_SIZE)
+        .WillRepeatedly(Return(make_priority_frame({0x11, 0x11, 0x11, 0x11, 0x11, 0x11}, 0, 1000))
+        );
+    EXPECT_CALL(*mock_eth0, send_frame).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_eth1, receive_frame)
+        .Times(Layer2Switch::SWITCH_BATCH_SIZE)
+        .WillRepeatedly(Return(make_priority_frame({0x22, 0x22, 0x22, 0x22, 0x22, 0x22}, 7, 1000))
+        );
+    EXPECT_CALL(*mock_eth1, send_frame).WillRepeatedly(Return(true));
+
+    for (size_t i = 0; i < Layer2Switch::SWITCH_BATCH_SIZE; ++i) {
+        l2switch.frame_receiver_worker_impl(0);
+        l2switch.frame_receiver_worker_impl(1);
+    }
+
+    // With equal weights, a full batch of network control can't lock out best effort
+    l2switch.switch_impl();
+    MetricsSnapshot snapshot = l2switch.collect_metrics();
+    ASSERT_EQ(
+        snapshot.classes[BEST_EFFORT].sent_frames_count +
+            snapshot.classes[NETWORK_CONTROL].sent_frames_count,
+        Layer2Switch::SWITCH_BATCH_SIZE
+    );
+    ASSERT_GE(snapshot.classes[BEST_EFFORT].sent_frames_count, 24);
+    ASSERT_GE(snapshot.classes[NETWORK_CONTROL].sent_frames_count, 24);
+}
+
+TEST(Layer2SwitchTests, StormControlTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1
+    };
+
+    // Far too slow a rate to refill during the test, so only the burst gets through
+    SwitchConfig config;
+    config.storm_control[BROADCAST] = {.rate = 1, .burst = 2};
+    Layer2Switch l2switch{mock_ports, config};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .Times(6)
+        .WillOnce(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0x22, 0x22, 0x22, 0x22, 0x22, 0x22}
+            )
+        ))
+        .WillRepeatedly(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}
+            )
+        ));
+
+    // Unknown unicast has no limit, so it's flooded along with the first two broadcasts
+    EXPECT_CALL(*mock_eth1, send_frame).Times(3).WillRepeatedly(Return(true));
+
+    for (int i = 0; i < 6; ++i) { l2switch.frame_receiver_worker_impl(0); }
+    l2switch.switch_impl();
+
+    const PortMetrics totals = l2switch.metrics.totals();
+    ASSERT_EQ(totals.flood_count, 3);
+    ASSERT_EQ(totals.sent_frames_count, 3);
+    ASSERT_EQ(totals.storm_suppressed_counts[BROADCAST], 3);
+    ASSERT_EQ(totals.storm_suppressed_counts[UNKNOWN_UNICAST], 0);
+}
+
+TEST(Layer2SwitchTests, StormShutdownTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1
+    };
+
+    SwitchConfig config;
+    config.storm_control[BROADCAST] = {.rate = 1, .burst = 1};
+    config.storm_shutdown_seconds = 5;
+    config.storm_shutdown_threshold = 2;
+    Layer2Switch l2switch{mock_ports, config};
+
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .WillRepeatedly(Return(
+            make_frame(
+                MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+                MacAddress{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}
+            )
+        ));
+    EXPECT_CALL(*mock_eth1, send_frame).Times(1).WillRepeatedly(Return(true));
+
+    // Only the first broadcast fits in the burst, leaving more suppressed than the threshold
+    for (int i = 0; i < 4; ++i) { l2switch.frame_receiver_worker_impl(0); }
+    l2switch.switch_impl();
+    l2switch.enforce_storm_shutdowns(10);
+    ASSERT_TRUE(l2switch.port_shut_down[0]);
+    ASSERT_FALSE(l2switch.port_shut_down[1]);
+    ASSERT_EQ(l2switch.metrics.totals().storm_shutdowns_count, 1);
+
+    // While the port is down, everything received on it is dropped without being rate limited
+    for (int i = 0; i < 2; ++i) { l2switch.frame_receiver_worker_impl(0); }
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.metrics.totals().storm_shutdown_drops_count, 2);
+    ASSERT_EQ(l2switch.metrics.totals().storm_suppressed_counts[BROADCAST], 3);
+
+    l2switch.enforce_storm_shutdowns(14);
+    ASSERT_TRUE(l2switch.port_shut_down[0]);
+    l2switch.enforce_storm_shutdowns(15);
+    ASSERT_FALSE(l2switch.port_shut_down[0]);
+    ASSERT_EQ(l2switch.metrics.totals().storm_shutdowns_count, 1);
+}
+
+TEST(Layer2SwitchTests, SpanningTreeTests) {
+    // Three switches wired in a triangle, each with a host of its own
+    auto [s0_to_s1, s1_to_s0] = LinkedEthernetPort::make_cable("s0-s1", "s1-s0");
+    auto [s0_to_s2, s2_to_s0] = LinkedEthernetPort::make_cable("s0-s2", "s2-s0");
+    auto [s1_to_s2, s2_to_s1] = LinkedEthernetPort::make_cable("s1-s2", "s2-s1");
+    std::vector<std::shared_ptr<LinkedEthernetPort>> hosts;
+    std::vector<std::vector<std::shared_ptr<EthernetPort>>> switch_ports{
+        {s0_to_s1, s0_to_s2}, {s1_to_s0, s1_to_s2}, {s2_to_s0, s2_to_s1}
+    };
+    for (size_t i = 0; i < switch_ports.size(); ++i) {
+        auto [host, switch_port] = LinkedEthernetPort::make_cable(
+            "host" + std::to_string(i), "s" + std::to_string(i) + "-host"
+        );
+        hosts.push_back(host);
+        switch_ports[i].push_back(switch_port);
+    }
+
+    std::vector<std::unique_ptr<Layer2Switch>> switches;
+    for (size_t i = 0; i < switch_ports.size(); ++i) {
+        SwitchConfig config;
+        config.spanning_tree = true;
+        config.bridge_priority = i == 0 ? 4096 : SpanningTree::DEFAULT_BRIDGE_PRIORITY;
+        switches.push_back(std::make_unique<Layer2Switch>(switch_ports[i], config));
+    }
+
+    // Moves frames through every switch until nothing is left in flight, if that ever happens
+    auto settle = [&] {
+        for (int round = 0; round < 100; ++round) {
+            bool busy = false;
+            for (std::unique_ptr<Layer2Switch>& l2switch : switches) {
+                for (size_t port = 0; port < l2switch->ports.size(); ++port) {
+                    l2switch->frame_receiver_worker_impl(port);
+                }
+                while (l2switch->queued_frame_count() > 0) {
+                    l2switch->switch_impl();
+                    busy = true;
+                }
+            }
+            if (!busy) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto tick = [&](size_t ticks) {
+        for (size_t i = 0; i < ticks; ++i) {
+            for (std::unique_ptr<Layer2Switch>& l2switch : switches) {
+                l2switch->spanning_tree->tick();
+            }
+            ASSERT_TRUE(settle());
+        }
+    };
+    auto broadcast_from_host0 = [&] {
+        for (const std::shared_ptr<LinkedEthernetPort>& host : hosts) { host->take_data_frames(); }
+        Frame frame = make_frame(
+            MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11},
+            MacAddress{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}
+        );
+        hosts[0]->send_frame(frame);
+        return settle();
+    };
+
+    /*
+     * Once the tree has converged and the host ports are found to be edge ports, exactly one of the
+     * links between switches is blocked
+     */
+    tick(SpanningTree::EDGE_DELAY + 1);
+    size_t blocked = 0;
+    for (std::unique_ptr<Layer2Switch>& l2switch : switches) {
+        EXPECT_EQ(l2switch->spanning_tree->root_id(), switches[0]->spanning_tree->id());
+        EXPECT_EQ(l2switch->spanning_tree->port_state(2), PortState::FORWARDING);
+        for (size_t port = 0; port < 2; ++port) {
+            blocked += l2switch->spanning_tree->port_state(port) != PortState::FORWARDING;
+        }
+    }
+    EXPECT_EQ(blocked, 1);
+
+    // So a broadcast reaches every other host exactly once instead of looping forever
+    ASSERT_TRUE(broadcast_from_host0());
+    EXPECT_EQ(hosts[0]->take_data_frames().size(), 0);
+    EXPECT_EQ(hosts[1]->take_data_frames().size(), 1);
+    EXPECT_EQ(hosts[2]->take_data_frames().size(), 1);
+    EXPECT_EQ(
+        switches[1]->metrics.totals().stp_discards_count +
+            switches[2]->metrics.totals().stp_discards_count,
+        1
+    );
+
+    // When a link fails, traffic takes the blocked link instead once the old path ages out
+    s0_to_s1->cut();
+    tick(3 * SpanningTree::HELLO_TIME + 1);
+    EXPECT_EQ(switches[1]->spanning_tree->port_role(1), PortRole::ROOT);
+    EXPECT_EQ(switches[1]->spanning_tree->port_state(1), PortState::FORWARDING);
+    EXPECT_EQ(switches[2]->spanning_tree->port_state(1), PortState::FORWARDING);
+
+    ASSERT_TRUE(broadcast_from_host0());
+    EXPECT_EQ(hosts[1]->take_data_frames().size(), 1);
+    EXPECT_EQ(hosts[2]->take_data_frames().size(), 1);
+}
+
+// Builds an IGMPv2 message of the given type about the given group, sent to the given IPv4 group
+static Frame make_igmp_frame(
+    const MacAddress& source, std::array<uint8_t, 4> destination, uint8_t type,
+    std::array<uint8_t, 4> group
+) {
+    std::vector<unsigned char> bytes = {
+        0x01, 0x00, 0x5E, (uint8_t)(destination[1] & 0x7F), destination[2], destination[3]
+    };
+    std::ranges::copy(source.raw_octets(), std::back_inserter(bytes));
+    bytes.insert(bytes.end(), {0x08, 0x00, 0x45, 0x00, 0x00, 28, 0x00, 0x00, 0x00, 0x00, 0x01});
+    bytes.insert(bytes.end(), {0x02, 0x00, 0x00, 10, 0, 0, 1});
+    bytes.insert(bytes.end(), destination.begin(), destination.end());
+    bytes.insert(bytes.end(), {type, 0x00, 0x00, 0x00});
+    bytes.insert(bytes.end(), group.begin(), group.end());
+    return Frame{test_frame_pool, bytes};
+}
+
+TEST(Layer2SwitchTests, MulticastSnoopingTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    auto mock_eth3 = std::make_shared<MockEthernetPort>("eth3");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1,
+        mock_eth2,
+        mock_eth3
+    };
+
+    SwitchConfig config;
+    config.multicast_snooping = true;
+    Layer2Switch l2switch{mock_ports, config};
+
+    // A router on eth0 queries every host, and the host on eth1 answers for 239.1.1.1
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .WillOnce(Return(make_igmp_frame(
+            MacAddress{0x00, 0x00, 0x00, 0x00, 0x00, 0x01}, {224, 0, 0, 1}, 0x11, {0, 0, 0, 0}
+        )));
+    EXPECT_CALL(*mock_eth1, receive_frame)
+        .WillOnce(Return(make_igmp_frame(
+            MacAddress{0x11, 0x11, 0x11, 0x11, 0x11, 0x11}, {239, 1, 1, 1}, 0x16, {239, 1, 1, 1}
+        )));
+    EXPECT_CALL(*mock_eth3, receive_frame)
+        .WillOnce(Return(make_frame(
+            MacAddress{0x33, 0x33, 0x33, 0x33, 0x33, 0x33},
+            MacAddress{0x01, 0x00, 0x5E, 0x01, 0x01, 0x01}
+        )));
+
+    /*
+     * The query is flooded, the report only goes to the router, and the group's traffic only goes
+     * to the router and the member
+     */
+    EXPECT_CALL(*mock_eth0, send_frame).Times(2).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_eth1, send_frame).Times(2).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_eth2, send_frame).Times(1).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_eth3, send_frame).Times(1).WillRepeatedly(Return(true));
+
+    for (size_t port : {0, 1, 3}) {
+        l2switch.frame_receiver_worker_impl(port);
+        l2switch.switch_impl();
+    }
+
+    const MetricsSnapshot snapshot = l2switch.collect_metrics();
+    ASSERT_EQ(snapshot.totals.flood_count, 1);
+    ASSERT_EQ(snapshot.totals.snooped_multicast_count, 2);
+    ASSERT_EQ(snapshot.multicast_groups, 1);
+}
+
+// Builds a header-only frame with the given MACs and an 802.1Q tag
+static Frame make_tagged_frame(
+    const MacAddress& source, const MacAddress& destination, uint16_t tci
+) {
+    std::vector<unsigned char> bytes;
+    std::ranges::copy(destination.raw_octets(), std::back_inserter(bytes));
+    std::ranges::copy(source.raw_octets(), std::back_inserter(bytes));
+    bytes.insert(bytes.end(), {0x81, 0x00, (uint8_t)(tci >> 8), (uint8_t)tci, 0x08, 0x00});
+    return Frame{test_frame_pool, bytes};
+}
+
+TEST(Layer2SwitchTests, VlanTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    auto mock_eth3 = std::make_shared<MockEthernetPort>("eth3");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1,
+        mock_eth2,
+        mock_eth3
+    };
+
+    // eth0 and eth3 are in VLAN 10, eth1 is in VLAN 20, and eth2 trunks both
+    SwitchConfig config;
+    config.port_vlans.resize(4);
+    config.port_vlans[0].native_vlan = 10;
+    config.port_vlans[1].native_vlan = 20;
+    config.port_vlans[2].mode = VlanMode::TRUNK;
+    config.port_vlans[2].tagged_vlans.set(10).set(20);
+    config.port_vlans[3].native_vlan = 10;
+    Layer2Switch l2switch{mock_ports, config};
+
+    // A flood set per VLAN any port carries, including eth2's native VLAN 1, not per port
+    ASSERT_EQ(l2switch.port_set.get()->flood_sets.size(), 3);
+
+    const MacAddress a{0x00, 0x00, 0x00, 0x00, 0x00, 0x0A};
+    const MacAddress b{0x00, 0x00, 0x00, 0x00, 0x00, 0x0B};
+    const MacAddress broadcast{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    EXPECT_CALL(*mock_eth0, receive_frame).WillOnce(Return(make_frame(a, broadcast)));
+    EXPECT_CALL(*mock_eth2, receive_frame)
+        .WillOnce(Return(make_tagged_frame(b, a, 20)))
+        .WillOnce(Return(make_tagged_frame(b, a, 0xA000 | 10)));
+    EXPECT_CALL(*mock_eth1, receive_frame).WillOnce(Return(make_tagged_frame(b, a, 30)));
+
+    // A's broadcast stays in VLAN 10, and only the trunk tags it
+    EXPECT_CALL(*mock_eth3, send_frame).WillOnce(Return(true));
+    EXPECT_CALL(*mock_eth2, send_frame(Truly([&](const Frame& frame) {
+                    return mock_eth2->egress_vlan_tci(frame) == 10;
+                })))
         .WillOnce(Return(true));
 
+    /*
+     * A is only known in VLAN 10, so a frame for it in VLAN 20 is flooded in VLAN 20. In VLAN 10 it
+     * goes straight to A, untagged but with its priority kept.
+     */
+    EXPECT_CALL(*mock_eth1, send_frame).WillOnce(Return(true));
+    EXPECT_CALL(*mock_eth0, send_frame(Truly([&](const Frame& frame) {
+                    return frame.vlan() == 10 && frame.buffer().size() == sizeof(ethhdr) &&
+                           frame.traffic_class() == INTERACTIVE &&
+                           !mock_eth0->egress_vlan_tci(frame).has_value();
+                })))
+        .WillOnce(Return(true));
+
+    // VLAN 30 isn't carried by eth1 at all
+    for (size_t port : {0, 2, 2, 1}) {
+        l2switch.frame_receiver_worker_impl(port);
+        l2switch.switch_impl();
+    }
+
+    const MetricsSnapshot snapshot = l2switch.collect_metrics();
+    ASSERT_EQ(snapshot.totals.flood_count, 2);
+    ASSERT_EQ(snapshot.totals.vlan_discards_count, 1);
+}
+
+TEST(Layer2SwitchTests, LinkAggregationTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1,
+        mock_eth2
+    };
+
+    // eth1 and eth2 are bundled into a static LAG
+    SwitchConfig config;
+    config.port_lags = {LinkAggregation::NO_LAG, 1, 1};
+    Layer2Switch l2switch{mock_ports, config};
+
+    const MacAddress a{0x00, 0x00, 0x00, 0x00, 0x00, 0x0A};
+    const MacAddress b{0x00, 0x00, 0x00, 0x00, 0x00, 0x0B};
+    const MacAddress broadcast{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    const Frame from_a = make_frame(a, broadcast);
+    const std::optional<size_t> member = l2switch.link_aggregation->egress_port(1, from_a.buffer());
+    ASSERT_TRUE(member.has_value());
+
+    // A's broadcast goes out of just the one member its flow hashes to
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .WillOnce(Return(from_a))
+        .WillOnce(Return(make_frame(a, b)));
+    EXPECT_CALL(*(member == 1 ? mock_eth1 : mock_eth2), send_frame).WillOnce(Return(true));
+    EXPECT_CALL(*(member == 1 ? mock_eth2 : mock_eth1), send_frame).Times(0);
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+
+    // B is learned on the LAG, whichever member it's heard on
+    EXPECT_CALL(*mock_eth2, receive_frame).WillOnce(Return(make_frame(b, a)));
+    EXPECT_CALL(*mock_eth0, send_frame).WillOnce(Return(true));
+    l2switch.frame_receiver_worker_impl(2);
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.mac_address_table.lookup(b), 1);
+
+    // With both links down, frames for B have nowhere to go
+    l2switch.link_aggregation->set_link_up(1, false);
+    l2switch.link_aggregation->set_link_up(2, false);
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+
+    const MetricsSnapshot snapshot = l2switch.collect_metrics();
+    ASSERT_EQ(snapshot.ports[1].lag_discards_count, 1);
+    ASSERT_EQ(snapshot.totals.sent_frames_count, 2);
+}
+
+TEST(Layer2SwitchTests, MirrorTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    auto mock_eth3 = std::make_shared<MockEthernetPort>("eth3");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1,
+        mock_eth2,
+        mock_eth3
+    };
+
+    // Frames received on eth0 and sent on eth1 are mirrored to eth3, and to a capture
+    char capture_path[] = "/tmp/test_Layer2Switch_XXXXXX";
+    close(mkstemp(capture_path));
+    SwitchConfig config;
+    config.mirror_sessions = {{{0}, {1}, 3, capture_path}};
+    Layer2Switch l2switch{mock_ports, config};
+
+    const MacAddress a{0x00, 0x00, 0x00, 0x00, 0x00, 0x0A};
+    const MacAddress b{0x00, 0x00, 0x00, 0x00, 0x00, 0x0B};
+    const MacAddress broadcast{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+    // The destination gets one copy of A's broadcast even though it's mirrored twice, and is
+    // otherwise left out of the flood
+    EXPECT_CALL(*mock_eth0, receive_frame).WillOnce(Return(make_frame(a, broadcast)));
+    EXPECT_CALL(*mock_eth1, send_frame).WillOnce(Return(true));
+    EXPECT_CALL(*mock_eth2, send_frame).WillOnce(Return(true));
+    EXPECT_CALL(*mock_eth3, send_frame).WillOnce(Return(true));
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+
+    // B's reply to A leaves through eth0, which is only mirrored on receive
+    EXPECT_CALL(*mock_eth2, receive_frame).WillOnce(Return(make_frame(b, a)));
+    EXPECT_CALL(*mock_eth0, send_frame).WillOnce(Return(true));
+    l2switch.frame_receiver_worker_impl(2);
+    l2switch.switch_impl();
+
+    // Nothing received on the destination is switched, or learned
+    EXPECT_CALL(*mock_eth3, receive_frame).WillOnce(Return(make_frame(b, broadcast)));
+    l2switch.frame_receiver_worker_impl(3);
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.mac_address_table.lookup(b), 2);
+
+    // A received on eth0 and sent on eth1 is all the capture takes
+    ASSERT_EQ(l2switch.captures[0]->write_pending(), 2);
+    ASSERT_EQ(l2switch.captures[0]->write_pending(), 0);
+    unlink(capture_path);
+
+    const MetricsSnapshot snapshot = l2switch.collect_metrics();
+    ASSERT_EQ(snapshot.totals.mirror_drops_count, 0);
+    ASSERT_EQ(snapshot.capture_write_errors_count, 0);
+}
+
+TEST(Layer2SwitchTests, AddRemovePortTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1
+    };
+
+    SwitchConfig config;
+    config.max_ports = 3;
+    Layer2Switch l2switch{mock_ports, config};
+
+    const MacAddress host0{0x11, 0x11, 0x11, 0x11, 0x11, 0x11};
+    const MacAddress host1{0x22, 0x22, 0x22, 0x22, 0x22, 0x22};
+    const MacAddress host2{0x33, 0x33, 0x33, 0x33, 0x33, 0x33};
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .WillOnce(Return(make_frame(host0, host1)))
+        .WillOnce(Return(make_frame(host0, host1)));
+    EXPECT_CALL(*mock_eth1, receive_frame)
+        .WillOnce(Return(make_frame(host1, host0)))
+        .WillOnce(Return(make_frame(host1, host2)));
+    EXPECT_CALL(*mock_eth0, send_frame)
+        .WillOnce(Return(true));
     EXPECT_CALL(*mock_eth1, send_frame)
         .WillOnce(Return(true));
+    EXPECT_CALL(*mock_eth2, send_frame)
+        .WillOnce(Return(true));
+
+    // The free slot isn't flooded to
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.metrics.totals().sent_frames_count, 1);
 
-    l2switch.frame_receiver_worker_impl(l2switch.ports.at(0));
-    l2switch.frame_receiver_worker_impl(l2switch.ports.at(0));
+    // A port is added in the free slot, and only once
+    ASSERT_FALSE(l2switch.add_port(mock_eth2).has_value());
+    ASSERT_EQ(l2switch.ports[2], mock_eth2);
+    ASSERT_TRUE(l2switch.add_port(mock_eth2).has_value());
+    ASSERT_TRUE(l2switch.add_port(std::make_shared<MockEthernetPort>("eth3")).has_value());
+    ASSERT_EQ(l2switch.execute_command("show-ports"), "0 eth0 raw\n1 eth1 raw\n2 eth2 raw\n");
 
-    // Ensure that failure on flooding increments metrics
+    // Once eth1 is learned and has frames queued, removing it forgets both
+    l2switch.frame_receiver_worker_impl(1);
     l2switch.switch_impl();
-    ASSERT_EQ(l2switch.input_queue.size(), 1);
-    ASSERT_EQ(l2switch.sent_frames_count, 1);
-    ASSERT_EQ(l2switch.flood_count, 1);
-    ASSERT_EQ(l2switch.send_errors_count, 0);
-    ASSERT_EQ(l2switch.flood_errors_count, 0);
+    ASSERT_EQ(l2switch.mac_address_table.lookup(host1), 1);
+    l2switch.frame_receiver_worker_impl(1);
+    ASSERT_EQ(l2switch.queued_frame_count(), 1);
 
-    // Ensure that error on regular send increments metrics
+    ASSERT_FALSE(l2switch.remove_port("eth1").has_value());
+    ASSERT_TRUE(l2switch.remove_port("eth1").has_value());
+    ASSERT_EQ(l2switch.ports[1], nullptr);
+    ASSERT_EQ(l2switch.queued_frame_count(), 0);
+    ASSERT_FALSE(l2switch.mac_address_table.lookup(host1));
+    ASSERT_EQ(l2switch.collect_metrics().ports[1].received_frames_count, 0);
+
+    // VLANs can't be given to a port on a switch without them
+    ASSERT_TRUE(l2switch.add_port(mock_eth1, PortVlans{}).has_value());
+
+    // Frames for the removed port's MACs now flood to the ports that are left
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+    ASSERT_EQ(l2switch.metrics.totals().flood_count, 2);
+    ASSERT_EQ(l2switch.execute_command("show-ports"), "0 eth0 raw\n2 eth2 raw\n");
+}
+
+TEST(Layer2SwitchTests, ControlCommandTests) {
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    std::vector<std::shared_ptr<EthernetPort>> mock_ports{
+        mock_eth0,
+        mock_eth1
+    };
+    Layer2Switch l2switch{mock_ports};
+
+    ASSERT_EQ(
+        l2switch.execute_command("show-tunables"),
+        "mac-aging 300\nidle-polls 4096\nclass-weights 1,2,4,8\n"
+    );
+    ASSERT_EQ(l2switch.execute_command("set mac-aging 60"), "ok\n");
+    ASSERT_EQ(l2switch.execute_command("set idle-polls never"), "ok\n");
+    ASSERT_EQ(l2switch.execute_command("set class-weights 1,1,1,3"), "ok\n");
+    ASSERT_EQ(
+        l2switch.execute_command("show-tunables"),
+        "mac-aging 60\nidle-polls never\nclass-weights 1,1,1,3\n"
+    );
+    ASSERT_EQ(l2switch.mac_address_table.get_aging_timeout(), 60);
+
+    // Bad values leave the tunables alone
+    ASSERT_TRUE(l2switch.execute_command("set class-weights 1,0,1,3").starts_with("error: "));
+    ASSERT_TRUE(l2switch.execute_command("set class-weights 1,1,1").starts_with("error: "));
+    ASSERT_TRUE(l2switch.execute_command("set mac-aging soon").starts_with("error: "));
+    ASSERT_EQ(l2switch.class_weights[3], 3);
+
+    l2switch.mac_address_table.learn({0x11, 0x11, 0x11, 0x11, 0x11, 0x11}, 0);
+    l2switch.mac_address_table.learn({0x22, 0x22, 0x22, 0x22, 0x22, 0x22}, 1);
+    const std::string mac_table = l2switch.execute_command("show-mac-table");
+    ASSERT_NE(mac_table.find("11:11:11:11:11:11 1 eth0 0\n"), std::string::npos);
+    ASSERT_EQ(l2switch.execute_command("flush-mac-table eth0"), "ok\n");
+    ASSERT_EQ(l2switch.execute_command("show-mac-table"), "22:22:22:22:22:22 1 eth1 0\n");
+    ASSERT_EQ(l2switch.execute_command("flush-mac-table"), "ok\n");
+    ASSERT_EQ(l2switch.execute_command("show-mac-table"), "");
+
+    // Ports can't be added without room, nor ones that don't exist
+    ASSERT_TRUE(l2switch.execute_command("add-port nosuch0").starts_with("error: "));
+    ASSERT_TRUE(l2switch.execute_command("add-port lo:lag=1").starts_with("error: "));
+    ASSERT_TRUE(l2switch.execute_command("frobnicate").starts_with("error: Unknown command"));
+    ASSERT_TRUE(l2switch.execute_command("frobnicate").ends_with(" or reload-acl\n"));
+}
+
+TEST(Layer2SwitchTests, MacSnapshotTests) {
+    char path[32] = "/tmp/test_Layer2Switch_XXXXXX";
+    close(mkstemp(path));
+
+    SwitchConfig config;
+    config.mac_snapshot_path = path;
+    const MacAddress host0{0x11, 0x11, 0x11, 0x11, 0x11, 0x11};
+    const MacAddress host1{0x22, 0x22, 0x22, 0x22, 0x22, 0x22};
+    const MacAddress host2{0x33, 0x33, 0x33, 0x33, 0x33, 0x33};
+    {
+        // A file that isn't a snapshot leaves the table empty
+        Layer2Switch l2switch{
+            {std::make_shared<MockEthernetPort>("eth0"), std::make_shared<MockEthernetPort>("eth1"),
+             std::make_shared<MockEthernetPort>("eth2")},
+            config
+        };
+        ASSERT_EQ(l2switch.mac_address_table.size(), 0);
+
+        l2switch.mac_address_table.learn(host0, 0);
+        l2switch.mac_address_table.learn(host1, 1);
+        l2switch.mac_address_table.learn(host2, 2);
+        ASSERT_EQ(l2switch.execute_command("save-mac-table"), "ok\n");
+    }
+
+    // The restarted switch has its ports in another order, and eth2 is gone
+    Layer2Switch l2switch{
+        {std::make_shared<MockEthernetPort>("eth1"), std::make_shared<MockEthernetPort>("eth0")},
+        config
+    };
+    EXPECT_EQ(l2switch.mac_address_table.lookup(host0), 1);
+    EXPECT_EQ(l2switch.mac_address_table.lookup(host1), 0);
+    EXPECT_EQ(l2switch.mac_address_table.lookup(host2), std::nullopt);
+
+    // An entry on a VLAN that can't exist is never checked against a trunk port's VLANs
+    const auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+    const uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(since_epoch).count();
+    ASSERT_TRUE(MacSnapshot::write(path, {{host0, 4096, "eth0", 0}}, now));
+    config.port_vlans.resize(1);
+    config.port_vlans[0].mode = VlanMode::TRUNK;
+    config.port_vlans[0].tagged_vlans.set(10);
+    Layer2Switch trunk_switch{{std::make_shared<MockEthernetPort>("eth0")}, config};
+    EXPECT_EQ(trunk_switch.mac_address_table.size(), 0);
+    unlink(path);
+
+    Layer2Switch unconfigured{{std::make_shared<MockEthernetPort>("eth0")}};
+    ASSERT_TRUE(unconfigured.execute_command("save-mac-table").starts_with("error: "));
+}
+
+TEST(Layer2SwitchTests, AccessListTests) {
+    char path[32] = "/tmp/test_Layer2Switch_XXXXXX";
+    close(mkstemp(path));
+    const auto write_acl = [&](const std::string& text) {
+        std::ofstream file{path, std::ios::trunc};
+        file << text;
+    };
+    write_acl(
+        "deny src-mac 66:66:66:66:66:66\n"
+        "redirect eth2 src-mac 33:33:33:33:33:33 dst-mac 22:22:22:22:22:22\n"
+        "mirror eth2 src-mac 44:44:44:44:44:44\n"
+    );
+
+    auto mock_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto mock_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto mock_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    SwitchConfig config;
+    config.acl_path = path;
+    Layer2Switch l2switch{{mock_eth0, mock_eth1, mock_eth2}, config};
+
+    const MacAddress host0{0x11, 0x11, 0x11, 0x11, 0x11, 0x11};
+    const MacAddress host1{0x22, 0x22, 0x22, 0x22, 0x22, 0x22};
+    const MacAddress redirected{0x33, 0x33, 0x33, 0x33, 0x33, 0x33};
+    const MacAddress mirrored{0x44, 0x44, 0x44, 0x44, 0x44, 0x44};
+    const MacAddress denied{0x66, 0x66, 0x66, 0x66, 0x66, 0x66};
+    const MacAddress unknown{0x77, 0x77, 0x77, 0x77, 0x77, 0x77};
+    EXPECT_CALL(*mock_eth1, receive_frame).WillOnce(Return(make_frame(host1, host0)));
+    EXPECT_CALL(*mock_eth0, receive_frame)
+        .WillOnce(Return(make_frame(denied, host1)))
+        .WillOnce(Return(make_frame(redirected, host1)))
+        .WillOnce(Return(make_frame(mirrored, host1)))
+        .WillOnce(Return(make_frame(mirrored, unknown)));
+    EXPECT_CALL(*mock_eth0, send_frame).Times(1).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_eth1, send_frame).Times(2).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_eth2, send_frame).Times(4).WillRepeatedly(Return(true));
+
+    // Frames no rule matches are switched as usual
+    l2switch.frame_receiver_worker_impl(1);
+    l2switch.switch_impl();
+
+    // A denied frame is dropped before its source is learned
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+    ASSERT_FALSE(l2switch.mac_address_table.lookup(denied).has_value());
+    ASSERT_EQ(l2switch.collect_metrics().ports[0].acl_drops_count, 1);
+
+    // A redirected frame skips eth1, where its destination is, for eth2
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+
+    // A mirrored frame goes to eth1 as usual, with a copy out of eth2
+    l2switch.frame_receiver_worker_impl(0);
+    l2switch.switch_impl();
+
+    // A mirrored frame that's flooded to eth2 anyway isn't sent there twice
+    l2switch.frame_receiver_worker_impl(0);
     l2switch.switch_impl();
-    ASSERT_EQ(l2switch.input_queue.size(), 0);
-    ASSERT_EQ(l2switch.sent_frames_count, 2);
-    ASSERT_EQ(l2switch.flood_count, 1);
-    ASSERT_EQ(l2switch.send_errors_count, 0);
-    ASSERT_EQ(l2switch.flood_errors_count, 0);
+
+    ASSERT_EQ(
+        l2switch.execute_command("show-acl"),
+        "0 1 deny src-mac 66:66:66:66:66:66\n"
+        "1 1 redirect eth2 src-mac 33:33:33:33:33:33 dst-mac 22:22:22:22:22:22\n"
+        "2 2 mirror eth2 src-mac 44:44:44:44:44:44\n"
+    );
+    ASSERT_EQ(l2switch.collect_metrics().acl_rule_hits, (std::vector<uint64_t>{1, 1, 2}));
+
+    // A new ACL replaces the old one, and an invalid one leaves it be
+    write_acl("permit ether-type 0x0800\n");
+    ASSERT_EQ(l2switch.execute_command("reload-acl"), "ok\n");
+    ASSERT_EQ(l2switch.execute_command("show-acl"), "0 0 permit ether-type 0x0800\n");
+    write_acl("redirect eth9\n");
+    ASSERT_TRUE(l2switch.execute_command("reload-acl").starts_with("error: "));
+    write_acl("frobnicate\n");
+    ASSERT_TRUE(l2switch.execute_command("reload-acl").starts_with("error: "));
+    ASSERT_EQ(l2switch.execute_command("show-acl"), "0 0 permit ether-type 0x0800\n");
+
+    // Nothing is mirrored or redirected out of a port that doesn't carry the frame's VLAN
+    write_acl(
+        "redirect eth2 dst-mac 22:22:22:22:22:22\n"
+        "mirror eth2\n"
+    );
+    auto vlan_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto vlan_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto vlan_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    config.port_vlans.resize(3);
+    config.port_vlans[0].native_vlan = 10;
+    config.port_vlans[1].native_vlan = 10;
+    config.port_vlans[2].native_vlan = 20;
+    Layer2Switch vlan_switch{{vlan_eth0, vlan_eth1, vlan_eth2}, config};
+
+    EXPECT_CALL(*vlan_eth0, receive_frame)
+        .WillOnce(Return(make_frame(host0, host1)))
+        .WillOnce(Return(make_frame(host0, unknown)));
+    EXPECT_CALL(*vlan_eth1, send_frame).Times(1).WillRepeatedly(Return(true));
+    EXPECT_CALL(*vlan_eth2, send_frame).Times(0);
+    for (int frame = 0; frame < 2; ++frame) {
+        vlan_switch.frame_receiver_worker_impl(0);
+        vlan_switch.switch_impl();
+    }
+    ASSERT_EQ(vlan_switch.collect_metrics().acl_rule_hits, (std::vector<uint64_t>{1, 1}));
+
+    // A mirror destination only gets its one mirrored copy, however the ACL would send it there
+    write_acl(
+        "mirror eth2 src-mac 44:44:44:44:44:44\n"
+        "redirect eth2 src-mac 33:33:33:33:33:33\n"
+    );
+    auto span_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto span_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto span_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    config.port_vlans.clear();
+    config.mirror_sessions = {{{0}, {}, 2, ""}};
+    Layer2Switch span_switch{{span_eth0, span_eth1, span_eth2}, config};
+
+    EXPECT_CALL(*span_eth0, receive_frame)
+        .WillOnce(Return(make_frame(mirrored, host1)))
+        .WillOnce(Return(make_frame(redirected, host1)));
+    EXPECT_CALL(*span_eth1, send_frame).Times(1).WillRepeatedly(Return(true));
+    EXPECT_CALL(*span_eth2, send_frame).Times(2).WillRepeatedly(Return(true));
+    for (int frame = 0; frame < 2; ++frame) {
+        span_switch.frame_receiver_worker_impl(0);
+        span_switch.switch_impl();
+    }
+    ASSERT_EQ(span_switch.collect_metrics().acl_rule_hits, (std::vector<uint64_t>{1, 1}));
+
+    // A flood storm control suppresses isn't mirrored either
+    write_acl("mirror eth2\n");
+    auto storm_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto storm_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    auto storm_eth2 = std::make_shared<MockEthernetPort>("eth2");
+    config.mirror_sessions.clear();
+    config.storm_control[BROADCAST] = {.rate = 1, .burst = 1};
+    Layer2Switch storm_switch{{storm_eth0, storm_eth1, storm_eth2}, config};
+
+    const MacAddress broadcast{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    EXPECT_CALL(*storm_eth0, receive_frame)
+        .Times(2)
+        .WillRepeatedly(Return(make_frame(host0, broadcast)));
+    EXPECT_CALL(*storm_eth1, send_frame).Times(1).WillRepeatedly(Return(true));
+    EXPECT_CALL(*storm_eth2, send_frame).Times(1).WillRepeatedly(Return(true));
+    for (int frame = 0; frame < 2; ++frame) {
+        storm_switch.frame_receiver_worker_impl(0);
+        storm_switch.switch_impl();
+    }
+    ASSERT_EQ(storm_switch.metrics.totals().storm_suppressed_counts[BROADCAST], 1);
+
+    // A learning port doesn't learn a host the ACL denies either
+    write_acl("deny src-mac 66:66:66:66:66:66\n");
+    auto stp_eth0 = std::make_shared<MockEthernetPort>("eth0");
+    auto stp_eth1 = std::make_shared<MockEthernetPort>("eth1");
+    config.storm_control = {};
+    config.spanning_tree = true;
+    Layer2Switch stp_switch{{stp_eth0, stp_eth1}, config};
+    EXPECT_CALL(*stp_eth0, send_frame).WillRepeatedly(Return(true));
+    EXPECT_CALL(*stp_eth1, send_frame).WillRepeatedly(Return(true));
+
+    // A topology change notification every tick keeps eth0 from being taken for an edge port
+    const std::vector<unsigned char> tcn{0x01, 0x80, 0xC2, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00,
+                                         0x00, 0x00, 0x01, 0x00, 0x07, 0x42, 0x42, 0x03, 0x00,
+                                         0x00, 0x00, 0x80};
+    for (uint32_t tick = 0; tick < SpanningTree::FORWARD_DELAY; ++tick) {
+        stp_switch.spanning_tree->receive_bpdu(0, tcn);
+        stp_switch.spanning_tree->tick();
+    }
+    ASSERT_EQ(stp_switch.spanning_tree->port_state(0), PortState::LEARNING);
+
+    EXPECT_CALL(*stp_eth0, receive_frame)
+        .WillOnce(Return(make_frame(denied, host1)))
+        .WillOnce(Return(make_frame(host0, host1)));
+    for (int frame = 0; frame < 2; ++frame) {
+        stp_switch.frame_receiver_worker_impl(0);
+        stp_switch.switch_impl();
+    }
+    ASSERT_FALSE(stp_switch.mac_address_table.lookup(denied).has_value());
+    ASSERT_EQ(stp_switch.mac_address_table.lookup(host0), 0);
+    unlink(path);
 }
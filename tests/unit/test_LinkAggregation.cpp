@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "LinkAggregation.hpp"
+
+/*
+ * A handful of switches' LAGs wired together port to port. LACPDUs are queued as they're sent and
+ * delivered in order by deliver(), so every test is deterministic.
+ */
+class LacpNetwork {
+private:
+    // Port on the other end of each connected (system, port)
+    std::map<std::pair<size_t, size_t>, std::pair<size_t, size_t>> links;
+
+    // LACPDUs sent but not delivered yet, by the (system, port) that sent them
+    std::deque<std::tuple<size_t, size_t, std::vector<unsigned char>>> in_flight;
+
+public:
+    std::vector<std::unique_ptr<LinkAggregation>> systems;
+
+    size_t add_system(const std::vector<uint16_t>& port_lags) {
+        const size_t system = systems.size();
+        std::vector<std::string> port_names;
+        for (size_t port = 0; port < port_lags.size(); ++port) {
+            port_names.push_back("s" + std::to_string(system) + "p" + std::to_string(port));
+        }
+
+        systems.push_back(std::make_unique<LinkAggregation>(
+            MacAddress{0x02, 0x00, 0x00, 0x00, 0x00, (uint8_t)(system + 1)}, port_lags,
+            port_names, true,
+            [this, system](size_t port, const Frame& lacpdu) {
+                in_flight.emplace_back(
+                    system, port,
+                    std::vector<unsigned char>{lacpdu.buffer().begin(), lacpdu.buffer().end()}
+                );
+            }
+        ));
+        return system;
+    }
+
+    void connect(size_t a, size_t a_port, size_t b, size_t b_port) {
+        links[{a, a_port}] = {b, b_port};
+        links[{b, b_port}] = {a, a_port};
+    }
+
+    void disconnect(size_t a, size_t a_port) {
+        links.erase(links.at({a, a_port}));
+        links.erase({a, a_port});
+    }
+
+    void deliver() {
+        while (!in_flight.empty()) {
+            auto [system, port, lacpdu] = in_flight.front();
+            in_flight.pop_front();
+
+            auto link = links.find({system, port});
+            if (link != links.end()) {
+                systems[link->second.first]->receive_lacpdu(link->second.second, lacpdu);
+            }
+        }
+    }
+
+    void tick(size_t ticks = 1) {
+        for (size_t i = 0; i < ticks; ++i) {
+            for (std::unique_ptr<LinkAggregation>& system : systems) { system->tick(); }
+            deliver();
+        }
+    }
+};
+
+// A UDP over IPv4 frame between two fixed hosts, from and to the given UDP ports
+static std::vector<unsigned char> make_udp_frame(uint16_t source_port, uint16_t destination_port) {
+    std::vector<unsigned char> frame = {
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x08, 0x00,
+        0x45, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+        10,   0,    0,    1,    10,   0,    0,    2,
+    };
+    frame.push_back(source_port >> 8);
+    frame.push_back(source_port & 0xFF);
+    frame.push_back(destination_port >> 8);
+    frame.push_back(destination_port & 0xFF);
+    frame.resize(60, 0);
+    return frame;
+}
+
+TEST(LinkAggregationTests, FlowHashTests) {
+    ASSERT_EQ(
+        LinkAggregation::flow_hash(make_udp_frame(1000, 53)),
+        LinkAggregation::flow_hash(make_udp_frame(1000, 53))
+    );
+
+    // Flows between the same two hosts still spread out by port
+    std::set<uint32_t> buckets;
+    for (uint16_t port = 1000; port < 1016; ++port) {
+        buckets.insert(LinkAggregation::flow_hash(make_udp_frame(port, 53)) % 2);
+    }
+    ASSERT_EQ(buckets.size(), 2);
+
+    // Fragments past the first have no ports, so no fragment of a datagram is hashed on them
+    std::vector<unsigned char> fragment = make_udp_frame(1000, 53);
+    fragment[20] = 0x00;
+    fragment[21] = 0x10;
+    std::vector<unsigned char> other_fragment = make_udp_frame(2000, 80);
+    other_fragment[20] = 0x00;
+    other_fragment[21] = 0x10;
+    ASSERT_EQ(LinkAggregation::flow_hash(fragment), LinkAggregation::flow_hash(other_fragment));
+}
+
+TEST(LinkAggregationTests, StaticLagTests) {
+    LinkAggregation lags{
+        MacAddress{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}, {0, 7, 7, 7}, {"p0", "p1", "p2", "p3"},
+        false, [](size_t, const Frame&) { FAIL() << "Static LAGs never send LACPDUs"; }
+    };
+
+    ASSERT_EQ(lags.aggregate_port(0), 0);
+    ASSERT_EQ(lags.aggregate_port(3), 1);
+    ASSERT_EQ(lags.active_members(1), 3);
+    ASSERT_EQ(lags.egress_port(0, make_udp_frame(1000, 53)), 0);
+
+    // Every flow sticks to one member, and a member that goes down takes none of them
+    lags.set_link_up(2, false);
+    ASSERT_FALSE(lags.is_active(2));
+    ASSERT_EQ(lags.active_members(1), 2);
+    std::set<size_t> used;
+    for (uint16_t port = 1000; port < 1064; ++port) {
+        std::optional<size_t> member = lags.egress_port(1, make_udp_frame(port, 53));
+        ASSERT_TRUE(member.has_value());
+        ASSERT_EQ(lags.egress_port(1, make_udp_frame(port, 53)), member);
+        used.insert(member.value());
+    }
+    ASSERT_EQ(used, (std::set<size_t>{1, 3}));
+
+    lags.set_link_up(1, false);
+    lags.set_link_up(3, false);
+    ASSERT_FALSE(lags.egress_port(1, make_udp_frame(1000, 53)).has_value());
+
+    lags.set_link_up(2, true);
+    ASSERT_EQ(lags.egress_port(1, make_udp_frame(1000, 53)), 2);
+}
+
+TEST(LinkAggregationTests, LacpNegotiationTests) {
+    LacpNetwork network;
+    const size_t a = network.add_system({1, 1, LinkAggregation::NO_LAG});
+    const size_t b = network.add_system({5, 5});
+    network.connect(a, 0, b, 0);
+    network.connect(a, 1, b, 1);
+
+    // Nothing is used until both ends agree, which takes a single exchange
+    ASSERT_EQ(network.systems[a]->active_members(0), 0);
+    ASSERT_TRUE(network.systems[a]->is_active(2));
+    network.tick();
+    ASSERT_EQ(network.systems[a]->active_members(0), 2);
+    ASSERT_EQ(network.systems[b]->active_members(0), 2);
+
+    // Both ends stop using a member whose partner goes quiet
+    network.disconnect(a, 1);
+    network.tick(LinkAggregation::SHORT_TIMEOUT_TIME - 1);
+    ASSERT_TRUE(network.systems[a]->is_active(1));
+    network.tick();
+    ASSERT_FALSE(network.systems[a]->is_active(1));
+    ASSERT_FALSE(network.systems[b]->is_active(1));
+    ASSERT_TRUE(network.systems[a]->is_active(0));
+    ASSERT_EQ(network.systems[a]->egress_port(0, make_udp_frame(1000, 53)), 0);
+
+    // A member whose link goes down leaves straight away, and rejoins once it's heard again
+    network.systems[a]->set_link_up(0, false);
+    ASSERT_EQ(network.systems[a]->active_members(0), 0);
+    network.connect(a, 1, b, 1);
+    network.tick();
+    ASSERT_EQ(network.systems[a]->active_members(0), 1);
+    ASSERT_TRUE(network.systems[a]->is_active(1));
+}
+
+TEST(LinkAggregationTests, PartnerMismatchTests) {
+    LacpNetwork network;
+    const size_t a = network.add_system({1, 1});
+    const size_t b = network.add_system({1});
+    const size_t c = network.add_system({1});
+    network.connect(a, 0, b, 0);
+    network.connect(a, 1, c, 0);
+    network.tick(2);
+
+    // The LAG goes to the partner of its lowest member, so the link to the other switch is unused
+    ASSERT_TRUE(network.systems[a]->is_active(0));
+    ASSERT_TRUE(network.systems[b]->is_active(0));
+    ASSERT_FALSE(network.systems[a]->is_active(1));
+    ASSERT_FALSE(network.systems[c]->is_active(0));
+
+    // Until that member goes away
+    network.systems[a]->set_link_up(0, false);
+    network.deliver();
+    network.tick();
+    ASSERT_TRUE(network.systems[a]->is_active(1));
+    ASSERT_TRUE(network.systems[c]->is_active(0));
+}
@@ -5,9 +5,34 @@
 TEST(MacAddressTests, RepresentationTests) {
     MacAddress m1(0x11, 0x22, 0x33, 0x44, 0x55, 0x66);
     std::array<unsigned char, 6> expected_raw_octets{{0x11, 0x22, 0x33, 0x44, 0x55, 0x66}};
-    EXPECT_EQ(m1.int_representation, 0x112233445566);
-    EXPECT_EQ(m1.readable_string, "11:22:33:44:55:66");
-    EXPECT_EQ(m1.raw_octets, expected_raw_octets);
+    EXPECT_EQ(m1.int_representation(), 0x112233445566);
+    EXPECT_EQ(m1.readable_string(), "11:22:33:44:55:66");
+    EXPECT_EQ(m1.raw_octets(), expected_raw_octets);
+}
+
+TEST(MacAddressTests, LoadTests) {
+    // Reading from a pointer handles any alignment and never touches bytes past the address
+    std::array<unsigned char, 9> buffer{{0xAA, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0xBB, 0xCC}};
+    MacAddress m1(buffer.data() + 1);
+    EXPECT_EQ(m1, MacAddress(0x11, 0x22, 0x33, 0x44, 0x55, 0x66));
+    EXPECT_EQ(m1.int_representation(), 0x112233445566);
+
+    MacAddress m2(buffer.data() + 3);
+    EXPECT_EQ(m2.readable_string(), "33:44:55:66:BB:CC");
+}
+
+TEST(MacAddressTests, AddressBitTests) {
+    constexpr MacAddress unicast(0x00, 0x1B, 0x21, 0x3C, 0x4D, 0x5E);
+    static_assert(!unicast.is_multicast() && !unicast.is_locally_administered());
+
+    constexpr MacAddress multicast(0x01, 0x00, 0x5E, 0x00, 0x00, 0x01);
+    static_assert(multicast.is_multicast() && !multicast.is_broadcast());
+
+    constexpr MacAddress local(0x02, 0x00, 0x00, 0x00, 0x00, 0x01);
+    static_assert(local.is_locally_administered() && !local.is_multicast());
+
+    constexpr MacAddress broadcast(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF);
+    static_assert(broadcast.is_broadcast() && broadcast.is_multicast());
 }
 
 TEST(MacAddressTests, IsBroadcastTest) {
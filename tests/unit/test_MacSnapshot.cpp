@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "MacSnapshot.hpp"
+
+class MacSnapshotTests : public testing::Test {
+protected:
+    char path[32] = "/tmp/test_MacSnapshot_XXXXXX";
+
+    void SetUp() override {
+        close(mkstemp(path));
+    }
+
+    void TearDown() override {
+        unlink(path);
+    }
+
+    std::vector<char> read_file() const {
+        std::ifstream file{path, std::ios::binary};
+        return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+
+    void write_file(const std::vector<char>& bytes) const {
+        std::ofstream file{path, std::ios::binary | std::ios::trunc};
+        file.write(bytes.data(), bytes.size());
+    }
+};
+
+TEST_F(MacSnapshotTests, RoundTripTests) {
+    const std::vector<MacSnapshot::Entry> entries{
+        {{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}, 1, "eth0", 5},
+        {{0x02, 0x00, 0x00, 0x00, 0x00, 0x02}, 10, "eth1", 0},
+        {{0x02, 0x00, 0x00, 0x00, 0x00, 0x03}, 20, "eth0", 100},
+    };
+    ASSERT_TRUE(MacSnapshot::write(path, entries, 1000));
+
+    // Port names are only stored once, and no temporary file is left behind
+    ASSERT_EQ(read_file().size(), 40 + 2 * 16 + 3 * 16);
+    ASSERT_NE(access((std::string{path} + ".tmp").c_str(), F_OK), 0);
+
+    // Entries keep aging for as long as the snapshot sat on disk
+    std::string error;
+    std::optional<std::vector<MacSnapshot::Entry>> read = MacSnapshot::read(path, 1030, error);
+    ASSERT_TRUE(read.has_value()) << error;
+    ASSERT_EQ(read->size(), 3);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        EXPECT_EQ((*read)[i].mac_address, entries[i].mac_address);
+        EXPECT_EQ((*read)[i].vlan, entries[i].vlan);
+        EXPECT_EQ((*read)[i].port_name, entries[i].port_name);
+        EXPECT_EQ((*read)[i].age, entries[i].age + 30);
+    }
+
+    // A clock that went backwards doesn't make entries any younger
+    read = MacSnapshot::read(path, 10, error);
+    ASSERT_TRUE(read.has_value());
+    EXPECT_EQ((*read)[0].age, 5);
+
+    // An empty table makes an empty snapshot
+    ASSERT_TRUE(MacSnapshot::write(path, {}, 1000));
+    read = MacSnapshot::read(path, 1000, error);
+    ASSERT_TRUE(read.has_value());
+    EXPECT_TRUE(read->empty());
+}
+
+TEST_F(MacSnapshotTests, InvalidSnapshotTests) {
+    std::string error;
+    ASSERT_FALSE(MacSnapshot::read("/nonexistent/snapshot", 0, error).has_value());
+    ASSERT_FALSE(error.empty());
+
+    const MacSnapshot::Entry entry{{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}, 1, "eth0", 5};
+    ASSERT_TRUE(MacSnapshot::write(path, {entry}, 0));
+    const std::vector<char> valid = read_file();
+
+    // Truncated, corrupted, and foreign files are all turned away
+    std::vector<char> truncated{valid.begin(), valid.end() - 1};
+    write_file(truncated);
+    ASSERT_FALSE(MacSnapshot::read(path, 0, error).has_value());
+
+    std::vector<char> corrupted = valid;
+    corrupted.back() ^= 1;
+    write_file(corrupted);
+    ASSERT_FALSE(MacSnapshot::read(path, 0, error).has_value());
+    EXPECT_EQ(error, "checksum mismatch");
+
+    std::vector<char> foreign = valid;
+    std::fill(foreign.begin(), foreign.begin() + 8, 'x');
+    write_file(foreign);
+    ASSERT_FALSE(MacSnapshot::read(path, 0, error).has_value());
+
+    write_file({});
+    ASSERT_FALSE(MacSnapshot::read(path, 0, error).has_value());
+
+    // So are entries on VLANs that can't exist, even with a valid checksum
+    for (uint16_t vlan : {0, 4095, 4096, 65535}) {
+        const MacSnapshot::Entry bad_vlan{entry.mac_address, vlan, "eth0", 5};
+        ASSERT_TRUE(MacSnapshot::write(path, {bad_vlan}, 0));
+        ASSERT_FALSE(MacSnapshot::read(path, 0, error).has_value());
+        EXPECT_EQ(error, "entry on an invalid VLAN " + std::to_string(vlan));
+    }
+
+    // Names that don't fit in an interface name can't be written
+    const MacSnapshot::Entry long_name{entry.mac_address, 1, std::string(16, 'x'), 0};
+    ASSERT_FALSE(MacSnapshot::write(path, {long_name}, 0));
+}
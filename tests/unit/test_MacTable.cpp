@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <optional>
+#include <vector>
+#include "MacTable.hpp"
+
+TEST(MacTableTests, LearnLookupTests) {
+    MacTable table{16, 300};
+    MacAddress m1(0x11, 0x22, 0x33, 0x44, 0x55, 0x66);
+    MacAddress m2(0x66, 0x55, 0x44, 0x33, 0x22, 0x11);
+
+    EXPECT_EQ(table.lookup(m1), std::nullopt);
+
+    table.learn(m1, 3);
+    table.learn(m2, 0);
+    EXPECT_EQ(table.lookup(m1), 3);
+    EXPECT_EQ(table.lookup(m2), 0);
+    EXPECT_EQ(table.size(), 2);
+
+    // Relearning a MAC on another port moves it instead of adding a new entry
+    table.learn(m1, 7);
+    EXPECT_EQ(table.lookup(m1), 7);
+    EXPECT_EQ(table.size(), 2);
+
+    // The all-zero MAC is a valid key, distinct from an empty slot
+    MacAddress zero(0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+    table.learn(zero, 0);
+    EXPECT_EQ(table.lookup(zero), 0);
+}
+
+TEST(MacTableTests, VlanTests) {
+    MacTable table{16, 300};
+    MacAddress m1(0x11, 0x22, 0x33, 0x44, 0x55, 0x66);
+
+    // The same MAC is learned separately in each VLAN
+    table.learn(m1, 1, 10);
+    table.learn(m1, 2, 20);
+    EXPECT_EQ(table.lookup(m1, 10), 1);
+    EXPECT_EQ(table.lookup(m1, 20), 2);
+    EXPECT_EQ(table.lookup(m1), std::nullopt);
+    EXPECT_EQ(table.size(), 2);
+
+    // Moving it in one VLAN leaves the other alone
+    table.learn(m1, 3, 10);
+    EXPECT_EQ(table.lookup(m1, 10), 3);
+    EXPECT_EQ(table.lookup(m1, 20), 2);
+
+    // Flushing a port flushes it in every VLAN
+    table.learn(m1, 3, MAX_VLAN);
+    EXPECT_EQ(table.flush_port(3), 2);
+    EXPECT_EQ(table.lookup(m1, 10), std::nullopt);
+    EXPECT_EQ(table.lookup(m1, MAX_VLAN), std::nullopt);
+    EXPECT_EQ(table.lookup(m1, 20), 2);
+}
+
+TEST(MacTableTests, AgingTests) {
+    MacTable table{16, 10};
+    MacAddress m1(0x11, 0x22, 0x33, 0x44, 0x55, 0x66);
+    MacAddress m2(0x66, 0x55, 0x44, 0x33, 0x22, 0x11);
+
+    table.learn(m1, 1);
+    table.learn(m2, 2);
+
+    // Refreshing m2 keeps it alive past m1's timeout
+    EXPECT_EQ(table.age_out(5), 0);
+    table.learn(m2, 2);
+
+    // Expired entries are treated as unknown even before they're swept
+    table.age_out(11);
+    EXPECT_EQ(table.lookup(m1), std::nullopt);
+    EXPECT_EQ(table.lookup(m2), 2);
+    EXPECT_EQ(table.size(), 1);
+
+    EXPECT_EQ(table.age_out(16), 1);
+    EXPECT_EQ(table.lookup(m2), std::nullopt);
+    EXPECT_EQ(table.size(), 0);
+}
+
+TEST(MacTableTests, NoAgingTests) {
+    MacTable table{16, 0};
+    MacAddress m1(0x11, 0x22, 0x33, 0x44, 0x55, 0x66);
+
+    table.learn(m1, 1);
+    EXPECT_EQ(table.age_out(1000000), 0);
+    EXPECT_EQ(table.lookup(m1), 1);
+}
+
+TEST(MacTableTests, EvictionTests) {
+    MacTable table{4, 0};
+
+    for (uint8_t i = 0; i < 4; ++i) {
+        table.age_out(i);
+        table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, i), i);
+    }
+    EXPECT_EQ(table.size(), 4);
+    EXPECT_EQ(table.evictions(), 0);
+
+    // A full table evicts an entry to make room, and the oldest sampled entry goes first
+    table.age_out(4);
+    table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x04), 4);
+    EXPECT_EQ(table.size(), 4);
+    EXPECT_EQ(table.evictions(), 1);
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x00)), std::nullopt);
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x04)), 4);
+}
+
+TEST(MacTableTests, ChurnTests) {
+    MacTable table{64, 1};
+
+    // Repeatedly fill the table and age everything out. Removals shift entries back, so every
+    // entry learned in a round must still be found no matter which entries were removed before it
+    for (uint32_t round = 0; round < 16; ++round) {
+        table.age_out(round * 2);
+        for (uint8_t i = 0; i < 64; ++i) {
+            table.learn(MacAddress(0x02, 0x00, 0x00, (uint8_t)round, i, i), i);
+        }
+        for (uint8_t i = 0; i < 64; ++i) {
+            ASSERT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, (uint8_t)round, i, i)), i);
+        }
+        ASSERT_EQ(table.size(), 64);
+        ASSERT_EQ(table.age_out(round * 2 + 2), 64);
+        ASSERT_EQ(table.size(), 0);
+    }
+    EXPECT_EQ(table.evictions(), 0);
+}
+
+TEST(MacTableTests, FlushTests) {
+    MacTable table{16, 0};
+    table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01), 1);
+    table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x02), 2, 10);
+
+    EXPECT_EQ(table.flush(), 2);
+    EXPECT_EQ(table.size(), 0);
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01)), std::nullopt);
+
+    // The table keeps learning as usual afterwards
+    table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01), 3);
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01)), 3);
+}
+
+TEST(MacTableTests, EntriesTests) {
+    MacTable table{16, 10};
+    table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01), 1);
+    table.age_out(4);
+    table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x02), 2, 10);
+    table.age_out(6);
+
+    std::vector<MacTable::Entry> entries = table.entries();
+    std::ranges::sort(entries, {}, &MacTable::Entry::port);
+    ASSERT_EQ(entries.size(), 2);
+    EXPECT_EQ(entries[0].mac_address, MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01));
+    EXPECT_EQ(entries[0].vlan, DEFAULT_VLAN);
+    EXPECT_EQ(entries[0].age, 6);
+    EXPECT_EQ(entries[1].mac_address, MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x02));
+    EXPECT_EQ(entries[1].vlan, 10);
+    EXPECT_EQ(entries[1].age, 2);
+}
+
+TEST(MacTableTests, SetAgingTimeoutTests) {
+    MacTable table{16, 0};
+    table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01), 1);
+    table.age_out(100);
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01)), 1);
+
+    // A shorter timeout applies to entries that were learned before it was set
+    table.set_aging_timeout(50);
+    EXPECT_EQ(table.get_aging_timeout(), 50);
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01)), std::nullopt);
+    EXPECT_EQ(table.age_out(101), 1);
+    EXPECT_EQ(table.size(), 0);
+}
+
+TEST(MacTableTests, RestoreTests) {
+    MacTable table{2, 10};
+    table.age_out(100);
+
+    // A restored entry carries on aging from the age it was restored with
+    ASSERT_TRUE(table.restore(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01), 1, DEFAULT_VLAN, 8));
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01)), 1);
+    EXPECT_EQ(table.entries()[0].age, 8);
+    table.age_out(103);
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01)), std::nullopt);
+
+    // Restoring never overrides what the table has learned, nor evicts anything
+    table.learn(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x02), 2, 10);
+    ASSERT_FALSE(table.restore(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x02), 3, 10, 0));
+    EXPECT_EQ(table.lookup(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x02), 10), 2);
+    ASSERT_TRUE(table.restore(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x03), 3, 10, 0));
+    ASSERT_FALSE(table.restore(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x04), 3, 10, 0));
+    EXPECT_EQ(table.size(), 2);
+    EXPECT_EQ(table.evictions(), 0);
+
+    // Entries older than the clock itself still age out
+    MacTable fresh{16, 10};
+    ASSERT_TRUE(fresh.restore(MacAddress(0x02, 0x00, 0x00, 0x00, 0x00, 0x01), 1, DEFAULT_VLAN, 5));
+    EXPECT_EQ(fresh.age_out(4), 0);
+    EXPECT_EQ(fresh.age_out(6), 1);
+}
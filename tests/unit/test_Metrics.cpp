@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Metrics.hpp"
+
+TEST(MetricsTests, HistogramBucketTests) {
+    // Small values get a bucket each
+    for (uint64_t value = 0; value < LatencyHistogram::SUB_BUCKETS; ++value) {
+        EXPECT_EQ(LatencyHistogram::bucket_of(value), value);
+        EXPECT_EQ(LatencyHistogram::bucket_upper_bound(value), value);
+    }
+
+    // Larger values are known to within 1/SUB_BUCKETS of themselves
+    for (uint64_t value : std::vector<uint64_t>{8, 9, 100, 1000, 123456789, UINT64_MAX}) {
+        const size_t bucket = LatencyHistogram::bucket_of(value);
+        ASSERT_LT(bucket, LatencyHistogram::BUCKET_COUNT);
+        EXPECT_GE(LatencyHistogram::bucket_upper_bound(bucket), value);
+        EXPECT_LE(LatencyHistogram::bucket_upper_bound(bucket) - value, value / 8);
+        EXPECT_LT(LatencyHistogram::bucket_upper_bound(bucket - 1), value);
+    }
+}
+
+TEST(MetricsTests, HistogramQuantileTests) {
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value) { histogram.record(value * 1000); }
+
+    HistogramSnapshot snapshot;
+    snapshot.merge(histogram);
+    EXPECT_EQ(snapshot.count, 1000);
+    EXPECT_EQ(snapshot.sum, 500'500'000);
+
+    EXPECT_GE(snapshot.quantile(0.5), 500'000);
+    EXPECT_LE(snapshot.quantile(0.5), 500'000 * 9 / 8);
+    EXPECT_GE(snapshot.quantile(0.99), 990'000);
+    EXPECT_LE(snapshot.quantile(0.99), 990'000 * 9 / 8);
+    EXPECT_EQ(snapshot.count_at_most(0), 0);
+    EXPECT_EQ(snapshot.count_at_most(UINT64_MAX), 1000);
+
+    EXPECT_EQ(HistogramSnapshot{}.quantile(0.99), 0);
+}
+
+TEST(MetricsTests, AggregationTests) {
+    SwitchMetrics metrics{2};
+    ThreadMetrics& first = metrics.add_thread();
+    ThreadMetrics& second = metrics.add_thread();
+
+    // Each thread only ever writes its own metrics
+    std::jthread first_thread([&] {
+        for (int i = 0; i < 10000; ++i) {
+            first.ports[0].received_frames.add(1);
+            first.forwarding_latency[BEST_EFFORT].record(100);
+        }
+    });
+    std::jthread second_thread([&] {
+        for (int i = 0; i < 10000; ++i) {
+            second.ports[0].received_frames.add(1);
+            second.ports[1].sent_frames.add(2);
+            second.forwarding_latency[NETWORK_CONTROL].record(100);
+        }
+    });
+    first_thread.join();
+    second_thread.join();
+
+    MetricsSnapshot snapshot = metrics.collect();
+    ASSERT_EQ(snapshot.ports.size(), 2);
+    EXPECT_EQ(snapshot.ports[0].received_frames_count, 20000);
+    EXPECT_EQ(snapshot.ports[1].sent_frames_count, 20000);
+    EXPECT_EQ(snapshot.totals.received_frames_count, 20000);
+    EXPECT_EQ(snapshot.forwarding_latency.count, 20000);
+    EXPECT_EQ(snapshot.classes[BEST_EFFORT].forwarding_latency.count, 10000);
+    EXPECT_EQ(snapshot.classes[NETWORK_CONTROL].forwarding_latency.count, 10000);
+    EXPECT_EQ(metrics.totals().sent_frames_count, 20000);
+}
+
+TEST(MetricsTests, PrometheusTests) {
+    SwitchMetrics metrics{2};
+    ThreadMetrics& thread = metrics.add_thread();
+    thread.ports[1].received_frames.add(3);
+    thread.queue_residency[INTERACTIVE].record(1000);
+    thread.classes[INTERACTIVE].received_frames.add(1);
+
+    MetricsSnapshot snapshot = metrics.collect();
+    snapshot.mac_table_entries = 5;
+    std::string output = snapshot.to_prometheus({"eth0", "eth1"});
+
+    EXPECT_NE(output.find("# TYPE vswitch_received_frames_total counter\n"), std::string::npos);
+    EXPECT_NE(output.find("vswitch_received_frames_total{port=\"eth0\"} 0\n"), std::string::npos);
+    EXPECT_NE(output.find("vswitch_received_frames_total{port=\"eth1\"} 3\n"), std::string::npos);
+    EXPECT_NE(output.find("# TYPE vswitch_queue_residency_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(
+        output.find(
+            "vswitch_queue_residency_seconds_bucket{class=\"interactive\",le=\"0.000000512\"} 0\n"
+        ),
+        std::string::npos
+    );
+    EXPECT_NE(
+        output.find(
+            "vswitch_queue_residency_seconds_bucket{class=\"interactive\",le=\"0.000001024\"} 1\n"
+        ),
+        std::string::npos
+    );
+    EXPECT_NE(
+        output.find("vswitch_queue_residency_seconds_count{class=\"interactive\"} 1\n"),
+        std::string::npos
+    );
+    EXPECT_NE(
+        output.find("vswitch_queue_residency_seconds_count{class=\"background\"} 0\n"),
+        std::string::npos
+    );
+    EXPECT_NE(
+        output.find("vswitch_class_received_frames_total{class=\"interactive\"} 1\n"),
+        std::string::npos
+    );
+    EXPECT_NE(output.find("vswitch_mac_table_entries 5\n"), std::string::npos);
+
+    // ACL rule hits are only exported while an ACL is loaded
+    EXPECT_EQ(output.find("vswitch_acl_rule_hits_total"), std::string::npos);
+    snapshot.acl_rule_hits = {7, 0};
+    output = snapshot.to_prometheus({"eth0", "eth1"});
+    EXPECT_NE(output.find("vswitch_acl_rule_hits_total{rule=\"0\"} 7\n"), std::string::npos);
+    EXPECT_NE(output.find("vswitch_acl_rule_hits_total{rule=\"1\"} 0\n"), std::string::npos);
+}
+
+TEST(MetricsTests, ResetPortTests) {
+    SwitchMetrics metrics{3};
+    ThreadMetrics& first = metrics.add_thread();
+    ThreadMetrics& second = metrics.add_thread();
+    first.ports[1].received_frames.add(3);
+    second.ports[1].storm_suppressed[BROADCAST].add(2);
+    second.ports[2].sent_frames.add(4);
+
+    // Only the reset port starts from scratch
+    metrics.reset_port(1);
+    MetricsSnapshot snapshot = metrics.collect();
+    EXPECT_EQ(snapshot.ports[1].received_frames_count, 0);
+    EXPECT_EQ(snapshot.ports[1].storm_suppressed_count(), 0);
+    EXPECT_EQ(snapshot.ports[2].sent_frames_count, 4);
+
+    // Free port slots have no name and are left out of the rendering
+    std::string output = snapshot.to_prometheus({"eth0", "", "eth2"});
+    EXPECT_NE(output.find("vswitch_sent_frames_total{port=\"eth2\"} 4\n"), std::string::npos);
+    EXPECT_EQ(output.find("port=\"\""), std::string::npos);
+}
@@ -0,0 +1,306 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MulticastSnooping.hpp"
+
+using Bytes = std::vector<unsigned char>;
+using Ipv4Address = std::array<uint8_t, 4>;
+using Ipv6Address = std::array<uint8_t, 16>;
+
+static const std::vector<std::string> PORT_NAMES = {"eth0", "eth1", "eth2", "eth3"};
+
+static const Ipv4Address ALL_SYSTEMS = {224, 0, 0, 1};
+static const Ipv4Address ALL_ROUTERS = {224, 0, 0, 2};
+static const Ipv4Address IGMPV3_ROUTERS = {224, 0, 0, 22};
+static const Ipv4Address GROUP = {239, 1, 1, 1};
+static const MacAddress GROUP_MAC{0x01, 0x00, 0x5E, 0x01, 0x01, 0x01};
+
+static const Ipv6Address ALL_NODES = {0xFF, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01};
+static const Ipv6Address MLDV2_ROUTERS = {0xFF, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x16};
+
+// Every port in the given set, in ascending order
+static std::vector<size_t> members(const PortBitmap& bitmap) {
+    std::vector<size_t> ports;
+    bitmap.for_each([&](size_t port) { ports.push_back(port); });
+    return ports;
+}
+
+static void append(Bytes& bytes, const auto& more) {
+    bytes.insert(bytes.end(), more.begin(), more.end());
+}
+
+// Builds an IPv4 frame to the given multicast group carrying the given payload
+static Bytes make_ipv4_frame(
+    const Ipv4Address& destination, uint8_t protocol, const Bytes& payload
+) {
+    Bytes frame = {0x01, 0x00, 0x5E, (uint8_t)(destination[1] & 0x7F), destination[2],
+                   destination[3], 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00};
+
+    // With a router alert option, as IGMP always is
+    const size_t total_length = 24 + payload.size();
+    append(frame, Bytes{0x46, 0x00, (uint8_t)(total_length >> 8), (uint8_t)total_length});
+    append(frame, Bytes{0x00, 0x00, 0x00, 0x00, 0x01, protocol, 0x00, 0x00, 10, 0, 0, 1});
+    append(frame, destination);
+    append(frame, Bytes{0x94, 0x04, 0x00, 0x00});
+    append(frame, payload);
+    return frame;
+}
+
+// Builds an IPv6 frame to the given multicast group carrying the given ICMPv6 message
+static Bytes make_icmpv6_frame(const Ipv6Address& destination, const Bytes& icmp) {
+    Bytes frame = {0x33, 0x33, destination[12], destination[13], destination[14], destination[15],
+                   0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x86, 0xDD};
+
+    // MLD always comes after a hop-by-hop options header with a router alert
+    const size_t payload_length = 8 + icmp.size();
+    append(frame, Bytes{0x60, 0x00, 0x00, 0x00, (uint8_t)(payload_length >> 8)});
+    append(frame, Bytes{(uint8_t)payload_length, 0x00, 0x01, 0xFE, 0x80});
+    append(frame, Bytes(13, 0x00));
+    append(frame, Bytes{0x01});
+    append(frame, destination);
+    append(frame, Bytes{58, 0x00, 0x05, 0x02, 0x00, 0x00, 0x01, 0x00});
+    append(frame, icmp);
+    return frame;
+}
+
+static Bytes make_igmp(uint8_t type, const Ipv4Address& group) {
+    Bytes igmp = {type, 0x64, 0x00, 0x00};
+    append(igmp, group);
+    const Ipv4Address& destination = type == 0x11 ? ALL_SYSTEMS
+                                     : type == 0x17 ? ALL_ROUTERS
+                                                    : group;
+    return make_ipv4_frame(destination, 2, igmp);
+}
+
+// Builds an IGMPv3 report from the given group records, each a record type and group
+static Bytes make_igmpv3_report(const std::vector<std::pair<uint8_t, Ipv4Address>>& records) {
+    Bytes igmp = {0x22, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, (uint8_t)records.size()};
+    for (const auto& [type, group] : records) {
+        // Include-mode records name a source, so they join rather than leave
+        const bool with_source = type == 1 || type == 5;
+        append(igmp, Bytes{type, 0x00, 0x00, (uint8_t)with_source});
+        append(igmp, group);
+        if (with_source) {
+            append(igmp, Bytes{10, 0, 0, 9});
+        }
+    }
+    return make_ipv4_frame(IGMPV3_ROUTERS, 2, igmp);
+}
+
+static Bytes make_udp_frame(const Ipv4Address& group) {
+    return make_ipv4_frame(group, 17, Bytes(16, 0x00));
+}
+
+TEST(MulticastSnoopingTests, IgmpTests) {
+    MulticastSnooping snooping{PORT_NAMES};
+    PortBitmap egress{PORT_NAMES.size()};
+
+    // Nobody has asked for the group yet, so it's flooded
+    ASSERT_FALSE(snooping.snoop(2, make_udp_frame(GROUP), egress));
+
+    // Queries are flooded to every host, and mark where the router is
+    ASSERT_FALSE(snooping.snoop(0, make_igmp(0x11, {0, 0, 0, 0}), egress));
+    ASSERT_TRUE(snooping.is_router_port(0));
+    ASSERT_FALSE(snooping.is_router_port(1));
+
+    // Reports only go to the router, so other hosts don't hold back their own
+    ASSERT_TRUE(snooping.snoop(1, make_igmp(0x16, GROUP), egress));
+    ASSERT_EQ(members(egress), (std::vector<size_t>{0}));
+    ASSERT_TRUE(snooping.is_member(GROUP_MAC, 1));
+    ASSERT_EQ(snooping.group_count(), 1);
+
+    // The group's traffic goes to its member and the router, and nowhere else
+    ASSERT_TRUE(snooping.snoop(2, make_udp_frame(GROUP), egress));
+    ASSERT_EQ(members(egress), (std::vector<size_t>{0, 1}));
+    ASSERT_TRUE(snooping.snoop(2, make_udp_frame({239, 129, 1, 1}), egress));
+    ASSERT_FALSE(snooping.snoop(2, make_udp_frame({239, 1, 1, 2}), egress));
+
+    // A leave gives the host until the router's follow up query times out
+    ASSERT_TRUE(snooping.snoop(1, make_igmp(0x17, GROUP), egress));
+    ASSERT_EQ(members(egress), (std::vector<size_t>{0}));
+    ASSERT_TRUE(snooping.is_member(GROUP_MAC, 1));
+    snooping.age_out(MulticastSnooping::LAST_MEMBER_QUERY_TIME);
+    ASSERT_FALSE(snooping.is_member(GROUP_MAC, 1));
+    ASSERT_EQ(snooping.group_count(), 0);
+    ASSERT_FALSE(snooping.snoop(2, make_udp_frame(GROUP), egress));
+}
+
+TEST(MulticastSnoopingTests, Igmpv3Tests) {
+    MulticastSnooping snooping{PORT_NAMES};
+    PortBitmap egress{PORT_NAMES.size()};
+    const MacAddress second_group_mac{0x01, 0x00, 0x5E, 0x02, 0x02, 0x02};
+    const MacAddress blocked_group_mac{0x01, 0x00, 0x5E, 0x03, 0x03, 0x03};
+
+    // Every record but a block joins, since sources aren't tracked
+    ASSERT_TRUE(snooping.snoop(
+        1, make_igmpv3_report({{4, GROUP}, {1, {239, 2, 2, 2}}, {6, {239, 3, 3, 3}}}), egress
+    ));
+    ASSERT_TRUE(egress.none());
+    ASSERT_TRUE(snooping.is_member(GROUP_MAC, 1));
+    ASSERT_TRUE(snooping.is_member(second_group_mac, 1));
+    ASSERT_FALSE(snooping.is_member(blocked_group_mac, 1));
+
+    // Changing to include no sources is a leave
+    ASSERT_TRUE(snooping.snoop(1, make_igmpv3_report({{3, GROUP}}), egress));
+    snooping.age_out(MulticastSnooping::LAST_MEMBER_QUERY_TIME);
+    ASSERT_FALSE(snooping.is_member(GROUP_MAC, 1));
+    ASSERT_TRUE(snooping.is_member(second_group_mac, 1));
+
+    // Records that claim to run past the end of the report are ignored
+    Bytes truncated = make_igmpv3_report({{4, GROUP}});
+    truncated[14 + 24 + 7] = 2;
+    ASSERT_TRUE(snooping.snoop(2, truncated, egress));
+    ASSERT_TRUE(snooping.is_member(GROUP_MAC, 2));
+    ASSERT_EQ(snooping.group_count(), 2);
+}
+
+TEST(MulticastSnoopingTests, MldTests) {
+    MulticastSnooping snooping{PORT_NAMES};
+    PortBitmap egress{PORT_NAMES.size()};
+    const Ipv6Address v1_group = {0xFF, 0x15, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0, 0x02};
+    const Ipv6Address v2_group = {0xFF, 0x3E, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x80, 0, 0, 0x01};
+
+    Bytes query = {130, 0x00, 0x00, 0x00, 0x27, 0x10, 0x00, 0x00};
+    append(query, Bytes(16, 0x00));
+    ASSERT_FALSE(snooping.snoop(0, make_icmpv6_frame(ALL_NODES, query), egress));
+    ASSERT_TRUE(snooping.is_router_port(0));
+
+    Bytes v1_report = {131, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    append(v1_report, v1_group);
+    ASSERT_TRUE(snooping.snoop(1, make_icmpv6_frame(v1_group, v1_report), egress));
+    ASSERT_EQ(members(egress), (std::vector<size_t>{0}));
+    ASSERT_TRUE(snooping.is_member(MacAddress{0x33, 0x33, 0x00, 0x01, 0x00, 0x02}, 1));
+
+    // A change to exclude no sources, i.e. a join
+    Bytes v2_report = {143, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00};
+    append(v2_report, v2_group);
+    ASSERT_TRUE(snooping.snoop(2, make_icmpv6_frame(MLDV2_ROUTERS, v2_report), egress));
+
+    const MacAddress v2_group_mac{0x33, 0x33, 0x80, 0x00, 0x00, 0x01};
+    ASSERT_TRUE(snooping.is_member(v2_group_mac, 2));
+    ASSERT_TRUE(snooping.snoop(3, make_icmpv6_frame(v2_group, {128, 0, 0, 0}), egress));
+    ASSERT_EQ(members(egress), (std::vector<size_t>{0, 2}));
+
+    Bytes done = v1_report;
+    done[0] = 132;
+    ASSERT_TRUE(snooping.snoop(1, make_icmpv6_frame(ALL_NODES, done), egress));
+    snooping.age_out(MulticastSnooping::LAST_MEMBER_QUERY_TIME);
+    ASSERT_EQ(snooping.group_count(), 1);
+}
+
+TEST(MulticastSnoopingTests, LinkLocalTests) {
+    MulticastSnooping snooping{PORT_NAMES};
+    PortBitmap egress{PORT_NAMES.size()};
+
+    // Link-local groups, e.g. mDNS, are always flooded even when reported
+    const Ipv4Address mdns = {224, 0, 0, 251};
+    ASSERT_TRUE(snooping.snoop(1, make_igmp(0x16, mdns), egress));
+    ASSERT_EQ(snooping.group_count(), 0);
+    ASSERT_FALSE(snooping.snoop(2, make_udp_frame(mdns), egress));
+    ASSERT_FALSE(snooping.snoop(2, make_udp_frame({224, 128, 0, 251}), egress));
+
+    ASSERT_FALSE(MulticastSnooping::is_snooped_group(MacAddress{0x33, 0x33, 0, 0, 0, 0x01}));
+    ASSERT_TRUE(MulticastSnooping::is_snooped_group(MacAddress{0x33, 0x33, 0xFF, 0, 0, 0x01}));
+    ASSERT_FALSE(MulticastSnooping::is_snooped_group(MacAddress{0x01, 0x00, 0x5E, 0x80, 0, 1}));
+    ASSERT_FALSE(MulticastSnooping::is_snooped_group(MacAddress{0x01, 0x80, 0xC2, 0, 0, 0}));
+
+    // Multicast that isn't IP is left alone
+    Bytes lldp = {0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x88,
+                  0xCC};
+    ASSERT_FALSE(snooping.snoop(1, lldp, egress));
+}
+
+TEST(MulticastSnoopingTests, AgingTests) {
+    MulticastSnooping snooping{PORT_NAMES};
+    PortBitmap egress{PORT_NAMES.size()};
+
+    snooping.snoop(0, make_igmp(0x11, {0, 0, 0, 0}), egress);
+    snooping.snoop(1, make_igmp(0x16, GROUP), egress);
+
+    // A report refreshes the membership, and a query the router port
+    snooping.age_out(100);
+    snooping.snoop(1, make_igmp(0x16, GROUP), egress);
+    ASSERT_EQ(snooping.age_out(MulticastSnooping::MEMBERSHIP_INTERVAL), 0);
+    ASSERT_TRUE(snooping.is_member(GROUP_MAC, 1));
+    ASSERT_FALSE(snooping.is_router_port(0));
+
+    ASSERT_EQ(snooping.age_out(100 + MulticastSnooping::MEMBERSHIP_INTERVAL), 1);
+    ASSERT_FALSE(snooping.is_member(GROUP_MAC, 1));
+}
+
+TEST(MulticastSnoopingTests, VlanTests) {
+    MulticastSnooping snooping{PORT_NAMES};
+    PortBitmap egress{PORT_NAMES.size()};
+
+    // A report only joins the group in the VLAN it was heard in
+    ASSERT_TRUE(snooping.snoop(1, make_igmp(0x16, GROUP), egress, 10));
+    ASSERT_TRUE(snooping.is_member(GROUP_MAC, 1, 10));
+    ASSERT_FALSE(snooping.is_member(GROUP_MAC, 1, 20));
+
+    ASSERT_TRUE(snooping.snoop(2, make_udp_frame(GROUP), egress, 10));
+    ASSERT_EQ(members(egress), (std::vector<size_t>{1}));
+    ASSERT_FALSE(snooping.snoop(2, make_udp_frame(GROUP), egress, 20));
+
+    // The same group in another VLAN is a group of its own
+    ASSERT_TRUE(snooping.snoop(3, make_igmp(0x16, GROUP), egress, 20));
+    ASSERT_EQ(snooping.group_count(), 2);
+    ASSERT_TRUE(snooping.snoop(2, make_udp_frame(GROUP), egress, 20));
+    ASSERT_EQ(members(egress), (std::vector<size_t>{3}));
+}
+
+TEST(MulticastSnoopingTests, ResetPortTests) {
+    MulticastSnooping snooping{PORT_NAMES};
+    PortBitmap egress{PORT_NAMES.size()};
+
+    snooping.snoop(0, make_igmp(0x11, {0, 0, 0, 0}), egress);
+    snooping.snoop(1, make_igmp(0x16, GROUP), egress);
+    snooping.snoop(2, make_igmp(0x16, GROUP), egress);
+
+    // Whatever takes the port's place starts out with no memberships, and no router
+    snooping.reset_port(1, "eth9");
+    snooping.reset_port(0, "");
+    ASSERT_FALSE(snooping.is_member(GROUP_MAC, 1));
+    ASSERT_TRUE(snooping.is_member(GROUP_MAC, 2));
+    ASSERT_FALSE(snooping.is_router_port(0));
+    ASSERT_TRUE(snooping.snoop(3, make_udp_frame(GROUP), egress));
+    ASSERT_EQ(members(egress), (std::vector<size_t>{2}));
+
+    // A group left without members goes away
+    snooping.reset_port(2, "eth2");
+    ASSERT_EQ(snooping.group_count(), 0);
+}
+
+TEST(MulticastSnoopingTests, ConcurrentLookupTests) {
+    MulticastSnooping snooping{PORT_NAMES, 2};
+
+    // Forwarding looks groups up as its own reader while reports and aging change them
+    std::atomic_bool stopping{false};
+    std::atomic_int wrong{0};
+    std::jthread forwarding{[&] {
+        PortBitmap egress{PORT_NAMES.size()};
+        while (!stopping.load()) {
+            if (snooping.snoop(3, make_udp_frame(GROUP), egress, DEFAULT_VLAN, 1) &&
+                members(egress) != std::vector<size_t>{1}) {
+                wrong.fetch_add(1);
+            }
+        }
+    }};
+
+    PortBitmap egress{PORT_NAMES.size()};
+    for (uint32_t round = 0; round < 1000; ++round) {
+        const uint32_t now = round * MulticastSnooping::MEMBERSHIP_INTERVAL;
+        snooping.snoop(1, make_igmp(0x16, GROUP), egress);
+        ASSERT_TRUE(snooping.snoop(2, make_udp_frame(GROUP), egress));
+        ASSERT_EQ(members(egress), (std::vector<size_t>{1}));
+        ASSERT_EQ(snooping.age_out(now + MulticastSnooping::MEMBERSHIP_INTERVAL), 1);
+        ASSERT_FALSE(snooping.snoop(2, make_udp_frame(GROUP), egress));
+    }
+
+    stopping.store(true);
+    forwarding.join();
+    ASSERT_EQ(wrong.load(), 0);
+}
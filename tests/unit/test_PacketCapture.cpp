@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "PacketCapture.hpp"
+
+// Reads a 32 bit value out of a capture, which is written in the host's byte order
+static uint32_t read32(const std::vector<unsigned char>& capture, size_t offset) {
+    uint32_t value;
+    memcpy(&value, capture.data() + offset, sizeof(uint32_t));
+    return value;
+}
+
+class PacketCaptureTests : public testing::Test {
+protected:
+    char path[32] = "/tmp/test_PacketCapture_XXXXXX";
+    FramePool pool{16};
+
+    void SetUp() override {
+        close(mkstemp(path));
+    }
+
+    void TearDown() override {
+        unlink(path);
+    }
+
+    std::vector<unsigned char> read_capture() const {
+        std::ifstream file{path, std::ios::binary};
+        return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+};
+
+TEST_F(PacketCaptureTests, FormatTests) {
+    PacketCapture capture{path, {"eth0", "eth1"}, 2};
+
+    std::vector<unsigned char> bytes(61);
+    for (size_t i = 0; i < bytes.size(); ++i) { bytes[i] = i; }
+    const Frame frame{pool, bytes};
+
+    // Captured frames hold onto the frame's buffer until they're written, rather than copying it
+    ASSERT_TRUE(capture.capture(0, frame, 1, false, {}));
+    ASSERT_TRUE(capture.capture(1, frame, 0, true, 0x2064));
+    ASSERT_EQ(frame.reference_count(), 3);
+    ASSERT_EQ(capture.write_pending(), 2);
+    ASSERT_EQ(frame.reference_count(), 1);
+
+    // A section header, then an interface per port
+    const std::vector<unsigned char> file = read_capture();
+    ASSERT_EQ(read32(file, 0), 0x0A0D0D0A);
+    ASSERT_EQ(read32(file, 8), 0x1A2B3C4D);
+    size_t offset = read32(file, 4);
+    for (size_t port = 0; port < 2; ++port) {
+        ASSERT_EQ(read32(file, offset), 1);
+        ASSERT_EQ(file[offset + 8], 1);
+        ASSERT_EQ(memcmp(&file[offset + 20], port == 0 ? "eth0" : "eth1", 4), 0);
+        offset += read32(file, offset + 4);
+    }
+
+    // The received frame, padded to a multiple of four bytes and flagged inbound
+    ASSERT_EQ(read32(file, offset), 6);
+    ASSERT_EQ(read32(file, offset + 4), 28 + 64 + 16);
+    ASSERT_EQ(read32(file, offset + 8), 1);
+    ASSERT_EQ(read32(file, offset + 20), 61);
+    ASSERT_EQ(memcmp(&file[offset + 28], bytes.data(), bytes.size()), 0);
+    ASSERT_EQ(read32(file, offset + 28 + 64 + 4), 1);
+    ASSERT_EQ(read32(file, offset + 28 + 64 + 12), 28 + 64 + 16);
+    offset += read32(file, offset + 4);
+
+    // The sent frame, with its VLAN tag back between the MACs and the rest, and flagged outbound
+    ASSERT_EQ(read32(file, offset), 6);
+    ASSERT_EQ(read32(file, offset + 8), 0);
+    ASSERT_EQ(read32(file, offset + 20), 65);
+    ASSERT_EQ(memcmp(&file[offset + 28], bytes.data(), 12), 0);
+    const std::vector<unsigned char> tag = {0x81, 0x00, 0x20, 0x64};
+    ASSERT_EQ(memcmp(&file[offset + 40], tag.data(), tag.size()), 0);
+    ASSERT_EQ(memcmp(&file[offset + 44], bytes.data() + 12, bytes.size() - 12), 0);
+    ASSERT_EQ(read32(file, offset + 28 + 68 + 4), 2);
+    offset += read32(file, offset + 4);
+    ASSERT_EQ(offset, file.size());
+}
+
+TEST_F(PacketCaptureTests, QueueFullTests) {
+    PacketCapture capture{path, {"eth0"}, 2};
+    const Frame frame{pool, std::vector<unsigned char>(60, 0)};
+
+    // A producer that's filled its queue has its frames dropped, without holding up the others
+    for (size_t i = 0; i < PacketCapture::QUEUE_DEPTH; ++i) {
+        ASSERT_TRUE(capture.capture(0, frame, 0, false, {}));
+    }
+    ASSERT_FALSE(capture.capture(0, frame, 0, false, {}));
+    ASSERT_TRUE(capture.capture(1, frame, 0, false, {}));
+
+    ASSERT_EQ(capture.write_pending(), PacketCapture::QUEUE_DEPTH + 1);
+    ASSERT_TRUE(capture.capture(0, frame, 0, false, {}));
+    ASSERT_EQ(capture.write_errors(), 0);
+}
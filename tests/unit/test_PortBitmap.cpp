@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "PortBitmap.hpp"
+
+// Every port in the given set, in the order for_each visits them
+static std::vector<size_t> members(const PortBitmap& bitmap) {
+    std::vector<size_t> ports;
+    bitmap.for_each([&](size_t port) { ports.push_back(port); });
+    return ports;
+}
+
+TEST(PortBitmapTests, SetAndResetTests) {
+    PortBitmap bitmap{130};
+    ASSERT_TRUE(bitmap.none());
+
+    // Ports on either side of each word boundary come back in ascending order
+    for (size_t port : {129, 0, 64, 63}) { bitmap.set(port); }
+    ASSERT_EQ(members(bitmap), (std::vector<size_t>{0, 63, 64, 129}));
+    ASSERT_EQ(bitmap.count(), 4);
+    ASSERT_TRUE(bitmap.test(64));
+    ASSERT_FALSE(bitmap.test(65));
+
+    bitmap.reset(64);
+    ASSERT_FALSE(bitmap.test(64));
+    ASSERT_EQ(members(bitmap), (std::vector<size_t>{0, 63, 129}));
+}
+
+TEST(PortBitmapTests, UnionAndIntersectionTests) {
+    PortBitmap a{100};
+    PortBitmap b{100};
+    a.set(1);
+    b.set(1);
+    b.set(99);
+
+    a |= b;
+    ASSERT_EQ(a, b);
+    ASSERT_EQ(members(a), (std::vector<size_t>{1, 99}));
+
+    PortBitmap c{100};
+    c.set(99);
+    c.set(50);
+    a &= c;
+    ASSERT_EQ(members(a), (std::vector<size_t>{99}));
+}
+
+TEST(PortBitmapTests, RemoveWhileVisitingTests) {
+    PortBitmap bitmap{70};
+    for (size_t port = 0; port < 70; port += 3) { bitmap.set(port); }
+
+    // Every port is still visited, even as they're all removed
+    size_t visited = 0;
+    bitmap.for_each([&](size_t port) {
+        bitmap.reset(port);
+        ++visited;
+    });
+    ASSERT_EQ(visited, 24);
+    ASSERT_TRUE(bitmap.none());
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "PortFilter.hpp"
+
+// A minimum size frame with the given EtherType, tagged with VLAN 10 if there's an outer EtherType
+static std::vector<unsigned char> make_frame(uint16_t ether_type, uint16_t outer_ether_type = 0) {
+    std::vector<unsigned char> frame = {
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02,
+    };
+    if (outer_ether_type != 0) {
+        frame.insert(frame.end(), {(uint8_t)(outer_ether_type >> 8), (uint8_t)outer_ether_type});
+        frame.insert(frame.end(), {0x00, 0x0A});
+    }
+    frame.insert(frame.end(), {(uint8_t)(ether_type >> 8), (uint8_t)ether_type});
+    frame.resize(60, 0);
+    return frame;
+}
+
+/*
+ * Runs the filter's program in the kernel, the same way it runs on a port's socket, by attaching it
+ * to one end of a datagram socket pair. Returns whether the frame made it through.
+ */
+static bool passes(const PortFilter& filter, const std::vector<unsigned char>& frame) {
+    int sockets[2];
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets), 0);
+
+    std::vector<sock_filter> program = filter.compile();
+    sock_fprog attached_program{(unsigned short)program.size(), program.data()};
+    EXPECT_EQ(
+        setsockopt(
+            sockets[1], SOL_SOCKET, SO_ATTACH_FILTER, &attached_program, sizeof(attached_program)
+        ),
+        0
+    );
+
+    EXPECT_EQ(send(sockets[0], frame.data(), frame.size(), 0), (ssize_t)frame.size());
+    unsigned char received[128];
+    const bool passed = recv(sockets[1], received, sizeof(received), MSG_DONTWAIT) > 0;
+    close(sockets[0]);
+    close(sockets[1]);
+    return passed;
+}
+
+TEST(PortFilterTests, DroppedEtherTypeTests) {
+    PortFilter filter;
+    filter.dropped_ether_types = {0x86DD, 0x88CC};
+    ASSERT_FALSE(filter.empty());
+
+    ASSERT_TRUE(passes(filter, make_frame(0x0800)));
+    ASSERT_FALSE(passes(filter, make_frame(0x86DD)));
+    ASSERT_FALSE(passes(filter, make_frame(0x88CC)));
+
+    // Tagged frames are matched on their inner EtherType
+    ASSERT_TRUE(passes(filter, make_frame(0x0800, 0x8100)));
+    ASSERT_FALSE(passes(filter, make_frame(0x86DD, 0x8100)));
+
+    // The tag itself never matches, since the kernel may have stripped it before the filter runs
+    filter.dropped_ether_types = {0x8100};
+    ASSERT_TRUE(passes(filter, make_frame(0x0800, 0x8100)));
+
+    // The jump to the drop still fits in a byte with the most EtherTypes a filter can have
+    filter.dropped_ether_types.clear();
+    for (size_t i = 0; i < PortFilter::MAX_DROPPED_ETHER_TYPES; ++i) {
+        filter.dropped_ether_types.push_back(0x9000 + i);
+    }
+    ASSERT_FALSE(passes(filter, make_frame(0x9000)));
+    ASSERT_FALSE(passes(filter, make_frame(0x9000 + PortFilter::MAX_DROPPED_ETHER_TYPES - 1)));
+    ASSERT_TRUE(passes(filter, make_frame(0x9000 + PortFilter::MAX_DROPPED_ETHER_TYPES)));
+}
+
+TEST(PortFilterTests, ProgramTests) {
+    // tcpdump -ddd arp
+    std::optional<std::vector<sock_filter>> program =
+        PortFilter::parse_program("4\n40 0 0 12\n21 0 1 2054\n6 0 0 262144\n6 0 0 0\n");
+    ASSERT_TRUE(program.has_value());
+    ASSERT_EQ(program->size(), 4);
+
+    PortFilter filter;
+    filter.program = program.value();
+    ASSERT_TRUE(passes(filter, make_frame(0x0806)));
+    ASSERT_FALSE(passes(filter, make_frame(0x0800)));
+
+    // The comma separated form, as in iptables' bpf match, works too
+    ASSERT_TRUE(PortFilter::parse_program("1,6 0 0 0").has_value());
+
+    ASSERT_FALSE(PortFilter::parse_program("").has_value());
+    ASSERT_FALSE(PortFilter::parse_program("0\n").has_value());
+    ASSERT_FALSE(PortFilter::parse_program("2\n6 0 0 0\n").has_value());
+    ASSERT_FALSE(PortFilter::parse_program("1\n6 0 0 0\n6 0 0 0\n").has_value());
+    ASSERT_FALSE(PortFilter::parse_program("1\n6 0 256 0\n").has_value());
+    ASSERT_FALSE(PortFilter::parse_program("1\nret #0\n").has_value());
+}
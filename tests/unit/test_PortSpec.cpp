@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <optional>
+#include <string>
+#include "PortSpec.hpp"
+
+TEST(PortSpecTests, ParseTests) {
+    std::string error;
+    std::optional<PortSpec> spec = PortSpec::parse("eth0", error);
+    ASSERT_TRUE(spec.has_value());
+    EXPECT_EQ(spec->interface_name, "eth0");
+    EXPECT_EQ(spec->backend, "raw");
+    EXPECT_FALSE(spec->vlans.has_value());
+    EXPECT_EQ(spec->lag, LinkAggregation::NO_LAG);
+
+    spec = PortSpec::parse("eth1:mmap:trunk=10,20:native=5:lag=2:drop=0x86dd,0x88cc", error);
+    ASSERT_TRUE(spec.has_value());
+    EXPECT_EQ(spec->backend, "mmap");
+    ASSERT_TRUE(spec->vlans.has_value());
+    EXPECT_EQ(spec->vlans->mode, VlanMode::TRUNK);
+    EXPECT_EQ(spec->vlans->native_vlan, 5);
+    EXPECT_TRUE(spec->vlans->tagged_vlans.test(10));
+    EXPECT_TRUE(spec->vlans->tagged_vlans.test(20));
+    EXPECT_EQ(spec->vlans->tagged_vlans.count(), 2);
+    EXPECT_EQ(spec->lag, 2);
+    EXPECT_EQ(spec->filter.dropped_ether_types, (std::vector<uint16_t>{0x86DD, 0x88CC}));
+
+    spec = PortSpec::parse("eth2:access=30", error);
+    ASSERT_TRUE(spec.has_value());
+    EXPECT_EQ(spec->vlans->mode, VlanMode::ACCESS);
+    EXPECT_EQ(spec->vlans->native_vlan, 30);
+}
+
+TEST(PortSpecTests, InvalidSpecTests) {
+    const char* invalid_specs[] = {
+        "",
+        ":access=10",
+        "eth0:access=0",
+        "eth0:access=4095",
+        "eth0:trunk=10,",
+        "eth0:access=10:native=20",
+        "eth0:lag=0",
+        "eth0:drop=ipv6",
+        "eth0:drop=0x86dd:bpf=/nonexistent",
+        "eth0:bpf=/nonexistent",
+        "eth0:fast",
+    };
+
+    for (const char* invalid_spec : invalid_specs) {
+        std::string error;
+        EXPECT_FALSE(PortSpec::parse(invalid_spec, error).has_value()) << invalid_spec;
+        EXPECT_FALSE(error.empty()) << invalid_spec;
+    }
+}
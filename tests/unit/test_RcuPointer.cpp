@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "RcuPointer.hpp"
+
+// Counts how many of its kind are alive, so tests can see when snapshots get freed
+struct Tracked {
+    static inline std::atomic_int alive{0};
+
+    int value;
+
+    explicit Tracked(int v)
+        : value{v} {
+        ++alive;
+    }
+
+    ~Tracked() {
+        --alive;
+    }
+};
+
+TEST(RcuPointerTests, PublishTests) {
+    {
+        RcuPointer<Tracked> pointer{std::make_unique<Tracked>(1), 2};
+        EXPECT_EQ(pointer.get()->value, 1);
+
+        // With no reader inside, the old value is freed as soon as the new one is published
+        pointer.publish(std::make_unique<Tracked>(2));
+        EXPECT_EQ(pointer.get()->value, 2);
+        EXPECT_EQ(Tracked::alive, 1);
+
+        EXPECT_EQ(pointer.enter(0)->value, 2);
+        pointer.exit(0);
+    }
+    EXPECT_EQ(Tracked::alive, 0);
+}
+
+TEST(RcuPointerTests, GracePeriodTests) {
+    RcuPointer<Tracked> pointer{std::make_unique<Tracked>(1), 2};
+    const Tracked* seen = pointer.enter(1);
+
+    // The writer waits for the reader that can still see the old value
+    std::atomic_bool published{false};
+    std::jthread writer{[&] {
+        pointer.publish(std::make_unique<Tracked>(2));
+        published = true;
+    }};
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(published);
+    EXPECT_EQ(seen->value, 1);
+
+    // A reader entering now already sees the new value
+    while (pointer.get()->value != 2) { std::this_thread::yield(); }
+    EXPECT_EQ(pointer.enter(0)->value, 2);
+    pointer.exit(0);
+
+    pointer.exit(1);
+    writer.join();
+    EXPECT_TRUE(published);
+    EXPECT_EQ(Tracked::alive, 1);
+}
+
+TEST(RcuPointerTests, ConcurrentReadersTests) {
+    RcuPointer<std::vector<int>> pointer{std::make_unique<std::vector<int>>(64, 0), 4};
+
+    // Every snapshot a reader sees must be whole: all of its elements are the same value
+    std::atomic_bool stopping{false};
+    std::atomic_int torn{0};
+    std::vector<std::jthread> readers;
+    for (size_t reader = 0; reader < 4; ++reader) {
+        readers.emplace_back([&, reader] {
+            while (!stopping) {
+                const std::vector<int>* values = pointer.enter(reader);
+                for (int value : *values) {
+                    if (value != values->front()) {
+                        ++torn;
+                    }
+                }
+                pointer.exit(reader);
+            }
+        });
+    }
+
+    for (int version = 1; version <= 1000; ++version) {
+        pointer.publish(std::make_unique<std::vector<int>>(64, version));
+    }
+    stopping = true;
+    readers.clear();
+
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(pointer.get()->front(), 1000);
+}
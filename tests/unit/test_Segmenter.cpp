@@ -0,0 +1,237 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "Frame.hpp"
+#include "FramePool.hpp"
+#include "Segmenter.hpp"
+
+static constexpr size_t IPV4_OFFSET = 14;
+static constexpr size_t IPV6_HEADER_SIZE = 40;
+
+static uint16_t read_u16(const unsigned char* bytes) {
+    return (uint16_t)(bytes[0] << 8 | bytes[1]);
+}
+
+static uint32_t read_u32(const unsigned char* bytes) {
+    return (uint32_t)read_u16(bytes) << 16 | read_u16(bytes + 2);
+}
+
+static void write_u16(unsigned char* bytes, uint16_t value) {
+    bytes[0] = value >> 8;
+    bytes[1] = value & 0xFF;
+}
+
+// Folded ones' complement sum of the given bytes, which is 0xFFFF over anything checksummed right
+static uint16_t ones_complement_sum(const unsigned char* bytes, size_t length, uint32_t sum = 0) {
+    for (size_t i = 0; i + 1 < length; i += 2) { sum += read_u16(bytes + i); }
+    if (length % 2) {
+        sum += bytes[length - 1] << 8;
+    }
+    while (sum >> 16) { sum = (sum & 0xFFFF) + (sum >> 16); }
+    return sum;
+}
+
+/*
+ * A TCP or UDP frame over IPv4 or IPv6 carrying the given number of payload bytes, with a TCP
+ * sequence number close to wrapping and FIN, PSH and CWR set
+ */
+static std::vector<unsigned char> make_frame(bool ipv6, bool tcp, size_t payload_size) {
+    std::vector<unsigned char> frame = {0x02, 0, 0, 0, 0, 0x01, 0x02, 0, 0, 0, 0, 0x02};
+    const size_t transport_size = tcp ? 20 : 8;
+    const size_t ip_size = ipv6 ? IPV6_HEADER_SIZE : 20;
+    const uint8_t protocol = tcp ? 6 : 17;
+
+    if (ipv6) {
+        frame.insert(frame.end(), {0x86, 0xDD, 0x60, 0, 0, 0, 0, 0, protocol, 64});
+        write_u16(&frame[IPV4_OFFSET + 4], transport_size + payload_size);
+        for (unsigned char address : {1, 2}) {
+            frame.insert(frame.end(), {0xFD, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, address});
+        }
+    } else {
+        frame.insert(frame.end(), {0x08, 0x00, 0x45, 0, 0, 0, 0x12, 0x34, 0x40, 0, 64, protocol});
+        frame.insert(frame.end(), {0, 0, 10, 0, 0, 1, 10, 0, 0, 2});
+        write_u16(&frame[IPV4_OFFSET + 2], ip_size + transport_size + payload_size);
+    }
+
+    if (tcp) {
+        frame.insert(frame.end(), {0x03, 0xE8, 0x07, 0xD0, 0xFF, 0xFF, 0xFF, 0x00, 0, 0, 0, 1});
+        frame.insert(frame.end(), {0x50, 0x99, 0xFF, 0xFF, 0xAB, 0xCD, 0, 0});
+    } else {
+        frame.insert(frame.end(), {0x03, 0xE8, 0x07, 0xD0, 0, 0, 0xAB, 0xCD});
+        write_u16(&frame[frame.size() - 4], transport_size + payload_size);
+    }
+    for (size_t i = 0; i < payload_size; ++i) { frame.push_back(i % 251); }
+    return frame;
+}
+
+// Whether the IP header (for IPv4) and TCP or UDP checksum of the given frame check out
+static bool checksums_valid(const std::vector<unsigned char>& frame, size_t network_offset) {
+    const unsigned char* network = frame.data() + network_offset;
+    const bool ipv6 = (network[0] >> 4) == 6;
+    const size_t network_size = ipv6 ? IPV6_HEADER_SIZE : (network[0] & 0x0F) * 4;
+    if (!ipv6 && ones_complement_sum(network, network_size) != 0xFFFF) {
+        return false;
+    }
+
+    const size_t transport_length = frame.size() - network_offset - network_size;
+    uint32_t pseudo_header_sum = transport_length + network[ipv6 ? 6 : 9];
+    pseudo_header_sum += ipv6 ? ones_complement_sum(network + 8, 32)
+                              : ones_complement_sum(network + 12, 8);
+    return ones_complement_sum(network + network_size, transport_length, pseudo_header_sum) ==
+           0xFFFF;
+}
+
+static std::vector<std::vector<unsigned char>> segment(
+    const std::vector<unsigned char>& frame, const FrameOffload& offload,
+    std::optional<uint16_t> tci = {}
+) {
+    const Segmenter segmenter{frame, offload};
+    EXPECT_TRUE(segmenter.valid());
+
+    std::vector<std::vector<unsigned char>> segments;
+    std::vector<unsigned char> written(segmenter.total_length(tci.has_value()));
+    size_t offset = 0;
+    for (size_t i = 0; i < segmenter.segments(); ++i) {
+        const size_t length = segmenter.write_segment(i, tci, written.data() + offset);
+        EXPECT_EQ(length, segmenter.segment_length(i, tci.has_value()));
+        segments.emplace_back(written.begin() + offset, written.begin() + offset + length);
+        offset += length;
+    }
+    EXPECT_EQ(offset, written.size());
+    return segments;
+}
+
+TEST(SegmenterTests, TcpSegmentTests) {
+    const std::vector<unsigned char> frame = make_frame(false, true, 2500);
+    const FrameOffload offload{
+        FrameOffload::NEEDS_CHECKSUM, FrameOffload::GSO_TCPV4 | FrameOffload::GSO_ECN, 54, 1000, 34,
+        16
+    };
+
+    const std::vector<std::vector<unsigned char>> segments = segment(frame, offload);
+    ASSERT_EQ(segments.size(), 3);
+    std::vector<unsigned char> payload;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const std::vector<unsigned char>& segment = segments[i];
+        ASSERT_EQ(segment.size(), i < 2 ? 1054 : 554);
+        ASSERT_TRUE(checksums_valid(segment, IPV4_OFFSET));
+
+        // Each segment picks up the IP ID and sequence number where the last one left off
+        ASSERT_EQ(read_u16(&segment[IPV4_OFFSET + 2]), segment.size() - IPV4_OFFSET);
+        ASSERT_EQ(read_u16(&segment[IPV4_OFFSET + 4]), 0x1234 + i);
+        ASSERT_EQ(read_u32(&segment[38]), (uint32_t)(0xFFFFFF00 + i * 1000));
+
+        // Only the first segment keeps CWR, and only the last keeps FIN and PSH
+        ASSERT_EQ(segment[47], i == 0 ? 0x90 : i == 1 ? 0x10 : 0x19);
+        payload.insert(payload.end(), segment.begin() + 54, segment.end());
+    }
+    ASSERT_EQ(payload, std::vector<unsigned char>(frame.begin() + 54, frame.end()));
+
+    // Tagged segments are the same behind the tag
+    const std::vector<std::vector<unsigned char>> tagged = segment(frame, offload, 0x200A);
+    ASSERT_EQ(tagged.size(), 3);
+    ASSERT_EQ(read_u16(&tagged[1][12]), 0x8100);
+    ASSERT_EQ(read_u16(&tagged[1][14]), 0x200A);
+    ASSERT_TRUE(std::equal(segments[1].begin() + 12, segments[1].end(), tagged[1].begin() + 16));
+}
+
+TEST(SegmenterTests, Ipv6SegmentTests) {
+    const size_t network_end = IPV4_OFFSET + IPV6_HEADER_SIZE;
+
+    const std::vector<unsigned char> tcp_frame = make_frame(true, true, 3000);
+    const FrameOffload tcp_offload{
+        FrameOffload::NEEDS_CHECKSUM, FrameOffload::GSO_TCPV6, 0, 1440, network_end, 16
+    };
+    const std::vector<std::vector<unsigned char>> tcp_segments = segment(tcp_frame, tcp_offload);
+    ASSERT_EQ(tcp_segments.size(), 3);
+    ASSERT_EQ(tcp_segments[2].size(), network_end + 20 + 120);
+    for (const std::vector<unsigned char>& segment : tcp_segments) {
+        ASSERT_TRUE(checksums_valid(segment, IPV4_OFFSET));
+        ASSERT_EQ(read_u16(&segment[IPV4_OFFSET + 4]), segment.size() - network_end);
+    }
+
+    // UDP segments each get a UDP header of their own, like separately sent datagrams
+    const std::vector<unsigned char> udp_frame = make_frame(true, false, 2500);
+    const FrameOffload udp_offload{
+        FrameOffload::NEEDS_CHECKSUM, FrameOffload::GSO_UDP_L4, 0, 1200, network_end, 6
+    };
+    const std::vector<std::vector<unsigned char>> udp_segments = segment(udp_frame, udp_offload);
+    ASSERT_EQ(udp_segments.size(), 3);
+    for (const std::vector<unsigned char>& segment : udp_segments) {
+        ASSERT_TRUE(checksums_valid(segment, IPV4_OFFSET));
+        ASSERT_EQ(read_u16(&segment[network_end + 4]), segment.size() - network_end);
+    }
+    ASSERT_EQ(udp_segments[2].size(), network_end + 8 + 100);
+}
+
+TEST(SegmenterTests, ChecksumTests) {
+    // The sender leaves the pseudo header sum in the checksum field for whoever finishes it
+    std::vector<unsigned char> frame = make_frame(false, false, 100);
+    write_u16(&frame[IPV4_OFFSET + 10], ~ones_complement_sum(&frame[IPV4_OFFSET], 20));
+    write_u16(&frame[40], ones_complement_sum(&frame[26], 8, 17 + 108));
+    const FrameOffload offload{FrameOffload::NEEDS_CHECKSUM, FrameOffload::GSO_NONE, 0, 0, 34, 6};
+    ASSERT_TRUE(Segmenter::needed(offload));
+
+    const std::vector<std::vector<unsigned char>> segments = segment(frame, offload);
+    ASSERT_EQ(segments.size(), 1);
+    ASSERT_EQ(segments[0].size(), frame.size());
+    ASSERT_TRUE(checksums_valid(segments[0], IPV4_OFFSET));
+
+    const std::vector<std::vector<unsigned char>> tagged = segment(frame, offload, 10);
+    ASSERT_EQ(tagged[0].size(), frame.size() + VLAN_TAG_SIZE);
+    ASSERT_TRUE(checksums_valid(
+        std::vector<unsigned char>(tagged[0].begin() + VLAN_TAG_SIZE, tagged[0].end()), IPV4_OFFSET
+    ));
+
+    // A frame without offloads is copied as is
+    ASSERT_FALSE(Segmenter::needed({}));
+    ASSERT_EQ(segment(frame, {})[0], frame);
+}
+
+TEST(SegmenterTests, InvalidOffloadTests) {
+    const std::vector<unsigned char> frame = make_frame(false, true, 2500);
+    const FrameOffload offload{
+        FrameOffload::NEEDS_CHECKSUM, FrameOffload::GSO_TCPV4, 54, 1000, 34, 16
+    };
+    ASSERT_TRUE(Segmenter(frame, offload).valid());
+
+    // UDP fragmentation offload isn't segmenting at all, and isn't supported
+    FrameOffload wrong = offload;
+    wrong.gso_type = FrameOffload::GSO_UDP;
+    ASSERT_FALSE(Segmenter(frame, wrong).valid());
+
+    // The offloads have to match the frame's headers
+    wrong = offload;
+    wrong.gso_type = FrameOffload::GSO_TCPV6;
+    ASSERT_FALSE(Segmenter(frame, wrong).valid());
+    wrong = offload;
+    wrong.checksum_start = 30;
+    ASSERT_FALSE(Segmenter(frame, wrong).valid());
+    wrong = offload;
+    wrong.gso_size = 0;
+    ASSERT_FALSE(Segmenter(frame, wrong).valid());
+
+    const uint16_t past_end = frame.size();
+    wrong = {FrameOffload::NEEDS_CHECKSUM, FrameOffload::GSO_NONE, 0, 0, 34, past_end};
+    ASSERT_FALSE(Segmenter(frame, wrong).valid());
+}
+
+TEST(SegmenterTests, VlanPopTests) {
+    // A tag popped off a received GSO frame takes the checksum start along with it
+    std::vector<unsigned char> tagged = make_frame(false, true, 2500);
+    tagged.insert(tagged.begin() + 12, {0x81, 0x00, 0x00, 0x0A});
+    const FrameOffload offload{
+        FrameOffload::NEEDS_CHECKSUM, FrameOffload::GSO_TCPV4, 58, 1000, 38, 16
+    };
+
+    FramePool pool{1};
+    Frame frame{pool, FrameView{tagged, {}, nullptr, offload}};
+    ASSERT_EQ(frame.vlan_tci(), 10);
+    ASSERT_EQ(frame.offload().checksum_start, 34);
+    ASSERT_EQ(frame.offload().header_length, 54);
+
+    const Segmenter segmenter{frame.buffer(), frame.offload()};
+    ASSERT_TRUE(segmenter.valid());
+    ASSERT_EQ(segmenter.segments(), 3);
+}
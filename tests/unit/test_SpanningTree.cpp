@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "SpanningTree.hpp"
+
+/*
+ * A handful of bridges wired together port to port. BPDUs are queued as they're sent and delivered
+ * in order by deliver(), so every test is deterministic.
+ */
+class BridgeNetwork {
+private:
+    // Port on the other end of each connected (bridge, port)
+    std::map<std::pair<size_t, size_t>, std::pair<size_t, size_t>> links;
+
+    // BPDUs sent but not delivered yet, by the (bridge, port) that sent them
+    std::deque<std::tuple<size_t, size_t, std::vector<unsigned char>>> in_flight;
+
+public:
+    std::vector<std::unique_ptr<SpanningTree>> bridges;
+
+    // Ports each bridge was asked to flush the MAC table of
+    std::vector<std::set<size_t>> flushed_ports;
+
+    // BPDUs each bridge sent, in order
+    std::vector<std::vector<std::vector<unsigned char>>> sent_bpdus;
+
+    size_t add_bridge(uint16_t priority, size_t port_count) {
+        const size_t bridge = bridges.size();
+        std::vector<std::string> port_names;
+        for (size_t port = 0; port < port_count; ++port) {
+            port_names.push_back("b" + std::to_string(bridge) + "p" + std::to_string(port));
+        }
+
+        flushed_ports.emplace_back();
+        sent_bpdus.emplace_back();
+        bridges.push_back(std::make_unique<SpanningTree>(
+            MacAddress{0x02, 0x00, 0x00, 0x00, 0x00, (uint8_t)(bridge + 1)}, priority,
+            SpanningTree::DEFAULT_PORT_PATH_COST, port_names,
+            [this, bridge](size_t port, const Frame& bpdu) {
+                std::vector<unsigned char> bytes{bpdu.buffer().begin(), bpdu.buffer().end()};
+                sent_bpdus[bridge].push_back(bytes);
+                in_flight.emplace_back(bridge, port, bytes);
+            },
+            [this, bridge](size_t port) { flushed_ports[bridge].insert(port); }
+        ));
+        return bridge;
+    }
+
+    void connect(size_t a, size_t a_port, size_t b, size_t b_port) {
+        links[{a, a_port}] = {b, b_port};
+        links[{b, b_port}] = {a, a_port};
+    }
+
+    void disconnect(size_t a, size_t a_port) {
+        links.erase(links.at({a, a_port}));
+        links.erase({a, a_port});
+    }
+
+    void deliver() {
+        while (!in_flight.empty()) {
+            auto [bridge, port, bpdu] = in_flight.front();
+            in_flight.pop_front();
+
+            auto link = links.find({bridge, port});
+            if (link != links.end()) {
+                bridges[link->second.first]->receive_bpdu(link->second.second, bpdu);
+            }
+        }
+    }
+
+    void tick(size_t ticks = 1) {
+        for (size_t i = 0; i < ticks; ++i) {
+            for (std::unique_ptr<SpanningTree>& bridge : bridges) { bridge->tick(); }
+            deliver();
+        }
+    }
+};
+
+/*
+ * Three bridges in a triangle, each with a port nothing is connected to. Bridge 0 has the lowest
+ * priority, and bridge 1 has a lower MAC than bridge 2.
+ */
+static void make_triangle(BridgeNetwork& network) {
+    network.add_bridge(4096, 3);
+    network.add_bridge(SpanningTree::DEFAULT_BRIDGE_PRIORITY, 3);
+    network.add_bridge(SpanningTree::DEFAULT_BRIDGE_PRIORITY, 3);
+    network.connect(0, 0, 1, 0);
+    network.connect(0, 1, 2, 0);
+    network.connect(1, 1, 2, 1);
+}
+
+TEST(SpanningTreeTests, RapidConvergenceTests) {
+    BridgeNetwork network;
+    make_triangle(network);
+    const std::vector<std::unique_ptr<SpanningTree>>& bridges = network.bridges;
+
+    // Proposals and agreements settle the whole tree within a single hello, not a forward delay
+    network.tick();
+    for (const std::unique_ptr<SpanningTree>& bridge : bridges) {
+        EXPECT_EQ(bridge->root_id(), bridges[0]->id());
+    }
+
+    EXPECT_EQ(bridges[0]->port_role(0), PortRole::DESIGNATED);
+    EXPECT_EQ(bridges[0]->port_role(1), PortRole::DESIGNATED);
+    EXPECT_EQ(bridges[1]->port_role(0), PortRole::ROOT);
+    EXPECT_EQ(bridges[2]->port_role(0), PortRole::ROOT);
+    EXPECT_EQ(bridges[1]->port_role(1), PortRole::DESIGNATED);
+    EXPECT_EQ(bridges[2]->port_role(1), PortRole::ALTERNATE);
+
+    EXPECT_EQ(bridges[0]->port_state(0), PortState::FORWARDING);
+    EXPECT_EQ(bridges[0]->port_state(1), PortState::FORWARDING);
+    EXPECT_EQ(bridges[1]->port_state(0), PortState::FORWARDING);
+    EXPECT_EQ(bridges[2]->port_state(0), PortState::FORWARDING);
+    EXPECT_EQ(bridges[1]->port_state(1), PortState::FORWARDING);
+    EXPECT_EQ(bridges[2]->port_state(1), PortState::DISCARDING);
+
+    // Ports that forward towards other bridges flush what was learned elsewhere
+    EXPECT_GT(bridges[1]->topology_changes(), 0);
+    EXPECT_TRUE(network.flushed_ports[1].contains(1));
+
+    // The unconnected ports never hear a BPDU, so they turn out to be edge ports
+    EXPECT_EQ(bridges[0]->port_state(2), PortState::DISCARDING);
+    network.tick(SpanningTree::EDGE_DELAY);
+    for (const std::unique_ptr<SpanningTree>& bridge : bridges) {
+        EXPECT_TRUE(bridge->is_edge(2));
+        EXPECT_EQ(bridge->port_state(2), PortState::FORWARDING);
+        EXPECT_FALSE(bridge->is_edge(0));
+    }
+    EXPECT_EQ(bridges[2]->port_state(1), PortState::DISCARDING);
+}
+
+TEST(SpanningTreeTests, FailoverTests) {
+    BridgeNetwork network;
+    make_triangle(network);
+    const std::vector<std::unique_ptr<SpanningTree>>& bridges = network.bridges;
+    network.tick(SpanningTree::EDGE_DELAY + 1);
+    network.flushed_ports[2].clear();
+
+    // Once bridge 2's information from the root ages out, its alternate port takes over right away
+    network.disconnect(0, 1);
+    network.tick(3 * SpanningTree::HELLO_TIME);
+    EXPECT_EQ(bridges[2]->root_id(), bridges[0]->id());
+    EXPECT_EQ(bridges[2]->port_role(1), PortRole::ROOT);
+    EXPECT_EQ(bridges[2]->port_state(1), PortState::FORWARDING);
+    EXPECT_EQ(bridges[1]->port_state(1), PortState::FORWARDING);
+    EXPECT_NE(bridges[2]->port_state(0), PortState::FORWARDING);
+
+    // MACs learned behind the old root port are forgotten, but edge ports keep theirs
+    EXPECT_TRUE(network.flushed_ports[2].contains(0));
+    EXPECT_FALSE(network.flushed_ports[2].contains(2));
+}
+
+TEST(SpanningTreeTests, RootFailureTests) {
+    BridgeNetwork network;
+    make_triangle(network);
+    const std::vector<std::unique_ptr<SpanningTree>>& bridges = network.bridges;
+    network.tick(SpanningTree::EDGE_DELAY + 1);
+
+    // With the root gone, the bridge with the next best ID takes over
+    network.disconnect(0, 0);
+    network.disconnect(0, 1);
+    network.tick(3 * SpanningTree::HELLO_TIME + 1);
+    EXPECT_EQ(bridges[1]->root_id(), bridges[1]->id());
+    EXPECT_EQ(bridges[2]->root_id(), bridges[1]->id());
+    EXPECT_EQ(bridges[1]->port_role(1), PortRole::DESIGNATED);
+    EXPECT_EQ(bridges[2]->port_role(1), PortRole::ROOT);
+    EXPECT_EQ(bridges[1]->port_state(1), PortState::FORWARDING);
+    EXPECT_EQ(bridges[2]->port_state(1), PortState::FORWARDING);
+}
+
+TEST(SpanningTreeTests, BpduFormatTests) {
+    BridgeNetwork network;
+    network.add_bridge(4096, 1);
+    network.tick();
+
+    // A proposal from a discarding designated port, claiming to be the root itself
+    ASSERT_EQ(network.sent_bpdus[0].size(), 1);
+    const std::vector<unsigned char>& bpdu = network.sent_bpdus[0][0];
+    ASSERT_EQ(bpdu.size(), 60);
+    using Bytes = std::vector<unsigned char>;
+    EXPECT_EQ(Bytes(bpdu.begin(), bpdu.begin() + 6), Bytes({0x01, 0x80, 0xC2, 0x00, 0x00, 0x00}));
+    EXPECT_EQ(Bytes(bpdu.begin() + 12, bpdu.begin() + 17), Bytes({0x00, 0x27, 0x42, 0x42, 0x03}));
+    EXPECT_EQ(bpdu[19], 0x02);
+    EXPECT_EQ(bpdu[20], 0x02);
+    EXPECT_EQ(bpdu[21], 0x0E);
+    EXPECT_EQ(
+        Bytes(bpdu.begin() + 22, bpdu.begin() + 30),
+        Bytes({0x10, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01})
+    );
+
+    // Frames that aren't BPDUs are ignored
+    network.bridges[0]->receive_bpdu(0, Bytes(bpdu.begin(), bpdu.begin() + 20));
+    std::vector<unsigned char> not_llc = bpdu;
+    not_llc[14] = 0xAA;
+    network.bridges[0]->receive_bpdu(0, not_llc);
+    EXPECT_EQ(network.bridges[0]->port_role(0), PortRole::DESIGNATED);
+    EXPECT_EQ(network.bridges[0]->root_id(), network.bridges[0]->id());
+}
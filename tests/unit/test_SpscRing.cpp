@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include "SpscRing.hpp"
+
+TEST(SpscRingTests, PushPeekPopTests) {
+    SpscRing<int> ring{4};
+    EXPECT_TRUE(ring.empty());
+
+    EXPECT_TRUE(ring.try_emplace(1));
+    EXPECT_TRUE(ring.try_emplace(2));
+    EXPECT_TRUE(ring.try_emplace(3));
+    EXPECT_EQ(ring.size(), 3);
+    EXPECT_EQ(ring.readable(), 3);
+
+    // Peeking doesn't consume anything
+    EXPECT_EQ(ring.peek(0), 1);
+    EXPECT_EQ(ring.peek(2), 3);
+    EXPECT_EQ(ring.size(), 3);
+
+    ring.pop(2);
+    EXPECT_EQ(ring.size(), 1);
+    EXPECT_EQ(ring.peek(0), 3);
+}
+
+TEST(SpscRingTests, CapacityTests) {
+    // Capacity is rounded up to the next power of two
+    SpscRing<int> ring{3};
+    for (int i = 0; i < 4; ++i) { EXPECT_TRUE(ring.try_emplace(i)); }
+    EXPECT_FALSE(ring.try_emplace(4));
+
+    // Popping frees up room, and indices wrap around the end of the ring
+    ring.pop(1);
+    EXPECT_TRUE(ring.try_emplace(4));
+    for (int i = 0; i < 4; ++i) { EXPECT_EQ(ring.peek(i), i + 1); }
+}
+
+TEST(SpscRingTests, DestroysElementsTests) {
+    auto element = std::make_shared<int>(0);
+    {
+        SpscRing<std::shared_ptr<int>> ring{4};
+        ring.try_emplace(element);
+        ring.try_emplace(element);
+        EXPECT_EQ(element.use_count(), 3);
+
+        ring.pop(1);
+        EXPECT_EQ(element.use_count(), 2);
+    }
+    EXPECT_EQ(element.use_count(), 1);
+}
+
+TEST(SpscRingTests, ConcurrentProducerConsumerTests) {
+    constexpr int ELEMENT_COUNT = 100000;
+    SpscRing<int> ring{64};
+
+    std::thread producer([&] {
+        for (int i = 0; i < ELEMENT_COUNT; ++i) {
+            while (!ring.try_emplace(i)) { std::this_thread::yield(); }
+        }
+    });
+
+    // Elements must come out in exactly the order they went in
+    int expected = 0;
+    while (expected < ELEMENT_COUNT) {
+        size_t readable = ring.readable();
+        if (readable == 0) {
+            std::this_thread::yield();
+        }
+        for (size_t i = 0; i < readable; ++i) { ASSERT_EQ(ring.peek(i), expected++); }
+        ring.pop(readable);
+    }
+
+    producer.join();
+    EXPECT_TRUE(ring.empty());
+}
@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include "StormControl.hpp"
+
+// Arbitrary metrics_clock() time the tests start at
+static constexpr uint64_t START = 1'000'000'000'000;
+
+TEST(StormControlTests, FrameRateTests) {
+    std::array<StormControlLimit, FLOOD_TYPE_COUNT> limits{};
+    limits[BROADCAST] = {.rate = 100, .burst = 10};
+    StormControl storm_control{limits, 2};
+
+    // A full burst gets through at once, then nothing until the bucket refills
+    for (int i = 0; i < 10; ++i) { ASSERT_TRUE(storm_control.allow(0, BROADCAST, 64, START)); }
+    ASSERT_FALSE(storm_control.allow(0, BROADCAST, 64, START));
+
+    // At 100 frames per second, a token comes back every 10ms
+    ASSERT_FALSE(storm_control.allow(0, BROADCAST, 64, START + 9'000'000));
+    ASSERT_TRUE(storm_control.allow(0, BROADCAST, 64, START + 10'000'000));
+    ASSERT_FALSE(storm_control.allow(0, BROADCAST, 64, START + 10'000'000));
+
+    // Every port has its own buckets, and other types are unlimited
+    ASSERT_TRUE(storm_control.allow(1, BROADCAST, 64, START));
+    for (int i = 0; i < 1000; ++i) { ASSERT_TRUE(storm_control.allow(0, MULTICAST, 64, START)); }
+}
+
+TEST(StormControlTests, BitRateTests) {
+    std::array<StormControlLimit, FLOOD_TYPE_COUNT> limits{};
+    limits[MULTICAST] = {.rate = 1'000'000, .rate_in_bits = true, .burst = 16000};
+    StormControl storm_control{limits, 1};
+
+    // The burst is 2000 bytes, so larger frames use it up faster
+    ASSERT_TRUE(storm_control.allow(0, MULTICAST, 1000, START));
+    ASSERT_TRUE(storm_control.allow(0, MULTICAST, 1000, START));
+    ASSERT_FALSE(storm_control.allow(0, MULTICAST, 100, START));
+
+    // At 1Mbps, 100 bytes take 800us to come back
+    ASSERT_TRUE(storm_control.allow(0, MULTICAST, 100, START + 800'000));
+}
+
+TEST(StormControlTests, DefaultBurstTests) {
+    std::array<StormControlLimit, FLOOD_TYPE_COUNT> limits{};
+    limits[UNKNOWN_UNICAST] = {.rate = 5};
+    limits[BROADCAST] = {.rate = 1000, .rate_in_bits = true};
+    StormControl storm_control{limits, 1};
+
+    // A tenth of a slow rate rounds down to nothing, but at least one frame must get through
+    ASSERT_TRUE(storm_control.allow(0, UNKNOWN_UNICAST, 64, START));
+    ASSERT_FALSE(storm_control.allow(0, UNKNOWN_UNICAST, 64, START));
+
+    // Likewise, a bit rate's burst always fits a full sized frame
+    ASSERT_TRUE(storm_control.allow(0, BROADCAST, 1518, START));
+    ASSERT_FALSE(storm_control.allow(0, BROADCAST, 64, START));
+}
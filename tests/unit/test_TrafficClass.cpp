@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <vector>
+#include "TrafficClass.hpp"
+
+// Builds a frame header with the given destination MAC and EtherType, followed by the given bytes
+static std::vector<unsigned char> make_header(
+    const std::array<unsigned char, 6>& destination, uint16_t ether_type,
+    std::vector<unsigned char> rest = {}
+) {
+    std::vector<unsigned char> header(destination.begin(), destination.end());
+    header.insert(header.end(), {0x02, 0x00, 0x00, 0x00, 0x00, 0x01});
+    header.push_back(ether_type >> 8);
+    header.push_back(ether_type & 0xFF);
+    header.insert(header.end(), rest.begin(), rest.end());
+    return header;
+}
+
+static const std::array<unsigned char, 6> UNICAST{0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+
+TEST(TrafficClassTests, UntaggedTests) {
+    EXPECT_EQ(classify_frame(make_header(UNICAST, 0x0800)), BEST_EFFORT);
+    EXPECT_EQ(classify_frame(make_header(UNICAST, 0x86DD)), BEST_EFFORT);
+    EXPECT_EQ(classify_frame(make_header(UNICAST, 0x0806)), INTERACTIVE);
+    EXPECT_EQ(classify_frame(make_header(UNICAST, 0x8809)), NETWORK_CONTROL);
+
+    // STP BPDUs and the like are recognized by their bridge group address
+    EXPECT_EQ(
+        classify_frame(make_header({0x01, 0x80, 0xC2, 0x00, 0x00, 0x00}, 0x0026)), NETWORK_CONTROL
+    );
+    EXPECT_EQ(
+        classify_frame(make_header({0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E}, 0x88CC)), NETWORK_CONTROL
+    );
+    EXPECT_EQ(
+        classify_frame(make_header({0x01, 0x80, 0xC2, 0x00, 0x00, 0x10}, 0x0800)), BEST_EFFORT
+    );
+
+    // Too short to have an EtherType
+    EXPECT_EQ(classify_frame(std::vector<unsigned char>(6, 0)), BEST_EFFORT);
+}
+
+TEST(TrafficClassTests, PriorityCodePointTests) {
+    const std::array<TrafficClass, 8> expected{
+        BEST_EFFORT, BACKGROUND,  BACKGROUND,      BEST_EFFORT,
+        INTERACTIVE, INTERACTIVE, NETWORK_CONTROL, NETWORK_CONTROL,
+    };
+
+    for (unsigned char pcp = 0; pcp < 8; ++pcp) {
+        // The priority code point wins over the inner EtherType
+        const unsigned char tci = pcp << 5;
+        EXPECT_EQ(
+            classify_frame(make_header(UNICAST, 0x8100, {tci, 0x01, 0x08, 0x06})), expected[pcp]
+        );
+        EXPECT_EQ(
+            classify_frame(make_header(UNICAST, 0x88A8, {tci, 0x01})), expected[pcp]
+        );
+
+        // A tag that was stripped off the frame wins over whatever the frame looks like now
+        EXPECT_EQ(
+            classify_frame(make_header(UNICAST, 0x0806), (uint16_t)(tci << 8 | 0x01)), expected[pcp]
+        );
+    }
+
+    // A tag with no room for its TCI isn't trusted
+    EXPECT_EQ(classify_frame(make_header(UNICAST, 0x8100)), BEST_EFFORT);
+}
+
+TEST(TrafficClassTests, NameTests) {
+    EXPECT_STREQ(traffic_class_name(BACKGROUND), "background");
+    EXPECT_STREQ(traffic_class_name(NETWORK_CONTROL), "network_control");
+}
@@ -0,0 +1,20 @@
+#include <gtest/gtest.h>
+#include "XdpEthernetPort.hpp"
+
+TEST(XdpUmemTests, CarveTests) {
+    XdpUmem umem{10};
+    unsigned char* first = umem.carve(4);
+    unsigned char* second = umem.carve(4);
+    ASSERT_EQ(first, umem.base());
+    ASSERT_EQ(second, umem.base() + 4 * FramePool::SLOT_SIZE);
+
+    // There are only two chunks left
+    ASSERT_EQ(umem.carve(4), nullptr);
+
+    // Chunks a port gives back are carved out again, rather than leaking from the UMEM
+    umem.release(first, 4);
+    ASSERT_EQ(umem.carve(3), first);
+    ASSERT_EQ(umem.carve(1), first + 3 * FramePool::SLOT_SIZE);
+    ASSERT_EQ(umem.carve(4), nullptr);
+    ASSERT_EQ(umem.carve(2), umem.base() + 8 * FramePool::SLOT_SIZE);
+}